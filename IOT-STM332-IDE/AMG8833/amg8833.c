@@ -8,13 +8,63 @@
 
 #include "amg8833.h"
 #include "dev_conf.h"
+#include "calib_store.h"
 #include "i2c.h"
+#include "stm32_seq.h"
+#include "stm32_timer.h"
+#include "stm32_lpm.h"
+#include "utilities_conf.h"
+#include "utilities_def.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdbool.h>
 
-/* Buffer for 8x8 grid of temperature values (64 pixels) */
-static int16_t pixelTemperatureRaw[64];
-static float pixelTemperature[64];
+/* Current frame, raw 0.25°C units (Q2); floats are only produced on demand */
+static int16_t pixelTemperatureRaw[64] __ALIGNED(4);
+static AMG8833_Stats_t pixelStats;
+
+/* Offset added to every pixel, raw 0.25°C units, saved in the calibration store */
+static int16_t pixelOffset = 0;
+
+/* Sensor settings, saved in the calibration store */
+static AMG8833_Config_t sensorConfig = {
+    .frameRate = AMG8833_FPS_10,
+    .movingAverage = 0,
+    .interruptMode = AMG8833_INT_DISABLED,
+    .interruptUpper = 0,
+    .interruptLower = 0,
+    .interruptHysteresis = 0
+};
+static bool configPending = false;             // sensorConfig not yet written to the sensor
+static uint32_t framePeriod = AMG8833_FRAME_PERIOD;
+
+/* Delta coding state of the thermal image uplink */
+static ThermalCodec_Encoder_t thermalEncoder;
+
+/* Background capture events, set from interrupt context */
+#define AMG8833_EVT_FRAME_TICK     (1U << 0)   // Frame period elapsed
+#define AMG8833_EVT_TRANSFER_DONE  (1U << 1)   // DMA transfer completed or failed
+
+/* Double-buffered frame store, filled by DMA (pixels are little-endian) */
+static int16_t frameStore[2][AMG8833_PIXEL_COUNT];
+static uint8_t frameBack = 0;                  // Buffer the next transfer writes
+static uint8_t frameSkip = 0;                  // Frames still to discard after wake-up
+static bool captureRunning = false;
+static volatile bool transferInFlight = false;
+static volatile HAL_StatusTypeDef transferStatus = HAL_OK;
+static volatile uint32_t captureEvents = 0;
+static AMG8833_FrameCallback_t frameCallback = NULL;
+static UTIL_TIMER_Object_t frameTimer;
+static bool frameTimerCreated = false;
+
+static void AMG8833_LoadFrame(const int16_t* frame);
+static HAL_StatusTypeDef AMG8833_ApplyConfig(void);
+static void AMG8833_SetEvent(uint32_t event);
+static void AMG8833_OnFrameTimer(void* context);
+static void AMG8833_CaptureProcess(void);
+static void AMG8833_StartTransfer(void);
+static void AMG8833_EndTransfer(HAL_StatusTypeDef status);
+static void AMG8833_AbortTransfer(void);
 
 /**
  * @brief Initialize the AMG8833 sensor
@@ -23,6 +73,7 @@ static float pixelTemperature[64];
 HAL_StatusTypeDef AMG8833_Init(void)
 {
     uint8_t config;
+    AMG8833_Config_t savedConfig;
     HAL_StatusTypeDef status;
 
     // Software reset
@@ -42,9 +93,11 @@ HAL_StatusTypeDef AMG8833_Init(void)
         return status;
     }
 
-    // Set frame rate to 10 FPS
-    config = AMG8833_FPS_10;
-    status = HAL_I2C_Mem_Write(&AMG8833_I2C, AMG8833_ADDR, AMG8833_FPSC, I2C_MEMADD_SIZE_8BIT, &config, 1, 100);
+    // Saved frame rate, averaging and interrupt settings, 10 FPS by default
+    if (CalibStore_Read(CALIB_STORE_KEY_THERMAL_CONFIG, &savedConfig, sizeof(savedConfig)) == (int)sizeof(savedConfig)) {
+        sensorConfig = savedConfig;
+    }
+    status = AMG8833_ApplyConfig();
     if (status != HAL_OK) {
         return status;
     }
@@ -52,6 +105,103 @@ HAL_StatusTypeDef AMG8833_Init(void)
     // Wait for thermistor to stabilize
     HAL_Delay(100);
 
+    // The first compressed frame is a keyframe
+    ThermalCodec_EncoderInit(&thermalEncoder, AMG8833_KEYFRAME_INTERVAL, AMG8833_DELTA_THRESHOLD);
+
+    // Saved offset, none if there is none
+    if (CalibStore_Read(CALIB_STORE_KEY_THERMAL_OFFSET, &pixelOffset, sizeof(pixelOffset)) != (int)sizeof(pixelOffset)) {
+        pixelOffset = 0;
+    }
+
+    return HAL_OK;
+}
+
+/**
+ * @brief Change the sensor settings and save them
+ * @param config Settings, levels must fit the 12-bit registers
+ * @return HAL_OK if successful, HAL_ERROR if invalid or not saved
+ */
+HAL_StatusTypeDef AMG8833_Configure(const AMG8833_Config_t* config)
+{
+    if (((config->frameRate != AMG8833_FPS_10) && (config->frameRate != AMG8833_FPS_1)) ||
+        (config->movingAverage > 1) ||
+        ((config->interruptMode != AMG8833_INT_DISABLED) && (config->interruptMode != AMG8833_INT_DIFFERENCE) &&
+         (config->interruptMode != AMG8833_INT_ABSOLUTE)) ||
+        (config->interruptUpper < -2048) || (config->interruptUpper > 2047) ||
+        (config->interruptLower < -2048) || (config->interruptLower > 2047) ||
+        (config->interruptHysteresis < 0) || (config->interruptHysteresis > 2047)) {
+        return HAL_ERROR;
+    }
+
+    // The sensor sleeps between acquisitions, the capture writes the settings
+    sensorConfig = *config;
+    configPending = true;
+
+    if (CalibStore_Write(CALIB_STORE_KEY_THERMAL_CONFIG, &sensorConfig, sizeof(sensorConfig)) != 0) {
+        return HAL_ERROR;
+    }
+
+    return HAL_OK;
+}
+
+/**
+ * @brief Get the sensor settings
+ * @param config Pointer to store the settings
+ */
+void AMG8833_GetConfig(AMG8833_Config_t* config)
+{
+    *config = sensorConfig;
+}
+
+/**
+ * @brief Set the offset added to every pixel and save it
+ * @param offset Offset in raw units (0.25°C), 0 deletes the saved offset
+ * @return HAL_OK if successful, HAL_ERROR if it could not be saved
+ */
+HAL_StatusTypeDef AMG8833_SetTemperatureOffset(int16_t offset)
+{
+    int result;
+
+    pixelOffset = offset;
+    if (offset == 0) {
+        result = CalibStore_Delete(CALIB_STORE_KEY_THERMAL_OFFSET);
+    } else {
+        result = CalibStore_Write(CALIB_STORE_KEY_THERMAL_OFFSET, &offset, sizeof(offset));
+    }
+
+    return (result == 0) ? HAL_OK : HAL_ERROR;
+}
+
+/**
+ * @brief Get the offset added to every pixel
+ * @return Offset in raw units (0.25°C)
+ */
+int16_t AMG8833_GetTemperatureOffset(void)
+{
+    return pixelOffset;
+}
+
+/**
+ * @brief Read and clear the interrupt flag
+ * @param flag Pointer to store the flag, true if a pixel was outside the levels
+ * @return HAL_OK if successful, HAL_ERROR otherwise
+ */
+HAL_StatusTypeDef AMG8833_ReadInterrupt(bool* flag)
+{
+    uint8_t status;
+    uint8_t clear = AMG8833_SCLR_INTCLR;
+
+    if (HAL_I2C_Mem_Read(&AMG8833_I2C, AMG8833_ADDR, AMG8833_STAT, I2C_MEMADD_SIZE_8BIT,
+                         &status, 1, AMG8833_READ_TIMEOUT) != HAL_OK) {
+        return HAL_ERROR;
+    }
+
+    *flag = ((status & AMG8833_STAT_INTF) != 0);
+    if (*flag) {
+        return HAL_I2C_Mem_Write(&AMG8833_I2C, AMG8833_ADDR, AMG8833_SCLR, I2C_MEMADD_SIZE_8BIT,
+                                 &clear, 1, 100);
+    }
+
     return HAL_OK;
 }
 
@@ -61,24 +211,17 @@ HAL_StatusTypeDef AMG8833_Init(void)
  */
 HAL_StatusTypeDef AMG8833_ReadPixels(void)
 {
-    uint8_t rawData[128]; // 2 bytes per pixel * 64 pixels
+    int16_t rawData[AMG8833_PIXEL_COUNT]; // 2 bytes per pixel, LSB first
     HAL_StatusTypeDef status;
 
     // Read all 64 temperature registers at once
-    status = HAL_I2C_Mem_Read(&AMG8833_I2C, AMG8833_ADDR, AMG8833_TEMP_BASE, I2C_MEMADD_SIZE_8BIT, rawData, 128, 1000);
+    status = HAL_I2C_Mem_Read(&AMG8833_I2C, AMG8833_ADDR, AMG8833_TEMP_BASE, I2C_MEMADD_SIZE_8BIT,
+                              (uint8_t*)rawData, AMG8833_FRAME_BYTES, AMG8833_READ_TIMEOUT);
     if (status != HAL_OK) {
         return status;
     }
 
-    // Process the raw data
-    for (int i = 0; i < 64; i++) {
-        // Combine the two bytes to create a 12-bit signed value
-        // Data is stored in 12-bit, sign extended to 16-bit, LSB first
-        pixelTemperatureRaw[i] = (int16_t)(rawData[i*2] | (rawData[i*2+1] << 8));
-
-        // Convert raw value to temperature in Celsius
-        pixelTemperature[i] = pixelTemperatureRaw[i] * AMG8833_TEMP_FACTOR;
-    }
+    AMG8833_LoadFrame(rawData);
 
     return HAL_OK;
 }
@@ -111,18 +254,48 @@ int AMG8833_PrepareChirpStackData(uint8_t* buffer, uint16_t bufferSize)
     // This maps temperature range from -20°C to 80°C to 0-255 value range (25°C = 127)
     else {
         for (int i = 0; i < 64; i++) {
-            // Convert temperature to 8-bit range (100°C range mapped to 0-255)
-            float temp = pixelTemperature[i];
-            // Clamp to expected range
-            if (temp < -20.0f) temp = -20.0f;
-            if (temp > 80.0f) temp = 80.0f;
-            // Map to 0-255 range
-            buffer[i] = (uint8_t)((temp + 20.0f) * 2.55f);
+            // Offset so that -20°C is 0, then clamp to the 100°C range
+            int32_t value = pixelTemperatureRaw[i] - AMG8833_RAW_MIN;
+            if (value < 0) value = 0;
+            if (value > AMG8833_RAW_SPAN) value = AMG8833_RAW_SPAN;
+            // Map to 0-255 range: (temp + 20) * 2.55 with temp = raw / 4
+            buffer[i] = (uint8_t)((value * 51) / 80);
         }
         return 64;
     }
 }
 
+/**
+ * @brief Compress the last reading with the thermal frame codec
+ * @param buffer Output buffer (THERMAL_CODEC_MAX_SIZE bytes always suffice)
+ * @param bufferSize Size of the output buffer
+ * @param shift Quantization shift, 0 keeps the full 0.25°C resolution
+ * @return Number of bytes written to buffer, or -1 on error
+ */
+int AMG8833_PrepareCompressedData(uint8_t* buffer, uint16_t bufferSize, uint8_t shift)
+{
+    return ThermalCodec_EncodeFrame(&thermalEncoder, pixelTemperatureRaw, shift, buffer, bufferSize);
+}
+
+/**
+ * @brief Mark the last compressed frame as delivered, later deltas refer to it
+ */
+void AMG8833_AcknowledgeCompressedData(void)
+{
+    ThermalCodec_Acknowledge(&thermalEncoder);
+}
+
+/**
+ * @brief Configure the delta coding of compressed frames
+ * @param keyframeInterval Frames between forced keyframes (1 = keyframes only)
+ * @param threshold Change a pixel must exceed to be sent, in raw units (0.25°C)
+ */
+void AMG8833_ConfigureCompression(uint8_t keyframeInterval, uint8_t threshold)
+{
+    // Restart from a keyframe, the decoder may not have the reference
+    ThermalCodec_EncoderInit(&thermalEncoder, keyframeInterval, threshold);
+}
+
 /**
  * @brief Get min, max, and average temperature from last reading
  * @param min Pointer to store minimum temperature
@@ -131,17 +304,76 @@ int AMG8833_PrepareChirpStackData(uint8_t* buffer, uint16_t bufferSize)
  */
 void AMG8833_GetStats(float* min, float* max, float* avg)
 {
-    *min = pixelTemperature[0];
-    *max = pixelTemperature[0];
-    float sum = 0.0f;
+    *min = pixelStats.min * AMG8833_TEMP_FACTOR;
+    *max = pixelStats.max * AMG8833_TEMP_FACTOR;
+    *avg = pixelStats.sum * (AMG8833_TEMP_FACTOR / AMG8833_PIXEL_COUNT);
+}
 
-    for (int i = 0; i < 64; i++) {
-        if (pixelTemperature[i] < *min) *min = pixelTemperature[i];
-        if (pixelTemperature[i] > *max) *max = pixelTemperature[i];
-        sum += pixelTemperature[i];
+/**
+ * @brief Get the integer statistics of the last reading
+ * @param stats Pointer to store the statistics
+ */
+void AMG8833_GetStatsRaw(AMG8833_Stats_t* stats)
+{
+    *stats = pixelStats;
+}
+
+/**
+ * @brief Compute min, max, sum and histogram of a frame in one pass
+ * @note  With the DSP extension two pixels are handled per 32-bit load:
+ *        __SSUB16 sets the GE flags per halfword and __SEL keeps the lower
+ *        or higher lane for min/max, __SMLAD adds both halves to the sum.
+ *        The histogram stays scalar.
+ * @param frame Raw pixel values (64 elements, 32-bit aligned)
+ * @param stats Pointer to store the statistics
+ */
+void AMG8833_ComputeStats(const int16_t* frame, AMG8833_Stats_t* stats)
+{
+    memset(stats->histogram, 0, sizeof(stats->histogram));
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+    const uint32_t* pairs = (const uint32_t*)frame;
+    uint32_t minPair = pairs[0];
+    uint32_t maxPair = pairs[0];
+    int32_t sum = 0;
+
+    for (int i = 0; i < AMG8833_PIXEL_COUNT / 2; i++) {
+        uint32_t pair = pairs[i];
+
+        (void)__SSUB16(pair, minPair);      // GE set where pair >= min
+        minPair = __SEL(minPair, pair);
+        (void)__SSUB16(pair, maxPair);      // GE set where pair >= max
+        maxPair = __SEL(pair, maxPair);
+        sum = (int32_t)__SMLAD(pair, 0x00010001U, (uint32_t)sum);
     }
 
-    *avg = sum / 64.0f;
+    // Fold the two lanes
+    int16_t minLo = (int16_t)minPair, minHi = (int16_t)(minPair >> 16);
+    int16_t maxLo = (int16_t)maxPair, maxHi = (int16_t)(maxPair >> 16);
+    stats->min = (minLo < minHi) ? minLo : minHi;
+    stats->max = (maxLo > maxHi) ? maxLo : maxHi;
+    stats->sum = sum;
+#else
+    stats->min = frame[0];
+    stats->max = frame[0];
+    stats->sum = 0;
+
+    for (int i = 0; i < AMG8833_PIXEL_COUNT; i++) {
+        if (frame[i] < stats->min) stats->min = frame[i];
+        if (frame[i] > stats->max) stats->max = frame[i];
+        stats->sum += frame[i];
+    }
+#endif
+
+    for (int i = 0; i < AMG8833_PIXEL_COUNT; i++) {
+        int32_t value = frame[i] - AMG8833_RAW_MIN;
+        if (value < 0) value = 0;
+        if (value >= AMG8833_RAW_SPAN) value = AMG8833_RAW_SPAN - 1;
+        stats->histogram[value / AMG8833_HIST_BIN_RAW]++;
+    }
+
+    // Rounded mean, still in 0.25°C units
+    stats->avg = (int16_t)((stats->sum + (AMG8833_PIXEL_COUNT / 2)) >> 6);
 }
 
 /**
@@ -160,20 +392,97 @@ HAL_StatusTypeDef AMG8833_Sleep(void)
  */
 HAL_StatusTypeDef AMG8833_WakeUp(void)
 {
-    uint8_t config = AMG8833_NORMAL_MODE;
     HAL_StatusTypeDef status;
 
-    status = HAL_I2C_Mem_Write(&AMG8833_I2C, AMG8833_ADDR, AMG8833_POWER_CTRL, I2C_MEMADD_SIZE_8BIT, &config, 1, 100);
+    status = AMG8833_StartWakeUp();
     if (status != HAL_OK) {
         return status;
     }
 
     // Wait for sensor to wake up
-    HAL_Delay(50);
+    HAL_Delay(AMG8833_WAKEUP_DELAY);
 
     return HAL_OK;
 }
 
+/**
+ * @brief Request normal mode without waiting for the sensor to wake up
+ * @return HAL_OK if successful, HAL_ERROR otherwise
+ */
+HAL_StatusTypeDef AMG8833_StartWakeUp(void)
+{
+    uint8_t config = AMG8833_NORMAL_MODE;
+
+    return HAL_I2C_Mem_Write(&AMG8833_I2C, AMG8833_ADDR, AMG8833_POWER_CTRL, I2C_MEMADD_SIZE_8BIT, &config, 1, AMG8833_I2C_TIMEOUT);
+}
+
+/**
+ * @brief Wake the sensor and capture frames in the background
+ * @param callback Called for every frame until AMG8833_StopCapture()
+ * @return HAL_BUSY if a capture is already running
+ */
+HAL_StatusTypeDef AMG8833_StartCapture(AMG8833_FrameCallback_t callback)
+{
+    HAL_StatusTypeDef status;
+
+    if (captureRunning) {
+        return HAL_BUSY;
+    }
+
+    if (!frameTimerCreated) {
+        UTIL_TIMER_Create(&frameTimer, AMG8833_FRAME_PERIOD, UTIL_TIMER_ONESHOT, AMG8833_OnFrameTimer, NULL);
+        UTIL_SEQ_RegTask((1 << CFG_SEQ_Task_AMG8833Capture), UTIL_SEQ_RFU, AMG8833_CaptureProcess);
+        frameTimerCreated = true;
+    }
+
+    status = AMG8833_StartWakeUp();
+    if (status != HAL_OK) {
+        return status;
+    }
+
+    frameCallback = callback;
+    frameSkip = AMG8833_SETTLE_FRAMES;
+    captureEvents = 0;
+    captureRunning = true;
+
+    // First transfer once the sensor accepts I2C again, then one per frame
+    UTIL_TIMER_StartWithPeriod(&frameTimer, AMG8833_WAKEUP_DELAY);
+
+    return HAL_OK;
+}
+
+/**
+ * @brief Stop the background capture (the sensor is left awake)
+ */
+void AMG8833_StopCapture(void)
+{
+    captureRunning = false;
+    UTIL_TIMER_Stop(&frameTimer);
+    AMG8833_AbortTransfer();
+}
+
+/**
+ * @brief I2C receive complete, shared by all I2C handles
+ * @param hi2c I2C handle
+ */
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef* hi2c)
+{
+    if (hi2c == &AMG8833_I2C && transferInFlight) {
+        AMG8833_EndTransfer(HAL_OK);
+    }
+}
+
+/**
+ * @brief I2C error, shared by all I2C handles
+ * @param hi2c I2C handle
+ */
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef* hi2c)
+{
+    if (hi2c == &AMG8833_I2C && transferInFlight) {
+        AMG8833_EndTransfer(HAL_ERROR);
+    }
+}
+
 /**
  * @brief Get raw pixel temperatures
  * @param pixelValues Pointer to buffer for storing the raw pixel values (must be at least 64 int16_t elements)
@@ -189,5 +498,186 @@ void AMG8833_GetRawPixels(int16_t* pixelValues)
  */
 void AMG8833_GetTemperatures(float* pixelValues)
 {
-    memcpy(pixelValues, pixelTemperature, 64 * sizeof(float));
+    for (int i = 0; i < 64; i++) {
+        pixelValues[i] = pixelTemperatureRaw[i] * AMG8833_TEMP_FACTOR;
+    }
+}
+
+/**
+ * @brief Make a raw frame the current frame
+ * @param frame Raw register values, 12-bit two's complement
+ */
+static void AMG8833_LoadFrame(const int16_t* frame)
+{
+    for (int i = 0; i < AMG8833_PIXEL_COUNT; i++) {
+        // Sign extend the 12-bit value, then keep the corrected one in 12 bits
+        int32_t value = ((int16_t)(frame[i] << 4) >> 4) + pixelOffset;
+        if (value > 2047) {
+            value = 2047;
+        } else if (value < -2048) {
+            value = -2048;
+        }
+        pixelTemperatureRaw[i] = (int16_t)value;
+    }
+
+    AMG8833_ComputeStats(pixelTemperatureRaw, &pixelStats);
+}
+
+/**
+ * @brief Write sensorConfig to the sensor, which must be awake
+ * @return HAL_OK if successful, otherwise the I2C error
+ */
+static HAL_StatusTypeDef AMG8833_ApplyConfig(void)
+{
+    HAL_StatusTypeDef status;
+
+    status = AMG8833_AdjustConfig(sensorConfig.frameRate);
+    if (status == HAL_OK) {
+        status = AMG8833_ConfigureAverage(sensorConfig.movingAverage);
+    }
+    if (status == HAL_OK) {
+        status = AMG8833_ConfigureInterrupt(sensorConfig.interruptMode,
+                                            sensorConfig.interruptUpper * AMG8833_TEMP_FACTOR,
+                                            sensorConfig.interruptLower * AMG8833_TEMP_FACTOR,
+                                            sensorConfig.interruptHysteresis * AMG8833_TEMP_FACTOR);
+    }
+    if (status != HAL_OK) {
+        return status;
+    }
+
+    framePeriod = (sensorConfig.frameRate == AMG8833_FPS_1) ? AMG8833_FRAME_PERIOD_1FPS : AMG8833_FRAME_PERIOD;
+    configPending = false;
+
+    return HAL_OK;
+}
+
+/**
+ * @brief Record a capture event and schedule the capture task
+ * @param event AMG8833_EVT_xxx
+ */
+static void AMG8833_SetEvent(uint32_t event)
+{
+    UTILS_ENTER_CRITICAL_SECTION();
+    captureEvents |= event;
+    UTILS_EXIT_CRITICAL_SECTION();
+
+    UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_AMG8833Capture), CFG_SEQ_Prio_0);
+}
+
+/**
+ * @brief Frame period timer (timer context)
+ * @param context Unused
+ */
+static void AMG8833_OnFrameTimer(void* context)
+{
+    UTIL_TIMER_StartWithPeriod(&frameTimer, framePeriod);
+    AMG8833_SetEvent(AMG8833_EVT_FRAME_TICK);
+}
+
+/**
+ * @brief Capture task (sequencer context)
+ */
+static void AMG8833_CaptureProcess(void)
+{
+    uint32_t events;
+    uint8_t front;
+
+    UTILS_ENTER_CRITICAL_SECTION();
+    events = captureEvents;
+    captureEvents = 0;
+    UTILS_EXIT_CRITICAL_SECTION();
+
+    if ((events & AMG8833_EVT_TRANSFER_DONE) && captureRunning) {
+        if (transferStatus != HAL_OK) {
+            if (frameCallback != NULL) {
+                frameCallback(transferStatus, NULL);
+            }
+        } else if (frameSkip > 0) {
+            frameSkip--;
+        } else {
+            // Swap: the next transfer fills the other buffer
+            front = frameBack;
+            frameBack ^= 1;
+            AMG8833_LoadFrame(frameStore[front]);
+            if (frameCallback != NULL) {
+                frameCallback(HAL_OK, frameStore[front]);
+            }
+        }
+    }
+
+    // The callback may have stopped the capture
+    if ((events & AMG8833_EVT_FRAME_TICK) && captureRunning) {
+        if (transferInFlight) {
+            // A whole frame period without completion, the bus is stuck:
+            // the callback gets HAL_TIMEOUT with the TRANSFER_DONE event
+            AMG8833_AbortTransfer();
+        } else {
+            // Settings changed while the sensor slept, the frame in progress
+            // used the previous ones
+            if (configPending && (AMG8833_ApplyConfig() == HAL_OK)) {
+                frameSkip = AMG8833_SETTLE_FRAMES;
+            }
+            AMG8833_StartTransfer();
+        }
+    }
+}
+
+/**
+ * @brief Start the DMA read of one frame into the back buffer
+ */
+static void AMG8833_StartTransfer(void)
+{
+    HAL_StatusTypeDef status;
+
+    // I2C and DMA stop in Stop mode, the CPU may still Sleep meanwhile
+    UTIL_LPM_SetStopMode((1 << CFG_LPM_AMG8833_Id), UTIL_LPM_DISABLE);
+    transferInFlight = true;
+
+    status = HAL_I2C_Mem_Read_DMA(&AMG8833_I2C, AMG8833_ADDR, AMG8833_TEMP_BASE, I2C_MEMADD_SIZE_8BIT,
+                                  (uint8_t*)frameStore[frameBack], AMG8833_FRAME_BYTES);
+    if (status != HAL_OK) {
+        AMG8833_EndTransfer(status);
+    }
+}
+
+/**
+ * @brief End of a frame transfer (interrupt or sequencer context)
+ * @param status Transfer result
+ */
+static void AMG8833_EndTransfer(HAL_StatusTypeDef status)
+{
+    transferStatus = status;
+    transferInFlight = false;
+    UTIL_LPM_SetStopMode((1 << CFG_LPM_AMG8833_Id), UTIL_LPM_ENABLE);
+    AMG8833_SetEvent(AMG8833_EVT_TRANSFER_DONE);
+}
+
+/**
+ * @brief Abort the frame transfer in flight, if any (sequencer context)
+ *
+ * The DMA channel is stopped and the I2C peripheral reset, which releases
+ * the bus even when the slave holds SCL low, where HAL_I2C_Master_Abort_IT()
+ * would never complete. The handle keeps its Init settings and DMA link.
+ */
+static void AMG8833_AbortTransfer(void)
+{
+    bool inFlight;
+
+    // A completion from now on is ignored by the callbacks
+    UTILS_ENTER_CRITICAL_SECTION();
+    inFlight = transferInFlight;
+    transferInFlight = false;
+    UTILS_EXIT_CRITICAL_SECTION();
+
+    if (!inFlight) {
+        return;
+    }
+
+    if (AMG8833_I2C.hdmarx != NULL) {
+        HAL_DMA_Abort(AMG8833_I2C.hdmarx);
+    }
+    HAL_I2C_DeInit(&AMG8833_I2C);
+    HAL_I2C_Init(&AMG8833_I2C);
+
+    AMG8833_EndTransfer(HAL_TIMEOUT);
 }
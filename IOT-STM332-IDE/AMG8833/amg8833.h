@@ -11,6 +11,8 @@
 
 #include "main.h"
 #include <stdint.h>
+#include <stdbool.h>
+#include "thermal_codec.h"
 
 /* AMG8833 I2C Configuration */
 #define AMG8833_I2C                 hi2c2          // I2C handle
@@ -50,9 +52,57 @@
 #define AMG8833_FPS_10             0x00    // 10 frames per second
 #define AMG8833_FPS_1              0x01    // 1 frame per second
 
+/* AMG8833 Interrupt Control Values (INTEN, INTMOD) */
+#define AMG8833_INT_DISABLED       0x00    // No interrupt
+#define AMG8833_INT_DIFFERENCE     0x01    // Levels compared with the change since the last frame
+#define AMG8833_INT_ABSOLUTE       0x03    // Levels compared with the pixel temperature
+
+// Status and status clear bits
+#define AMG8833_STAT_INTF          0x02    // A pixel is outside the interrupt levels
+#define AMG8833_SCLR_INTCLR        0x02    // Clear the interrupt flag
+
 /* Temperature Conversion Factor */
 #define AMG8833_TEMP_FACTOR        0.25f   // Temperature conversion factor (0.25°C per LSB)
 
+/* Integer Pixel Range (raw 0.25°C units) */
+#define AMG8833_RAW_MIN            (-80)   // -20°C, bottom of the 8-bit image range
+#define AMG8833_RAW_SPAN           400     // 100°C image range
+#define AMG8833_HIST_BINS          8       // Histogram bins over the image range
+#define AMG8833_HIST_BIN_RAW       (AMG8833_RAW_SPAN / AMG8833_HIST_BINS) // 12.5°C per bin
+
+/**
+ * @brief Frame statistics in raw 0.25°C units
+ */
+typedef struct {
+    int16_t min;                            // Coldest pixel
+    int16_t max;                            // Hottest pixel
+    int16_t avg;                            // Rounded mean
+    int32_t sum;                            // Sum of the 64 pixels (mean without rounding)
+    uint8_t histogram[AMG8833_HIST_BINS];   // Pixel count per bin from -20°C, clamped at both ends
+} AMG8833_Stats_t;
+
+/**
+ * @brief Sensor settings, levels in raw 0.25°C units
+ */
+typedef struct {
+    uint8_t frameRate;                      // AMG8833_FPS_10 or AMG8833_FPS_1
+    uint8_t movingAverage;                  // 1 to output the twice moving average
+    uint8_t interruptMode;                  // AMG8833_INT_xxx
+    int16_t interruptUpper;                 // Upper interrupt level
+    int16_t interruptLower;                 // Lower interrupt level
+    int16_t interruptHysteresis;            // Interrupt hysteresis
+} AMG8833_Config_t;
+
+/**
+ * @brief Frame capture callback, called from the sequencer
+ * @param status HAL_OK with a new frame, HAL_TIMEOUT when a transfer did not
+ *               complete within a frame period and was aborted, otherwise
+ *               the transfer error
+ * @param frame Raw pixel values (64 elements), NULL on error. Valid until
+ *              the next frame is delivered.
+ */
+typedef void (*AMG8833_FrameCallback_t)(HAL_StatusTypeDef status, const int16_t* frame);
+
 /* Function Prototypes */
 
 /**
@@ -75,6 +125,67 @@ HAL_StatusTypeDef AMG8833_ReadPixels(void);
  */
 int AMG8833_PrepareChirpStackData(uint8_t* buffer, uint16_t bufferSize);
 
+/**
+ * @brief Compress the last reading with the thermal frame codec, as a delta
+ *        against the last acknowledged frame when possible
+ * @param buffer Output buffer (THERMAL_CODEC_MAX_SIZE bytes always suffice)
+ * @param bufferSize Size of the output buffer
+ * @param shift Quantization shift, 0 keeps the full 0.25°C resolution
+ * @return Number of bytes written to buffer, or -1 on error
+ */
+int AMG8833_PrepareCompressedData(uint8_t* buffer, uint16_t bufferSize, uint8_t shift);
+
+/**
+ * @brief Mark the last compressed frame as delivered, later deltas refer to it
+ */
+void AMG8833_AcknowledgeCompressedData(void);
+
+/**
+ * @brief Configure the delta coding of compressed frames
+ * @param keyframeInterval Frames between forced keyframes (1 = keyframes only)
+ * @param threshold Change a pixel must exceed to be sent, in raw units (0.25°C)
+ */
+void AMG8833_ConfigureCompression(uint8_t keyframeInterval, uint8_t threshold);
+
+/**
+ * @brief Change the sensor settings and save them in flash
+ * @note  The settings are written to the sensor at the next capture, when it
+ *        is awake, and again by AMG8833_Init after a reset
+ * @param config Settings, levels must fit the 12-bit registers
+ * @return HAL_OK if successful, HAL_ERROR if invalid or not saved
+ */
+HAL_StatusTypeDef AMG8833_Configure(const AMG8833_Config_t* config);
+
+/**
+ * @brief Get the sensor settings
+ * @param config Pointer to store the settings
+ */
+void AMG8833_GetConfig(AMG8833_Config_t* config);
+
+/**
+ * @brief Set the offset added to every pixel and save it in flash
+ * @note  The saved offset is applied again by AMG8833_Init after a reset
+ * @param offset Offset in raw units (0.25°C), 0 deletes the saved offset
+ * @return HAL_OK if successful, HAL_ERROR if it could not be saved
+ */
+HAL_StatusTypeDef AMG8833_SetTemperatureOffset(int16_t offset);
+
+/**
+ * @brief Get the offset added to every pixel
+ * @return Offset in raw units (0.25°C)
+ */
+int16_t AMG8833_GetTemperatureOffset(void);
+
+/**
+ * @brief Read and clear the interrupt flag
+ * @note  The INT pin is not wired, the flag is polled while the sensor is
+ *        awake. It is set when a frame had a pixel outside the levels of
+ *        AMG8833_ConfigureInterrupt()
+ * @param flag Pointer to store the flag, true if a pixel was outside the levels
+ * @return HAL_OK if successful, HAL_ERROR otherwise
+ */
+HAL_StatusTypeDef AMG8833_ReadInterrupt(bool* flag);
+
 /**
  * @brief Get min, max, and average temperature from last reading
  * @param min Pointer to store minimum temperature
@@ -83,6 +194,19 @@ int AMG8833_PrepareChirpStackData(uint8_t* buffer, uint16_t bufferSize);
  */
 void AMG8833_GetStats(float* min, float* max, float* avg);
 
+/**
+ * @brief Get the integer statistics of the last reading
+ * @param stats Pointer to store the statistics
+ */
+void AMG8833_GetStatsRaw(AMG8833_Stats_t* stats);
+
+/**
+ * @brief Compute min, max, sum and histogram of a frame in one pass
+ * @param frame Raw pixel values (64 elements, 32-bit aligned)
+ * @param stats Pointer to store the statistics
+ */
+void AMG8833_ComputeStats(const int16_t* frame, AMG8833_Stats_t* stats);
+
 /**
  * @brief Power down the AMG8833
  * @return HAL_OK if successful, HAL_ERROR otherwise
@@ -95,6 +219,34 @@ HAL_StatusTypeDef AMG8833_Sleep(void);
  */
 HAL_StatusTypeDef AMG8833_WakeUp(void);
 
+/**
+ * @brief Request normal mode without waiting for the sensor to wake up
+ * @note  The caller must wait AMG8833_WAKEUP_DELAY before reading pixels
+ * @return HAL_OK if successful, HAL_ERROR otherwise
+ */
+HAL_StatusTypeDef AMG8833_StartWakeUp(void);
+
+/**
+ * @brief Wake the sensor and capture frames in the background
+ * @note  A frame-period timer starts a DMA read of the pixel registers into
+ *        the back buffer of a double-buffered frame store. On completion the
+ *        buffers are swapped and the callback is called from the sequencer
+ *        with the front buffer, which also becomes the frame used by
+ *        AMG8833_GetStats() and AMG8833_PrepareChirpStackData(). The first
+ *        AMG8833_SETTLE_FRAMES frames after wake-up are discarded. Stop mode
+ *        is held off only while a transfer is in flight; a transfer still
+ *        in flight at the next frame tick is aborted and the I2C reset.
+ * @param callback Called for every frame until AMG8833_StopCapture()
+ * @return HAL_BUSY if a capture is already running
+ */
+HAL_StatusTypeDef AMG8833_StartCapture(AMG8833_FrameCallback_t callback);
+
+/**
+ * @brief Stop the background capture (the sensor is left awake)
+ * @note  A transfer in flight is aborted and the I2C reset.
+ */
+void AMG8833_StopCapture(void);
+
 /**
  * @brief Get raw pixel temperatures
  * @param pixelValues Pointer to buffer for storing the raw pixel values (must be at least 64 int16_t elements)
@@ -135,3 +135,41 @@ HAL_StatusTypeDef AMG8833_ConfigureInterrupt(uint8_t interruptMode,
 
     return status;
 }
+
+/**
+ * @brief Enable or disable the twice moving average output
+ *
+ * The average register is only written between the unlock sequence and
+ * the lock value of register AMG8833_AVERAGE_KEY.
+ *
+ * @param enable 1 to average two frames, 0 for single frames
+ * @return HAL_OK if successful, HAL_ERROR otherwise
+ */
+HAL_StatusTypeDef AMG8833_ConfigureAverage(uint8_t enable)
+{
+    static const uint8_t unlock[3] = {0x50, 0x45, 0x57};
+    uint8_t value;
+    HAL_StatusTypeDef status;
+
+    for (int i = 0; i < 3; i++) {
+        value = unlock[i];
+        status = HAL_I2C_Mem_Write(&AMG8833_I2C, AMG8833_ADDR, AMG8833_AVERAGE_KEY,
+                                  I2C_MEMADD_SIZE_8BIT, &value, 1, AMG8833_I2C_TIMEOUT);
+        if (status != HAL_OK) {
+            return status;
+        }
+    }
+
+    value = enable ? AMG8833_AVERAGE_TWICE : 0x00;
+    status = HAL_I2C_Mem_Write(&AMG8833_I2C, AMG8833_ADDR, AMG8833_AVERAGE,
+                              I2C_MEMADD_SIZE_8BIT, &value, 1, AMG8833_I2C_TIMEOUT);
+
+    // Lock the setting again, even after a failed write
+    value = 0x00;
+    if (HAL_I2C_Mem_Write(&AMG8833_I2C, AMG8833_ADDR, AMG8833_AVERAGE_KEY,
+                          I2C_MEMADD_SIZE_8BIT, &value, 1, AMG8833_I2C_TIMEOUT) != HAL_OK) {
+        status = HAL_ERROR;
+    }
+
+    return status;
+}
@@ -48,6 +48,8 @@ extern I2C_HandleTypeDef hi2c2;           // I2C handle used for AMG8833 communi
 #define AMG8833_SOFT_RESET        0x3F // Software reset
 #define AMG8833_FPS_10            0x00 // 10 FPS operation
 #define AMG8833_FPS_1             0x01 // 1 FPS operation
+#define AMG8833_AVERAGE_TWICE     0x20 // Twice moving average output (MAMOD)
+#define AMG8833_AVERAGE_KEY       0x1F // Register unlocking the moving average setting
 
 /* Temperature conversion constants */
 #define AMG8833_TEMP_FACTOR       0.25f // Each raw value equals 0.25°C
@@ -61,11 +63,28 @@ extern I2C_HandleTypeDef hi2c2;           // I2C handle used for AMG8833 communi
 #define AMG8833_INIT_DELAY        100   // Delay after initialization in ms
 #define AMG8833_RESET_DELAY       100   // Delay after reset in ms
 #define AMG8833_WAKEUP_DELAY       50   // Delay after wakeup in ms
+#define AMG8833_FRAME_PERIOD      100   // Frame period at AMG8833_FPS_10 in ms
+#define AMG8833_FRAME_PERIOD_1FPS 1000  // Frame period at AMG8833_FPS_1 in ms
+#define AMG8833_SETTLE_FRAMES       1   // Frames discarded after wake-up (integrated while asleep)
 #define AMG8833_I2C_TIMEOUT       100   // I2C timeout for short operations in ms
-#define AMG8833_READ_TIMEOUT     1000   // I2C timeout for reading all pixels in ms
+#define AMG8833_READ_TIMEOUT      100   // I2C timeout for reading all pixels in ms (128 bytes ~12 ms at 100 kHz)
 
 /* Other constants */
 #define AMG8833_PIXEL_COUNT        64   // Number of pixels (8x8 grid)
 #define AMG8833_GRID_SIZE           8   // Size of the grid (8x8)
+#define AMG8833_FRAME_BYTES       128   // Bytes of one frame (2 per pixel)
+
+/* Thermal image uplink */
+#define AMG8833_KEYFRAME_INTERVAL  16   // Uplinks between forced keyframes
+#define AMG8833_DELTA_THRESHOLD     2   // Change a pixel must exceed to be sent, raw units (0.5°C)
+
+/* Configuration functions */
+HAL_StatusTypeDef AMG8833_ConfigureI2C(void);
+HAL_StatusTypeDef AMG8833_AdjustConfig(uint8_t frameRate);
+HAL_StatusTypeDef AMG8833_ConfigureInterrupt(uint8_t interruptMode,
+                                           float upperLimit,
+                                           float lowerLimit,
+                                           float hysteresis);
+HAL_StatusTypeDef AMG8833_ConfigureAverage(uint8_t enable);
 
 #endif /* DEV_CONF_H */
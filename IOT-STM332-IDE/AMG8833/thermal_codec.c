@@ -0,0 +1,585 @@
+/**
+ * @file thermal_codec.c
+ * @brief Lossless/near-lossless codec for 8x8 thermal frames
+ *
+ * See thermal_codec.h for the stream layout.
+ */
+
+#include "thermal_codec.h"
+#include <string.h>
+
+/* Bit cursor over a byte buffer, MSB first */
+typedef struct {
+    uint8_t* buffer;
+    const uint8_t* input;
+    uint16_t size;
+    uint32_t bitPos;
+} ThermalCodec_Bits_t;
+
+static int ThermalCodec_EncodeDelta(ThermalCodec_Encoder_t* encoder, const int16_t* frame, uint8_t shift,
+                                    uint8_t* out, uint16_t outSize, int16_t* decoded);
+static int ThermalCodec_DecodeDelta(const uint8_t* in, uint16_t len, const int16_t* reference, int16_t* frame);
+static int16_t ThermalCodec_Predict(const int16_t* pixels, int index);
+static uint16_t ThermalCodec_ZigZag(int32_t residual);
+static int32_t ThermalCodec_UnZigZag(uint16_t value);
+static uint8_t ThermalCodec_BestK(const uint16_t* values, int count, uint32_t* cost);
+static int ThermalCodec_PutRice(ThermalCodec_Bits_t* bits, uint16_t value, uint8_t k);
+static int ThermalCodec_GetRice(ThermalCodec_Bits_t* bits, uint8_t k, uint16_t* value);
+static int ThermalCodec_Put(ThermalCodec_Bits_t* bits, uint32_t value, uint8_t count);
+static int ThermalCodec_Get(ThermalCodec_Bits_t* bits, uint8_t count, uint32_t* value);
+
+/**
+ * @brief Encode a keyframe
+ * @param frame Raw pixel values, 12-bit two's complement (64 elements)
+ * @param shift Quantization shift, 0 for lossless (0.25°C), 1 for 0.5°C...
+ * @param id Frame id written in the header
+ * @param out Output buffer
+ * @param outSize Size of the output buffer
+ * @return Number of bytes written, or -1 if the buffer is too small
+ */
+int ThermalCodec_Encode(const int16_t* frame, uint8_t shift, uint8_t id, uint8_t* out, uint16_t outSize)
+{
+    int16_t pixels[THERMAL_CODEC_PIXELS];
+    uint16_t zigzag[THERMAL_CODEC_PIXELS];
+    uint32_t cost;
+    uint8_t k;
+    ThermalCodec_Bits_t bits;
+
+    if (shift > THERMAL_CODEC_MAX_SHIFT || outSize < THERMAL_CODEC_HEADER_SIZE) {
+        return -1;
+    }
+
+    // Quantize, then predict every pixel from the quantized neighbours
+    for (int i = 0; i < THERMAL_CODEC_PIXELS; i++) {
+        pixels[i] = (int16_t)(frame[i] >> shift);
+    }
+    for (int i = 1; i < THERMAL_CODEC_PIXELS; i++) {
+        zigzag[i] = ThermalCodec_ZigZag((int32_t)pixels[i] - ThermalCodec_Predict(pixels, i));
+    }
+
+    // One Rice parameter per frame, the cheapest one
+    k = ThermalCodec_BestK(&zigzag[1], THERMAL_CODEC_PIXELS - 1, &cost);
+
+    bits.buffer = out;
+    bits.input = NULL;
+    bits.size = outSize;
+    bits.bitPos = THERMAL_CODEC_HEADER_SIZE * 8;
+    out[1] = id;
+
+    if (THERMAL_CODEC_PIXEL_BITS + cost >= THERMAL_CODEC_PIXELS * THERMAL_CODEC_PIXEL_BITS) {
+        // Noise-like frame, store it packed
+        out[0] = THERMAL_CODEC_MODE_PACKED | (uint8_t)(shift << THERMAL_CODEC_SHIFT_POS);
+        for (int i = 0; i < THERMAL_CODEC_PIXELS; i++) {
+            if (ThermalCodec_Put(&bits, (uint16_t)pixels[i], THERMAL_CODEC_PIXEL_BITS) != 0) {
+                return -1;
+            }
+        }
+    } else {
+        out[0] = (uint8_t)(shift << THERMAL_CODEC_SHIFT_POS) | k;
+        if (ThermalCodec_Put(&bits, (uint16_t)pixels[0], THERMAL_CODEC_PIXEL_BITS) != 0) {
+            return -1;
+        }
+        for (int i = 1; i < THERMAL_CODEC_PIXELS; i++) {
+            if (ThermalCodec_PutRice(&bits, zigzag[i], k) != 0) {
+                return -1;
+            }
+        }
+    }
+
+    return (int)((bits.bitPos + 7) / 8);
+}
+
+/**
+ * @brief Decode a keyframe
+ * @param in Encoded stream
+ * @param len Length of the stream
+ * @param frame Decoded raw pixel values (64 elements)
+ * @return 0 if successful, -1 if the stream is malformed, truncated or a delta frame
+ */
+int ThermalCodec_Decode(const uint8_t* in, uint16_t len, int16_t* frame)
+{
+    int16_t pixels[THERMAL_CODEC_PIXELS];
+    ThermalCodec_Bits_t bits;
+    uint32_t value;
+    uint16_t zigzag;
+    uint8_t shift;
+    uint8_t k;
+
+    if (len < THERMAL_CODEC_HEADER_SIZE || (in[0] & THERMAL_CODEC_TYPE_DELTA) != 0) {
+        return -1;
+    }
+
+    shift = (in[0] & THERMAL_CODEC_SHIFT_MASK) >> THERMAL_CODEC_SHIFT_POS;
+    k = in[0] & THERMAL_CODEC_K_MASK;
+
+    bits.buffer = NULL;
+    bits.input = in;
+    bits.size = len;
+    bits.bitPos = THERMAL_CODEC_HEADER_SIZE * 8;
+
+    if (in[0] & THERMAL_CODEC_MODE_PACKED) {
+        for (int i = 0; i < THERMAL_CODEC_PIXELS; i++) {
+            if (ThermalCodec_Get(&bits, THERMAL_CODEC_PIXEL_BITS, &value) != 0) {
+                return -1;
+            }
+            // Sign extend the 12-bit value
+            pixels[i] = (int16_t)(value << 4) >> 4;
+        }
+    } else {
+        if (k > THERMAL_CODEC_MAX_K || ThermalCodec_Get(&bits, THERMAL_CODEC_PIXEL_BITS, &value) != 0) {
+            return -1;
+        }
+        pixels[0] = (int16_t)(value << 4) >> 4;
+
+        for (int i = 1; i < THERMAL_CODEC_PIXELS; i++) {
+            if (ThermalCodec_GetRice(&bits, k, &zigzag) != 0) {
+                return -1;
+            }
+            pixels[i] = (int16_t)(ThermalCodec_Predict(pixels, i) + ThermalCodec_UnZigZag(zigzag));
+        }
+    }
+
+    for (int i = 0; i < THERMAL_CODEC_PIXELS; i++) {
+        frame[i] = (int16_t)(pixels[i] * (1 << shift));
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Initialize an encoder
+ * @param encoder Encoder state
+ * @param keyframeInterval Force a keyframe after this many frames (1 = keyframes only)
+ * @param threshold Smallest pixel change sent in a delta frame, in raw units
+ */
+void ThermalCodec_EncoderInit(ThermalCodec_Encoder_t* encoder, uint8_t keyframeInterval, uint8_t threshold)
+{
+    memset(encoder, 0, sizeof(*encoder));
+    encoder->keyframeInterval = keyframeInterval;
+    encoder->threshold = threshold;
+}
+
+/**
+ * @brief Encode a frame as a delta or as a keyframe
+ * @param encoder Encoder state
+ * @param frame Raw pixel values (64 elements)
+ * @param shift Quantization shift
+ * @param out Output buffer
+ * @param outSize Size of the output buffer
+ * @return Number of bytes written, or -1 if the buffer is too small
+ */
+int ThermalCodec_EncodeFrame(ThermalCodec_Encoder_t* encoder, const int16_t* frame, uint8_t shift,
+                             uint8_t* out, uint16_t outSize)
+{
+    uint8_t delta[THERMAL_CODEC_MAX_SIZE];
+    int16_t decoded[THERMAL_CODEC_PIXELS];
+    int keySize;
+    int deltaSize = -1;
+
+    keySize = ThermalCodec_Encode(frame, shift, encoder->nextId, out, outSize);
+
+    if (encoder->hasReference && (encoder->sinceKeyframe + 1U < encoder->keyframeInterval)) {
+        deltaSize = ThermalCodec_EncodeDelta(encoder, frame, shift, delta, sizeof(delta), decoded);
+    }
+
+    if (deltaSize > 0 && (keySize < 0 || deltaSize < keySize) && deltaSize <= outSize) {
+        memcpy(out, delta, deltaSize);
+        memcpy(encoder->pending, decoded, sizeof(encoder->pending));
+        encoder->pendingIsKey = false;
+    } else if (keySize > 0) {
+        // The decoder rebuilds the quantized frame
+        for (int i = 0; i < THERMAL_CODEC_PIXELS; i++) {
+            encoder->pending[i] = (int16_t)((frame[i] >> shift) * (1 << shift));
+        }
+        encoder->pendingIsKey = true;
+    } else {
+        return -1;
+    }
+
+    encoder->pendingId = encoder->nextId++;
+    encoder->pendingValid = true;
+    encoder->sinceKeyframe++;
+
+    return encoder->pendingIsKey ? keySize : deltaSize;
+}
+
+/**
+ * @brief Record that the last encoded frame reached the decoder
+ * @param encoder Encoder state
+ */
+void ThermalCodec_Acknowledge(ThermalCodec_Encoder_t* encoder)
+{
+    if (!encoder->pendingValid) {
+        return;
+    }
+
+    memcpy(encoder->reference, encoder->pending, sizeof(encoder->reference));
+    encoder->referenceId = encoder->pendingId;
+    encoder->hasReference = true;
+    encoder->pendingValid = false;
+    if (encoder->pendingIsKey) {
+        encoder->sinceKeyframe = 0;
+    }
+}
+
+/**
+ * @brief Initialize a decoder
+ * @param decoder Decoder state
+ */
+void ThermalCodec_DecoderInit(ThermalCodec_Decoder_t* decoder)
+{
+    memset(decoder, 0, sizeof(*decoder));
+}
+
+/**
+ * @brief Decode a keyframe or a delta frame and keep it as a possible reference
+ * @param decoder Decoder state
+ * @param in Encoded stream
+ * @param len Length of the stream
+ * @param frame Decoded raw pixel values (64 elements)
+ * @return 0 if successful, -1 if the stream is malformed or its reference is unknown
+ */
+int ThermalCodec_DecodeFrame(ThermalCodec_Decoder_t* decoder, const uint8_t* in, uint16_t len, int16_t* frame)
+{
+    int status = -1;
+
+    if (len < THERMAL_CODEC_HEADER_SIZE) {
+        return -1;
+    }
+
+    if ((in[0] & THERMAL_CODEC_TYPE_DELTA) == 0) {
+        status = ThermalCodec_Decode(in, len, frame);
+    } else if (len > THERMAL_CODEC_HEADER_SIZE) {
+        for (int slot = 0; slot < THERMAL_CODEC_HISTORY; slot++) {
+            if ((decoder->validMask & (1U << slot)) && decoder->ids[slot] == in[2]) {
+                status = ThermalCodec_DecodeDelta(in, len, decoder->frames[slot], frame);
+                break;
+            }
+        }
+    }
+
+    if (status == 0) {
+        memcpy(decoder->frames[decoder->next], frame, sizeof(decoder->frames[0]));
+        decoder->ids[decoder->next] = in[1];
+        decoder->validMask |= (1U << decoder->next);
+        decoder->next = (decoder->next + 1) % THERMAL_CODEC_HISTORY;
+    }
+
+    return status;
+}
+
+/**
+ * @brief Encode the pixels that moved since the reference
+ * @param encoder Encoder state with a valid reference
+ * @param frame Raw pixel values
+ * @param shift Quantization shift
+ * @param out Output buffer
+ * @param outSize Size of the output buffer
+ * @param decoded Frame as the decoder will rebuild it
+ * @return Number of bytes written, or -1 if the buffer is too small
+ */
+static int ThermalCodec_EncodeDelta(ThermalCodec_Encoder_t* encoder, const int16_t* frame, uint8_t shift,
+                                    uint8_t* out, uint16_t outSize, int16_t* decoded)
+{
+    uint16_t zigzag[THERMAL_CODEC_PIXELS];
+    uint8_t columns[THERMAL_CODEC_HEIGHT] = {0};
+    uint8_t rows = 0;
+    int count = 0;
+    int pos;
+    uint32_t cost;
+    uint8_t k;
+    ThermalCodec_Bits_t bits;
+
+    memcpy(decoded, encoder->reference, THERMAL_CODEC_PIXELS * sizeof(int16_t));
+
+    for (int i = 0; i < THERMAL_CODEC_PIXELS; i++) {
+        int32_t diff = (int32_t)frame[i] - encoder->reference[i];
+        int32_t quantized;
+
+        if (diff <= encoder->threshold && diff >= -(int32_t)encoder->threshold) {
+            continue;
+        }
+
+        // Rounded to the quantization step, rebuilt exactly by the decoder
+        quantized = (diff + ((1 << shift) >> 1)) >> shift;
+        if (quantized == 0) {
+            continue;
+        }
+
+        decoded[i] = (int16_t)(encoder->reference[i] + quantized * (1 << shift));
+        zigzag[count++] = ThermalCodec_ZigZag(quantized);
+        columns[i / THERMAL_CODEC_WIDTH] |= (uint8_t)(1U << (i % THERMAL_CODEC_WIDTH));
+        rows |= (uint8_t)(1U << (i / THERMAL_CODEC_WIDTH));
+    }
+
+    k = ThermalCodec_BestK(zigzag, count, &cost);
+
+    if (outSize < THERMAL_CODEC_HEADER_SIZE + 2) {
+        return -1;
+    }
+    out[0] = THERMAL_CODEC_TYPE_DELTA | (uint8_t)(shift << THERMAL_CODEC_SHIFT_POS) | k;
+    out[1] = encoder->nextId;
+    out[2] = encoder->referenceId;
+    out[3] = rows;
+    pos = 4;
+    for (int row = 0; row < THERMAL_CODEC_HEIGHT; row++) {
+        if (rows & (1U << row)) {
+            if (pos >= outSize) {
+                return -1;
+            }
+            out[pos++] = columns[row];
+        }
+    }
+
+    bits.buffer = out;
+    bits.input = NULL;
+    bits.size = outSize;
+    bits.bitPos = (uint32_t)pos * 8;
+    for (int i = 0; i < count; i++) {
+        if (ThermalCodec_PutRice(&bits, zigzag[i], k) != 0) {
+            return -1;
+        }
+    }
+
+    return (int)((bits.bitPos + 7) / 8);
+}
+
+/**
+ * @brief Apply a delta frame to its reference
+ * @param in Encoded stream
+ * @param len Length of the stream
+ * @param reference Reference frame named in the stream
+ * @param frame Decoded raw pixel values
+ * @return 0 if successful, -1 if the stream is malformed or truncated
+ */
+static int ThermalCodec_DecodeDelta(const uint8_t* in, uint16_t len, const int16_t* reference, int16_t* frame)
+{
+    uint8_t shift = (in[0] & THERMAL_CODEC_SHIFT_MASK) >> THERMAL_CODEC_SHIFT_POS;
+    uint8_t k = in[0] & THERMAL_CODEC_K_MASK;
+    uint8_t rows;
+    uint16_t zigzag;
+    int pos;
+    ThermalCodec_Bits_t bits;
+
+    if ((in[0] & THERMAL_CODEC_MODE_PACKED) || k > THERMAL_CODEC_MAX_K || len < 4) {
+        return -1;
+    }
+
+    memcpy(frame, reference, THERMAL_CODEC_PIXELS * sizeof(int16_t));
+
+    rows = in[3];
+    pos = 4;
+    bits.buffer = NULL;
+    bits.input = in;
+    bits.size = len;
+
+    // Column masks come first, the Rice codes follow all of them
+    for (int row = 0; row < THERMAL_CODEC_HEIGHT; row++) {
+        if (rows & (1U << row)) {
+            pos++;
+        }
+    }
+    if (pos > len) {
+        return -1;
+    }
+    bits.bitPos = (uint32_t)pos * 8;
+
+    pos = 4;
+    for (int row = 0; row < THERMAL_CODEC_HEIGHT; row++) {
+        uint8_t columns;
+
+        if ((rows & (1U << row)) == 0) {
+            continue;
+        }
+        columns = in[pos++];
+        for (int col = 0; col < THERMAL_CODEC_WIDTH; col++) {
+            if (columns & (1U << col)) {
+                int i = row * THERMAL_CODEC_WIDTH + col;
+                if (ThermalCodec_GetRice(&bits, k, &zigzag) != 0) {
+                    return -1;
+                }
+                frame[i] = (int16_t)(reference[i] + ThermalCodec_UnZigZag(zigzag) * (1 << shift));
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Median edge detector prediction from the causal neighbours
+ * @param pixels Frame, only pixels before index are used
+ * @param index Pixel to predict (> 0)
+ * @return Predicted value
+ */
+static int16_t ThermalCodec_Predict(const int16_t* pixels, int index)
+{
+    int x = index % THERMAL_CODEC_WIDTH;
+    int y = index / THERMAL_CODEC_WIDTH;
+
+    if (y == 0) {
+        return pixels[index - 1];
+    }
+    if (x == 0) {
+        return pixels[index - THERMAL_CODEC_WIDTH];
+    }
+
+    int16_t a = pixels[index - 1];                         // left
+    int16_t b = pixels[index - THERMAL_CODEC_WIDTH];       // above
+    int16_t c = pixels[index - THERMAL_CODEC_WIDTH - 1];   // above left
+    int16_t lo = (a < b) ? a : b;
+    int16_t hi = (a < b) ? b : a;
+
+    if (c >= hi) {
+        return lo;
+    }
+    if (c <= lo) {
+        return hi;
+    }
+    return (int16_t)(a + b - c);
+}
+
+/**
+ * @brief Map a signed residual to 0, -1, 1, -2... -> 0, 1, 2, 3...
+ */
+static uint16_t ThermalCodec_ZigZag(int32_t residual)
+{
+    return (uint16_t)((residual >= 0) ? (residual << 1) : ((-residual << 1) - 1));
+}
+
+/**
+ * @brief Inverse of ThermalCodec_ZigZag()
+ */
+static int32_t ThermalCodec_UnZigZag(uint16_t value)
+{
+    return (value & 1) ? -(int32_t)((value + 1) >> 1) : (int32_t)(value >> 1);
+}
+
+/**
+ * @brief Find the Rice parameter giving the fewest bits
+ * @param values Zig-zag values
+ * @param count Number of values
+ * @param cost Number of bits with the returned parameter
+ * @return Rice parameter
+ */
+static uint8_t ThermalCodec_BestK(const uint16_t* values, int count, uint32_t* cost)
+{
+    uint32_t bestCost = UINT32_MAX;
+    uint8_t bestK = 0;
+
+    for (uint8_t k = 0; k <= THERMAL_CODEC_MAX_K; k++) {
+        uint32_t bits = 0;
+        for (int i = 0; i < count; i++) {
+            uint32_t quotient = values[i] >> k;
+            bits += (quotient >= THERMAL_CODEC_ESCAPE) ? (THERMAL_CODEC_ESCAPE + THERMAL_CODEC_RESIDUAL_BITS)
+                                                       : (quotient + 1 + k);
+        }
+        if (bits < bestCost) {
+            bestCost = bits;
+            bestK = k;
+        }
+    }
+
+    *cost = bestCost;
+    return bestK;
+}
+
+/**
+ * @brief Append one Rice code word
+ * @return 0 if successful, -1 if the buffer is full
+ */
+static int ThermalCodec_PutRice(ThermalCodec_Bits_t* bits, uint16_t value, uint8_t k)
+{
+    uint16_t quotient = value >> k;
+
+    if (quotient >= THERMAL_CODEC_ESCAPE) {
+        if (ThermalCodec_Put(bits, (1U << THERMAL_CODEC_ESCAPE) - 1, THERMAL_CODEC_ESCAPE) != 0) {
+            return -1;
+        }
+        return ThermalCodec_Put(bits, value, THERMAL_CODEC_RESIDUAL_BITS);
+    }
+
+    // quotient ones, a terminating zero, then the remainder
+    if (ThermalCodec_Put(bits, ((1U << quotient) - 1) << 1, quotient + 1) != 0) {
+        return -1;
+    }
+    return ThermalCodec_Put(bits, value & ((1U << k) - 1), k);
+}
+
+/**
+ * @brief Read one Rice code word
+ * @return 0 if successful, -1 past the end of the stream
+ */
+static int ThermalCodec_GetRice(ThermalCodec_Bits_t* bits, uint8_t k, uint16_t* value)
+{
+    uint32_t quotient = 0;
+    uint32_t bit;
+    uint32_t remainder;
+
+    do {
+        if (ThermalCodec_Get(bits, 1, &bit) != 0) {
+            return -1;
+        }
+    } while (bit && ++quotient < THERMAL_CODEC_ESCAPE);
+
+    if (quotient == THERMAL_CODEC_ESCAPE) {
+        if (ThermalCodec_Get(bits, THERMAL_CODEC_RESIDUAL_BITS, &remainder) != 0) {
+            return -1;
+        }
+        *value = (uint16_t)remainder;
+        return 0;
+    }
+
+    if (ThermalCodec_Get(bits, k, &remainder) != 0) {
+        return -1;
+    }
+    *value = (uint16_t)((quotient << k) | remainder);
+    return 0;
+}
+
+/**
+ * @brief Append bits, MSB first
+ * @return 0 if successful, -1 if the buffer is full
+ */
+static int ThermalCodec_Put(ThermalCodec_Bits_t* bits, uint32_t value, uint8_t count)
+{
+    while (count > 0) {
+        uint32_t byte = bits->bitPos >> 3;
+        uint8_t room = 8 - (bits->bitPos & 7);
+        uint8_t n = (count < room) ? count : room;
+        uint8_t chunk = (uint8_t)((value >> (count - n)) & ((1U << n) - 1));
+
+        if (byte >= bits->size) {
+            return -1;
+        }
+        if (room == 8) {
+            bits->buffer[byte] = 0;
+        }
+        bits->buffer[byte] |= (uint8_t)(chunk << (room - n));
+        bits->bitPos += n;
+        count -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Read bits, MSB first
+ * @return 0 if successful, -1 past the end of the stream
+ */
+static int ThermalCodec_Get(ThermalCodec_Bits_t* bits, uint8_t count, uint32_t* value)
+{
+    *value = 0;
+    while (count > 0) {
+        uint32_t byte = bits->bitPos >> 3;
+        uint8_t left = 8 - (bits->bitPos & 7);
+        uint8_t n = (count < left) ? count : left;
+
+        if (byte >= bits->size) {
+            return -1;
+        }
+        *value = (*value << n) | ((bits->input[byte] >> (left - n)) & ((1U << n) - 1));
+        bits->bitPos += n;
+        count -= n;
+    }
+    return 0;
+}
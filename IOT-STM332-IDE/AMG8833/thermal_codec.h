@@ -0,0 +1,163 @@
+/**
+ * @file thermal_codec.h
+ * @brief Lossless/near-lossless codec for 8x8 thermal frames
+ *
+ * Keyframes: pixels are predicted from their causal neighbours (LOCO-I
+ * median edge detector), the residuals are zig-zag mapped and Rice coded
+ * with one parameter per frame. Keyframes that do not compress are stored
+ * packed at 12 bits per pixel.
+ *
+ * Delta frames: only the pixels that moved by more than a threshold since
+ * a reference frame the decoder already has are sent, as a sparse row/column
+ * bitmap followed by their Rice coded zig-zag differences. The encoder keeps
+ * the last acknowledged frame as reconstructed by the decoder, so thresholded
+ * pixels never drift, and forces a keyframe periodically.
+ *
+ * Stream layout (bits are written MSB first):
+ *   byte 0   bit 7    mode (0 = Rice, 1 = packed)
+ *            bit 6:5  quantization shift (pixel = raw >> shift)
+ *            bit 4    frame type (0 = keyframe, 1 = delta)
+ *            bit 3:0  Rice parameter k
+ *   byte 1   frame id
+ *   keyframe, Rice
+ *            first pixel on 12 bits (two's complement), then for each
+ *            other pixel in row-major order: quotient in unary (ones
+ *            ended by a zero) and k remainder bits. A quotient of
+ *            THERMAL_CODEC_ESCAPE ones is followed by the 13-bit zig-zag
+ *            residual instead.
+ *   keyframe, packed
+ *            64 pixels on 12 bits each
+ *   delta    byte 2: id of the reference frame
+ *            byte 3: row mask (bit n = row n has changed pixels)
+ *            one column mask byte per row set in the row mask
+ *            Rice codes (as above) of the quantized differences of the
+ *            changed pixels, in row-major order
+ *
+ * The file has no hardware dependency so the decoder can be built on a host.
+ */
+
+#ifndef THERMAL_CODEC_H
+#define THERMAL_CODEC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Frame geometry */
+#define THERMAL_CODEC_WIDTH          8
+#define THERMAL_CODEC_HEIGHT         8
+#define THERMAL_CODEC_PIXELS         (THERMAL_CODEC_WIDTH * THERMAL_CODEC_HEIGHT)
+
+/* Stream parameters */
+#define THERMAL_CODEC_PIXEL_BITS     12      // Raw AMG8833 pixel width
+#define THERMAL_CODEC_RESIDUAL_BITS  13      // Zig-zag residual width
+#define THERMAL_CODEC_ESCAPE         12      // Unary length that escapes to a raw residual
+#define THERMAL_CODEC_MAX_K          11      // Largest Rice parameter tried
+#define THERMAL_CODEC_MAX_SHIFT      3       // Largest quantization shift
+#define THERMAL_CODEC_HEADER_SIZE    2       // Header and frame id
+
+/* Header fields */
+#define THERMAL_CODEC_MODE_PACKED    0x80
+#define THERMAL_CODEC_SHIFT_POS      5
+#define THERMAL_CODEC_SHIFT_MASK     0x60
+#define THERMAL_CODEC_TYPE_DELTA     0x10
+#define THERMAL_CODEC_K_MASK         0x0F
+
+/* Largest encoded frame: header + packed pixels */
+#define THERMAL_CODEC_MAX_SIZE       (THERMAL_CODEC_HEADER_SIZE + (THERMAL_CODEC_PIXELS * THERMAL_CODEC_PIXEL_BITS) / 8)
+
+/* Decoder history */
+#define THERMAL_CODEC_HISTORY        4       // Frames kept as possible references
+
+/**
+ * @brief Encoder state for keyframe/delta coding
+ */
+typedef struct {
+    int16_t reference[THERMAL_CODEC_PIXELS]; // Last acknowledged frame, as decoded
+    int16_t pending[THERMAL_CODEC_PIXELS];   // Last encoded frame, as it will be decoded
+    uint8_t referenceId;                     // Frame id of reference
+    uint8_t pendingId;                       // Frame id of pending
+    uint8_t nextId;                          // Frame id of the next frame
+    bool hasReference;                       // reference is valid
+    bool pendingValid;                       // pending waits for an acknowledge
+    bool pendingIsKey;                       // pending is a keyframe
+    uint8_t sinceKeyframe;                   // Frames encoded since the last acknowledged keyframe
+    uint8_t keyframeInterval;                // Force a keyframe after this many frames
+    uint8_t threshold;                       // Smallest change sent, in raw units
+} ThermalCodec_Encoder_t;
+
+/**
+ * @brief Decoder state for keyframe/delta coding
+ */
+typedef struct {
+    int16_t frames[THERMAL_CODEC_HISTORY][THERMAL_CODEC_PIXELS]; // Recently decoded frames
+    uint8_t ids[THERMAL_CODEC_HISTORY];                          // Their frame ids
+    uint8_t validMask;                                           // Bit n set when frames[n] is valid
+    uint8_t next;                                                // Slot for the next frame
+} ThermalCodec_Decoder_t;
+
+/**
+ * @brief Encode a keyframe
+ * @param frame Raw pixel values, 12-bit two's complement (64 elements)
+ * @param shift Quantization shift, 0 for lossless (0.25°C), 1 for 0.5°C...
+ * @param id Frame id written in the header
+ * @param out Output buffer
+ * @param outSize Size of the output buffer
+ * @return Number of bytes written, or -1 if the buffer is too small
+ */
+int ThermalCodec_Encode(const int16_t* frame, uint8_t shift, uint8_t id, uint8_t* out, uint16_t outSize);
+
+/**
+ * @brief Decode a keyframe
+ * @param in Encoded stream
+ * @param len Length of the stream
+ * @param frame Decoded raw pixel values (64 elements), already scaled back
+ *              by the quantization shift
+ * @return 0 if successful, -1 if the stream is malformed, truncated or a delta frame
+ */
+int ThermalCodec_Decode(const uint8_t* in, uint16_t len, int16_t* frame);
+
+/**
+ * @brief Initialize an encoder
+ * @param encoder Encoder state
+ * @param keyframeInterval Force a keyframe after this many frames (1 = keyframes only)
+ * @param threshold Smallest pixel change sent in a delta frame, in raw units
+ */
+void ThermalCodec_EncoderInit(ThermalCodec_Encoder_t* encoder, uint8_t keyframeInterval, uint8_t threshold);
+
+/**
+ * @brief Encode a frame as a delta against the last acknowledged frame, or
+ *        as a keyframe when none is acknowledged, when one is due or when
+ *        it is smaller
+ * @param encoder Encoder state
+ * @param frame Raw pixel values (64 elements)
+ * @param shift Quantization shift
+ * @param out Output buffer
+ * @param outSize Size of the output buffer
+ * @return Number of bytes written, or -1 if the buffer is too small
+ */
+int ThermalCodec_EncodeFrame(ThermalCodec_Encoder_t* encoder, const int16_t* frame, uint8_t shift,
+                             uint8_t* out, uint16_t outSize);
+
+/**
+ * @brief Record that the last encoded frame reached the decoder
+ * @param encoder Encoder state
+ */
+void ThermalCodec_Acknowledge(ThermalCodec_Encoder_t* encoder);
+
+/**
+ * @brief Initialize a decoder
+ * @param decoder Decoder state
+ */
+void ThermalCodec_DecoderInit(ThermalCodec_Decoder_t* decoder);
+
+/**
+ * @brief Decode a keyframe or a delta frame and keep it as a possible reference
+ * @param decoder Decoder state
+ * @param in Encoded stream
+ * @param len Length of the stream
+ * @param frame Decoded raw pixel values (64 elements)
+ * @return 0 if successful, -1 if the stream is malformed or its reference is unknown
+ */
+int ThermalCodec_DecodeFrame(ThermalCodec_Decoder_t* decoder, const uint8_t* in, uint16_t len, int16_t* frame);
+
+#endif /* THERMAL_CODEC_H */
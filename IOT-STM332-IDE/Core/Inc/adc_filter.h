@@ -0,0 +1,98 @@
+/**
+  ******************************************************************************
+  * @file    adc_filter.h
+  * @brief   Streaming fixed-point filter of one ADC channel
+  * @note    Each new sample goes through:
+  *            - Hampel rejection: a sample further than threshold * 1.4826 *
+  *              MAD from the median of the last window raw samples is
+  *              replaced by that median
+  *            - a running median of the last medianSize accepted samples
+  *            - a first-order IIR, y += (median - y) / 2^iirShift
+  *          Samples and outputs are unsigned 12-bit conversions. The file has
+  *          no hardware dependency.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __ADC_FILTER_H__
+#define __ADC_FILTER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+/**
+  * @brief Largest ring buffer
+  */
+#define ADC_FILTER_MAX_WINDOW           16
+
+/**
+  * @brief Fractional bits of the IIR state, more than the largest iirShift so
+  *        that the truncated update still settles within half an LSB
+  */
+#define ADC_FILTER_IIR_FRAC             16
+
+/**
+  * @brief Fractional bits of the Hampel threshold
+  */
+#define ADC_FILTER_HAMPEL_FRAC          4
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief Filter configuration of one channel
+  */
+typedef struct
+{
+  uint8_t window;               /*!< Ring buffer length, 1..ADC_FILTER_MAX_WINDOW, 1 passes samples through */
+  uint8_t medianSize;           /*!< Running median length, 1..window, odd */
+  uint8_t iirShift;             /*!< IIR coefficient 1/2^iirShift, 0 disables the IIR */
+  uint8_t hampelThreshold;      /*!< Rejection threshold in standard deviations (Q4), 0 disables it */
+} ADC_FilterConfig_t;
+
+/**
+  * @brief Filter state of one channel
+  */
+typedef struct
+{
+  ADC_FilterConfig_t config;
+  uint16_t raw[ADC_FILTER_MAX_WINDOW];   /*!< Last samples, before rejection */
+  uint16_t clean[ADC_FILTER_MAX_WINDOW]; /*!< Last samples, after rejection */
+  uint8_t head;                 /*!< Slot of the next sample in both rings */
+  uint8_t count;                /*!< Valid samples in the rings */
+  int32_t iir;                  /*!< IIR state, ADC_FILTER_IIR_FRAC fractional bits */
+  uint16_t output;              /*!< Last output */
+  uint16_t rejected;            /*!< Samples replaced by the Hampel rule since the last reset */
+} ADC_FilterChannel_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  Configure a channel and reset it
+  * @param  channel filter state
+  * @param  config configuration, out of range fields are clamped
+  */
+void ADC_Filter_Init(ADC_FilterChannel_t *channel, const ADC_FilterConfig_t *config);
+
+/**
+  * @brief  Forget the samples of a channel, its configuration is kept
+  * @param  channel filter state
+  */
+void ADC_Filter_Reset(ADC_FilterChannel_t *channel);
+
+/**
+  * @brief  Filter a new sample
+  * @param  channel filter state
+  * @param  sample conversion
+  * @retval filtered value
+  */
+uint16_t ADC_Filter_Push(ADC_FilterChannel_t *channel, uint16_t sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ADC_FILTER_H__ */
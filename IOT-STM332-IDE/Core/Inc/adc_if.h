@@ -29,11 +29,40 @@ extern "C" {
 #include "platform.h"
 
 /* USER CODE BEGIN Includes */
+#include <stdbool.h>
+#include "adc_filter.h"
 
 /* USER CODE END Includes */
 
 /* Exported types ------------------------------------------------------------*/
 /* USER CODE BEGIN ET */
+/**
+  * @brief Regular ranks configured by MX_ADC_Init(), index of each in ADC_Snapshot_t.raw
+  */
+#define ADC_SCAN_RANKS              6
+#define ADC_SCAN_TDS                0   /*!< ADC_IN2, PB3 */
+#define ADC_SCAN_IN3                1   /*!< ADC_IN3, PB4 */
+#define ADC_SCAN_PH                 2   /*!< ADC_IN5, PB1 */
+#define ADC_SCAN_IN6                3   /*!< ADC_IN6, PA10 */
+#define ADC_SCAN_VREFINT            4
+#define ADC_SCAN_TEMPSENSOR         5
+
+/**
+  * @brief Result of one scan of all the regular ranks of MX_ADC_Init()
+  */
+typedef struct
+{
+  uint16_t raw[ADC_SCAN_RANKS];   /*!< Oversampled conversions, 12-bit scale, indexed by rank - 1 */
+  uint16_t filtered[ADC_SCAN_RANKS]; /*!< Output of the filter of each rank */
+  uint16_t vddaMv;                /*!< VDDA computed from VREFINT, 0 if VREFINT was out of range */
+  int16_t temperature;            /*!< Die temperature, degC */
+  uint32_t tick;                  /*!< HAL tick at the end of the scan */
+} ADC_Snapshot_t;
+
+/**
+  * @brief Scan complete callback, called from the DMA interrupt
+  */
+typedef void (*ADC_ScanCallback_t)(const ADC_Snapshot_t *snapshot);
 
 /* USER CODE END ET */
 
@@ -52,6 +81,15 @@ extern "C" {
 #define VDD_MIN                     1800
 
 /* USER CODE BEGIN EC */
+/**
+  * @brief Longest wait of ADC_ScanRead() in ms, a scan takes about 2.8 ms
+  */
+#define ADC_SCAN_TIMEOUT            10
+
+/**
+  * @brief A scan later than this after the previous one restarts the filters, in ms
+  */
+#define ADC_SCAN_FILTER_HOLD        1000
 
 /* USER CODE END EC */
 
@@ -90,6 +128,54 @@ int16_t SYS_GetTemperatureLevel(void);
 uint16_t SYS_GetBatteryLevel(void);
 
 /* USER CODE BEGIN EFP */
+/**
+  * @brief  Calibrate the ADC once, the factor is restored if the ADC loses it
+  * @retval HAL status
+  */
+HAL_StatusTypeDef ADC_ScanInit(void);
+
+/**
+  * @brief  Start a DMA scan of all the ranks, Stop mode is held off until it ends
+  * @param  callback called from the DMA interrupt with the snapshot, NULL if
+  *         the scan failed; may be NULL
+  * @retval HAL_BUSY if a scan is running, HAL status otherwise
+  */
+HAL_StatusTypeDef ADC_ScanStart(ADC_ScanCallback_t callback);
+
+/**
+  * @brief  Start back-to-back scans feeding the filters, Stop mode is held off until they end
+  * @param  count number of scans, at least 1
+  * @param  callback called from the DMA interrupt with the snapshot of the last scan, may be NULL
+  * @retval HAL_BUSY if a scan is running, HAL status otherwise
+  */
+HAL_StatusTypeDef ADC_ScanStartSeries(uint8_t count, ADC_ScanCallback_t callback);
+
+/**
+  * @brief  Configure the filter of a rank, its samples are dropped
+  * @param  rank index in ADC_Snapshot_t.raw
+  * @param  config filter configuration
+  */
+void ADC_ScanConfigureFilter(uint8_t rank, const ADC_FilterConfig_t *config);
+
+/**
+  * @brief  Run a scan and wait for it
+  * @param  snapshot result of the scan
+  * @retval HAL status
+  */
+HAL_StatusTypeDef ADC_ScanRead(ADC_Snapshot_t *snapshot);
+
+/**
+  * @brief  Copy of the result of the last completed scan
+  * @param  snapshot result of the scan, left unchanged if no scan completed yet
+  * @retval true if a scan completed
+  */
+bool ADC_ScanGetLast(ADC_Snapshot_t *snapshot);
+
+/**
+  * @brief  Whether a scan is running
+  * @retval true while the DMA transfer is not complete
+  */
+bool ADC_ScanIsBusy(void);
 
 /* USER CODE END EFP */
 
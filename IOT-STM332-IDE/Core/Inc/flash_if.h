@@ -0,0 +1,73 @@
+/**
+  ******************************************************************************
+  * @file    flash_if.h
+  * @brief   Page erase and double-word programming of the internal flash
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __FLASH_IF_H__
+#define __FLASH_IF_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include "main.h"
+
+/* Exported constants --------------------------------------------------------*/
+/**
+  * @brief Flash reserved for the calibration store by the CALIB region of the
+  *        linker script, two pages
+  */
+extern uint8_t _calib_start[];
+extern uint8_t _calib_end[];
+
+/**
+  * @brief Flash reserved for the uplink log by the LOG region of the linker
+  *        script, UPLINK_LOG_FLASH_PAGES pages
+  */
+extern uint8_t _log_start[];
+extern uint8_t _log_end[];
+#define UPLINK_LOG_FLASH_PAGES          16
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  Erase one page
+  * @param  address address in the page
+  * @retval HAL status
+  */
+HAL_StatusTypeDef FLASH_IF_ErasePage(uint32_t address);
+
+/**
+  * @brief  Program one double-word, which must be erased
+  * @param  address address, 8-byte aligned
+  * @param  data value
+  * @retval HAL status
+  */
+HAL_StatusTypeDef FLASH_IF_Program(uint32_t address, uint64_t data);
+
+/**
+  * @brief  Copy from the flash, catching the uncorrectable ECC errors of
+  *         double-words torn by a reset
+  * @param  address address
+  * @param  data destination
+  * @param  size size to copy
+  * @retval HAL_ERROR if an ECC error was detected, the data are then not valid
+  */
+HAL_StatusTypeDef FLASH_IF_Read(uint32_t address, void *data, uint32_t size);
+
+/**
+  * @brief  Acknowledge the NMI of an ECC error raised by FLASH_IF_Read(),
+  *         called first by the NMI handler
+  * @retval true if the NMI was handled, false if it is another fault
+  */
+bool FLASH_IF_NMI_Handler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FLASH_IF_H__ */
@@ -44,6 +44,8 @@ typedef enum
   CFG_LPM_UART_TX_Id,
   CFG_LPM_TCXO_WA_Id,
   /* USER CODE BEGIN CFG_LPM_Id_t */
+  CFG_LPM_AMG8833_Id,
+  CFG_LPM_ADC_Id,
 
   /* USER CODE END CFG_LPM_Id_t */
 } CFG_LPM_Id_t;
@@ -74,6 +76,11 @@ typedef enum
   CFG_SEQ_Task_LmHandlerProcess,
   CFG_SEQ_Task_LoRaSendOnTxTimerOrButtonEvent,
   /* USER CODE BEGIN CFG_SEQ_Task_Id_t */
+  CFG_SEQ_Task_SensorAcqProcess,
+  CFG_SEQ_Task_LoRaSendSensorData,
+  CFG_SEQ_Task_DS18B20Conversion,
+  CFG_SEQ_Task_AMG8833Capture,
+  CFG_SEQ_Task_LoRaSendBacklog,
 
   /* USER CODE END CFG_SEQ_Task_Id_t */
   CFG_SEQ_Task_NBR
@@ -0,0 +1,174 @@
+/**
+  ******************************************************************************
+  * @file    adc_filter.c
+  * @brief   Streaming fixed-point filter of one ADC channel
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "adc_filter.h"
+
+/* Private define ------------------------------------------------------------*/
+/**
+  * @brief MAD to standard deviation factor, 1.4826 ~ 95/64
+  */
+#define ADC_FILTER_MAD_NUM              95
+#define ADC_FILTER_MAD_SHIFT            6
+
+/**
+  * @brief Fewest samples before the Hampel rule applies
+  */
+#define ADC_FILTER_HAMPEL_MIN           3
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t ADC_Filter_Median(uint16_t *values, uint8_t count);
+static uint16_t ADC_Filter_RingMedian(const ADC_FilterChannel_t *channel, const uint16_t *ring, uint8_t length);
+
+/* Exported functions --------------------------------------------------------*/
+void ADC_Filter_Init(ADC_FilterChannel_t *channel, const ADC_FilterConfig_t *config)
+{
+  channel->config = *config;
+
+  if (channel->config.window == 0)
+  {
+    channel->config.window = 1;
+  }
+  if (channel->config.window > ADC_FILTER_MAX_WINDOW)
+  {
+    channel->config.window = ADC_FILTER_MAX_WINDOW;
+  }
+  if ((channel->config.medianSize == 0) || (channel->config.medianSize > channel->config.window))
+  {
+    channel->config.medianSize = channel->config.window;
+  }
+  if ((channel->config.medianSize & 1U) == 0)
+  {
+    channel->config.medianSize--;
+  }
+  if (channel->config.iirShift > 15)
+  {
+    channel->config.iirShift = 15;
+  }
+
+  ADC_Filter_Reset(channel);
+}
+
+void ADC_Filter_Reset(ADC_FilterChannel_t *channel)
+{
+  memset(channel->raw, 0, sizeof(channel->raw));
+  memset(channel->clean, 0, sizeof(channel->clean));
+  channel->head = 0;
+  channel->count = 0;
+  channel->iir = 0;
+  channel->output = 0;
+  channel->rejected = 0;
+}
+
+uint16_t ADC_Filter_Push(ADC_FilterChannel_t *channel, uint16_t sample)
+{
+  const ADC_FilterConfig_t *config = &channel->config;
+  uint16_t deviation[ADC_FILTER_MAX_WINDOW];
+  uint16_t accepted = sample;
+  uint16_t median;
+  uint16_t mad;
+  uint32_t distance;
+  uint8_t i;
+
+  /* Hampel: compare the sample with the spread of the raw window, which
+     keeps the outliers so that a real step is accepted once it fills half
+     of it */
+  if ((config->hampelThreshold != 0) && (channel->count >= ADC_FILTER_HAMPEL_MIN))
+  {
+    median = ADC_Filter_RingMedian(channel, channel->raw, channel->count);
+    for (i = 0; i < channel->count; i++)
+    {
+      deviation[i] = (channel->raw[i] > median) ? (channel->raw[i] - median) : (median - channel->raw[i]);
+    }
+    mad = ADC_Filter_Median(deviation, channel->count);
+    /* A flat window would reject every change, allow one LSB of spread */
+    if (mad == 0)
+    {
+      mad = 1;
+    }
+
+    distance = (sample > median) ? (sample - median) : (median - sample);
+    if ((distance << (ADC_FILTER_MAD_SHIFT + ADC_FILTER_HAMPEL_FRAC)) >
+        ((uint32_t)config->hampelThreshold * ADC_FILTER_MAD_NUM * mad))
+    {
+      accepted = median;
+      if (channel->rejected < UINT16_MAX)
+      {
+        channel->rejected++;
+      }
+    }
+  }
+
+  channel->raw[channel->head] = sample;
+  channel->clean[channel->head] = accepted;
+  channel->head = (channel->head + 1) % config->window;
+  if (channel->count < config->window)
+  {
+    channel->count++;
+  }
+
+  median = ADC_Filter_RingMedian(channel, channel->clean, (channel->count < config->medianSize) ? channel->count : config->medianSize);
+
+  if ((config->iirShift == 0) || (channel->count == 1))
+  {
+    channel->iir = (int32_t)median << ADC_FILTER_IIR_FRAC;
+  }
+  else
+  {
+    channel->iir += (((int32_t)median << ADC_FILTER_IIR_FRAC) - channel->iir) >> config->iirShift;
+  }
+
+  channel->output = (uint16_t)((channel->iir + (1 << (ADC_FILTER_IIR_FRAC - 1))) >> ADC_FILTER_IIR_FRAC);
+  return channel->output;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Median of a small array, sorts it in place
+  * @param  values array
+  * @param  count number of values, at least 1
+  * @retval median, the upper one for an even count
+  */
+static uint16_t ADC_Filter_Median(uint16_t *values, uint8_t count)
+{
+  uint16_t value;
+  uint8_t i;
+  uint8_t j;
+
+  for (i = 1; i < count; i++)
+  {
+    value = values[i];
+    for (j = i; (j > 0) && (values[j - 1] > value); j--)
+    {
+      values[j] = values[j - 1];
+    }
+    values[j] = value;
+  }
+  return values[count / 2];
+}
+
+/**
+  * @brief  Median of the most recent samples of a ring buffer
+  * @param  channel filter state
+  * @param  ring raw or clean ring of the channel
+  * @param  length number of samples, 1..count
+  * @retval median
+  */
+static uint16_t ADC_Filter_RingMedian(const ADC_FilterChannel_t *channel, const uint16_t *ring, uint8_t length)
+{
+  uint16_t values[ADC_FILTER_MAX_WINDOW];
+  uint8_t slot = channel->head;
+  uint8_t i;
+
+  for (i = 0; i < length; i++)
+  {
+    slot = (slot == 0) ? (channel->config.window - 1) : (slot - 1);
+    values[i] = ring[slot];
+  }
+  return ADC_Filter_Median(values, length);
+}
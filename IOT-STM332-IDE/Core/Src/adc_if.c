@@ -22,6 +22,9 @@
 #include "sys_app.h"
 
 /* USER CODE BEGIN Includes */
+#include "stm32_lpm.h"
+#include "utilities_conf.h"
+#include "utilities_def.h"
 
 /* USER CODE END Includes */
 
@@ -44,6 +47,16 @@ extern ADC_HandleTypeDef hadc;
 #define TEMPSENSOR_TYP_AVGSLOPE        (( int32_t) 2500)        /*!< Internal temperature sensor, parameter Avg_Slope (unit: uV/DegCelsius). Refer to device datasheet for min/typ/max values. */
 
 /* USER CODE BEGIN PD */
+/**
+  * @brief Conversions closer than this to the rails are taken as a floating input
+  */
+#define ADC_LEVEL_MIN                  10
+#define ADC_LEVEL_MAX                  4090
+
+/**
+  * @brief Longest wait for the ADC ready flag in ms
+  */
+#define ADC_ENABLE_TIMEOUT             2
 
 /* USER CODE END PD */
 
@@ -55,6 +68,50 @@ extern ADC_HandleTypeDef hadc;
 /* Private variables ---------------------------------------------------------*/
 
 /* USER CODE BEGIN PV */
+/**
+  * @brief DMA destination of the scan, one halfword per rank
+  */
+static uint16_t ScanBuffer[ADC_SCAN_RANKS];
+
+/**
+  * @brief Result of the last completed scan
+  */
+static ADC_Snapshot_t ScanSnapshot;
+static bool ScanSnapshotValid = false;
+
+/**
+  * @brief Scan in progress and its completion callback
+  */
+static volatile bool ScanBusy = false;
+static volatile HAL_StatusTypeDef ScanStatus = HAL_OK;
+static volatile uint8_t ScanRemaining = 0;
+static volatile uint32_t ScanCount = 0;
+static ADC_ScanCallback_t ScanCallback = NULL;
+
+/**
+  * @brief Filters of the ranks, fed by every scan
+  */
+static ADC_FilterChannel_t ScanFilters[ADC_SCAN_RANKS];
+
+/**
+  * @brief Default filters: the pH electrode is high impedance and the
+  *        noisiest, the internal channels are passed through
+  */
+static const ADC_FilterConfig_t ScanFilterDefaults[ADC_SCAN_RANKS] =
+{
+  [ADC_SCAN_TDS]        = { .window = 9,  .medianSize = 5, .iirShift = 2, .hampelThreshold = 3 << ADC_FILTER_HAMPEL_FRAC },
+  [ADC_SCAN_IN3]        = { .window = 1,  .medianSize = 1, .iirShift = 0, .hampelThreshold = 0 },
+  [ADC_SCAN_PH]         = { .window = 15, .medianSize = 7, .iirShift = 3, .hampelThreshold = 3 << ADC_FILTER_HAMPEL_FRAC },
+  [ADC_SCAN_IN6]        = { .window = 1,  .medianSize = 1, .iirShift = 0, .hampelThreshold = 0 },
+  [ADC_SCAN_VREFINT]    = { .window = 1,  .medianSize = 1, .iirShift = 0, .hampelThreshold = 0 },
+  [ADC_SCAN_TEMPSENSOR] = { .window = 1,  .medianSize = 1, .iirShift = 0, .hampelThreshold = 0 },
+};
+
+/**
+  * @brief Calibration factor measured by ADC_ScanInit()
+  */
+static uint32_t CalibrationFactor = 0;
+static bool Calibrated = false;
 
 /* USER CODE END PV */
 
@@ -67,11 +124,222 @@ extern ADC_HandleTypeDef hadc;
 static uint32_t ADC_ReadChannels(uint32_t channel);
 
 /* USER CODE BEGIN PFP */
+/**
+  * @brief Power the ADC back up with its calibration factor if it was switched off
+  * @return HAL status
+  */
+static HAL_StatusTypeDef ADC_ScanRestore(void);
+
+/**
+  * @brief End a scan: stop the DMA, allow Stop mode and call the callback
+  * @param status result of the scan
+  */
+static void ADC_ScanEnd(HAL_StatusTypeDef status);
+
+/**
+  * @brief VDDA from a VREFINT conversion
+  * @param level VREFINT conversion
+  * @return VDDA in mV, 0 if the conversion is out of range
+  */
+static uint16_t ADC_ComputeVdda(uint32_t level);
+
+/**
+  * @brief Die temperature from a TEMPSENSOR conversion
+  * @param vddaMv VDDA in mV
+  * @param level TEMPSENSOR conversion
+  * @return temperature in degC
+  */
+static int16_t ADC_ComputeTemperature(uint16_t vddaMv, uint32_t level);
 
 /* USER CODE END PFP */
 
 /* Exported functions --------------------------------------------------------*/
 /* USER CODE BEGIN EF */
+HAL_StatusTypeDef ADC_ScanInit(void)
+{
+  if (ScanBusy)
+  {
+    return HAL_BUSY;
+  }
+  /* Calibration needs the ADC disabled, which MX_ADC_Init() leaves it */
+  if (HAL_ADCEx_Calibration_Start(&hadc) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+  CalibrationFactor = HAL_ADCEx_Calibration_GetValue(&hadc);
+  Calibrated = true;
+
+  for (uint32_t i = 0; i < ADC_SCAN_RANKS; i++)
+  {
+    ADC_Filter_Init(&ScanFilters[i], &ScanFilterDefaults[i]);
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef ADC_ScanStart(ADC_ScanCallback_t callback)
+{
+  return ADC_ScanStartSeries(1, callback);
+}
+
+HAL_StatusTypeDef ADC_ScanStartSeries(uint8_t count, ADC_ScanCallback_t callback)
+{
+  HAL_StatusTypeDef status;
+
+  if (ScanBusy)
+  {
+    return HAL_BUSY;
+  }
+  if (count == 0)
+  {
+    return HAL_ERROR;
+  }
+  if (ADC_ScanRestore() != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  /* Old samples would only delay the response to the new ones */
+  if (!ScanSnapshotValid || ((HAL_GetTick() - ScanSnapshot.tick) > ADC_SCAN_FILTER_HOLD))
+  {
+    for (uint32_t i = 0; i < ADC_SCAN_RANKS; i++)
+    {
+      ADC_Filter_Reset(&ScanFilters[i]);
+    }
+  }
+
+  ScanCallback = callback;
+  ScanRemaining = count;
+  ScanStatus = HAL_OK;
+  ScanBusy = true;
+  /* The ADC and its DMA do not run in Stop mode */
+  UTIL_LPM_SetStopMode((1 << CFG_LPM_ADC_Id), UTIL_LPM_DISABLE);
+
+  status = HAL_ADC_Start_DMA(&hadc, (uint32_t *)ScanBuffer, ADC_SCAN_RANKS);
+  if (status != HAL_OK)
+  {
+    ScanCallback = NULL;
+    ScanBusy = false;
+    UTIL_LPM_SetStopMode((1 << CFG_LPM_ADC_Id), UTIL_LPM_ENABLE);
+  }
+  return status;
+}
+
+void ADC_ScanConfigureFilter(uint8_t rank, const ADC_FilterConfig_t *config)
+{
+  if (rank >= ADC_SCAN_RANKS)
+  {
+    return;
+  }
+  UTILS_ENTER_CRITICAL_SECTION();
+  ADC_Filter_Init(&ScanFilters[rank], config);
+  UTILS_EXIT_CRITICAL_SECTION();
+}
+
+HAL_StatusTypeDef ADC_ScanRead(ADC_Snapshot_t *snapshot)
+{
+  HAL_StatusTypeDef status;
+  uint32_t tickstart;
+  uint32_t count;
+
+  /* A scan already running is as fresh as a new one */
+  if (!ScanBusy)
+  {
+    status = ADC_ScanStart(NULL);
+    if (status != HAL_OK)
+    {
+      return status;
+    }
+  }
+
+  /* The timeout applies to each scan of a series */
+  tickstart = HAL_GetTick();
+  count = ScanCount;
+  while (ScanBusy)
+  {
+    if (count != ScanCount)
+    {
+      tickstart = HAL_GetTick();
+      count = ScanCount;
+    }
+    else if ((HAL_GetTick() - tickstart) > ADC_SCAN_TIMEOUT)
+    {
+      /* The DMA interrupt may have ended the scan since ScanBusy was read */
+      UTILS_ENTER_CRITICAL_SECTION();
+      if (ScanBusy)
+      {
+        ADC_ScanEnd(HAL_TIMEOUT);
+      }
+      UTILS_EXIT_CRITICAL_SECTION();
+    }
+  }
+
+  if (ScanStatus != HAL_OK)
+  {
+    return ScanStatus;
+  }
+  *snapshot = ScanSnapshot;
+  return HAL_OK;
+}
+
+bool ADC_ScanGetLast(ADC_Snapshot_t *snapshot)
+{
+  bool valid;
+
+  /* The DMA interrupt of a running series rewrites ScanSnapshot */
+  UTILS_ENTER_CRITICAL_SECTION();
+  valid = ScanSnapshotValid;
+  if (valid)
+  {
+    *snapshot = ScanSnapshot;
+  }
+  UTILS_EXIT_CRITICAL_SECTION();
+  return valid;
+}
+
+bool ADC_ScanIsBusy(void)
+{
+  return ScanBusy;
+}
+
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc)
+{
+  uint32_t i;
+
+  if ((hadc->Instance != ADC) || !ScanBusy)
+  {
+    return;
+  }
+
+  for (i = 0; i < ADC_SCAN_RANKS; i++)
+  {
+    ScanSnapshot.raw[i] = ScanBuffer[i];
+    ScanSnapshot.filtered[i] = ADC_Filter_Push(&ScanFilters[i], ScanBuffer[i]);
+  }
+  ScanSnapshot.vddaMv = ADC_ComputeVdda(ScanSnapshot.filtered[ADC_SCAN_VREFINT]);
+  ScanSnapshot.temperature = ADC_ComputeTemperature(ScanSnapshot.vddaMv, ScanSnapshot.filtered[ADC_SCAN_TEMPSENSOR]);
+  ScanSnapshot.tick = HAL_GetTick();
+  ScanSnapshotValid = true;
+  ScanCount++;
+
+  if (--ScanRemaining == 0)
+  {
+    ADC_ScanEnd(HAL_OK);
+  }
+  else if ((HAL_ADC_Stop_DMA(hadc) != HAL_OK) ||
+           (HAL_ADC_Start_DMA(hadc, (uint32_t *)ScanBuffer, ADC_SCAN_RANKS) != HAL_OK))
+  {
+    ADC_ScanEnd(HAL_ERROR);
+  }
+}
+
+void HAL_ADC_ErrorCallback(ADC_HandleTypeDef *hadc)
+{
+  if ((hadc->Instance != ADC) || !ScanBusy)
+  {
+    return;
+  }
+  ADC_ScanEnd(HAL_ERROR);
+}
 
 /* USER CODE END EF */
 
@@ -82,6 +350,11 @@ void SYS_InitMeasurement(void)
   /* USER CODE END SYS_InitMeasurement_1 */
   hadc.Instance = ADC;
   /* USER CODE BEGIN SYS_InitMeasurement_2 */
+  /* MX_ADC_Init() configured the scan, calibrate it once for all the reads */
+  if (ADC_ScanInit() != HAL_OK)
+  {
+    APP_LOG(TS_ON, VLEVEL_M, "ADC calibration failed\r\n");
+  }
 
   /* USER CODE END SYS_InitMeasurement_2 */
 }
@@ -176,53 +449,118 @@ uint16_t SYS_GetBatteryLevel(void)
 
 /* Private Functions Definition -----------------------------------------------*/
 /* USER CODE BEGIN PrFD */
+static HAL_StatusTypeDef ADC_ScanRestore(void)
+{
+  uint32_t tickstart;
 
-/* USER CODE END PrFD */
-
-static uint32_t ADC_ReadChannels(uint32_t channel) {
-    uint32_t ADCxConvertedValues = 0;
-    ADC_ChannelConfTypeDef sConfig = {0};
+  if (LL_ADC_IsInternalRegulatorEnabled(hadc.Instance) != 0UL)
+  {
+    return HAL_OK;
+  }
 
-    // Initialisation de l'ADC
-    MX_ADC_Init();
+  /* The regulator was switched off (SYS_DeInitMeasurement, low power) and the
+     calibration factor with it: configure the scan again and write the factor
+     back instead of running a new calibration */
+  MX_ADC_Init();
+  if (!Calibrated)
+  {
+    return ADC_ScanInit();
+  }
 
-    // Démarrer la calibration de l'ADC
-    if (HAL_ADCEx_Calibration_Start(&hadc) != HAL_OK) {
-        Error_Handler();  // Gérer l'erreur si la calibration échoue
+  LL_ADC_Enable(hadc.Instance);
+  tickstart = HAL_GetTick();
+  while (LL_ADC_IsActiveFlag_ADRDY(hadc.Instance) == 0UL)
+  {
+    if ((HAL_GetTick() - tickstart) > ADC_ENABLE_TIMEOUT)
+    {
+      return HAL_TIMEOUT;
     }
+  }
+  return HAL_ADCEx_Calibration_SetValue(&hadc, CalibrationFactor);
+}
 
-    // Configurer le canal de lecture de l'ADC
-    sConfig.Channel = channel;
-    sConfig.Rank = ADC_REGULAR_RANK_1;
-    sConfig.SamplingTime = ADC_SAMPLINGTIME_COMMON_1;
-    if (HAL_ADC_ConfigChannel(&hadc, &sConfig) != HAL_OK) {
-        Error_Handler();  // Gérer l'erreur si la configuration échoue
-    }
+static void ADC_ScanEnd(HAL_StatusTypeDef status)
+{
+  ADC_ScanCallback_t callback = ScanCallback;
 
-    // Démarrer la conversion ADC
-    if (HAL_ADC_Start(&hadc) != HAL_OK) {
-        Error_Handler();  // Gérer l'erreur si le démarrage échoue
-    }
+  /* Disables the ADC until the next scan, the calibration factor is kept */
+  (void)HAL_ADC_Stop_DMA(&hadc);
 
-    // Attendre la fin de la conversion
-    HAL_ADC_PollForConversion(&hadc, HAL_MAX_DELAY);
+  ScanCallback = NULL;
+  ScanRemaining = 0;
+  ScanStatus = status;
+  ScanBusy = false;
+  UTIL_LPM_SetStopMode((1 << CFG_LPM_ADC_Id), UTIL_LPM_ENABLE);
 
-    // Arrêter l'ADC
-    HAL_ADC_Stop(&hadc);  // Cette fonction désactive aussi l'ADC
+  if (callback != NULL)
+  {
+    callback((status == HAL_OK) ? &ScanSnapshot : NULL);
+  }
+}
 
-    // Lire la valeur convertie
-    ADCxConvertedValues = HAL_ADC_GetValue(&hadc);
+static uint16_t ADC_ComputeVdda(uint32_t level)
+{
+  if ((level < ADC_LEVEL_MIN) || (level > ADC_LEVEL_MAX))
+  {
+    return 0;
+  }
+  if ((uint32_t)*VREFINT_CAL_ADDR != (uint32_t)0xFFFFU)
+  {
+    return __LL_ADC_CALC_VREFANALOG_VOLTAGE(level, ADC_RESOLUTION_12B);
+  }
+  return (VREFINT_CAL_VREF * 1510) / level;
+}
 
-    // Vérifier si la valeur de l'ADC est dans une plage valide (0-4095)
-    if (ADCxConvertedValues < 10 || ADCxConvertedValues > 4090) {
-        // Si la valeur est hors plage (probablement débranché), renvoyer une valeur par défaut (ex : 0 ou 4095)
-        ADCxConvertedValues = 0;  // Vous pouvez aussi mettre 4095 selon la logique de votre application
-    }
+static int16_t ADC_ComputeTemperature(uint16_t vddaMv, uint32_t level)
+{
+  if (vddaMv == 0)
+  {
+    return 0;
+  }
+  if (((int32_t)*TEMPSENSOR_CAL2_ADDR - (int32_t)*TEMPSENSOR_CAL1_ADDR) != 0)
+  {
+    return __LL_ADC_CALC_TEMPERATURE(vddaMv, level, LL_ADC_RESOLUTION_12B);
+  }
+  return __LL_ADC_CALC_TEMPERATURE_TYP_PARAMS(TEMPSENSOR_TYP_AVGSLOPE, TEMPSENSOR_TYP_CAL1_V,
+                                              TEMPSENSOR_CAL1_TEMP, vddaMv, level,
+                                              LL_ADC_RESOLUTION_12B);
+}
+
+/* USER CODE END PrFD */
+
+static uint32_t ADC_ReadChannels(uint32_t channel)
+{
+  /* USER CODE BEGIN ADC_ReadChannels_1 */
+
+  /* USER CODE END ADC_ReadChannels_1 */
+  uint32_t ADCxConvertedValues = 0;
+  ADC_Snapshot_t snapshot;
+
+  /* The scan configured by MX_ADC_Init() converts the internal channels too */
+  if (ADC_ScanRead(&snapshot) != HAL_OK)
+  {
+    return 0;
+  }
+
+  if (channel == ADC_CHANNEL_VREFINT)
+  {
+    ADCxConvertedValues = snapshot.raw[ADC_SCAN_VREFINT];
+  }
+  else if (channel == ADC_CHANNEL_TEMPSENSOR)
+  {
+    ADCxConvertedValues = snapshot.raw[ADC_SCAN_TEMPSENSOR];
+  }
+
+  /* Out of range, most likely a floating input */
+  if ((ADCxConvertedValues < ADC_LEVEL_MIN) || (ADCxConvertedValues > ADC_LEVEL_MAX))
+  {
+    ADCxConvertedValues = 0;
+  }
 
-    // Réinitialiser l'ADC
-    HAL_ADC_DeInit(&hadc);
+  return ADCxConvertedValues;
+  /* USER CODE BEGIN ADC_ReadChannels_2 */
 
-    return ADCxConvertedValues;
+  /* USER CODE END ADC_ReadChannels_2 */
 }
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,97 @@
+/**
+  ******************************************************************************
+  * @file    flash_if.c
+  * @brief   Page erase and double-word programming of the internal flash
+  * @note    The CPU stalls on flash reads while a page is erased (about 22 ms)
+  *          or a double-word programmed (about 90 us).
+  *          A double-word whose programming was cut by a reset can hold an
+  *          uncorrectable ECC error, reading it raises the NMI.
+  *          FLASH_IF_Read() flags its reads so that the NMI handler can clear
+  *          the error and return, the read then fails instead of the NMI
+  *          handler looping.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "flash_if.h"
+
+/* Private variables ---------------------------------------------------------*/
+/**
+  * @brief Set while FLASH_IF_Read() copies, and when an ECC error was caught
+  */
+static volatile bool EccReading = false;
+static volatile bool EccError = false;
+
+/* Exported functions --------------------------------------------------------*/
+HAL_StatusTypeDef FLASH_IF_ErasePage(uint32_t address)
+{
+  FLASH_EraseInitTypeDef erase = {0};
+  uint32_t pageError = 0;
+  HAL_StatusTypeDef status;
+
+  if ((address < FLASH_BASE) || (address >= (FLASH_BASE + FLASH_SIZE)))
+  {
+    return HAL_ERROR;
+  }
+
+  erase.TypeErase = FLASH_TYPEERASE_PAGES;
+  erase.Page = (address - FLASH_BASE) / FLASH_PAGE_SIZE;
+  erase.NbPages = 1;
+
+  status = HAL_FLASH_Unlock();
+  if (status == HAL_OK)
+  {
+    /* Errors left by an earlier operation would fail this one */
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+    status = HAL_FLASHEx_Erase(&erase, &pageError);
+    (void)HAL_FLASH_Lock();
+  }
+  return status;
+}
+
+HAL_StatusTypeDef FLASH_IF_Program(uint32_t address, uint64_t data)
+{
+  HAL_StatusTypeDef status;
+
+  if ((address < FLASH_BASE) || (address >= (FLASH_BASE + FLASH_SIZE)) || ((address & 7U) != 0U))
+  {
+    return HAL_ERROR;
+  }
+
+  status = HAL_FLASH_Unlock();
+  if (status == HAL_OK)
+  {
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+    status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, address, data);
+    (void)HAL_FLASH_Lock();
+  }
+  return status;
+}
+
+HAL_StatusTypeDef FLASH_IF_Read(uint32_t address, void *data, uint32_t size)
+{
+  if ((address < FLASH_BASE) || ((address + size) > (FLASH_BASE + FLASH_SIZE)))
+  {
+    return HAL_ERROR;
+  }
+
+  EccError = false;
+  EccReading = true;
+  memcpy(data, (const void *)address, size);
+  /* Let a pending NMI be taken before the flag is cleared */
+  __DSB();
+  EccReading = false;
+  return EccError ? HAL_ERROR : HAL_OK;
+}
+
+bool FLASH_IF_NMI_Handler(void)
+{
+  if (!EccReading || (__HAL_FLASH_GET_FLAG(FLASH_FLAG_ECCD) == 0U))
+  {
+    return false;
+  }
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ECCD);
+  EccError = true;
+  return true;
+}
@@ -22,6 +22,7 @@
 #include "i2c.h"
 #include "app_lorawan.h"
 #include "adc.h"
+#include "dma.h"
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
@@ -86,6 +87,7 @@ int main(void)
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
+  MX_DMA_Init();
   MX_ADC_Init();
   MX_LoRaWAN_Init();
   MX_I2C1_Init();
@@ -454,6 +454,37 @@ static void I2C2_MspInit(I2C_HandleTypeDef* i2cHandle)
     __HAL_RCC_I2C2_CLK_ENABLE();
   /* USER CODE BEGIN I2C2_MspInit 1 */
 
+    /* I2C2_RX DMA, used by the AMG8833 frame capture. The I2C2 bus belongs
+       to the BSP, which CubeMX generates without DMA, so the channel lives
+       here and the interrupt handlers reach it through hi2c2.hdmarx */
+    static DMA_HandleTypeDef hdma_i2c2_rx;
+
+    __HAL_RCC_DMAMUX1_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    hdma_i2c2_rx.Instance = DMA1_Channel6;
+    hdma_i2c2_rx.Init.Request = DMA_REQUEST_I2C2_RX;
+    hdma_i2c2_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_i2c2_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_i2c2_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_i2c2_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_i2c2_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_i2c2_rx.Init.Mode = DMA_NORMAL;
+    hdma_i2c2_rx.Init.Priority = DMA_PRIORITY_LOW;
+    /* Without a DMA channel HAL_I2C_Mem_Read_DMA() fails and the capture reports it */
+    if (HAL_DMA_Init(&hdma_i2c2_rx) == HAL_OK)
+    {
+      __HAL_LINKDMA(i2cHandle, hdmarx, hdma_i2c2_rx);
+    }
+
+    /* DMA transfers are started and stopped by the I2C event interrupt */
+    HAL_NVIC_SetPriority(DMA1_Channel6_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel6_IRQn);
+    HAL_NVIC_SetPriority(I2C2_EV_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(I2C2_EV_IRQn);
+    HAL_NVIC_SetPriority(I2C2_ER_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(I2C2_ER_IRQn);
+
   /* USER CODE END I2C2_MspInit 1 */
 }
 
@@ -474,6 +505,10 @@ static void I2C2_MspDeInit(I2C_HandleTypeDef* i2cHandle)
     HAL_GPIO_DeInit(BUS_I2C2_SDA_GPIO_PORT, BUS_I2C2_SDA_GPIO_PIN);
 
   /* USER CODE BEGIN I2C2_MspDeInit 1 */
+    HAL_DMA_DeInit(i2cHandle->hdmarx);
+    HAL_NVIC_DisableIRQ(DMA1_Channel6_IRQn);
+    HAL_NVIC_DisableIRQ(I2C2_EV_IRQn);
+    HAL_NVIC_DisableIRQ(I2C2_ER_IRQn);
 
   /* USER CODE END I2C2_MspDeInit 1 */
 }
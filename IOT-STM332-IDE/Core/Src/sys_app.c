@@ -31,6 +31,9 @@
 #include "sys_sensors.h"
 
 /* USER CODE BEGIN Includes */
+#include "flash_if.h"
+#include "calib_store.h"
+#include "uplink_log.h"
 
 /* USER CODE END Includes */
 
@@ -84,6 +87,34 @@ static void TimestampNow(uint8_t *buff, uint16_t *size);
   */
 static void tiny_snprintf_like(char *buf, uint32_t maxsize, const char *strFormat, ...);
 /* USER CODE BEGIN PFP */
+static int FlashStore_Erase(uintptr_t address);
+static int FlashStore_Program(uintptr_t address, uint64_t data);
+static int FlashStore_Read(uintptr_t address, void *data, uint32_t size);
+
+/**
+  * @brief Flash pages and operations of the calibration store
+  */
+static const CalibStore_Flash_t CalibStoreFlash =
+{
+  .page = { (uintptr_t)_calib_start, (uintptr_t)_calib_start + FLASH_PAGE_SIZE },
+  .pageSize = FLASH_PAGE_SIZE,
+  .erase = FlashStore_Erase,
+  .program = FlashStore_Program,
+  .read = FlashStore_Read,
+};
+
+/**
+  * @brief Flash pages and operations of the uplink log
+  */
+static const UplinkLog_Flash_t UplinkLogFlash =
+{
+  .base = (uintptr_t)_log_start,
+  .pageCount = UPLINK_LOG_FLASH_PAGES,
+  .pageSize = FLASH_PAGE_SIZE,
+  .erase = FlashStore_Erase,
+  .program = FlashStore_Program,
+  .read = FlashStore_Read,
+};
 
 /* USER CODE END PFP */
 
@@ -133,6 +164,21 @@ void SystemApp_Init(void)
 #error LOW_POWER_DISABLE not defined
 #endif /* LOW_POWER_DISABLE */
   /* USER CODE BEGIN SystemApp_Init_2 */
+  /* Index the stored calibrations before the sensor drivers read them */
+  if (CalibStore_Init(&CalibStoreFlash) != 0)
+  {
+    APP_LOG(TS_ON, VLEVEL_M, "Calibration store unavailable\r\n");
+  }
+
+  /* Uplinks not sent before the reset */
+  if (UplinkLog_Init(&UplinkLogFlash) != 0)
+  {
+    APP_LOG(TS_ON, VLEVEL_M, "Uplink log unavailable\r\n");
+  }
+  else
+  {
+    APP_LOG(TS_ON, VLEVEL_M, "Uplink log: %d pending\r\n", (int)UplinkLog_GetPending());
+  }
 
   /* USER CODE END SystemApp_Init_2 */
 }
@@ -353,6 +399,20 @@ static void tiny_snprintf_like(char *buf, uint32_t maxsize, const char *strForma
 }
 
 /* USER CODE BEGIN PrFD */
+static int FlashStore_Erase(uintptr_t address)
+{
+  return (FLASH_IF_ErasePage((uint32_t)address) == HAL_OK) ? 0 : -1;
+}
+
+static int FlashStore_Program(uintptr_t address, uint64_t data)
+{
+  return (FLASH_IF_Program((uint32_t)address, data) == HAL_OK) ? 0 : -1;
+}
+
+static int FlashStore_Read(uintptr_t address, void *data, uint32_t size)
+{
+  return (FLASH_IF_Read((uint32_t)address, data, size) == HAL_OK) ? 0 : -1;
+}
 
 /* USER CODE END PrFD */
 /* HAL overload functions ---------------------------------------------------------*/
@@ -19,7 +19,7 @@
   * \author    Miguel Luis ( Semtech )
   */
 /* Includes ------------------------------------------------------------------*/
-#include "stm32_mem.h"
+#include <stddef.h>
 #include "CayenneLpp.h"
 /* USER CODE BEGIN Includes */
 
@@ -36,7 +36,6 @@
 /* USER CODE END PTD */
 
 /* Private define ------------------------------------------------------------*/
-#define CAYENNE_LPP_MAXBUFFER_SIZE                  242
 #define LPP_DIGITAL_INPUT       0       /* 1 byte */
 #define LPP_DIGITAL_OUTPUT      1       /* 1 byte */
 #define LPP_ANALOG_INPUT        2       /* 2 bytes, 0.01 signed */
@@ -74,7 +73,9 @@
 /* USER CODE END PM */
 
 /* Private variables ---------------------------------------------------------*/
-static uint8_t CayenneLppBuffer[CAYENNE_LPP_MAXBUFFER_SIZE];
+/* Cursor over the caller storage given to CayenneLppInit(), the frame is built in place */
+static uint8_t *CayenneLppBuffer = NULL;
+static uint8_t CayenneLppBufferSize = 0;
 static uint8_t CayenneLppCursor = 0;
 /* USER CODE BEGIN PV */
 
@@ -87,8 +88,10 @@ static uint8_t CayenneLppCursor = 0;
 /* USER CODE END PFP */
 
 /* Exported functions --------------------------------------------------------*/
-void CayenneLppInit(void)
+void CayenneLppInit(uint8_t *buffer, uint8_t size)
 {
+  CayenneLppBuffer = buffer;
+  CayenneLppBufferSize = (buffer != NULL) ? size : 0;
   CayenneLppCursor = 0;
   /* USER CODE BEGIN CayenneLppCursor */
 
@@ -119,24 +122,12 @@ uint8_t *CayenneLppGetBuffer(void)
   return CayenneLppBuffer;
 }
 
-uint8_t CayenneLppCopy(uint8_t *dst)
-{
-  /* USER CODE BEGIN CayenneLppCopy_1 */
-
-  /* USER CODE END CayenneLppCopy_1 */
-  UTIL_MEM_cpy_8(dst, CayenneLppBuffer, CayenneLppCursor);
-  /* USER CODE BEGIN CayenneLppCopy_2 */
-
-  /* USER CODE END CayenneLppCopy_2 */
-  return CayenneLppCursor;
-}
-
 uint8_t CayenneLppAddDigitalInput(uint8_t channel, uint8_t value)
 {
   /* USER CODE BEGIN CayenneLppAddDigitalInput_1 */
 
   /* USER CODE END CayenneLppAddDigitalInput_1 */
-  if ((CayenneLppCursor + LPP_DIGITAL_INPUT_SIZE) > CAYENNE_LPP_MAXBUFFER_SIZE)
+  if ((CayenneLppCursor + LPP_DIGITAL_INPUT_SIZE) > CayenneLppBufferSize)
   {
     return 0;
   }
@@ -154,7 +145,7 @@ uint8_t CayenneLppAddDigitalOutput(uint8_t channel, uint8_t value)
   /* USER CODE BEGIN CayenneLppAddDigitalOutput_1 */
 
   /* USER CODE END CayenneLppAddDigitalOutput_1 */
-  if ((CayenneLppCursor + LPP_DIGITAL_OUTPUT_SIZE) > CAYENNE_LPP_MAXBUFFER_SIZE)
+  if ((CayenneLppCursor + LPP_DIGITAL_OUTPUT_SIZE) > CayenneLppBufferSize)
   {
     return 0;
   }
@@ -172,7 +163,7 @@ uint8_t CayenneLppAddAnalogInput(uint8_t channel, uint16_t value)
   /* USER CODE BEGIN CayenneLppAddAnalogInput_1 */
 
   /* USER CODE END CayenneLppAddAnalogInput_1 */
-  if ((CayenneLppCursor + LPP_ANALOG_INPUT_SIZE) > CAYENNE_LPP_MAXBUFFER_SIZE)
+  if ((CayenneLppCursor + LPP_ANALOG_INPUT_SIZE) > CayenneLppBufferSize)
   {
     return 0;
   }
@@ -193,7 +184,7 @@ uint8_t CayenneLppAddAnalogOutput(uint8_t channel, uint16_t value)
   /* USER CODE BEGIN CayenneLppAddAnalogOutput_1 */
 
   /* USER CODE END CayenneLppAddAnalogOutput_1 */
-  if ((CayenneLppCursor + LPP_ANALOG_OUTPUT_SIZE) > CAYENNE_LPP_MAXBUFFER_SIZE)
+  if ((CayenneLppCursor + LPP_ANALOG_OUTPUT_SIZE) > CayenneLppBufferSize)
   {
     return 0;
   }
@@ -213,7 +204,7 @@ uint8_t CayenneLppAddLuminosity(uint8_t channel, uint16_t lux)
   /* USER CODE BEGIN CayenneLppAddLuminosity_1 */
 
   /* USER CODE END CayenneLppAddLuminosity_1 */
-  if ((CayenneLppCursor + LPP_LUMINOSITY_SIZE) > CAYENNE_LPP_MAXBUFFER_SIZE)
+  if ((CayenneLppCursor + LPP_LUMINOSITY_SIZE) > CayenneLppBufferSize)
   {
     return 0;
   }
@@ -232,7 +223,7 @@ uint8_t CayenneLppAddPresence(uint8_t channel, uint8_t value)
   /* USER CODE BEGIN CayenneLppAddPresence_1 */
 
   /* USER CODE END CayenneLppAddPresence_1 */
-  if ((CayenneLppCursor + LPP_PRESENCE_SIZE) > CAYENNE_LPP_MAXBUFFER_SIZE)
+  if ((CayenneLppCursor + LPP_PRESENCE_SIZE) > CayenneLppBufferSize)
   {
     return 0;
   }
@@ -250,7 +241,7 @@ uint8_t CayenneLppAddTemperature(uint8_t channel, int16_t celsius)
   /* USER CODE BEGIN CayenneLppAddTemperature_1 */
 
   /* USER CODE END CayenneLppAddTemperature_1 */
-  if ((CayenneLppCursor + LPP_TEMPERATURE_SIZE) > CAYENNE_LPP_MAXBUFFER_SIZE)
+  if ((CayenneLppCursor + LPP_TEMPERATURE_SIZE) > CayenneLppBufferSize)
   {
     return 0;
   }
@@ -270,7 +261,7 @@ uint8_t CayenneLppAddRelativeHumidity(uint8_t channel, uint16_t rh)
   /* USER CODE BEGIN CayenneLppAddRelativeHumidity_1 */
 
   /* USER CODE END CayenneLppAddRelativeHumidity_1 */
-  if ((CayenneLppCursor + LPP_RELATIVE_HUMIDITY_SIZE) > CAYENNE_LPP_MAXBUFFER_SIZE)
+  if ((CayenneLppCursor + LPP_RELATIVE_HUMIDITY_SIZE) > CayenneLppBufferSize)
   {
     return 0;
   }
@@ -288,7 +279,7 @@ uint8_t CayenneLppAddAccelerometer(uint8_t channel, int16_t x, int16_t y, int16_
   /* USER CODE BEGIN CayenneLppAddAccelerometer_1 */
 
   /* USER CODE END CayenneLppAddAccelerometer_1 */
-  if ((CayenneLppCursor + LPP_ACCELEROMETER_SIZE) > CAYENNE_LPP_MAXBUFFER_SIZE)
+  if ((CayenneLppCursor + LPP_ACCELEROMETER_SIZE) > CayenneLppBufferSize)
   {
     return 0;
   }
@@ -315,7 +306,7 @@ uint8_t CayenneLppAddBarometricPressure(uint8_t channel, uint16_t hpa)
   /* USER CODE BEGIN CayenneLppAddBarometricPressure_1 */
 
   /* USER CODE END CayenneLppAddBarometricPressure_1 */
-  if ((CayenneLppCursor + LPP_BAROMETRIC_PRESSURE_SIZE) > CAYENNE_LPP_MAXBUFFER_SIZE)
+  if ((CayenneLppCursor + LPP_BAROMETRIC_PRESSURE_SIZE) > CayenneLppBufferSize)
   {
     return 0;
   }
@@ -336,7 +327,7 @@ uint8_t CayenneLppAddGyrometer(uint8_t channel, int16_t x, int16_t y, int16_t z)
   /* USER CODE BEGIN CayenneLppAddGyrometer_1 */
 
   /* USER CODE END CayenneLppAddGyrometer_1 */
-  if ((CayenneLppCursor + LPP_GYROMETER_SIZE) > CAYENNE_LPP_MAXBUFFER_SIZE)
+  if ((CayenneLppCursor + LPP_GYROMETER_SIZE) > CayenneLppBufferSize)
   {
     return 0;
   }
@@ -363,7 +354,7 @@ uint8_t CayenneLppAddGps(uint8_t channel, int32_t latitude, int32_t longitude, i
   /* USER CODE BEGIN CayenneLppAddGps_1 */
 
   /* USER CODE END CayenneLppAddGps_1 */
-  if ((CayenneLppCursor + LPP_GPS_SIZE) > CAYENNE_LPP_MAXBUFFER_SIZE)
+  if ((CayenneLppCursor + LPP_GPS_SIZE) > CayenneLppBufferSize)
   {
     return 0;
   }
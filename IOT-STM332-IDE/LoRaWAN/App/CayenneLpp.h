@@ -53,7 +53,13 @@ extern "C" {
 /* USER CODE END EM */
 
 /* Exported functions prototypes ---------------------------------------------*/
-void CayenneLppInit(void);
+/**
+  * @brief  Start a frame in caller storage, usually the LmHandler application
+  *         buffer, so it is built in place without an intermediate copy
+  * @param  buffer frame storage, must stay valid while the frame is built
+  * @param  size size of the storage, the Add functions return 0 past it
+  */
+void CayenneLppInit(uint8_t *buffer, uint8_t size);
 
 void CayenneLppReset(void);
 
@@ -61,8 +67,6 @@ uint8_t CayenneLppGetSize(void);
 
 uint8_t *CayenneLppGetBuffer(void);
 
-uint8_t CayenneLppCopy(uint8_t *buffer);
-
 uint8_t CayenneLppAddDigitalInput(uint8_t channel, uint8_t value);
 
 uint8_t CayenneLppAddDigitalOutput(uint8_t channel, uint8_t value);
@@ -0,0 +1,465 @@
+/**
+  ******************************************************************************
+  * @file    calib_store.c
+  * @brief   Key/value store of the sensor calibrations in two flash pages
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "calib_store.h"
+
+/* Private define ------------------------------------------------------------*/
+/**
+  * @brief Flash programming unit
+  */
+#define CALIB_STORE_DWORD               8U
+
+/**
+  * @brief Size of the page and record headers
+  */
+#define CALIB_STORE_HEADER_SIZE         CALIB_STORE_DWORD
+
+/* Private macro -------------------------------------------------------------*/
+#define CALIB_STORE_ALIGN(n)            (((n) + CALIB_STORE_DWORD - 1U) & ~(CALIB_STORE_DWORD - 1U))
+
+/**
+  * @brief Largest record in the page, header and padded value
+  */
+#define CALIB_STORE_RECORD_MAX          (CALIB_STORE_HEADER_SIZE + CALIB_STORE_ALIGN(CALIB_STORE_MAX_VALUE))
+
+/* Private variables ---------------------------------------------------------*/
+/**
+  * @brief Flash of the store, NULL until CalibStore_Init() succeeds
+  */
+static const CalibStore_Flash_t *Flash = NULL;
+
+/**
+  * @brief Page in use, its sequence number and the offset of the next record
+  */
+static uint8_t ActivePage = 0;
+static uint32_t ActiveSequence = 0;
+static uint32_t WriteOffset = 0;
+
+/**
+  * @brief Offset of the last record of each key in the active page, 0 if none
+  */
+static uint16_t RecordOffset[CALIB_STORE_MAX_KEYS];
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t CalibStore_Crc(uint8_t key, const uint8_t *value, uint8_t length);
+static uintptr_t CalibStore_Address(uint8_t page, uint32_t offset);
+static int CalibStore_ReadFlash(uint8_t page, uint32_t offset, void *data, uint32_t size);
+static int CalibStore_ReadRecord(uint8_t page, uint32_t offset, uint8_t *record);
+static bool CalibStore_ReadPageHeader(uint8_t page, uint32_t *sequence);
+static void CalibStore_Scan(void);
+static int CalibStore_Format(uint8_t page, uint32_t sequence);
+static int CalibStore_Compact(void);
+static int CalibStore_Append(uint8_t key, const uint8_t *value, uint8_t length);
+static int CalibStore_Program(uint8_t page, uint32_t offset, const uint8_t *data, uint32_t size);
+
+/* Exported functions --------------------------------------------------------*/
+int CalibStore_Init(const CalibStore_Flash_t *flash)
+{
+  uint32_t sequence[2];
+  bool valid[2];
+
+  Flash = NULL;
+  if ((flash == NULL) || (flash->erase == NULL) || (flash->program == NULL) ||
+      ((flash->pageSize % CALIB_STORE_DWORD) != 0U) || (flash->pageSize <= CALIB_STORE_HEADER_SIZE))
+  {
+    return -1;
+  }
+  Flash = flash;
+
+  valid[0] = CalibStore_ReadPageHeader(0, &sequence[0]);
+  valid[1] = CalibStore_ReadPageHeader(1, &sequence[1]);
+
+  if (valid[0] && valid[1])
+  {
+    /* A reset during a compaction leaves both pages valid, the newer one is complete */
+    ActivePage = ((int32_t)(sequence[1] - sequence[0]) > 0) ? 1U : 0U;
+  }
+  else if (valid[0] || valid[1])
+  {
+    ActivePage = valid[1] ? 1U : 0U;
+  }
+  else
+  {
+    /* First use */
+    if (CalibStore_Format(0, 1) != 0)
+    {
+      Flash = NULL;
+      return -1;
+    }
+    return 0;
+  }
+
+  ActiveSequence = sequence[ActivePage];
+  CalibStore_Scan();
+  return 0;
+}
+
+bool CalibStore_IsReady(void)
+{
+  return (Flash != NULL);
+}
+
+int CalibStore_Read(CalibStore_Key_t key, void *value, uint16_t size)
+{
+  uint8_t record[CALIB_STORE_RECORD_MAX];
+  int length;
+
+  if ((Flash == NULL) || ((uint32_t)key == 0U) || ((uint32_t)key >= CALIB_STORE_MAX_KEYS) ||
+      (RecordOffset[key] == 0U))
+  {
+    return -1;
+  }
+
+  length = CalibStore_ReadRecord(ActivePage, RecordOffset[key], record);
+  if ((length < 0) || (length > (int)size))
+  {
+    return -1;
+  }
+  memcpy(value, &record[CALIB_STORE_HEADER_SIZE], (uint32_t)length);
+  return length;
+}
+
+int CalibStore_Write(CalibStore_Key_t key, const void *value, uint16_t length)
+{
+  uint8_t record[CALIB_STORE_RECORD_MAX];
+
+  if ((Flash == NULL) || ((uint32_t)key == 0U) || ((uint32_t)key >= CALIB_STORE_MAX_KEYS) ||
+      (value == NULL) || (length == 0U) || (length > CALIB_STORE_MAX_VALUE))
+  {
+    return -1;
+  }
+
+  /* Save the flash an erase cycle when nothing changed */
+  if ((RecordOffset[key] != 0U) && (CalibStore_ReadRecord(ActivePage, RecordOffset[key], record) == (int)length) &&
+      (memcmp(&record[CALIB_STORE_HEADER_SIZE], value, length) == 0))
+  {
+    return 0;
+  }
+
+  return CalibStore_Append((uint8_t)key, (const uint8_t *)value, (uint8_t)length);
+}
+
+int CalibStore_Delete(CalibStore_Key_t key)
+{
+  if ((Flash == NULL) || ((uint32_t)key == 0U) || ((uint32_t)key >= CALIB_STORE_MAX_KEYS))
+  {
+    return -1;
+  }
+  if (RecordOffset[key] == 0U)
+  {
+    return 0;
+  }
+  return CalibStore_Append((uint8_t)key, NULL, 0);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  CRC-16/CCITT of a record
+  * @param  key key
+  * @param  value value
+  * @param  length length of the value
+  * @retval CRC
+  */
+static uint16_t CalibStore_Crc(uint8_t key, const uint8_t *value, uint8_t length)
+{
+  uint16_t crc = 0xFFFF;
+  uint8_t byte;
+  uint8_t bit;
+
+  for (int32_t i = -2; i < (int32_t)length; i++)
+  {
+    byte = (i == -2) ? key : ((i == -1) ? length : value[i]);
+    crc ^= (uint16_t)byte << 8;
+    for (bit = 0; bit < 8; bit++)
+    {
+      crc = ((crc & 0x8000U) != 0U) ? (uint16_t)((crc << 1) ^ 0x1021U) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+/**
+  * @brief  Address of an offset in a page
+  * @param  page page index
+  * @param  offset offset in the page
+  * @retval address
+  */
+static uintptr_t CalibStore_Address(uint8_t page, uint32_t offset)
+{
+  return Flash->page[page] + offset;
+}
+
+/**
+  * @brief  Copy from a page
+  * @param  page page index
+  * @param  offset offset in the page
+  * @param  data destination
+  * @param  size size to copy
+  * @retval 0 if successful, -1 on an uncorrectable ECC error
+  */
+static int CalibStore_ReadFlash(uint8_t page, uint32_t offset, void *data, uint32_t size)
+{
+  if (Flash->read == NULL)
+  {
+    memcpy(data, (const void *)CalibStore_Address(page, offset), size);
+    return 0;
+  }
+  return Flash->read(CalibStore_Address(page, offset), data, size);
+}
+
+/**
+  * @brief  Copy a record checked by CalibStore_Scan(), header and padded value
+  * @param  page page index
+  * @param  offset offset of the record
+  * @param  record destination, CALIB_STORE_RECORD_MAX bytes
+  * @retval length of the value, -1 if the record cannot be read
+  */
+static int CalibStore_ReadRecord(uint8_t page, uint32_t offset, uint8_t *record)
+{
+  if ((CalibStore_ReadFlash(page, offset, record, CALIB_STORE_HEADER_SIZE) != 0) ||
+      (record[1] > CALIB_STORE_MAX_VALUE) ||
+      (CalibStore_ReadFlash(page, offset + CALIB_STORE_HEADER_SIZE, &record[CALIB_STORE_HEADER_SIZE],
+                            CALIB_STORE_ALIGN(record[1])) != 0))
+  {
+    return -1;
+  }
+  return record[1];
+}
+
+/**
+  * @brief  Check the header of a page
+  * @param  page page index
+  * @param  sequence sequence number of the page
+  * @retval true if the page is in use
+  */
+static bool CalibStore_ReadPageHeader(uint8_t page, uint32_t *sequence)
+{
+  uint32_t header[2];
+
+  if (CalibStore_ReadFlash(page, 0, header, sizeof(header)) != 0)
+  {
+    /* Torn by a reset during its format */
+    return false;
+  }
+  *sequence = header[1];
+  return (header[0] == CALIB_STORE_MAGIC);
+}
+
+/**
+  * @brief  Index the records of the active page and find the end of the log
+  */
+static void CalibStore_Scan(void)
+{
+  uint8_t record[CALIB_STORE_RECORD_MAX];
+  uint64_t erased;
+  uint32_t offset = CALIB_STORE_HEADER_SIZE;
+  uint32_t size;
+  uint16_t crc;
+  uint8_t i;
+
+  memset(RecordOffset, 0, sizeof(RecordOffset));
+
+  while ((offset + CALIB_STORE_HEADER_SIZE) <= Flash->pageSize)
+  {
+    if (CalibStore_ReadFlash(ActivePage, offset, record, CALIB_STORE_HEADER_SIZE) != 0)
+    {
+      /* Torn header that fails to read, as below */
+      offset = Flash->pageSize;
+      break;
+    }
+
+    memcpy(&erased, record, sizeof(erased));
+    if (erased == UINT64_MAX)
+    {
+      /* End of the log, a header torn with its first bytes still erased is not */
+      break;
+    }
+
+    for (i = 0; i < 4U; i++)
+    {
+      if ((record[i] ^ record[4U + i]) != 0xFFU)
+      {
+        break;
+      }
+    }
+    size = CALIB_STORE_HEADER_SIZE + CALIB_STORE_ALIGN(record[1]);
+    if ((i < 4U) || (offset + size > Flash->pageSize))
+    {
+      /* Torn header: the rest of the page cannot be parsed, the next write compacts */
+      offset = Flash->pageSize;
+      break;
+    }
+
+    /* A record whose value was not completely programmed, or fails to read, is skipped */
+    crc = (uint16_t)record[2] | ((uint16_t)record[3] << 8);
+    if ((record[0] < CALIB_STORE_MAX_KEYS) && (CalibStore_ReadRecord(ActivePage, offset, record) >= 0) &&
+        (crc == CalibStore_Crc(record[0], &record[CALIB_STORE_HEADER_SIZE], record[1])))
+    {
+      RecordOffset[record[0]] = (record[1] != 0U) ? (uint16_t)offset : 0U;
+    }
+    offset += size;
+  }
+
+  WriteOffset = offset;
+}
+
+/**
+  * @brief  Erase a page and make it the empty active page
+  * @param  page page index
+  * @param  sequence sequence number of the page
+  * @retval 0 if successful, -1 otherwise
+  */
+static int CalibStore_Format(uint8_t page, uint32_t sequence)
+{
+  uint32_t header[2] = { CALIB_STORE_MAGIC, sequence };
+
+  if ((Flash->erase(Flash->page[page]) != 0) ||
+      (CalibStore_Program(page, 0, (const uint8_t *)header, sizeof(header)) != 0))
+  {
+    return -1;
+  }
+
+  ActivePage = page;
+  ActiveSequence = sequence;
+  WriteOffset = CALIB_STORE_HEADER_SIZE;
+  memset(RecordOffset, 0, sizeof(RecordOffset));
+  return 0;
+}
+
+/**
+  * @brief  Copy the live records to the other page and make it active
+  * @retval 0 if successful, -1 otherwise
+  */
+static int CalibStore_Compact(void)
+{
+  uint8_t target = ActivePage ^ 1U;
+  uint16_t offset[CALIB_STORE_MAX_KEYS];
+  uint32_t header[2] = { CALIB_STORE_MAGIC, ActiveSequence + 1U };
+  uint32_t writeOffset = CALIB_STORE_HEADER_SIZE;
+  uint8_t record[CALIB_STORE_RECORD_MAX];
+  int length;
+  uint32_t size;
+  uint8_t key;
+
+  if (Flash->erase(Flash->page[target]) != 0)
+  {
+    return -1;
+  }
+
+  for (key = 1; key < CALIB_STORE_MAX_KEYS; key++)
+  {
+    offset[key] = 0;
+    if (RecordOffset[key] == 0U)
+    {
+      continue;
+    }
+    length = CalibStore_ReadRecord(ActivePage, RecordOffset[key], record);
+    if (length < 0)
+    {
+      /* Unreadable since the scan, dropped as a torn record would be */
+      continue;
+    }
+    size = CALIB_STORE_HEADER_SIZE + CALIB_STORE_ALIGN((uint32_t)length);
+    if (CalibStore_Program(target, writeOffset, record, size) != 0)
+    {
+      return -1;
+    }
+    offset[key] = (uint16_t)writeOffset;
+    writeOffset += size;
+  }
+
+  /* The page becomes valid with its header, the old one stays valid until then */
+  if (CalibStore_Program(target, 0, (const uint8_t *)header, sizeof(header)) != 0)
+  {
+    return -1;
+  }
+
+  ActivePage = target;
+  ActiveSequence = header[1];
+  WriteOffset = writeOffset;
+  memcpy(&RecordOffset[1], &offset[1], sizeof(RecordOffset) - sizeof(RecordOffset[0]));
+  return 0;
+}
+
+/**
+  * @brief  Append a record, compacting the page first if it is full
+  * @param  key key
+  * @param  value value, NULL if length is 0
+  * @param  length length of the value, 0 deletes the key
+  * @retval 0 if successful, -1 otherwise
+  */
+static int CalibStore_Append(uint8_t key, const uint8_t *value, uint8_t length)
+{
+  uint8_t record[CALIB_STORE_RECORD_MAX];
+  uint32_t size = CALIB_STORE_HEADER_SIZE + CALIB_STORE_ALIGN(length);
+  uint16_t crc = CalibStore_Crc(key, value, length);
+  uint8_t i;
+
+  if ((WriteOffset + size) > Flash->pageSize)
+  {
+    if (CalibStore_Compact() != 0)
+    {
+      return -1;
+    }
+    /* The live records alone fill the page */
+    if ((WriteOffset + size) > Flash->pageSize)
+    {
+      return -1;
+    }
+  }
+
+  memset(record, 0xFF, size);
+  record[0] = key;
+  record[1] = length;
+  record[2] = (uint8_t)crc;
+  record[3] = (uint8_t)(crc >> 8);
+  for (i = 0; i < 4U; i++)
+  {
+    record[4U + i] = (uint8_t)~record[i];
+  }
+  if (length != 0U)
+  {
+    memcpy(&record[CALIB_STORE_HEADER_SIZE], value, length);
+  }
+
+  if (CalibStore_Program(ActivePage, WriteOffset, record, size) != 0)
+  {
+    /* Skip what may have been programmed */
+    WriteOffset = Flash->pageSize;
+    return -1;
+  }
+
+  RecordOffset[key] = (length != 0U) ? (uint16_t)WriteOffset : 0U;
+  WriteOffset += size;
+  return 0;
+}
+
+/**
+  * @brief  Program whole double-words
+  * @param  page page index
+  * @param  offset offset in the page, a multiple of 8
+  * @param  data data
+  * @param  size size of the data, a multiple of 8
+  * @retval 0 if successful, -1 otherwise
+  */
+static int CalibStore_Program(uint8_t page, uint32_t offset, const uint8_t *data, uint32_t size)
+{
+  uint64_t dword;
+  uint32_t i;
+
+  for (i = 0; i < size; i += CALIB_STORE_DWORD)
+  {
+    memcpy(&dword, &data[i], sizeof(dword));
+    if (Flash->program(Flash->page[page] + offset + i, dword) != 0)
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
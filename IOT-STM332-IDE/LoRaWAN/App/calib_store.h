@@ -0,0 +1,123 @@
+/**
+  ******************************************************************************
+  * @file    calib_store.h
+  * @brief   Key/value store of the sensor calibrations in two flash pages
+  * @note    Records are appended to the active page as a log, the last record
+  *          of a key wins and a record of length 0 deletes the key. When the
+  *          active page is full, the live records are copied to the other page,
+  *          whose header is programmed last with the next sequence number, so a
+  *          reset during the copy leaves the previous page in use. The two pages
+  *          are erased in turn.
+  *          Layout, in 64-bit double-words (the flash programming unit):
+  *            - page header: magic (CALIB_STORE_MAGIC), sequence number
+  *            - record header: key, length, CRC-16 of key, length and value,
+  *              then the bitwise inverse of these 4 bytes
+  *            - value, padded to a double-word with 0xFF
+  *          The flash is accessed through CalibStore_Flash_t, the file has no
+  *          hardware dependency so the store can run on a host against RAM.
+  *          A double-word torn by a reset can fail to read with an ECC error;
+  *          it is handled as a torn record, like a bad CRC.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __CALIB_STORE_H__
+#define __CALIB_STORE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+/**
+  * @brief First word of a page in use, "CAL1"
+  */
+#define CALIB_STORE_MAGIC               0x314C4143U
+
+/**
+  * @brief Number of keys, key 0 is not used
+  */
+#define CALIB_STORE_MAX_KEYS            16
+
+/**
+  * @brief Largest value
+  */
+#define CALIB_STORE_MAX_VALUE           64
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief Keys of the stored calibrations
+  */
+typedef enum
+{
+  CALIB_STORE_KEY_PH = 1,               /*!< pH_CalibrationTypeDef */
+  CALIB_STORE_KEY_TDS = 2,              /*!< TDS_CalibrationTypeDef */
+  CALIB_STORE_KEY_THERMAL_OFFSET = 3,   /*!< AMG8833 pixel offset, int16_t in 0.25 degC */
+  CALIB_STORE_KEY_THERMAL_CONFIG = 4,   /*!< AMG8833_Config_t */
+  CALIB_STORE_KEY_APP_CONFIG = 5,       /*!< Settings changed by downlink commands, see lora_app.c */
+  CALIB_STORE_KEY_REPORT_CONFIG = 6,    /*!< Reporting mode and rules, see lora_app.c */
+} CalibStore_Key_t;
+
+/**
+  * @brief Flash pages and operations of the store
+  */
+typedef struct
+{
+  uintptr_t page[2];            /*!< Memory mapped base address of the two pages */
+  uint32_t pageSize;            /*!< Size of a page, a multiple of 8 */
+  int (*erase)(uintptr_t address);                  /*!< Erase the page at address, 0 if successful */
+  int (*program)(uintptr_t address, uint64_t data); /*!< Program a double-word, 0 if successful */
+  int (*read)(uintptr_t address, void *data, uint32_t size); /*!< Copy from the flash, 0 if successful, -1 on an
+                                                                  uncorrectable ECC error; NULL to read the memory */
+} CalibStore_Flash_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  Find the page in use and index its records, format the store if
+  *         no page is in use
+  * @param  flash flash pages and operations, must stay valid
+  * @retval 0 if successful, -1 if the store could not be formatted
+  */
+int CalibStore_Init(const CalibStore_Flash_t *flash);
+
+/**
+  * @brief  Whether CalibStore_Init() succeeded
+  * @retval true if values can be read and written
+  */
+bool CalibStore_IsReady(void);
+
+/**
+  * @brief  Read a value
+  * @param  key key
+  * @param  value output buffer
+  * @param  size size of the output buffer
+  * @retval length of the stored value, -1 if the key is not stored or the
+  *         buffer is too small
+  */
+int CalibStore_Read(CalibStore_Key_t key, void *value, uint16_t size);
+
+/**
+  * @brief  Write a value, nothing is programmed if it is already stored
+  * @param  key key
+  * @param  value value
+  * @param  length length of the value, 1..CALIB_STORE_MAX_VALUE
+  * @retval 0 if successful, -1 otherwise
+  */
+int CalibStore_Write(CalibStore_Key_t key, const void *value, uint16_t length);
+
+/**
+  * @brief  Delete a value
+  * @param  key key
+  * @retval 0 if successful or not stored, -1 otherwise
+  */
+int CalibStore_Delete(CalibStore_Key_t key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CALIB_STORE_H__ */
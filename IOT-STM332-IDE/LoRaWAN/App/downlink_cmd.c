@@ -0,0 +1,218 @@
+/**
+  ******************************************************************************
+  * @file    downlink_cmd.c
+  * @brief   Binary configuration commands received on LORAWAN_COMMAND_PORT
+  * @note    See downlink_cmd.h for the frame layouts.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "downlink_cmd.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/**
+  * @brief Byte cursor over a frame, big-endian
+  */
+typedef struct
+{
+  uint8_t *out;
+  const uint8_t *in;
+  uint16_t size;
+  uint16_t pos;
+} DownlinkCmd_Bytes_t;
+
+/* Private function prototypes -----------------------------------------------*/
+static int DownlinkCmd_ArgSize(uint8_t opcode);
+static void DownlinkCmd_Decode(DownlinkCmd_Bytes_t *bytes, DownlinkCmd_t *command);
+static uint32_t DownlinkCmd_Get(DownlinkCmd_Bytes_t *bytes, uint8_t count);
+static void DownlinkCmd_Put(DownlinkCmd_Bytes_t *bytes, uint32_t value, uint8_t count);
+
+/* Exported functions --------------------------------------------------------*/
+int DownlinkCmd_Process(const uint8_t *frame, uint8_t size, DownlinkCmd_Handler_t handler, DownlinkCmd_Ack_t *ack)
+{
+  DownlinkCmd_Bytes_t bytes = { NULL, frame, size, 1 };
+  DownlinkCmd_t command;
+  uint8_t count = 0;
+  int argSize;
+
+  ack->sequence = (size > 0) ? frame[0] : 0;
+  ack->failedMask = 0xFF;
+
+  if (size < 2)
+  {
+    return -1;
+  }
+
+  /* Check the whole frame before running anything */
+  while (bytes.pos < size)
+  {
+    argSize = DownlinkCmd_ArgSize(frame[bytes.pos]);
+    if ((argSize < 0) || (count == DOWNLINK_CMD_MAX_BATCH) || ((bytes.pos + 1 + argSize) > size))
+    {
+      return -1;
+    }
+    bytes.pos += 1 + argSize;
+    count++;
+  }
+
+  ack->failedMask = 0;
+  bytes.pos = 1;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    DownlinkCmd_Decode(&bytes, &command);
+    if (!handler(&command))
+    {
+      ack->failedMask |= (uint8_t)(1U << i);
+    }
+  }
+
+  return count;
+}
+
+uint16_t DownlinkCmd_AckValue(const DownlinkCmd_Ack_t *ack)
+{
+  return (uint16_t)((ack->sequence << 8) | ack->failedMask);
+}
+
+int DownlinkCmd_EncodeDiagnostic(const DownlinkCmd_Diagnostic_t *diagnostic, const DownlinkCmd_Ack_t *ack,
+                                 uint8_t *out, uint16_t outSize)
+{
+  DownlinkCmd_Bytes_t bytes = { out, NULL, outSize, 0 };
+
+  if (outSize < DOWNLINK_CMD_DIAGNOSTIC_SIZE)
+  {
+    return -1;
+  }
+
+  DownlinkCmd_Put(&bytes, DOWNLINK_CMD_DIAGNOSTIC_ID, 1);
+  DownlinkCmd_Put(&bytes, ack->sequence, 1);
+  DownlinkCmd_Put(&bytes, ack->failedMask, 1);
+  DownlinkCmd_Put(&bytes, diagnostic->firmwareVersion, 4);
+  DownlinkCmd_Put(&bytes, diagnostic->uptime, 4);
+  DownlinkCmd_Put(&bytes, diagnostic->txPeriod, 2);
+  DownlinkCmd_Put(&bytes, diagnostic->fieldMask, 4);
+  DownlinkCmd_Put(&bytes, diagnostic->vddaMv, 2);
+  DownlinkCmd_Put(&bytes, (uint8_t)diagnostic->mcuTemperature, 1);
+  DownlinkCmd_Put(&bytes, diagnostic->batteryLevel, 1);
+  DownlinkCmd_Put(&bytes, diagnostic->calibrationFlags, 1);
+  DownlinkCmd_Put(&bytes, diagnostic->phNeutralVoltage, 2);
+  DownlinkCmd_Put(&bytes, (uint16_t)diagnostic->phSlope, 2);
+  DownlinkCmd_Put(&bytes, diagnostic->tdsKValue, 2);
+  DownlinkCmd_Put(&bytes, (uint16_t)diagnostic->tdsOffsetVoltage, 2);
+  DownlinkCmd_Put(&bytes, diagnostic->thermalFlags, 1);
+  DownlinkCmd_Put(&bytes, (uint16_t)diagnostic->thermalOffset, 2);
+  DownlinkCmd_Put(&bytes, (uint16_t)diagnostic->rssi, 2);
+  DownlinkCmd_Put(&bytes, (uint8_t)diagnostic->snr, 1);
+
+  return bytes.pos;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Size of the arguments of an opcode
+  * @retval size in bytes, -1 if the opcode is unknown
+  */
+static int DownlinkCmd_ArgSize(uint8_t opcode)
+{
+  switch (opcode)
+  {
+    case DOWNLINK_CMD_SET_TX_PERIOD:
+      return 2;
+    case DOWNLINK_CMD_SET_PH_CALIBRATION:
+      return 4;
+    case DOWNLINK_CMD_SET_TDS_CALIBRATION:
+      return 4;
+    case DOWNLINK_CMD_SET_THERMAL:
+      return 7;
+    case DOWNLINK_CMD_SET_FIELDS:
+      return 4;
+    case DOWNLINK_CMD_REQUEST_DIAGNOSTIC:
+      return 0;
+    case DOWNLINK_CMD_SET_THERMAL_OFFSET:
+      return 2;
+    case DOWNLINK_CMD_SET_REPORT_RULE:
+      return 12;
+    case DOWNLINK_CMD_SET_REPORTING:
+      return 3;
+    default:
+      return -1;
+  }
+}
+
+/**
+  * @brief  Decode the command at the cursor, already checked
+  */
+static void DownlinkCmd_Decode(DownlinkCmd_Bytes_t *bytes, DownlinkCmd_t *command)
+{
+  memset(command, 0, sizeof(*command));
+  command->opcode = (DownlinkCmd_Opcode_t)DownlinkCmd_Get(bytes, 1);
+
+  switch (command->opcode)
+  {
+    case DOWNLINK_CMD_SET_TX_PERIOD:
+      command->arg.txPeriod = (uint16_t)DownlinkCmd_Get(bytes, 2);
+      break;
+    case DOWNLINK_CMD_SET_PH_CALIBRATION:
+      command->arg.ph.acidVoltage = (uint16_t)DownlinkCmd_Get(bytes, 2);
+      command->arg.ph.neutralVoltage = (uint16_t)DownlinkCmd_Get(bytes, 2);
+      break;
+    case DOWNLINK_CMD_SET_TDS_CALIBRATION:
+      command->arg.tds.kValue = (uint16_t)DownlinkCmd_Get(bytes, 2);
+      command->arg.tds.offsetVoltage = (int16_t)DownlinkCmd_Get(bytes, 2);
+      break;
+    case DOWNLINK_CMD_SET_THERMAL:
+      command->arg.thermal.flags = (uint8_t)DownlinkCmd_Get(bytes, 1);
+      command->arg.thermal.upper = (int16_t)DownlinkCmd_Get(bytes, 2);
+      command->arg.thermal.lower = (int16_t)DownlinkCmd_Get(bytes, 2);
+      command->arg.thermal.hysteresis = (int16_t)DownlinkCmd_Get(bytes, 2);
+      break;
+    case DOWNLINK_CMD_SET_FIELDS:
+      command->arg.fieldMask = DownlinkCmd_Get(bytes, 4);
+      break;
+    case DOWNLINK_CMD_SET_THERMAL_OFFSET:
+      command->arg.thermalOffset = (int16_t)DownlinkCmd_Get(bytes, 2);
+      break;
+    case DOWNLINK_CMD_SET_REPORT_RULE:
+      command->arg.rule.metric = (uint8_t)DownlinkCmd_Get(bytes, 1);
+      command->arg.rule.flags = (uint8_t)DownlinkCmd_Get(bytes, 1);
+      command->arg.rule.high = (int16_t)DownlinkCmd_Get(bytes, 2);
+      command->arg.rule.low = (int16_t)DownlinkCmd_Get(bytes, 2);
+      command->arg.rule.hysteresis = (uint16_t)DownlinkCmd_Get(bytes, 2);
+      command->arg.rule.delta = (uint16_t)DownlinkCmd_Get(bytes, 2);
+      command->arg.rule.rate = (uint16_t)DownlinkCmd_Get(bytes, 2);
+      break;
+    case DOWNLINK_CMD_SET_REPORTING:
+      command->arg.reporting.mode = (uint8_t)DownlinkCmd_Get(bytes, 1);
+      command->arg.reporting.heartbeat = (uint16_t)DownlinkCmd_Get(bytes, 2);
+      break;
+    case DOWNLINK_CMD_REQUEST_DIAGNOSTIC:
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  Read a big-endian value, the size was checked
+  */
+static uint32_t DownlinkCmd_Get(DownlinkCmd_Bytes_t *bytes, uint8_t count)
+{
+  uint32_t value = 0;
+
+  while (count-- > 0)
+  {
+    value = (value << 8) | bytes->in[bytes->pos++];
+  }
+  return value;
+}
+
+/**
+  * @brief  Write a big-endian value, the size was checked
+  */
+static void DownlinkCmd_Put(DownlinkCmd_Bytes_t *bytes, uint32_t value, uint8_t count)
+{
+  while (count-- > 0)
+  {
+    bytes->out[bytes->pos++] = (uint8_t)(value >> (8U * count));
+  }
+}
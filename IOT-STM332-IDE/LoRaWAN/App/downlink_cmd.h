@@ -0,0 +1,230 @@
+/**
+  ******************************************************************************
+  * @file    downlink_cmd.h
+  * @brief   Binary configuration commands received on LORAWAN_COMMAND_PORT
+  * @note    Downlink frame layout (multi-byte values are big-endian):
+  *            - byte 0: sequence number chosen by the server
+  *            - up to DOWNLINK_CMD_MAX_BATCH commands, each an opcode
+  *              followed by its arguments:
+  *              0x01 SET_TX_PERIOD       u16 period, s
+  *              0x02 SET_PH_CALIBRATION  u16 voltage at pH 4, u16 voltage
+  *                                       at pH 7, 0.1 mV
+  *              0x03 SET_TDS_CALIBRATION u16 k value, 1/10000, i16 offset
+  *                                       voltage, 0.1 mV
+  *              0x04 SET_THERMAL         u8 flags (DOWNLINK_CMD_THERMAL_xxx),
+  *                                       i16 upper, i16 lower, i16 hysteresis
+  *                                       interrupt levels, 0.25 degC
+  *              0x05 SET_FIELDS          u32 presence mask of the uplink
+  *                                       fields (sensor_payload.h)
+  *              0x06 REQUEST_DIAGNOSTIC  no argument
+  *              0x07 SET_THERMAL_OFFSET  i16 pixel offset, 0.25 degC
+  *              0x08 SET_REPORT_RULE     u8 metric, u8 flags, i16 high,
+  *                                       i16 low, u16 hysteresis, u16 delta,
+  *                                       u16 rate per minute, in the steps of
+  *                                       the metric (report_rules.h)
+  *              0x09 SET_REPORTING       u8 mode (0 every transmit period,
+  *                                       1 on rules, 2 batched), u16
+  *                                       heartbeat, min
+  *          The frame is checked as a whole first: an unknown opcode,
+  *          truncated arguments or too many commands reject it and no
+  *          command runs.
+  *          The commands are acknowledged by the next uplink with the
+  *          sequence number and one bit per command that failed, command 0
+  *          in bit 0, all bits set for a rejected frame:
+  *            - in SENSOR_PAYLOAD_COMMAND_ACK, sequence << 8 | failed mask
+  *            - in bytes 1 and 2 of a diagnostic frame
+  *          Diagnostic uplink layout, on LORAWAN_COMMAND_PORT:
+  *            - DOWNLINK_CMD_DIAGNOSTIC_ID, ack sequence, ack failed mask
+  *            - u32 firmware version, u32 uptime in s, u16 transmit period
+  *              in s, u32 presence mask of the uplink fields
+  *            - u16 VDDA in mV, i8 MCU temperature in degC, u8 battery level
+  *              (0 external power, 1..254, 255 unknown)
+  *            - u8 calibration flags (DOWNLINK_CMD_DIAG_xxx), u16 pH 7
+  *              voltage in 0.1 mV, i16 pH slope in 0.1 mV/pH, u16 TDS k
+  *              value in 1/10000, i16 TDS offset voltage in 0.1 mV
+  *            - u8 thermal flags as in SET_THERMAL, i16 thermal pixel offset
+  *            - i16 RSSI in dBm and i8 SNR in dB of the last downlink
+  *          The file has no hardware dependency.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __DOWNLINK_CMD_H__
+#define __DOWNLINK_CMD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+/**
+  * @brief Most commands in one downlink, one bit each in the ack
+  */
+#define DOWNLINK_CMD_MAX_BATCH          8
+
+/**
+  * @brief First byte of a diagnostic uplink
+  */
+#define DOWNLINK_CMD_DIAGNOSTIC_ID      0x01
+
+/**
+  * @brief Size of a diagnostic uplink
+  */
+#define DOWNLINK_CMD_DIAGNOSTIC_SIZE    36
+
+/**
+  * @brief Flags of SET_THERMAL
+  */
+#define DOWNLINK_CMD_THERMAL_1FPS       (1U << 0)   /*!< 1 frame per second instead of 10 */
+#define DOWNLINK_CMD_THERMAL_AVERAGE    (1U << 1)   /*!< Twice moving average */
+#define DOWNLINK_CMD_THERMAL_INT_POS    2           /*!< Interrupt mode: 0 off, 1 difference, 2 absolute */
+#define DOWNLINK_CMD_THERMAL_INT_MASK   (3U << DOWNLINK_CMD_THERMAL_INT_POS)
+
+/**
+  * @brief Calibration flags of the diagnostic uplink
+  */
+#define DOWNLINK_CMD_DIAG_PH_CALIBRATED  (1U << 0)
+#define DOWNLINK_CMD_DIAG_TDS_CALIBRATED (1U << 1)
+#define DOWNLINK_CMD_DIAG_STORE_OK       (1U << 2)  /*!< Calibration store available */
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief Opcodes
+  */
+typedef enum
+{
+  DOWNLINK_CMD_SET_TX_PERIOD = 0x01,
+  DOWNLINK_CMD_SET_PH_CALIBRATION = 0x02,
+  DOWNLINK_CMD_SET_TDS_CALIBRATION = 0x03,
+  DOWNLINK_CMD_SET_THERMAL = 0x04,
+  DOWNLINK_CMD_SET_FIELDS = 0x05,
+  DOWNLINK_CMD_REQUEST_DIAGNOSTIC = 0x06,
+  DOWNLINK_CMD_SET_THERMAL_OFFSET = 0x07,
+  DOWNLINK_CMD_SET_REPORT_RULE = 0x08,
+  DOWNLINK_CMD_SET_REPORTING = 0x09,
+} DownlinkCmd_Opcode_t;
+
+/**
+  * @brief Decoded command, arguments in the units of the frame
+  */
+typedef struct
+{
+  DownlinkCmd_Opcode_t opcode;
+  union
+  {
+    uint16_t txPeriod;                  /*!< SET_TX_PERIOD */
+    struct
+    {
+      uint16_t acidVoltage;
+      uint16_t neutralVoltage;
+    } ph;                               /*!< SET_PH_CALIBRATION */
+    struct
+    {
+      uint16_t kValue;
+      int16_t offsetVoltage;
+    } tds;                              /*!< SET_TDS_CALIBRATION */
+    struct
+    {
+      uint8_t flags;
+      int16_t upper;
+      int16_t lower;
+      int16_t hysteresis;
+    } thermal;                          /*!< SET_THERMAL */
+    uint32_t fieldMask;                 /*!< SET_FIELDS */
+    int16_t thermalOffset;              /*!< SET_THERMAL_OFFSET */
+    struct
+    {
+      uint8_t metric;
+      uint8_t flags;
+      int16_t high;
+      int16_t low;
+      uint16_t hysteresis;
+      uint16_t delta;
+      uint16_t rate;
+    } rule;                             /*!< SET_REPORT_RULE */
+    struct
+    {
+      uint8_t mode;
+      uint16_t heartbeat;
+    } reporting;                        /*!< SET_REPORTING */
+  } arg;
+} DownlinkCmd_t;
+
+/**
+  * @brief Acknowledgement of one downlink
+  */
+typedef struct
+{
+  uint8_t sequence;             /*!< Sequence number of the downlink */
+  uint8_t failedMask;           /*!< Bit n set when command n failed */
+} DownlinkCmd_Ack_t;
+
+/**
+  * @brief Content of a diagnostic uplink, in the units of the frame
+  */
+typedef struct
+{
+  uint32_t firmwareVersion;
+  uint32_t uptime;
+  uint16_t txPeriod;
+  uint32_t fieldMask;
+  uint16_t vddaMv;
+  int8_t mcuTemperature;
+  uint8_t batteryLevel;
+  uint8_t calibrationFlags;
+  uint16_t phNeutralVoltage;
+  int16_t phSlope;
+  uint16_t tdsKValue;
+  int16_t tdsOffsetVoltage;
+  uint8_t thermalFlags;
+  int16_t thermalOffset;
+  int16_t rssi;
+  int8_t snr;
+} DownlinkCmd_Diagnostic_t;
+
+/**
+  * @brief  Run one command
+  * @param  command decoded command
+  * @retval true if it was applied, false if its arguments are out of range or
+  *         it could not be saved
+  */
+typedef bool (*DownlinkCmd_Handler_t)(const DownlinkCmd_t *command);
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  Check a downlink, then run its commands in order
+  * @param  frame downlink payload
+  * @param  size size of the payload
+  * @param  handler called for each command
+  * @param  ack acknowledgement of the downlink
+  * @retval number of commands run, -1 if the frame was rejected
+  */
+int DownlinkCmd_Process(const uint8_t *frame, uint8_t size, DownlinkCmd_Handler_t handler, DownlinkCmd_Ack_t *ack);
+
+/**
+  * @brief  Value of an acknowledgement in SENSOR_PAYLOAD_COMMAND_ACK
+  * @param  ack acknowledgement
+  * @retval sequence << 8 | failed mask
+  */
+uint16_t DownlinkCmd_AckValue(const DownlinkCmd_Ack_t *ack);
+
+/**
+  * @brief  Encode a diagnostic uplink
+  * @param  diagnostic content
+  * @param  ack acknowledgement it carries
+  * @param  out output buffer
+  * @param  outSize size of the output buffer
+  * @retval number of bytes written, -1 if the buffer is too small
+  */
+int DownlinkCmd_EncodeDiagnostic(const DownlinkCmd_Diagnostic_t *diagnostic, const DownlinkCmd_Ack_t *ack,
+                                 uint8_t *out, uint16_t outSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DOWNLINK_CMD_H__ */
@@ -33,14 +33,21 @@
 #include "stm32_lpm.h"
 #include "adc_if.h"
 #include "sys_conf.h"
-#include "CayenneLpp.h"
+#include "sensor_payload.h"
 #include "sys_sensors.h"
+#include "sensor_acq.h"
+#include "downlink_cmd.h"
+#include "calib_store.h"
+#include "report_rules.h"
+#include "sample_batch.h"
+#include "uplink_log.h"
 
 
 
 #include "../AMG8833/amg8833.h"
-#include "../AMG8833/amg8833.C"
-#include "../AMG8833/dev_conf.C"
+#include "../AMG8833/amg8833.c"
+#include "../AMG8833/thermal_codec.c"
+#include "../AMG8833/dev_conf.c"
 #include "../AMG8833/dev_conf.h"
 
 #include "../TDS/tds_sensor.h"
@@ -52,9 +59,10 @@
 
 
 #include "../Water_Temperature/ds18b20.h"
+#include "../Water_Temperature/onewire.c"
 #include "../Water_Temperature/ds18b20.c"
 /* USER CODE BEGIN Includes */
-
+#include <stdlib.h>
 /* USER CODE END Includes */
 
 /* External variables ---------------------------------------------------------*/
@@ -82,11 +90,49 @@ typedef enum TxEventType_e
 } TxEventType_t;
 
 /* USER CODE BEGIN PTD */
+/**
+  * @brief Settings changed by downlink commands, saved in the calibration store
+  */
+typedef struct
+{
+  uint32_t txPeriod;            /*!< Transmission duty cycle, ms */
+  uint32_t fieldMask;           /*!< Uplink fields sent, presence mask of sensor_payload.h */
+} AppConfig_t;
+
+/**
+  * @brief Reporting settings, saved in the calibration store
+  */
+typedef struct
+{
+  ReportRules_Config_t rules;   /*!< Rules of each metric and heartbeat */
+  uint8_t mode;                 /*!< REPORT_MODE_xxx */
+} ReportConfig_t;
 
 /* USER CODE END PTD */
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+/**
+  * @brief Delay before retrying a thermal image fragment the MAC refused, in ms
+  */
+#define THERMAL_FRAGMENT_RETRY_DELAY    1000
+
+/**
+  * @brief Reporting modes, see APP_REPORT_MODE
+  */
+#define REPORT_MODE_PERIODIC            0
+#define REPORT_MODE_RULES               1
+#define REPORT_MODE_BATCH               2
+
+/**
+  * @brief Delay before retrying a backlog uplink the MAC refused, in ms
+  */
+#define BACKLOG_RETRY_DELAY             10000
+
+/**
+  * @brief Capture time and original port in front of a backlog uplink
+  */
+#define BACKLOG_HEADER_SIZE             5
 
 /* USER CODE END PD */
 
@@ -97,7 +143,7 @@ typedef enum TxEventType_e
 
 /* Private function prototypes -----------------------------------------------*/
 /**
-  * @brief  LoRa endNode send request
+  * @brief  LoRa endNode send request: starts a sensor acquisition cycle
   * @param  none
   * @retval none
   */
@@ -160,6 +206,114 @@ static void OnRxData(LmHandlerAppData_t *appData, LmHandlerRxParams_t *params);
 static void OnMacProcessNotify(void);
 
 /* USER CODE BEGIN PFP */
+/**
+  * @brief  Builds and sends the uplink once the acquisition cycle completed
+  * @param  none
+  * @retval none
+  */
+static void SendSensorData(void);
+
+/**
+  * @brief  Sensor acquisition completion callback
+  * @param  snapshot sensor values of the completed cycle
+  * @retval none
+  */
+static void OnSensorAcqComplete(const SensorAcq_Snapshot_t *snapshot);
+
+/**
+  * @brief  Fits the payload and the pending thermal image fragment to the
+  *         current datarate and sends it
+  * @param  payload sensor fields, the thermal image fragment is added here
+  * @retval true if the MAC accepted the uplink
+  */
+static bool SendPayload(SensorPayload_t *payload);
+
+/**
+  * @brief  Largest application payload the MAC accepts for the next uplink
+  * @retval size in bytes, datarate and pending MAC commands accounted for
+  */
+static uint8_t GetMaxPayloadSize(void);
+
+/**
+  * @brief  Thermal image fragment timer callback function
+  * @param  context ptr of timer context
+  */
+static void OnThermalFragmentTimerEvent(void *context);
+
+/**
+  * @brief  Runs the commands of a downlink on LORAWAN_COMMAND_PORT
+  * @param  buffer downlink payload
+  * @param  size size of the payload
+  */
+static void OnCommandData(const uint8_t *buffer, uint8_t size);
+
+/**
+  * @brief  Applies one downlink command
+  * @param  command decoded command
+  * @retval true if it was applied
+  */
+static bool OnCommand(const DownlinkCmd_t *command);
+
+/**
+  * @brief  Sends the diagnostic frame requested by a downlink command
+  * @retval true if the frame was sent
+  */
+static bool SendDiagnostic(void);
+
+/**
+  * @brief  Saves AppConfig in the calibration store
+  * @retval true if successful
+  */
+static bool SaveAppConfig(void);
+
+/**
+  * @brief  Values of a sensor acquisition checked by the reporting rules
+  * @param  acq sensor acquisition
+  * @param  sample rule sample
+  */
+static void GetReportSample(const SensorAcq_Snapshot_t *acq, ReportRules_Sample_t *sample);
+
+/**
+  * @brief  Applies a reporting rule from a downlink command
+  * @param  command SET_REPORT_RULE command
+  * @retval true if it was applied and saved
+  */
+static bool SetReportRule(const DownlinkCmd_t *command);
+
+/**
+  * @brief  Programs the AMG8833 interrupt levels of a hardware thermal rule
+  * @retval true if successful or the rule is evaluated in software
+  */
+static bool ApplyThermalRule(void);
+
+/**
+  * @brief  Buffers the values of a sensor acquisition for a batch uplink
+  * @param  acq sensor acquisition
+  */
+static void PushBatchSample(const SensorAcq_Snapshot_t *acq);
+
+/**
+  * @brief  Sends the oldest buffered samples that fit the current datarate
+  * @retval true if the frame was sent
+  */
+static bool SendBatch(void);
+
+/**
+  * @brief  Keeps a sensor payload the MAC refused in the flash log
+  * @param  payload fitted sensor fields, the thermal image fragment is left out
+  */
+static void LogSensorPayload(SensorPayload_t *payload);
+
+/**
+  * @brief  Sends the next pending record of the flash log
+  */
+static void SendBacklog(void);
+
+/**
+  * @brief  Backlog timer callback function
+  * @param  context ptr of timer context
+  */
+static void OnBacklogTimerEvent(void *context);
 
 /* USER CODE END PFP */
 
@@ -232,7 +386,92 @@ static UTIL_TIMER_Object_t RxLedTimer;
 static UTIL_TIMER_Object_t JoinLedTimer;
 
 /* USER CODE BEGIN PV */
+/**
+  * @brief Last completed sensor acquisition, consumed by SendSensorData
+  */
+static const SensorAcq_Snapshot_t *AcquiredData = NULL;
+
+/**
+  * @brief Encoded thermal image being sent, split over several uplinks when
+  *        it does not fit in the room left by the sensor fields
+  */
+static uint8_t ThermalImage[THERMAL_CODEC_MAX_SIZE];
+static uint8_t ThermalImageSize = 0;      /* 0 when no image is being sent */
+static uint8_t ThermalImageOffset = 0;    /* First byte not yet delivered */
+static uint8_t ThermalImageInFlight = 0;  /* Bytes carried by the uplink in flight */
+
+/**
+  * @brief Timer to send the next thermal image fragment once the MAC allows it
+  */
+static UTIL_TIMER_Object_t ThermalFragmentTimer;
+
+/**
+  * @brief Settings changed by downlink commands
+  */
+static AppConfig_t AppConfig = { APP_TX_DUTYCYCLE, UINT32_MAX };
 
+/**
+  * @brief Acknowledgement of the last command downlink, carried by the next uplink
+  */
+static DownlinkCmd_Ack_t CommandAck;
+static bool CommandAckPending = false;
+
+/**
+  * @brief Diagnostic frame requested, sent instead of the next acquisition
+  */
+static bool DiagnosticRequested = false;
+
+/**
+  * @brief Radio quality of the last downlink
+  */
+static int16_t LastRxRssi = 0;
+static int8_t LastRxSnr = 0;
+
+/**
+  * @brief Reporting settings: the transmit period samples the sensors, an
+  *        uplink goes out when a rule fires or the heartbeat expires.
+  *        Thermal max uses the AMG8833 interrupt (absolute levels, 0.25 degC)
+  */
+static ReportConfig_t ReportConfig =
+{
+  .rules =
+  {
+    .rule =
+    {
+      [REPORT_METRIC_WATER_TEMPERATURE] =
+      { REPORT_RULE_DELTA | REPORT_RULE_RATE, 0, 0, 0, 50, 50 },                        /* 0.5 degC, 0.5 degC/min */
+      [REPORT_METRIC_PH] =
+      { REPORT_RULE_HIGH | REPORT_RULE_LOW | REPORT_RULE_DELTA, 8500, 6500, 50, 200, 0 }, /* 6.5..8.5, 0.2 */
+      [REPORT_METRIC_TDS] =
+      { REPORT_RULE_HIGH | REPORT_RULE_DELTA, 10000, 0, 200, 500, 0 },                  /* 1000 ppm, 50 ppm */
+      [REPORT_METRIC_THERMAL_MAX] =
+      { REPORT_RULE_HARDWARE | REPORT_RULE_HIGH | REPORT_RULE_RATE, 6000, 0, 200, 0, 200 }, /* 60 degC, 2 degC/min */
+    },
+    .heartbeat = APP_REPORT_HEARTBEAT,
+  },
+  .mode = APP_REPORT_MODE,
+};
+
+/**
+  * @brief Reporting rules and the values of the last report
+  */
+static ReportRules_t Reporting;
+
+/**
+  * @brief Samples buffered in REPORT_MODE_BATCH
+  */
+static SampleBatch_t Batch;
+
+/**
+  * @brief Flash log record carried by the backlog uplink in flight
+  */
+static bool BacklogInFlight = false;
+static uint64_t BacklogRecordId;
+
+/**
+  * @brief Timer to send the next backlog uplink once the MAC allows it
+  */
+static UTIL_TIMER_Object_t BacklogTimer;
 /* USER CODE END PV */
 
 /* Exported functions ---------------------------------------------------------*/
@@ -243,6 +482,30 @@ static UTIL_TIMER_Object_t JoinLedTimer;
 void LoRaWAN_Init(void)
 {
   /* USER CODE BEGIN LoRaWAN_Init_1 */
+  AppConfig_t savedConfig;
+  ReportConfig_t savedReportConfig;
+
+  /* Settings of the last downlink commands, the defaults if there are none */
+  if ((CalibStore_Read(CALIB_STORE_KEY_APP_CONFIG, &savedConfig, sizeof(savedConfig)) == (int)sizeof(savedConfig)) &&
+      (savedConfig.txPeriod >= APP_TX_DUTYCYCLE_MIN) && (savedConfig.txPeriod <= APP_TX_DUTYCYCLE_MAX))
+  {
+    AppConfig = savedConfig;
+  }
+  if ((CalibStore_Read(CALIB_STORE_KEY_REPORT_CONFIG, &savedReportConfig, sizeof(savedReportConfig)) ==
+       (int)sizeof(savedReportConfig)) && (savedReportConfig.mode <= REPORT_MODE_BATCH))
+  {
+    ReportConfig = savedReportConfig;
+  }
+  ReportRules_Init(&Reporting, &ReportConfig.rules);
+  SampleBatch_Init(&Batch);
+
+  UTIL_TIMER_Create(&ThermalFragmentTimer, 0xFFFFFFFFU, UTIL_TIMER_ONESHOT, OnThermalFragmentTimerEvent, NULL);
+  UTIL_TIMER_Create(&BacklogTimer, 0xFFFFFFFFU, UTIL_TIMER_ONESHOT, OnBacklogTimerEvent, NULL);
+  UTIL_SEQ_RegTask((1 << CFG_SEQ_Task_LoRaSendSensorData), UTIL_SEQ_RFU, SendSensorData);
+  UTIL_SEQ_RegTask((1 << CFG_SEQ_Task_LoRaSendBacklog), UTIL_SEQ_RFU, SendBacklog);
+
+  /* Init the sensors and the non-blocking acquisition */
+  SensorAcq_Init(OnSensorAcqComplete);
 
   /* USER CODE END LoRaWAN_Init_1 */
 #if defined(USE_BSP_DRIVER)
@@ -316,6 +579,17 @@ void LoRaWAN_Init(void)
   }
 
   /* USER CODE BEGIN LoRaWAN_Init_Last */
+  /* Saved period of the last SET_TX_PERIOD command, restarts the timer */
+  if (EventType == TX_ON_TIMER)
+  {
+    UTIL_TIMER_SetPeriod(&TxTimer, AppConfig.txPeriod);
+  }
+
+  /* The thermal rule owns the AMG8833 interrupt levels, written at the next capture */
+  if (!ApplyThermalRule())
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "AMG8833 interrupt levels not set\r\n");
+  }
 
   /* USER CODE END LoRaWAN_Init_Last */
 }
@@ -394,6 +668,679 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 
 /* Private functions ---------------------------------------------------------*/
 /* USER CODE BEGIN PrFD */
+static void OnSensorAcqComplete(const SensorAcq_Snapshot_t *snapshot)
+{
+  AcquiredData = snapshot;
+  UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_LoRaSendSensorData), CFG_SEQ_Prio_0);
+}
+
+/**
+ * @brief Send sensor data via LoRaWAN
+ * Formats the last acquisition (Environmental, pH, TDS, AMG8833) and transmits via LoRaWAN
+ */
+static void SendSensorData(void)
+{
+  const SensorAcq_Snapshot_t *acq = AcquiredData;
+  ReportRules_Sample_t report_sample;
+  uint32_t report_triggers;
+  uint32_t now;
+
+  // Variables for thermal data
+  float min_temp = 0.0f;
+  float max_temp = 0.0f;
+  float avg_temp = 0.0f;
+
+  // Encoded thermal frame (thermal_codec, at most THERMAL_CODEC_MAX_SIZE bytes)
+  const uint8_t *thermal_image_data = NULL;
+  int thermal_data_size = 0;
+
+  // GPS coordinates (Tunisia)
+  float gps_latitude = 36.7461f;        // Latitude (°N)
+  float gps_longitude = 10.4231f;       // Longitude (°E)
+
+  // Without a new acquisition, send the next fragment of the thermal image
+  if (acq == NULL) {
+    if ((ThermalImageSize != 0) && (ThermalImageInFlight == 0)) {
+      SensorPayload_t fragment;
+      SensorPayload_Init(&fragment);
+      SendPayload(&fragment);
+    }
+    return;
+  }
+  AcquiredData = NULL;
+
+  // Reporting rules: a sample that changed nothing is not sent, a pending
+  // command ack is never held back
+  now = UTIL_TIMER_GetCurrentTime();
+  GetReportSample(acq, &report_sample);
+  report_triggers = ReportRules_Evaluate(&Reporting, &report_sample, now);
+
+  // Batched samples go out together, a rule or a command ack sends them early
+  if (ReportConfig.mode == REPORT_MODE_BATCH) {
+    PushBatchSample(acq);
+    if (((SampleBatch_Count(&Batch) >= APP_BATCH_RECORDS) || (report_triggers != 0) || CommandAckPending) &&
+        SendBatch()) {
+      ReportRules_Reported(&Reporting, &report_sample, now);
+    }
+    return;
+  }
+
+  if ((ReportConfig.mode == REPORT_MODE_RULES) && (report_triggers == 0) && !CommandAckPending) {
+    APP_LOG(TS_ON, VLEVEL_M, "No reporting rule fired\r\n");
+    return;
+  }
+  APP_LOG(TS_ON, VLEVEL_M, "Reporting triggers: 0x%08X\r\n", (unsigned int)report_triggers);
+
+  const sensor_t *sensor_data = &acq->env;
+
+  if (acq->validMask & SENSOR_ACQ_VALID_THERMAL) {
+    APP_LOG(TS_ON, VLEVEL_L, "AMG8833 data read successfully\r\n");
+    min_temp = acq->thermalMin;
+    max_temp = acq->thermalMax;
+    avg_temp = acq->thermalAvg;
+  }
+  if (acq->validMask & SENSOR_ACQ_VALID_THERMAL_IMAGE) {
+    thermal_image_data = acq->thermalImage;
+    thermal_data_size = acq->thermalImageSize;
+    APP_LOG(TS_ON, VLEVEL_L, "Thermal image data prepared: %d bytes\r\n", thermal_data_size);
+  }
+
+  /*** Logging Data for Debug ***/
+  APP_LOG(TS_ON, VLEVEL_L, "=== Water Quality Sensor Data ===\r\n");
+
+  // Log environmental sensor data
+  APP_LOG(TS_ON, VLEVEL_L, "Temperature: %d C\r\n", (uint16_t)(sensor_data->temperature));
+  APP_LOG(TS_ON, VLEVEL_L, "Pressure: %d hPa\r\n", (uint16_t)(sensor_data->pressure));
+  APP_LOG(TS_ON, VLEVEL_L, "Humidity: %d%%\r\n", (uint16_t)(sensor_data->humidity));
+
+  // Log water quality sensor data, the sensors that did not report are left out
+  if (acq->validMask & SENSOR_ACQ_VALID_WATER_TEMP) {
+    APP_LOG(TS_ON, VLEVEL_L, "Water Temp (DS18B20): %d.%d C\r\n",
+            (int16_t)acq->waterTemperature, abs((int16_t)(acq->waterTemperature * 10) % 10));
+  } else {
+    APP_LOG(TS_ON, VLEVEL_L, "Water Temp (DS18B20): no reading\r\n");
+  }
+  for (uint8_t i = 0; i < acq->waterProbeCount && i < SENSOR_ACQ_WATER_PROBES; i++) {
+    if (acq->waterProfileMask & (1U << i)) {
+      APP_LOG(TS_ON, VLEVEL_L, "  Probe %d: %d.%d C\r\n", i,
+              (int16_t)acq->waterProfile[i], abs((int16_t)(acq->waterProfile[i] * 10) % 10));
+    }
+  }
+  if (acq->validMask & SENSOR_ACQ_VALID_PH) {
+    APP_LOG(TS_ON, VLEVEL_L, "pH Value: %d.%d\r\n",
+            (int16_t)acq->phValue, (int16_t)(acq->phValue * 10) % 10);
+  } else {
+    APP_LOG(TS_ON, VLEVEL_L, "pH Value: no reading\r\n");
+  }
+  if (acq->validMask & SENSOR_ACQ_VALID_TDS) {
+    APP_LOG(TS_ON, VLEVEL_L, "TDS Value: %d.%d ppm (%s)\r\n",
+            (int16_t)acq->tdsValue, (int16_t)(acq->tdsValue * 10) % 10, TDS_GetWaterQualityString(acq->tdsValue));
+  } else {
+    APP_LOG(TS_ON, VLEVEL_L, "TDS Value: no reading\r\n");
+  }
+  APP_LOG(TS_ON, VLEVEL_L, "GPS Location: %d.%04d N, %d.%04d E\r\n",
+          (int16_t)gps_latitude, (int16_t)((gps_latitude - (int16_t)gps_latitude) * 10000),
+          (int16_t)gps_longitude, (int16_t)((gps_longitude - (int16_t)gps_longitude) * 10000));
+
+  // Log thermal data only if available
+  if (avg_temp > 0.0f) {
+    APP_LOG(TS_ON, VLEVEL_L, "Thermal Min: %d.%d C\r\n",
+            (int16_t)(min_temp * 10) / 10, abs((int16_t)(min_temp * 10) % 10));
+    APP_LOG(TS_ON, VLEVEL_L, "Thermal Max: %d.%d C\r\n",
+            (int16_t)(max_temp * 10) / 10, abs((int16_t)(max_temp * 10) % 10));
+    APP_LOG(TS_ON, VLEVEL_L, "Thermal Avg: %d.%d C\r\n",
+            (int16_t)(avg_temp * 10) / 10, abs((int16_t)(avg_temp * 10) % 10));
+  }
+
+  /*** LoRaWAN Data Preparation and Transmission ***/
+  // Bit-packed payload, layout in sensor_payload.h; the fields that do not
+  // fit the current datarate are dropped by priority in SendPayload()
+  SensorPayload_t payload;
+  SensorPayload_Init(&payload);
+
+  /*** Standard Environmental Data ***/
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_PRESSURE, sensor_data->pressure);
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_AIR_TEMPERATURE, sensor_data->temperature);
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_HUMIDITY, sensor_data->humidity);
+
+  /*** Water Quality Data (absent when a sensor did not report) ***/
+  if (acq->validMask & SENSOR_ACQ_VALID_WATER_TEMP) {
+    SensorPayload_Set(&payload, SENSOR_PAYLOAD_WATER_TEMPERATURE, acq->waterTemperature);
+  }
+  if (acq->validMask & SENSOR_ACQ_VALID_PH) {
+    SensorPayload_Set(&payload, SENSOR_PAYLOAD_PH, acq->phValue);
+  }
+  if (acq->validMask & SENSOR_ACQ_VALID_TDS) {
+    TDS_WaterQualityTypeDef quality = TDS_GetWaterQuality(acq->tdsValue);
+
+    // Water quality class of the measured TDS, Poor and worse share the last class
+    SensorPayload_Set(&payload, SENSOR_PAYLOAD_TDS, acq->tdsValue);
+    SensorPayload_Set(&payload, SENSOR_PAYLOAD_WATER_QUALITY,
+                      (quality > TDS_QUALITY_POOR) ? TDS_QUALITY_POOR : quality);
+  }
+
+  /*** GPS Coordinates ***/
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_LATITUDE, gps_latitude);
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_LONGITUDE, gps_longitude);
+
+  /*** Extended Data ***/
+  if (acq->validMask & SENSOR_ACQ_VALID_THERMAL) {
+    SensorPayload_Set(&payload, SENSOR_PAYLOAD_THERMAL_MIN, min_temp);
+    SensorPayload_Set(&payload, SENSOR_PAYLOAD_THERMAL_MAX, max_temp);
+    SensorPayload_Set(&payload, SENSOR_PAYLOAD_THERMAL_AVG, avg_temp);
+  }
+
+  // Water temperature of the deeper probes (probe 0 is the water temperature)
+  for (uint8_t i = 1; i < acq->waterProbeCount && i < SENSOR_ACQ_WATER_PROBES; i++) {
+    if (acq->waterProfileMask & (1U << i)) {
+      SensorPayload_Set(&payload, (SensorPayload_Field_t)(SENSOR_PAYLOAD_WATER_TEMPERATURE_1 + i - 1),
+                        acq->waterProfile[i]);
+    }
+  }
+
+  // Encoded 8x8 thermal frame (see thermal_codec.h), replaces an image not fully sent
+  if ((thermal_data_size > 0) && (AppConfig.fieldMask & (1UL << SENSOR_PAYLOAD_THERMAL_IMAGE))) {
+    UTIL_TIMER_Stop(&ThermalFragmentTimer);
+    memcpy(ThermalImage, thermal_image_data, thermal_data_size);
+    ThermalImageSize = (uint8_t)thermal_data_size;
+    ThermalImageOffset = 0;
+    ThermalImageInFlight = 0;
+  }
+
+  if (SendPayload(&payload)) {
+    ReportRules_Reported(&Reporting, &report_sample, now);
+  }
+}
+
+static bool SendPayload(SensorPayload_t *payload)
+{
+  UTIL_TIMER_Time_t nextTxIn = 0;
+  uint8_t maxSize = GetMaxPayloadSize();
+  int payload_size;
+
+  AppData.Port = LORAWAN_USER_APP_PORT;
+
+  // Fields selected by downlink command, the command ack is always sent
+  payload->presentMask &= AppConfig.fieldMask;
+  if (CommandAckPending) {
+    SensorPayload_Set(payload, SENSOR_PAYLOAD_COMMAND_ACK, DownlinkCmd_AckValue(&CommandAck));
+  }
+
+  // The thermal image goes last, in the room the sensor fields leave
+  if (ThermalImageSize != 0) {
+    SensorPayload_SetImage(payload, ThermalImage, ThermalImageSize, ThermalImageOffset);
+  }
+
+  if (!SensorPayload_Fit(payload, maxSize)) {
+    // Pending MAC commands fill the frame, LmHandler sends them alone
+    APP_LOG(TS_ON, VLEVEL_L, "No room for application data (max %d bytes)\r\n", maxSize);
+    SensorPayload_Init(payload);
+    payload_size = 0;
+  } else {
+    payload_size = SensorPayload_Encode(payload, AppData.Buffer, LORAWAN_APP_DATA_BUFFER_MAX_SIZE);
+    if (payload_size < 0) {
+      APP_LOG(TS_ON, VLEVEL_L, "Payload encoding failed\r\n");
+      return false;
+    }
+  }
+  AppData.BufferSize = (uint8_t)payload_size;
+
+  APP_LOG(TS_ON, VLEVEL_L, "Total payload size: %d bytes (max %d)\r\n", AppData.BufferSize, maxSize);
+  if (payload->presentMask & (1UL << SENSOR_PAYLOAD_THERMAL_IMAGE)) {
+    APP_LOG(TS_ON, VLEVEL_L, "Thermal image bytes %d..%d of %d\r\n", payload->imageOffset,
+            payload->imageOffset + payload->imageSize - 1, payload->imageTotal);
+  }
+
+  // Attempt to send data via LoRaWAN
+  if (LORAMAC_HANDLER_SUCCESS == LmHandlerSend(&AppData, LORAWAN_DEFAULT_CONFIRMED_MSG_STATE, &nextTxIn, false))
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "SEND REQUEST SUCCESS\r\n");
+    if (payload->presentMask & (1UL << SENSOR_PAYLOAD_COMMAND_ACK)) {
+      CommandAckPending = false;
+    }
+    ThermalImageInFlight = (payload->presentMask & (1UL << SENSOR_PAYLOAD_THERMAL_IMAGE)) ? payload->imageSize : 0;
+    return true;
+  }
+  else if (nextTxIn > 0)
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "Next Tx in: ~%d second(s)\r\n", (nextTxIn / 1000));
+    // Sensor fields go to the flash log, the image resumes once the MAC allows it
+    LogSensorPayload(payload);
+    if (ThermalImageSize != 0) {
+      UTIL_TIMER_SetPeriod(&ThermalFragmentTimer, nextTxIn);
+      UTIL_TIMER_Start(&ThermalFragmentTimer);
+    }
+  }
+  else
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "SEND REQUEST FAILED\r\n");
+    LogSensorPayload(payload);
+    if (ThermalImageSize != 0) {
+      UTIL_TIMER_SetPeriod(&ThermalFragmentTimer, THERMAL_FRAGMENT_RETRY_DELAY);
+      UTIL_TIMER_Start(&ThermalFragmentTimer);
+    }
+  }
+  return false;
+}
+
+static uint8_t GetMaxPayloadSize(void)
+{
+  LoRaMacTxInfo_t txInfo;
+
+  // Same check LmHandlerSend() makes: max payload of the next datarate
+  // (RegionGetPhyParam PHY_MAX_PAYLOAD) less the pending MAC commands
+  if (LoRaMacQueryTxPossible(0, &txInfo) != LORAMAC_STATUS_OK)
+  {
+    return 0;
+  }
+  return (txInfo.MaxPossibleApplicationDataSize < LORAWAN_APP_DATA_BUFFER_MAX_SIZE) ?
+         txInfo.MaxPossibleApplicationDataSize : LORAWAN_APP_DATA_BUFFER_MAX_SIZE;
+}
+
+static void OnThermalFragmentTimerEvent(void *context)
+{
+  UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_LoRaSendSensorData), CFG_SEQ_Prio_0);
+}
+
+static void OnCommandData(const uint8_t *buffer, uint8_t size)
+{
+  int count;
+
+  if (CommandAckPending)
+  {
+    APP_LOG(TS_ON, VLEVEL_M, "Command ack %d not sent, replaced\r\n", CommandAck.sequence);
+  }
+
+  count = DownlinkCmd_Process(buffer, size, OnCommand, &CommandAck);
+  CommandAckPending = true;
+
+  if (count < 0)
+  {
+    APP_LOG(TS_ON, VLEVEL_M, "Command frame %d rejected\r\n", CommandAck.sequence);
+  }
+  else
+  {
+    APP_LOG(TS_ON, VLEVEL_M, "Command frame %d: %d command(s), failed mask 0x%02X\r\n",
+            CommandAck.sequence, count, CommandAck.failedMask);
+  }
+}
+
+static bool OnCommand(const DownlinkCmd_t *command)
+{
+  AMG8833_Config_t thermalConfig;
+  uint32_t period;
+  uint8_t interruptMode;
+  bool saved;
+
+  switch (command->opcode)
+  {
+    case DOWNLINK_CMD_SET_TX_PERIOD:
+      period = (uint32_t)command->arg.txPeriod * 1000U;
+      if (period < APP_TX_DUTYCYCLE_MIN)
+      {
+        return false;
+      }
+      AppConfig.txPeriod = period;
+      if (EventType == TX_ON_TIMER)
+      {
+        UTIL_TIMER_Stop(&TxTimer);
+        UTIL_TIMER_SetPeriod(&TxTimer, AppConfig.txPeriod);
+        UTIL_TIMER_Start(&TxTimer);
+      }
+      return SaveAppConfig();
+
+    case DOWNLINK_CMD_SET_PH_CALIBRATION:
+      return (pH_CalibrateTwoPoint(command->arg.ph.acidVoltage / 10.0f,
+                                   command->arg.ph.neutralVoltage / 10.0f) == HAL_OK);
+
+    case DOWNLINK_CMD_SET_TDS_CALIBRATION:
+      return (TDS_SetCalibration(command->arg.tds.kValue / 10000.0f,
+                                 command->arg.tds.offsetVoltage / 10.0f) == HAL_OK);
+
+    case DOWNLINK_CMD_SET_THERMAL:
+      interruptMode = (command->arg.thermal.flags & DOWNLINK_CMD_THERMAL_INT_MASK) >> DOWNLINK_CMD_THERMAL_INT_POS;
+      if (interruptMode > 2)
+      {
+        return false;
+      }
+      thermalConfig.frameRate = (command->arg.thermal.flags & DOWNLINK_CMD_THERMAL_1FPS) ? AMG8833_FPS_1 : AMG8833_FPS_10;
+      thermalConfig.movingAverage = (command->arg.thermal.flags & DOWNLINK_CMD_THERMAL_AVERAGE) ? 1 : 0;
+      thermalConfig.interruptMode = (interruptMode == 0) ? AMG8833_INT_DISABLED :
+                                    ((interruptMode == 1) ? AMG8833_INT_DIFFERENCE : AMG8833_INT_ABSOLUTE);
+      thermalConfig.interruptUpper = command->arg.thermal.upper;
+      thermalConfig.interruptLower = command->arg.thermal.lower;
+      thermalConfig.interruptHysteresis = command->arg.thermal.hysteresis;
+      return (AMG8833_Configure(&thermalConfig) == HAL_OK);
+
+    case DOWNLINK_CMD_SET_FIELDS:
+      AppConfig.fieldMask = command->arg.fieldMask;
+      return SaveAppConfig();
+
+    case DOWNLINK_CMD_REQUEST_DIAGNOSTIC:
+      DiagnosticRequested = true;
+      return true;
+
+    case DOWNLINK_CMD_SET_THERMAL_OFFSET:
+      saved = (AMG8833_SetTemperatureOffset(command->arg.thermalOffset) == HAL_OK);
+      /* The interrupt levels of a HARDWARE rule depend on the offset */
+      return ApplyThermalRule() && saved;
+
+    case DOWNLINK_CMD_SET_REPORT_RULE:
+      return SetReportRule(command);
+
+    case DOWNLINK_CMD_SET_REPORTING:
+      if (command->arg.reporting.mode > REPORT_MODE_BATCH)
+      {
+        return false;
+      }
+      ReportConfig.mode = command->arg.reporting.mode;
+      ReportConfig.rules.heartbeat = (uint32_t)command->arg.reporting.heartbeat * 60000U;
+      ReportRules_Configure(&Reporting, &ReportConfig.rules);
+      return (CalibStore_Write(CALIB_STORE_KEY_REPORT_CONFIG, &ReportConfig, sizeof(ReportConfig)) == 0);
+
+    default:
+      return false;
+  }
+}
+
+static bool SendDiagnostic(void)
+{
+  DownlinkCmd_Diagnostic_t diagnostic = {0};
+  ADC_Snapshot_t adc;
+  pH_CalibrationTypeDef phCalibration = pH_GetCalibration();
+  TDS_CalibrationTypeDef tdsCalibration = TDS_GetCalibration();
+  AMG8833_Config_t thermalConfig;
+  UTIL_TIMER_Time_t nextTxIn = 0;
+  int size;
+
+  AMG8833_GetConfig(&thermalConfig);
+
+  diagnostic.firmwareVersion = __LORA_APP_VERSION;
+  diagnostic.uptime = SysTimeGetMcuTime().Seconds;
+  diagnostic.txPeriod = (uint16_t)(AppConfig.txPeriod / 1000U);
+  diagnostic.fieldMask = AppConfig.fieldMask;
+  if (ADC_ScanGetLast(&adc))
+  {
+    diagnostic.vddaMv = adc.vddaMv;
+    diagnostic.mcuTemperature = (int8_t)adc.temperature;
+  }
+  diagnostic.batteryLevel = GetBatteryLevel();
+  diagnostic.calibrationFlags = (phCalibration.isCalibrated ? DOWNLINK_CMD_DIAG_PH_CALIBRATED : 0) |
+                                (tdsCalibration.isCalibrated ? DOWNLINK_CMD_DIAG_TDS_CALIBRATED : 0) |
+                                (CalibStore_IsReady() ? DOWNLINK_CMD_DIAG_STORE_OK : 0);
+  diagnostic.phNeutralVoltage = (uint16_t)(phCalibration.neutralVoltage * 10.0f + 0.5f);
+  diagnostic.phSlope = (int16_t)(phCalibration.slope * 10.0f);
+  diagnostic.tdsKValue = (uint16_t)(tdsCalibration.kValue * 10000.0f + 0.5f);
+  diagnostic.tdsOffsetVoltage = (int16_t)(tdsCalibration.offsetVoltage * 10.0f);
+  diagnostic.thermalFlags = ((thermalConfig.frameRate == AMG8833_FPS_1) ? DOWNLINK_CMD_THERMAL_1FPS : 0) |
+                            (thermalConfig.movingAverage ? DOWNLINK_CMD_THERMAL_AVERAGE : 0) |
+                            (((thermalConfig.interruptMode == AMG8833_INT_DISABLED) ? 0 :
+                              ((thermalConfig.interruptMode == AMG8833_INT_DIFFERENCE) ? 1 : 2)) << DOWNLINK_CMD_THERMAL_INT_POS);
+  diagnostic.thermalOffset = AMG8833_GetTemperatureOffset();
+  diagnostic.rssi = LastRxRssi;
+  diagnostic.snr = LastRxSnr;
+
+  size = DownlinkCmd_EncodeDiagnostic(&diagnostic, &CommandAck, AppData.Buffer, GetMaxPayloadSize());
+  if (size < 0)
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "No room for the diagnostic frame\r\n");
+    return false;
+  }
+
+  AppData.Port = LORAWAN_COMMAND_PORT;
+  AppData.BufferSize = (uint8_t)size;
+  if (LORAMAC_HANDLER_SUCCESS != LmHandlerSend(&AppData, LORAWAN_DEFAULT_CONFIRMED_MSG_STATE, &nextTxIn, false))
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "Diagnostic frame not sent\r\n");
+    return false;
+  }
+
+  APP_LOG(TS_ON, VLEVEL_L, "Diagnostic frame sent\r\n");
+  DiagnosticRequested = false;
+  CommandAckPending = false;
+  return true;
+}
+
+static bool SaveAppConfig(void)
+{
+  return (CalibStore_Write(CALIB_STORE_KEY_APP_CONFIG, &AppConfig, sizeof(AppConfig)) == 0);
+}
+
+static void GetReportSample(const SensorAcq_Snapshot_t *acq, ReportRules_Sample_t *sample)
+{
+  memset(sample, 0, sizeof(*sample));
+
+  if (acq->validMask & SENSOR_ACQ_VALID_WATER_TEMP)
+  {
+    sample->value[REPORT_METRIC_WATER_TEMPERATURE] = acq->waterTemperature;
+    sample->validMask |= (1U << REPORT_METRIC_WATER_TEMPERATURE);
+  }
+  if (acq->validMask & SENSOR_ACQ_VALID_PH)
+  {
+    sample->value[REPORT_METRIC_PH] = acq->phValue;
+    sample->validMask |= (1U << REPORT_METRIC_PH);
+  }
+  if (acq->validMask & SENSOR_ACQ_VALID_TDS)
+  {
+    sample->value[REPORT_METRIC_TDS] = acq->tdsValue;
+    sample->validMask |= (1U << REPORT_METRIC_TDS);
+  }
+  if (acq->validMask & SENSOR_ACQ_VALID_THERMAL)
+  {
+    sample->value[REPORT_METRIC_THERMAL_MAX] = acq->thermalMax;
+    sample->validMask |= (1U << REPORT_METRIC_THERMAL_MAX);
+  }
+  if ((acq->validMask & SENSOR_ACQ_VALID_THERMAL_ALARM) && acq->thermalAlarm)
+  {
+    sample->hardwareAlarm |= (1U << REPORT_METRIC_THERMAL_MAX);
+  }
+}
+
+static bool SetReportRule(const DownlinkCmd_t *command)
+{
+  ReportRules_Rule_t *rule;
+  uint8_t flags = command->arg.rule.flags;
+
+  if ((command->arg.rule.metric >= REPORT_METRIC_COUNT) ||
+      ((flags & ~(REPORT_RULE_HIGH | REPORT_RULE_LOW | REPORT_RULE_DELTA | REPORT_RULE_RATE | REPORT_RULE_HARDWARE)) != 0) ||
+      (((flags & REPORT_RULE_HARDWARE) != 0) && (command->arg.rule.metric != REPORT_METRIC_THERMAL_MAX)) ||
+      (((flags & REPORT_RULE_HIGH) != 0) && ((flags & REPORT_RULE_LOW) != 0) &&
+       (command->arg.rule.low > command->arg.rule.high)))
+  {
+    return false;
+  }
+
+  rule = &ReportConfig.rules.rule[command->arg.rule.metric];
+  rule->flags = flags;
+  rule->high = command->arg.rule.high;
+  rule->low = command->arg.rule.low;
+  rule->hysteresis = command->arg.rule.hysteresis;
+  rule->delta = command->arg.rule.delta;
+  rule->rate = command->arg.rule.rate;
+  ReportRules_Configure(&Reporting, &ReportConfig.rules);
+
+  if ((command->arg.rule.metric == REPORT_METRIC_THERMAL_MAX) && !ApplyThermalRule())
+  {
+    return false;
+  }
+  return (CalibStore_Write(CALIB_STORE_KEY_REPORT_CONFIG, &ReportConfig, sizeof(ReportConfig)) == 0);
+}
+
+static void PushBatchSample(const SensorAcq_Snapshot_t *acq)
+{
+  float value[SAMPLE_BATCH_CHANNEL_COUNT];
+  uint8_t validMask = (1U << SAMPLE_BATCH_AIR_TEMPERATURE) | (1U << SAMPLE_BATCH_HUMIDITY) |
+                      (1U << SAMPLE_BATCH_PRESSURE);
+
+  value[SAMPLE_BATCH_WATER_TEMPERATURE] = acq->waterTemperature;
+  value[SAMPLE_BATCH_PH] = acq->phValue;
+  value[SAMPLE_BATCH_TDS] = acq->tdsValue;
+  value[SAMPLE_BATCH_THERMAL_MAX] = acq->thermalMax;
+  value[SAMPLE_BATCH_AIR_TEMPERATURE] = acq->env.temperature;
+  value[SAMPLE_BATCH_HUMIDITY] = acq->env.humidity;
+  value[SAMPLE_BATCH_PRESSURE] = acq->env.pressure;
+  validMask |= ((acq->validMask & SENSOR_ACQ_VALID_WATER_TEMP) ? (1U << SAMPLE_BATCH_WATER_TEMPERATURE) : 0) |
+               ((acq->validMask & SENSOR_ACQ_VALID_PH) ? (1U << SAMPLE_BATCH_PH) : 0) |
+               ((acq->validMask & SENSOR_ACQ_VALID_TDS) ? (1U << SAMPLE_BATCH_TDS) : 0) |
+               ((acq->validMask & SENSOR_ACQ_VALID_THERMAL) ? (1U << SAMPLE_BATCH_THERMAL_MAX) : 0);
+
+  /* A full ring pages its oldest records out to the flash log instead of overwriting them */
+  if (SampleBatch_Count(&Batch) == SAMPLE_BATCH_CAPACITY)
+  {
+    uint8_t frame[APP_BACKLOG_BATCH_SIZE];
+    uint8_t count;
+    int size = SampleBatch_Encode(&Batch, NULL, frame, sizeof(frame), &count);
+
+    if ((size > 0) && (UplinkLog_Append(SysTimeGet().Seconds, LORAWAN_BATCH_PORT, frame, (uint8_t)size) == 0))
+    {
+      SampleBatch_Drop(&Batch, count);
+    }
+  }
+  SampleBatch_Push(&Batch, SysTimeGet().Seconds, value, validMask);
+  APP_LOG(TS_ON, VLEVEL_M, "Samples buffered: %d\r\n", SampleBatch_Count(&Batch));
+}
+
+static bool SendBatch(void)
+{
+  UTIL_TIMER_Time_t nextTxIn = 0;
+  uint16_t ack = DownlinkCmd_AckValue(&CommandAck);
+  uint8_t count;
+  int size;
+
+  size = SampleBatch_Encode(&Batch, CommandAckPending ? &ack : NULL, AppData.Buffer, GetMaxPayloadSize(), &count);
+  if (size < 0)
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "No room for a batch record\r\n");
+    return false;
+  }
+
+  AppData.Port = LORAWAN_BATCH_PORT;
+  AppData.BufferSize = (uint8_t)size;
+  if (LORAMAC_HANDLER_SUCCESS != LmHandlerSend(&AppData, LORAWAN_DEFAULT_CONFIRMED_MSG_STATE, &nextTxIn, false))
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "Batch not sent, %d samples buffered\r\n", SampleBatch_Count(&Batch));
+    return false;
+  }
+
+  /* The records left over go with the next batch */
+  APP_LOG(TS_ON, VLEVEL_L, "Batch of %d samples sent: %d bytes\r\n", count, size);
+  SampleBatch_Drop(&Batch, count);
+  CommandAckPending = false;
+  return true;
+}
+
+static void LogSensorPayload(SensorPayload_t *payload)
+{
+  uint8_t buffer[LORAWAN_APP_DATA_BUFFER_MAX_SIZE];
+  int size;
+
+  /* A thermal fragment is resent from RAM and the command ack stays pending for the next
+     live frame, a replayed ack would arrive after newer ones; a frame left with nothing
+     else is not kept */
+  payload->presentMask &= ~((1UL << SENSOR_PAYLOAD_THERMAL_IMAGE) | (1UL << SENSOR_PAYLOAD_COMMAND_ACK));
+  if (payload->presentMask == 0)
+  {
+    return;
+  }
+  size = SensorPayload_Encode(payload, buffer, sizeof(buffer));
+  if ((size <= 0) || (UplinkLog_Append(SysTimeGet().Seconds, LORAWAN_USER_APP_PORT, buffer, (uint8_t)size) != 0))
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "Uplink not logged\r\n");
+    return;
+  }
+  APP_LOG(TS_ON, VLEVEL_L, "Uplink logged, %d pending\r\n", (int)UplinkLog_GetPending());
+}
+
+static void SendBacklog(void)
+{
+  UTIL_TIMER_Time_t nextTxIn = 0;
+  UplinkLog_Record_t record;
+  uint8_t maxSize;
+
+  if (BacklogInFlight || (UplinkLog_GetPending() == 0) || (LmHandlerJoinStatus() != LORAMAC_HANDLER_SET))
+  {
+    return;
+  }
+
+  /* Records too large for the current datarate wait for a better one */
+  maxSize = GetMaxPayloadSize();
+  if ((maxSize <= BACKLOG_HEADER_SIZE) ||
+      (UplinkLog_Next(APP_BACKLOG_NEWEST_FIRST ? UPLINK_LOG_NEWEST_FIRST : UPLINK_LOG_OLDEST_FIRST,
+                      maxSize - BACKLOG_HEADER_SIZE, &record) != 0))
+  {
+    return;
+  }
+
+  AppData.Port = LORAWAN_BACKLOG_PORT;
+  AppData.Buffer[0] = (uint8_t)(record.time >> 24);
+  AppData.Buffer[1] = (uint8_t)(record.time >> 16);
+  AppData.Buffer[2] = (uint8_t)(record.time >> 8);
+  AppData.Buffer[3] = (uint8_t)record.time;
+  AppData.Buffer[4] = record.port;
+  memcpy(&AppData.Buffer[BACKLOG_HEADER_SIZE], record.data, record.size);
+  AppData.BufferSize = (uint8_t)(BACKLOG_HEADER_SIZE + record.size);
+
+  if (LORAMAC_HANDLER_SUCCESS == LmHandlerSend(&AppData, LORAWAN_DEFAULT_CONFIRMED_MSG_STATE, &nextTxIn, false))
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "Backlog uplink sent: %d bytes\r\n", AppData.BufferSize);
+    BacklogInFlight = true;
+    BacklogRecordId = record.id;
+    return;
+  }
+
+  UTIL_TIMER_SetPeriod(&BacklogTimer, (nextTxIn > 0) ? nextTxIn : BACKLOG_RETRY_DELAY);
+  UTIL_TIMER_Start(&BacklogTimer);
+}
+
+static void OnBacklogTimerEvent(void *context)
+{
+  UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_LoRaSendBacklog), CFG_SEQ_Prio_0);
+}
+
+static bool ApplyThermalRule(void)
+{
+  const ReportRules_Rule_t *rule = &ReportConfig.rules.rule[REPORT_METRIC_THERMAL_MAX];
+  AMG8833_Config_t thermalConfig;
+  AMG8833_Config_t current;
+  /* 0.01 degC rule steps per 0.25 degC register step */
+  const int16_t step = REPORT_RULES_SCALE_THERMAL_MAX / 4;
+  const int32_t offset = AMG8833_GetTemperatureOffset();
+  int32_t upper = 2047;
+  int32_t lower = -2048;
+
+  if ((rule->flags & REPORT_RULE_HARDWARE) == 0)
+  {
+    return true;
+  }
+
+  AMG8833_GetConfig(&current);
+  thermalConfig = current;
+  /* Any pixel above the upper level or below the lower level raises the flag.
+     The sensor compares the raw pixels, the rule the pixels with the offset
+     added, so the levels are programmed without the offset. */
+  if ((rule->flags & REPORT_RULE_HIGH) != 0)
+  {
+    upper = (rule->high / step) - offset;
+    upper = (upper > 2047) ? 2047 : ((upper < -2048) ? -2048 : upper);
+  }
+  if ((rule->flags & REPORT_RULE_LOW) != 0)
+  {
+    lower = (rule->low / step) - offset;
+    lower = (lower > 2047) ? 2047 : ((lower < -2048) ? -2048 : lower);
+  }
+  thermalConfig.interruptMode = AMG8833_INT_ABSOLUTE;
+  thermalConfig.interruptUpper = (int16_t)upper;
+  thermalConfig.interruptLower = (int16_t)lower;
+  thermalConfig.interruptHysteresis = (int16_t)(rule->hysteresis / step);
+  if ((thermalConfig.interruptMode == current.interruptMode) &&
+      (thermalConfig.interruptUpper == current.interruptUpper) &&
+      (thermalConfig.interruptLower == current.interruptLower) &&
+      (thermalConfig.interruptHysteresis == current.interruptHysteresis))
+  {
+    return true;
+  }
+  return (AMG8833_Configure(&thermalConfig) == HAL_OK);
+}
 
 /* USER CODE END PrFD */
 
@@ -470,7 +1417,9 @@ static void OnRxData(LmHandlerAppData_t *appData, LmHandlerRxParams_t *params)
         }
         break;
     /* USER CODE BEGIN OnRxData_Switch_case */
-
+      case LORAWAN_COMMAND_PORT:
+        OnCommandData(appData->Buffer, appData->BufferSize);
+        break;
     /* USER CODE END OnRxData_Switch_case */
       default:
     /* USER CODE BEGIN OnRxData_Switch_default */
@@ -481,209 +1430,32 @@ static void OnRxData(LmHandlerAppData_t *appData, LmHandlerRxParams_t *params)
   }
 
   /* USER CODE BEGIN OnRxData_2 */
+  if (params != NULL)
+  {
+    LastRxRssi = params->Rssi;
+    LastRxSnr = params->Snr;
+  }
 
   /* USER CODE END OnRxData_2 */
 }
 /**
- * @brief Send sensor data via LoRaWAN
- * Reads all sensors (Environmental, pH, TDS, AMG8833) and transmits via LoRaWAN
+ * @brief Start a sensor acquisition for the next uplink
+ * The sensors are read asynchronously; SendSensorData() runs once they all reported
  */
 static void SendTxData(void)
 {
-  sensor_t sensor_data;
-  UTIL_TIMER_Time_t nextTxIn = 0;
-
-  // Variables for thermal data
-  float min_temp = 0.0f;
-  float max_temp = 0.0f;
-  float avg_temp = 0.0f;
-
-  // Buffer for compressed thermal image data (64 bytes for 8-bit compression)
-  uint8_t thermal_image_data[64];
-  int thermal_data_size = 0;
-
-  // Static sensor values only
-  float static_water_temp = 20.0f;      // DS18B20 water temperature (°C)
-  float static_ph_value = 7.2f;         // Static pH value
-  float static_tds_value = 150.0f;      // Static TDS value (ppm)
-
-  // GPS coordinates (Tunisia)
-  float gps_latitude = 36.7461f;        // Latitude (°N)
-  float gps_longitude = 10.4231f;       // Longitude (°E)
-
-  /*** Environmental Sensors Reading ***/
-  // Read environmental sensor data
-  EnvSensors_Read(&sensor_data);
-
-  /*** AMG8833 Thermal Camera Operation ***/
-  // Activate AMG8833 thermal camera
-  HAL_StatusTypeDef status = AMG8833_WakeUp();
-  if (status != HAL_OK) {
-    APP_LOG(TS_ON, VLEVEL_L, "Error waking up AMG8833: %d\r\n", status);
-  }
-
-  // Check if device is responding
-  status = HAL_I2C_IsDeviceReady(&hi2c2, AMG8833_ADDR, 2, 100);
-  if (status != HAL_OK) {
-    APP_LOG(TS_ON, VLEVEL_L, "AMG8833 not responding on I2C2: %d\r\n", status);
-  } else {
-    APP_LOG(TS_ON, VLEVEL_L, "AMG8833 device ready on I2C2\r\n");
-
-    HAL_Delay(100); // Give the sensor time to stabilize
-
-    // Read AMG8833 thermal data
-    status = AMG8833_ReadPixels();
-    if (status != HAL_OK) {
-      APP_LOG(TS_ON, VLEVEL_L, "Error reading AMG8833 data: %d\r\n", status);
-    } else {
-      APP_LOG(TS_ON, VLEVEL_L, "AMG8833 data read successfully\r\n");
-
-      // Get thermal camera statistics
-      AMG8833_GetStats(&min_temp, &max_temp, &avg_temp);
-
-      // Prepare thermal image data for transmission
-      thermal_data_size = AMG8833_PrepareChirpStackData(thermal_image_data, sizeof(thermal_image_data));
-      if (thermal_data_size <= 0) {
-        APP_LOG(TS_ON, VLEVEL_L, "Error preparing thermal image data\r\n");
-      } else {
-        APP_LOG(TS_ON, VLEVEL_L, "Thermal image data prepared: %d bytes\r\n", thermal_data_size);
-      }
-    }
-  }
-
-  // Put AMG8833 back to sleep to save power
-  AMG8833_Sleep();
-
-  /*** Logging Data for Debug ***/
-  APP_LOG(TS_ON, VLEVEL_L, "=== Water Quality Sensor Data ===\r\n");
-
-  // Log environmental sensor data
-  APP_LOG(TS_ON, VLEVEL_L, "Temperature: %d C\r\n", (uint16_t)(sensor_data.temperature));
-  APP_LOG(TS_ON, VLEVEL_L, "Pressure: %d hPa\r\n", (uint16_t)(sensor_data.pressure));
-  APP_LOG(TS_ON, VLEVEL_L, "Humidity: %d%%\r\n", (uint16_t)(sensor_data.humidity));
-
-  // Log static sensor data only
-  APP_LOG(TS_ON, VLEVEL_L, "Water Temp (DS18B20): %d.%d C\r\n",
-          (int16_t)static_water_temp, (int16_t)(static_water_temp * 10) % 10);
-  APP_LOG(TS_ON, VLEVEL_L, "pH Value: %d.%d\r\n",
-          (int16_t)static_ph_value, (int16_t)(static_ph_value * 10) % 10);
-  APP_LOG(TS_ON, VLEVEL_L, "TDS Value: %d.%d ppm (Good)\r\n",
-          (int16_t)static_tds_value, (int16_t)(static_tds_value * 10) % 10);
-  APP_LOG(TS_ON, VLEVEL_L, "GPS Location: %d.%04d N, %d.%04d E\r\n",
-          (int16_t)gps_latitude, (int16_t)((gps_latitude - (int16_t)gps_latitude) * 10000),
-          (int16_t)gps_longitude, (int16_t)((gps_longitude - (int16_t)gps_longitude) * 10000));
-
-  // Log thermal data only if available
-  if (avg_temp > 0.0f) {
-    APP_LOG(TS_ON, VLEVEL_L, "Thermal Min: %d.%d C\r\n",
-            (int16_t)(min_temp * 10) / 10, abs((int16_t)(min_temp * 10) % 10));
-    APP_LOG(TS_ON, VLEVEL_L, "Thermal Max: %d.%d C\r\n",
-            (int16_t)(max_temp * 10) / 10, abs((int16_t)(max_temp * 10) % 10));
-    APP_LOG(TS_ON, VLEVEL_L, "Thermal Avg: %d.%d C\r\n",
-            (int16_t)(avg_temp * 10) / 10, abs((int16_t)(avg_temp * 10) % 10));
-  }
-
-  /*** LoRaWAN Data Preparation and Transmission ***/
-  AppData.Port = LORAWAN_USER_APP_PORT;
-
-  // Determine packet transmission strategy based on region
-  bool send_full_image = false;
-  bool send_compact_payload = false;
-
-  // Check region for payload size limitations
-  if ((LmHandlerParams.ActiveRegion == LORAMAC_REGION_US915) ||
-      (LmHandlerParams.ActiveRegion == LORAMAC_REGION_AU915) ||
-      (LmHandlerParams.ActiveRegion == LORAMAC_REGION_AS923)) {
-    send_compact_payload = true;
-    APP_LOG(TS_ON, VLEVEL_L, "Using compact payload for region restrictions\r\n");
-  } else {
-    send_full_image = true;
-    APP_LOG(TS_ON, VLEVEL_L, "Using full payload with thermal image\r\n");
-  }
-
-  // Reset Cayenne LPP buffer
-  CayenneLppReset();
-
-  /*** Standard Environmental Data (Always Included) ***/
-  // Channels 1-3: Environmental sensors
-  CayenneLppAddBarometricPressure(1, (uint16_t)(sensor_data.pressure));
-  CayenneLppAddTemperature(2, (uint16_t)(sensor_data.temperature));
-  CayenneLppAddRelativeHumidity(3, (uint16_t)(sensor_data.humidity));
-
-  /*** Static Sensor Data (Primary Data) ***/
-  // Channel 4: Water temperature (static DS18B20 value)
-  CayenneLppAddTemperature(4, (uint16_t)(static_water_temp * 10));
-
-  // Channel 5: pH value (static)
-  CayenneLppAddAnalogInput(5, static_ph_value);
-
-  // Channel 6: TDS value (static)
-  CayenneLppAddAnalogInput(6, static_tds_value);
-
-  /*** GPS Coordinates ***/
-  // Channel 7: GPS Latitude
-  CayenneLppAddAnalogInput(7, gps_latitude);
-
-  // Channel 8: GPS Longitude
-  CayenneLppAddAnalogInput(8, gps_longitude);
-
-  /*** Extended Data ***/
-  if (!send_compact_payload) {
-    // Water quality classification based on static TDS value
-    uint8_t water_quality_code = 1; // Good (TDS = 150ppm)
-    CayenneLppAddDigitalInput(9, water_quality_code);
-
-    // Thermal data
-    if (avg_temp > 0.0f) {
-      CayenneLppAddTemperature(10, (int16_t)((min_temp + 100.0f) * 10.0f));
-      CayenneLppAddTemperature(11, (int16_t)((max_temp + 100.0f) * 10.0f));
-      CayenneLppAddTemperature(12, (int16_t)((avg_temp + 100.0f) * 10.0f));
-    }
-
-    // Add thermal image data if available
-    if (thermal_data_size > 0 && send_full_image) {
-      // Channels 20-21: Thermal image metadata
-      CayenneLppAddDigitalInput(20, 8);  // Width
-      CayenneLppAddDigitalInput(21, 8);  // Height
-
-      // Channels 30-93: Compressed pixel data
-      int pixels_to_send = (thermal_data_size < 64) ? thermal_data_size : 64;
-      for (int i = 0; i < pixels_to_send; i++) {
-        CayenneLppAddDigitalInput(30 + i, thermal_image_data[i]);
-      }
-    }
-  } else {
-    /*** Compact Payload Mode ***/
-    // Only send essential data
-    uint8_t water_quality_code = 1; // Good (based on static TDS = 150ppm)
-    CayenneLppAddDigitalInput(18, water_quality_code);
-
-    // Thermal average if available
-    if (avg_temp > 0.0f) {
-      CayenneLppAddTemperature(19, (int16_t)((avg_temp + 100.0f) * 10.0f));
-    }
-  }
-
-  // Copy formatted data to AppData buffer
-  CayenneLppCopy(AppData.Buffer);
-  AppData.BufferSize = CayenneLppGetSize();
-
-  APP_LOG(TS_ON, VLEVEL_L, "Total payload size: %d bytes\r\n", AppData.BufferSize);
-
-  // Attempt to send data via LoRaWAN
-  if (LORAMAC_HANDLER_SUCCESS == LmHandlerSend(&AppData, LORAWAN_DEFAULT_CONFIRMED_MSG_STATE, &nextTxIn, false))
+  // A requested diagnostic frame takes the place of one acquisition
+  if (DiagnosticRequested && SendDiagnostic())
   {
-    APP_LOG(TS_ON, VLEVEL_L, "SEND REQUEST SUCCESS\r\n");
+    return;
   }
-  else if (nextTxIn > 0)
-  {
-    APP_LOG(TS_ON, VLEVEL_L, "Next Tx in: ~%d second(s)\r\n", (nextTxIn / 1000));
-  }
-  else
+
+  if (!SensorAcq_Start())
   {
-    APP_LOG(TS_ON, VLEVEL_L, "SEND REQUEST FAILED\r\n");
+    APP_LOG(TS_ON, VLEVEL_L, "Sensor acquisition still in progress\r\n");
   }
 }
+
 static void OnTxTimerEvent(void *context)
 {
   /* USER CODE BEGIN OnTxTimerEvent_1 */
@@ -773,7 +1545,49 @@ static void OnTxData(LmHandlerTxParams_t *params)
   }
 
   /* USER CODE BEGIN OnTxData_2 */
+  if ((params != NULL) && (params->IsMcpsConfirm != 0) &&
+      (params->AppData.Port == LORAWAN_USER_APP_PORT) && (ThermalImageInFlight != 0))
+  {
+    /* Unconfirmed uplinks are assumed delivered, a lost one is recovered by the next keyframe */
+    if ((params->MsgType == LORAMAC_HANDLER_UNCONFIRMED_MSG) || (params->AckReceived != 0))
+    {
+      ThermalImageOffset += ThermalImageInFlight;
+    }
+    ThermalImageInFlight = 0;
 
+    if (ThermalImageOffset >= ThermalImageSize)
+    {
+      /* Whole image delivered, the next one can be a delta against it */
+      ThermalImageSize = 0;
+      AMG8833_AcknowledgeCompressedData();
+    }
+    else
+    {
+      /* Next fragment, LmHandlerSend() reports the duty cycle wait if any */
+      UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_LoRaSendSensorData), CFG_SEQ_Prio_0);
+    }
+  }
+
+  if ((params != NULL) && (params->IsMcpsConfirm != 0))
+  {
+    if ((params->AppData.Port == LORAWAN_BACKLOG_PORT) && BacklogInFlight)
+    {
+      /* Same delivery rule as the thermal fragments, the record is kept for a NACK */
+      if ((params->Status == LORAMAC_EVENT_INFO_STATUS_OK) &&
+          ((params->MsgType == LORAMAC_HANDLER_UNCONFIRMED_MSG) || (params->AckReceived != 0)) &&
+          (UplinkLog_MarkSent(BacklogRecordId, params->UplinkCounter) != 0))
+      {
+        APP_LOG(TS_ON, VLEVEL_L, "Backlog record not marked sent\r\n");
+      }
+      BacklogInFlight = false;
+    }
+
+    /* The link is up, drain the flash log at the pace the MAC allows */
+    if (UplinkLog_GetPending() != 0)
+    {
+      UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_LoRaSendBacklog), CFG_SEQ_Prio_0);
+    }
+  }
   /* USER CODE END OnTxData_2 */
 }
 
@@ -811,7 +1625,10 @@ static void OnJoinRequest(LmHandlerJoinParams_t *joinParams)
   }
 
   /* USER CODE BEGIN OnJoinRequest_2 */
-
+  if ((joinParams != NULL) && (joinParams->Status == LORAMAC_HANDLER_SUCCESS) && (UplinkLog_GetPending() != 0))
+  {
+    UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_LoRaSendBacklog), CFG_SEQ_Prio_0);
+  }
   /* USER CODE END OnJoinRequest_2 */
 }
 
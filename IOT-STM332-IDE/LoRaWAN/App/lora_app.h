@@ -103,6 +103,61 @@ extern "C" {
 #define LORAWAN_DEFAULT_PING_SLOT_PERIODICITY       4
 
 /* USER CODE BEGIN EC */
+/*!
+ * LoRaWAN configuration command port, see downlink_cmd.h
+ * @note do not use 224. It is reserved for certification
+ */
+#define LORAWAN_COMMAND_PORT                        10
+
+/*!
+ * Range of the transmission duty cycle set by a downlink command, value in [ms]
+ */
+#define APP_TX_DUTYCYCLE_MIN                        10000
+#define APP_TX_DUTYCYCLE_MAX                        (65535UL * 1000UL)
+
+/*!
+ * Reporting mode, changed by downlink command:
+ * 0: one uplink every duty cycle
+ * 1: the duty cycle is the sampling period, an uplink goes out when a rule of
+ *    report_rules.h fires
+ * 2: the duty cycle is the sampling period, the samples are buffered and sent
+ *    APP_BATCH_RECORDS at a time on LORAWAN_BATCH_PORT, or earlier when a rule
+ *    fires
+ */
+#define APP_REPORT_MODE                             1
+
+/*!
+ * Longest time without a report when reporting on rules, value in [ms]
+ */
+#define APP_REPORT_HEARTBEAT                        (15UL * 60UL * 1000UL)
+
+/*!
+ * LoRaWAN port of the batched samples, see sample_batch.h
+ */
+#define LORAWAN_BATCH_PORT                          11
+
+/*!
+ * Buffered samples that trigger a batch uplink, at most SAMPLE_BATCH_CAPACITY
+ */
+#define APP_BATCH_RECORDS                           8
+
+/*!
+ * LoRaWAN port of the uplinks sent late from the flash log (uplink_log.h):
+ * u32 capture time in s (SysTimeGet(), big-endian), u8 port of the original
+ * uplink, then its payload
+ */
+#define LORAWAN_BACKLOG_PORT                        12
+
+/*!
+ * Drain the flash log newest first (1) or oldest first (0)
+ */
+#define APP_BACKLOG_NEWEST_FIRST                    0
+
+/*!
+ * Largest batch frame paged out to the flash log when the RAM ring is full,
+ * fits the smallest EU868 datarate with the backlog header
+ */
+#define APP_BACKLOG_BATCH_SIZE                      46
 
 /* USER CODE END EC */
 
@@ -0,0 +1,153 @@
+/**
+  ******************************************************************************
+  * @file    report_rules.c
+  * @brief   Rules deciding whether a sensor sample is worth an uplink
+  * @note    See report_rules.h for the rule semantics.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "report_rules.h"
+
+/* Private variables ---------------------------------------------------------*/
+/**
+  * @brief Steps per unit, indexed by metric
+  */
+static const int32_t Scale[REPORT_METRIC_COUNT] =
+{
+  [REPORT_METRIC_WATER_TEMPERATURE] = REPORT_RULES_SCALE_WATER_TEMPERATURE,
+  [REPORT_METRIC_PH]                = REPORT_RULES_SCALE_PH,
+  [REPORT_METRIC_TDS]               = REPORT_RULES_SCALE_TDS,
+  [REPORT_METRIC_THERMAL_MAX]       = REPORT_RULES_SCALE_THERMAL_MAX,
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t ReportRules_Abs(int32_t value);
+
+/* Exported functions --------------------------------------------------------*/
+void ReportRules_Init(ReportRules_t *rules, const ReportRules_Config_t *config)
+{
+  memset(rules, 0, sizeof(*rules));
+  rules->config = *config;
+}
+
+void ReportRules_Configure(ReportRules_t *rules, const ReportRules_Config_t *config)
+{
+  rules->config = *config;
+}
+
+uint32_t ReportRules_Evaluate(ReportRules_t *rules, const ReportRules_Sample_t *sample, uint32_t now)
+{
+  const ReportRules_Rule_t *rule;
+  uint32_t triggers = 0;
+  uint32_t elapsed;
+  uint8_t bit;
+  bool high;
+  bool low;
+  int32_t value;
+
+  for (uint8_t m = 0; m < REPORT_METRIC_COUNT; m++)
+  {
+    rule = &rules->config.rule[m];
+    bit = (uint8_t)(1U << m);
+    if ((sample->validMask & bit) == 0)
+    {
+      continue;
+    }
+    value = ReportRules_Scale((ReportRules_Metric_t)m, sample->value[m]);
+
+    /* Alarm bands, left only once back by the hysteresis */
+    if ((rule->flags & REPORT_RULE_HARDWARE) != 0)
+    {
+      high = ((sample->hardwareAlarm & bit) != 0);
+      low = false;
+    }
+    else
+    {
+      high = ((rule->flags & REPORT_RULE_HIGH) != 0) &&
+             ((value > rule->high) ||
+              (((rules->alarmHigh & bit) != 0) && (value > ((int32_t)rule->high - rule->hysteresis))));
+      low = ((rule->flags & REPORT_RULE_LOW) != 0) &&
+            ((value < rule->low) ||
+             (((rules->alarmLow & bit) != 0) && (value < ((int32_t)rule->low + rule->hysteresis))));
+    }
+    if (high != ((rules->alarmHigh & bit) != 0))
+    {
+      rules->alarmHigh ^= bit;
+      triggers |= (uint32_t)(((rule->flags & REPORT_RULE_HARDWARE) != 0) ? REPORT_RULE_HARDWARE : REPORT_RULE_HIGH)
+                  << REPORT_TRIGGER_SHIFT(m);
+    }
+    if (low != ((rules->alarmLow & bit) != 0))
+    {
+      rules->alarmLow ^= bit;
+      triggers |= (uint32_t)REPORT_RULE_LOW << REPORT_TRIGGER_SHIFT(m);
+    }
+
+    if (((rule->flags & REPORT_RULE_DELTA) != 0) && ((rules->reportedMask & bit) != 0) &&
+        (ReportRules_Abs(value - rules->reported[m]) >= rule->delta))
+    {
+      triggers |= (uint32_t)REPORT_RULE_DELTA << REPORT_TRIGGER_SHIFT(m);
+    }
+
+    /* |change| / elapsed >= rate / 1 min */
+    elapsed = now - rules->previousTime[m];
+    if (((rule->flags & REPORT_RULE_RATE) != 0) && ((rules->previousMask & bit) != 0) && (elapsed > 0) &&
+        (((uint64_t)ReportRules_Abs(value - rules->previous[m]) * 60000U) >= ((uint64_t)rule->rate * elapsed)))
+    {
+      triggers |= (uint32_t)REPORT_RULE_RATE << REPORT_TRIGGER_SHIFT(m);
+    }
+
+    rules->previous[m] = value;
+    rules->previousTime[m] = now;
+    rules->previousMask |= bit;
+  }
+
+  if ((rules->config.heartbeat != 0) &&
+      (!rules->hasReported || ((now - rules->lastReportTime) >= rules->config.heartbeat)))
+  {
+    triggers |= REPORT_TRIGGER_HEARTBEAT;
+  }
+
+  rules->pending |= triggers;
+  return rules->pending;
+}
+
+void ReportRules_Reported(ReportRules_t *rules, const ReportRules_Sample_t *sample, uint32_t now)
+{
+  for (uint8_t m = 0; m < REPORT_METRIC_COUNT; m++)
+  {
+    if ((sample->validMask & (1U << m)) != 0)
+    {
+      rules->reported[m] = ReportRules_Scale((ReportRules_Metric_t)m, sample->value[m]);
+      rules->reportedMask |= (uint8_t)(1U << m);
+    }
+  }
+  rules->hasReported = true;
+  rules->lastReportTime = now;
+  rules->pending = 0;
+}
+
+int32_t ReportRules_Scale(ReportRules_Metric_t metric, float value)
+{
+  float scaled = value * (float)Scale[metric];
+
+  if (scaled >= 2147483520.0f)
+  {
+    return INT32_MAX;
+  }
+  if (scaled <= -2147483520.0f)
+  {
+    return INT32_MIN;
+  }
+  return (scaled >= 0.0f) ? (int32_t)(scaled + 0.5f) : (int32_t)(scaled - 0.5f);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Absolute value, without overflow
+  */
+static uint32_t ReportRules_Abs(int32_t value)
+{
+  return (value < 0) ? (0U - (uint32_t)value) : (uint32_t)value;
+}
@@ -0,0 +1,168 @@
+/**
+  ******************************************************************************
+  * @file    report_rules.h
+  * @brief   Rules deciding whether a sensor sample is worth an uplink
+  * @note    Each metric has its own rule, any enabled condition fires it:
+  *            - HIGH, LOW: the value enters or leaves the band above high or
+  *              below low. Leaving needs the value back by hysteresis, so a
+  *              value dwelling on a threshold fires once.
+  *            - HARDWARE: the same as HIGH/LOW, but the alarm state is given
+  *              by the sensor (ReportRules_Sample_t.hardwareAlarm), e.g. the
+  *              AMG8833 pixel interrupt
+  *            - DELTA: the value moved by delta since the last report
+  *            - RATE: the value moves by rate per minute or more since the
+  *              previous sample
+  *          The heartbeat fires when nothing was reported for heartbeat ms.
+  *          Triggers stay pending until ReportRules_Reported(), so a trigger
+  *          whose uplink failed fires again with the next sample.
+  *          Values are compared in fixed point, in the resolution of each
+  *          metric (REPORT_RULES_SCALE_xxx steps per unit). The file has no
+  *          hardware dependency.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __REPORT_RULES_H__
+#define __REPORT_RULES_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+/**
+  * @brief Resolution of the rule levels, steps per unit of each metric
+  */
+#define REPORT_RULES_SCALE_WATER_TEMPERATURE 100   /*!< 0.01 degC */
+#define REPORT_RULES_SCALE_PH           1000       /*!< 0.001 */
+#define REPORT_RULES_SCALE_TDS          10         /*!< 0.1 ppm */
+#define REPORT_RULES_SCALE_THERMAL_MAX  100        /*!< 0.01 degC */
+
+/**
+  * @brief Conditions of a rule, ReportRules_Rule_t.flags
+  */
+#define REPORT_RULE_HIGH                (1U << 0)
+#define REPORT_RULE_LOW                 (1U << 1)
+#define REPORT_RULE_DELTA               (1U << 2)
+#define REPORT_RULE_RATE                (1U << 3)
+#define REPORT_RULE_HARDWARE            (1U << 4)
+
+/**
+  * @brief Triggers returned by ReportRules_Evaluate(): the condition bit of
+  *        metric m is shifted by REPORT_TRIGGER_SHIFT(m)
+  */
+#define REPORT_TRIGGER_SHIFT(metric)    (5U * (uint32_t)(metric))
+#define REPORT_TRIGGER_HEARTBEAT        (1UL << 31)
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief Metrics with a rule
+  */
+typedef enum
+{
+  REPORT_METRIC_WATER_TEMPERATURE = 0,  /*!< degC */
+  REPORT_METRIC_PH,
+  REPORT_METRIC_TDS,                    /*!< ppm */
+  REPORT_METRIC_THERMAL_MAX,            /*!< degC */
+  REPORT_METRIC_COUNT
+} ReportRules_Metric_t;
+
+/**
+  * @brief Rule of one metric, levels in REPORT_RULES_SCALE_xxx steps
+  */
+typedef struct
+{
+  uint8_t flags;                /*!< REPORT_RULE_xxx */
+  int16_t high;                 /*!< HIGH level */
+  int16_t low;                  /*!< LOW level */
+  uint16_t hysteresis;          /*!< Return needed to leave HIGH or LOW */
+  uint16_t delta;               /*!< DELTA change since the last report */
+  uint16_t rate;                /*!< RATE change per minute */
+} ReportRules_Rule_t;
+
+/**
+  * @brief Rules of all metrics
+  */
+typedef struct
+{
+  ReportRules_Rule_t rule[REPORT_METRIC_COUNT];
+  uint32_t heartbeat;           /*!< Longest time without report, ms, 0 disables it */
+} ReportRules_Config_t;
+
+/**
+  * @brief One sample
+  */
+typedef struct
+{
+  float value[REPORT_METRIC_COUNT];
+  uint8_t validMask;            /*!< Bit m set when value[m] is valid */
+  uint8_t hardwareAlarm;        /*!< Bit m set when the sensor of metric m is in alarm */
+} ReportRules_Sample_t;
+
+/**
+  * @brief Rules and their state
+  */
+typedef struct
+{
+  ReportRules_Config_t config;
+  int32_t reported[REPORT_METRIC_COUNT];  /*!< Value of the last report */
+  int32_t previous[REPORT_METRIC_COUNT];  /*!< Value of the previous sample */
+  uint32_t previousTime[REPORT_METRIC_COUNT];
+  uint8_t reportedMask;         /*!< Bit m set when reported[m] is valid */
+  uint8_t previousMask;         /*!< Bit m set when previous[m] is valid */
+  uint8_t alarmHigh;            /*!< Bit m set while metric m is above high */
+  uint8_t alarmLow;             /*!< Bit m set while metric m is below low */
+  bool hasReported;             /*!< lastReportTime is valid */
+  uint32_t lastReportTime;
+  uint32_t pending;             /*!< Triggers not yet reported */
+} ReportRules_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  Set the rules and forget the state
+  * @param  rules rules
+  * @param  config configuration
+  */
+void ReportRules_Init(ReportRules_t *rules, const ReportRules_Config_t *config);
+
+/**
+  * @brief  Change the rules, keeping the state
+  * @param  rules rules
+  * @param  config configuration
+  */
+void ReportRules_Configure(ReportRules_t *rules, const ReportRules_Config_t *config);
+
+/**
+  * @brief  Evaluate a sample
+  * @param  rules rules
+  * @param  sample sample
+  * @param  now time of the sample, ms
+  * @retval pending triggers, 0 if the sample need not be reported
+  */
+uint32_t ReportRules_Evaluate(ReportRules_t *rules, const ReportRules_Sample_t *sample, uint32_t now);
+
+/**
+  * @brief  Record that a sample was reported, clears the pending triggers
+  * @param  rules rules
+  * @param  sample sample carried by the uplink
+  * @param  now time of the uplink, ms
+  */
+void ReportRules_Reported(ReportRules_t *rules, const ReportRules_Sample_t *sample, uint32_t now);
+
+/**
+  * @brief  Fixed-point value of a metric
+  * @param  metric metric
+  * @param  value value in the metric unit
+  * @retval value in REPORT_RULES_SCALE_xxx steps
+  */
+int32_t ReportRules_Scale(ReportRules_Metric_t metric, float value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __REPORT_RULES_H__ */
@@ -0,0 +1,278 @@
+/**
+  ******************************************************************************
+  * @file    sample_batch.c
+  * @brief   Ring buffer of timestamped sensor records sent as batched uplinks
+  * @note    See sample_batch.h for the frame layout.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "sample_batch.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/**
+  * @brief Resolution of a channel: raw = (value - offset) * scale
+  */
+typedef struct
+{
+  float scale;
+  float offset;
+} SampleBatch_Scale_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const SampleBatch_Scale_t Scale[SAMPLE_BATCH_CHANNEL_COUNT] =
+{
+  [SAMPLE_BATCH_WATER_TEMPERATURE] = { 100.0f, 0.0f },
+  [SAMPLE_BATCH_PH]                = { 100.0f, 0.0f },
+  [SAMPLE_BATCH_TDS]               = { 1.0f, 0.0f },
+  [SAMPLE_BATCH_THERMAL_MAX]       = { 4.0f, 0.0f },
+  [SAMPLE_BATCH_AIR_TEMPERATURE]   = { 10.0f, 0.0f },
+  [SAMPLE_BATCH_HUMIDITY]          = { 2.0f, 0.0f },
+  [SAMPLE_BATCH_PRESSURE]          = { 10.0f, 1000.0f },
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t SampleBatch_PutVarint(uint8_t *out, int32_t value);
+static int SampleBatch_GetVarint(const uint8_t *in, uint16_t len, uint16_t *pos, int32_t *value);
+
+/* Exported functions --------------------------------------------------------*/
+void SampleBatch_Init(SampleBatch_t *batch)
+{
+  batch->first = 0;
+  batch->count = 0;
+  batch->lost = false;
+}
+
+void SampleBatch_Push(SampleBatch_t *batch, uint32_t time, const float *value, uint8_t validMask)
+{
+  SampleBatch_Record_t *record;
+  float raw;
+
+  if (batch->count == SAMPLE_BATCH_CAPACITY)
+  {
+    batch->first = (uint8_t)((batch->first + 1) % SAMPLE_BATCH_CAPACITY);
+    batch->count--;
+    batch->lost = true;
+  }
+  record = &batch->record[(batch->first + batch->count) % SAMPLE_BATCH_CAPACITY];
+  batch->count++;
+
+  record->time = time;
+  record->validMask = validMask & ((1U << SAMPLE_BATCH_CHANNEL_COUNT) - 1U);
+  for (uint8_t c = 0; c < SAMPLE_BATCH_CHANNEL_COUNT; c++)
+  {
+    raw = (value[c] - Scale[c].offset) * Scale[c].scale;
+    raw = (raw >= 0.0f) ? (raw + 0.5f) : (raw - 0.5f);
+    if (raw > 32767.0f)
+    {
+      raw = 32767.0f;
+    }
+    else if (raw < -32768.0f)
+    {
+      raw = -32768.0f;
+    }
+    record->value[c] = ((record->validMask & (1U << c)) != 0) ? (int16_t)raw : 0;
+  }
+}
+
+uint8_t SampleBatch_Count(const SampleBatch_t *batch)
+{
+  return batch->count;
+}
+
+int SampleBatch_Encode(const SampleBatch_t *batch, const uint16_t *ack, uint8_t *out, uint16_t outSize,
+                       uint8_t *count)
+{
+  const SampleBatch_Record_t *record;
+  uint8_t encoded[SAMPLE_BATCH_RECORD_MAX_SIZE];
+  int16_t last[SAMPLE_BATCH_CHANNEL_COUNT];
+  uint8_t seenMask = 0;
+  uint32_t previousTime;
+  uint16_t pos = 0;
+  uint8_t size;
+  uint8_t n;
+
+  *count = 0;
+  if ((batch->count == 0) ||
+      (outSize < (SAMPLE_BATCH_HEADER_SIZE + ((ack != NULL) ? SAMPLE_BATCH_ACK_SIZE : 0))))
+  {
+    return -1;
+  }
+
+  previousTime = batch->record[batch->first].time;
+  out[pos++] = SAMPLE_BATCH_ID;
+  out[pos++] = (uint8_t)(((ack != NULL) ? SAMPLE_BATCH_FLAG_ACK : 0) | (batch->lost ? SAMPLE_BATCH_FLAG_LOST : 0));
+  if (ack != NULL)
+  {
+    out[pos++] = (uint8_t)(*ack >> 8);
+    out[pos++] = (uint8_t)*ack;
+  }
+  out[pos++] = (uint8_t)(previousTime >> 24);
+  out[pos++] = (uint8_t)(previousTime >> 16);
+  out[pos++] = (uint8_t)(previousTime >> 8);
+  out[pos++] = (uint8_t)previousTime;
+  pos++;    /* record count, written last */
+
+  for (n = 0; n < batch->count; n++)
+  {
+    record = &batch->record[(batch->first + n) % SAMPLE_BATCH_CAPACITY];
+
+    /* Encode aside, the record goes in only if it fits whole */
+    size = SampleBatch_PutVarint(encoded, (int32_t)(record->time - previousTime));
+    encoded[size++] = record->validMask;
+    for (uint8_t c = 0; c < SAMPLE_BATCH_CHANNEL_COUNT; c++)
+    {
+      if ((record->validMask & (1U << c)) != 0)
+      {
+        size += SampleBatch_PutVarint(&encoded[size], ((seenMask & (1U << c)) != 0) ?
+                                      ((int32_t)record->value[c] - last[c]) : record->value[c]);
+      }
+    }
+    if ((pos + size) > outSize)
+    {
+      break;
+    }
+
+    memcpy(&out[pos], encoded, size);
+    pos += size;
+    previousTime = record->time;
+    for (uint8_t c = 0; c < SAMPLE_BATCH_CHANNEL_COUNT; c++)
+    {
+      if ((record->validMask & (1U << c)) != 0)
+      {
+        last[c] = record->value[c];
+        seenMask |= (uint8_t)(1U << c);
+      }
+    }
+  }
+
+  if (n == 0)
+  {
+    return -1;
+  }
+  out[(ack != NULL) ? (SAMPLE_BATCH_HEADER_SIZE + SAMPLE_BATCH_ACK_SIZE - 1) : (SAMPLE_BATCH_HEADER_SIZE - 1)] = n;
+  *count = n;
+  return pos;
+}
+
+void SampleBatch_Drop(SampleBatch_t *batch, uint8_t count)
+{
+  if (count > batch->count)
+  {
+    count = batch->count;
+  }
+  batch->first = (uint8_t)((batch->first + count) % SAMPLE_BATCH_CAPACITY);
+  batch->count -= count;
+  batch->lost = false;
+}
+
+int SampleBatch_Decode(const uint8_t *in, uint16_t len, SampleBatch_Frame_t *frame,
+                       SampleBatch_Record_t *records, uint8_t maxRecords)
+{
+  SampleBatch_Record_t *record;
+  int16_t last[SAMPLE_BATCH_CHANNEL_COUNT] = { 0 };
+  uint16_t pos = 2;
+  uint32_t time;
+  int32_t value;
+
+  if ((len < SAMPLE_BATCH_HEADER_SIZE) || (in[0] != SAMPLE_BATCH_ID))
+  {
+    return -1;
+  }
+  frame->flags = in[1];
+  frame->ack = 0;
+  if ((frame->flags & SAMPLE_BATCH_FLAG_ACK) != 0)
+  {
+    if (len < (SAMPLE_BATCH_HEADER_SIZE + SAMPLE_BATCH_ACK_SIZE))
+    {
+      return -1;
+    }
+    frame->ack = (uint16_t)((in[2] << 8) | in[3]);
+    pos += SAMPLE_BATCH_ACK_SIZE;
+  }
+  time = ((uint32_t)in[pos] << 24) | ((uint32_t)in[pos + 1] << 16) | ((uint32_t)in[pos + 2] << 8) | in[pos + 3];
+  pos += 4;
+  frame->count = in[pos++];
+  if (frame->count > maxRecords)
+  {
+    return -1;
+  }
+
+  for (uint8_t n = 0; n < frame->count; n++)
+  {
+    record = &records[n];
+    if ((SampleBatch_GetVarint(in, len, &pos, &value) != 0) || (pos >= len))
+    {
+      return -1;
+    }
+    time += (uint32_t)value;
+    record->time = time;
+    record->validMask = in[pos++];
+    for (uint8_t c = 0; c < SAMPLE_BATCH_CHANNEL_COUNT; c++)
+    {
+      record->value[c] = 0;
+      if ((record->validMask & (1U << c)) != 0)
+      {
+        if (SampleBatch_GetVarint(in, len, &pos, &value) != 0)
+        {
+          return -1;
+        }
+        /* last[] is 0 before the first occurrence, the raw value is sent */
+        last[c] = (int16_t)(last[c] + value);
+        record->value[c] = last[c];
+      }
+    }
+  }
+
+  return 0;
+}
+
+float SampleBatch_GetValue(const SampleBatch_Record_t *record, SampleBatch_Channel_t channel)
+{
+  return ((float)record->value[channel] / Scale[channel].scale) + Scale[channel].offset;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Write a zigzag varint
+  * @retval number of bytes written, 1..5
+  */
+static uint8_t SampleBatch_PutVarint(uint8_t *out, int32_t value)
+{
+  uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+  uint8_t size = 0;
+
+  while (zigzag >= 0x80U)
+  {
+    out[size++] = (uint8_t)(zigzag | 0x80U);
+    zigzag >>= 7;
+  }
+  out[size++] = (uint8_t)zigzag;
+  return size;
+}
+
+/**
+  * @brief  Read a zigzag varint
+  * @retval 0 if successful, -1 if truncated or too long
+  */
+static int SampleBatch_GetVarint(const uint8_t *in, uint16_t len, uint16_t *pos, int32_t *value)
+{
+  uint32_t zigzag = 0;
+  uint8_t shift = 0;
+  uint8_t byte;
+
+  do
+  {
+    if ((*pos >= len) || (shift > 28))
+    {
+      return -1;
+    }
+    byte = in[(*pos)++];
+    zigzag |= (uint32_t)(byte & 0x7FU) << shift;
+    shift += 7;
+  } while ((byte & 0x80U) != 0);
+
+  *value = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1U);
+  return 0;
+}
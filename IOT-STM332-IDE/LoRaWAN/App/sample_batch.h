@@ -0,0 +1,181 @@
+/**
+  ******************************************************************************
+  * @file    sample_batch.h
+  * @brief   Ring buffer of timestamped sensor records sent as batched uplinks
+  * @note    Batch frame layout (multi-byte values are big-endian):
+  *            - byte 0: SAMPLE_BATCH_ID
+  *            - u8 flags (SAMPLE_BATCH_FLAG_xxx), then u16 command ack
+  *              (sequence << 8 | failed mask, see downlink_cmd.h) when
+  *              SAMPLE_BATCH_FLAG_ACK is set
+  *            - u32 time of the first record, s (SysTimeGet())
+  *            - u8 number of records
+  *            - each record, oldest first:
+  *                - time since the previous record, s, as a zigzag varint
+  *                - u8 mask of the channels present
+  *                - each present channel, in channel order, as a zigzag
+  *                  varint: the raw value for the first occurrence of the
+  *                  channel in the frame, the change since its previous
+  *                  occurrence after that
+  *          Varints are little-endian base 128, zigzag maps 0, -1, 1, -2 to
+  *          0, 1, 2, 3. A raw value is value * scale, rounded and saturated
+  *          to 16 bits, with the scales of SampleBatch_Channel_t.
+  *          When the ring is full the oldest record is overwritten and the
+  *          next frame has SAMPLE_BATCH_FLAG_LOST set.
+  *          The file has no hardware dependency.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SAMPLE_BATCH_H__
+#define __SAMPLE_BATCH_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+/**
+  * @brief Records held in RAM
+  */
+#define SAMPLE_BATCH_CAPACITY           32
+
+/**
+  * @brief First byte of every batch frame
+  */
+#define SAMPLE_BATCH_ID                 0x01
+
+/**
+  * @brief Size of the frame header without and with the command ack
+  */
+#define SAMPLE_BATCH_HEADER_SIZE        7
+#define SAMPLE_BATCH_ACK_SIZE           2
+
+/**
+  * @brief Largest encoded record: time, mask and 3 bytes per channel
+  */
+#define SAMPLE_BATCH_RECORD_MAX_SIZE    (5 + 1 + 3 * SAMPLE_BATCH_CHANNEL_COUNT)
+
+/**
+  * @brief Frame flags
+  */
+#define SAMPLE_BATCH_FLAG_ACK           (1U << 0)   /*!< Command ack follows the flags */
+#define SAMPLE_BATCH_FLAG_LOST          (1U << 1)   /*!< Records were overwritten since the last frame */
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief Channels of a record, with their resolution
+  */
+typedef enum
+{
+  SAMPLE_BATCH_WATER_TEMPERATURE = 0,   /*!< 0.01 degC */
+  SAMPLE_BATCH_PH,                      /*!< 0.01 */
+  SAMPLE_BATCH_TDS,                     /*!< 1 ppm */
+  SAMPLE_BATCH_THERMAL_MAX,             /*!< 0.25 degC */
+  SAMPLE_BATCH_AIR_TEMPERATURE,         /*!< 0.1 degC */
+  SAMPLE_BATCH_HUMIDITY,                /*!< 0.5 % */
+  SAMPLE_BATCH_PRESSURE,                /*!< 0.1 hPa from 1000 hPa */
+  SAMPLE_BATCH_CHANNEL_COUNT
+} SampleBatch_Channel_t;
+
+/**
+  * @brief One record, raw values
+  */
+typedef struct
+{
+  uint32_t time;                /*!< s */
+  int16_t value[SAMPLE_BATCH_CHANNEL_COUNT];
+  uint8_t validMask;            /*!< Bit n set when value[n] is valid */
+} SampleBatch_Record_t;
+
+/**
+  * @brief Ring of records
+  */
+typedef struct
+{
+  SampleBatch_Record_t record[SAMPLE_BATCH_CAPACITY];
+  uint8_t first;                /*!< Index of the oldest record */
+  uint8_t count;
+  bool lost;                    /*!< A record was overwritten since the last SampleBatch_Drop() */
+} SampleBatch_t;
+
+/**
+  * @brief Header of a decoded frame
+  */
+typedef struct
+{
+  uint8_t flags;                /*!< SAMPLE_BATCH_FLAG_xxx */
+  uint16_t ack;                 /*!< Command ack when SAMPLE_BATCH_FLAG_ACK is set */
+  uint8_t count;                /*!< Records decoded */
+} SampleBatch_Frame_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  Empty a ring
+  * @param  batch ring
+  */
+void SampleBatch_Init(SampleBatch_t *batch);
+
+/**
+  * @brief  Add a record, overwriting the oldest one when the ring is full
+  * @param  batch ring
+  * @param  time time of the sample, s
+  * @param  value values in the channel units, SAMPLE_BATCH_CHANNEL_COUNT entries
+  * @param  validMask bit n set when value[n] is valid
+  */
+void SampleBatch_Push(SampleBatch_t *batch, uint32_t time, const float *value, uint8_t validMask);
+
+/**
+  * @brief  Number of records in the ring
+  * @param  batch ring
+  * @retval count
+  */
+uint8_t SampleBatch_Count(const SampleBatch_t *batch);
+
+/**
+  * @brief  Encode the oldest records that fit in a frame size
+  * @param  batch ring, unchanged
+  * @param  ack command ack to carry, NULL if none
+  * @param  out output buffer
+  * @param  outSize largest frame size
+  * @param  count number of records encoded
+  * @retval number of bytes written, -1 if not even one record fits
+  */
+int SampleBatch_Encode(const SampleBatch_t *batch, const uint16_t *ack, uint8_t *out, uint16_t outSize,
+                       uint8_t *count);
+
+/**
+  * @brief  Remove the oldest records, once their frame is sent
+  * @param  batch ring
+  * @param  count number of records
+  */
+void SampleBatch_Drop(SampleBatch_t *batch, uint8_t count);
+
+/**
+  * @brief  Decode a frame
+  * @param  in frame
+  * @param  len length of the frame
+  * @param  frame decoded header
+  * @param  records decoded records
+  * @param  maxRecords size of records
+  * @retval 0 if successful, -1 if the frame is malformed or has too many records
+  */
+int SampleBatch_Decode(const uint8_t *in, uint16_t len, SampleBatch_Frame_t *frame,
+                       SampleBatch_Record_t *records, uint8_t maxRecords);
+
+/**
+  * @brief  Value of a raw channel
+  * @param  record record
+  * @param  channel channel
+  * @retval value in the channel units
+  */
+float SampleBatch_GetValue(const SampleBatch_Record_t *record, SampleBatch_Channel_t channel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SAMPLE_BATCH_H__ */
@@ -0,0 +1,282 @@
+/**
+  ******************************************************************************
+  * @file    sensor_acq.c
+  * @brief   Non-blocking sensor acquisition state machine
+  * @note    A cycle is:
+  *            - Start: read the environmental sensors, start the AMG8833
+  *              frame capture and the DS18B20 conversion.
+  *            - Both drivers collect their data in the background and call
+  *              back; each callback marks its step ready and schedules the
+  *              acquisition task.
+  *            - Once the water temperature is known (pH/TDS use it for
+  *              compensation) a series of DMA scans of the analog channels
+  *              feeds the ADC filters; pH/TDS are computed from the filter
+  *              outputs when it calls back.
+  *            - When no step is pending, the completion callback is invoked.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "platform.h"
+#include "sys_app.h"
+#include "stm32_seq.h"
+#include "stm32_timer.h"
+#include "utilities_conf.h"
+#include "utilities_def.h"
+#include "sensor_acq.h"
+#include "adc_if.h"
+
+#include "amg8833.h"
+#include "dev_conf.h"
+#include "ds18b20.h"
+#include "ph_sensor.h"
+#include "tds_sensor.h"
+
+/* Private define ------------------------------------------------------------*/
+/**
+  * @brief Acquisition steps that complete asynchronously
+  */
+#define SENSOR_ACQ_STEP_THERMAL         (1U << 0)
+#define SENSOR_ACQ_STEP_WATER_TEMP      (1U << 1)
+#define SENSOR_ACQ_STEP_ANALOG          (1U << 2)
+
+/**
+  * @brief Scans run for the pH/TDS filters, about 2.8 ms each
+  */
+#define SENSOR_ACQ_ANALOG_SCANS         16
+
+/* Private variables ---------------------------------------------------------*/
+/**
+  * @brief Snapshot being filled by the current cycle
+  */
+static SensorAcq_Snapshot_t Snapshot;
+
+/**
+  * @brief Steps started but not yet collected
+  */
+static uint32_t PendingSteps = 0;
+
+/**
+  * @brief Steps whose wait has elapsed, set from timer context
+  */
+static volatile uint32_t ReadySteps = 0;
+
+/**
+  * @brief Completion callback
+  */
+static SensorAcq_Callback_t OnComplete = NULL;
+
+/* Private function prototypes -----------------------------------------------*/
+static void SensorAcq_Process(void);
+static void SensorAcq_SetReady(uint32_t step);
+static void SensorAcq_OnThermalFrame(HAL_StatusTypeDef status, const int16_t *frame);
+static void SensorAcq_OnWaterTemp(DS18B20_Status_t status, float temperature);
+static void SensorAcq_OnAnalogScan(const ADC_Snapshot_t *snapshot);
+static void SensorAcq_CollectAnalog(void);
+
+/* Exported functions --------------------------------------------------------*/
+void SensorAcq_Init(SensorAcq_Callback_t onComplete)
+{
+  OnComplete = onComplete;
+
+  UTIL_SEQ_RegTask((1 << CFG_SEQ_Task_SensorAcqProcess), UTIL_SEQ_RFU, SensorAcq_Process);
+
+  if (AMG8833_Init() == HAL_OK)
+  {
+    /* Keep the camera asleep between acquisitions */
+    AMG8833_Sleep();
+  }
+  else
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "AMG8833 init failed\r\n");
+  }
+
+  if (DS18B20_Init() != DS18B20_OK)
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "DS18B20 not detected\r\n");
+  }
+
+  if ((pH_Init() != HAL_OK) || (TDS_Init() != HAL_OK))
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "ADC not ready for pH/TDS\r\n");
+  }
+}
+
+bool SensorAcq_Start(void)
+{
+  if (PendingSteps != 0)
+  {
+    return false;
+  }
+
+  memset(&Snapshot, 0, sizeof(Snapshot));
+  ReadySteps = 0;
+  PendingSteps = SENSOR_ACQ_STEP_THERMAL | SENSOR_ACQ_STEP_WATER_TEMP;
+
+  /* Environmental sensors answer immediately */
+  EnvSensors_Read(&Snapshot.env);
+
+  /* AMG8833: wake up and capture, the driver calls back with the first settled frame */
+  if (AMG8833_StartCapture(SensorAcq_OnThermalFrame) != HAL_OK)
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "Error waking up AMG8833\r\n");
+    SensorAcq_SetReady(SENSOR_ACQ_STEP_THERMAL);
+  }
+
+  /* DS18B20: the driver collects the conversion and calls back */
+  if (DS18B20_StartConversionAsync(SensorAcq_OnWaterTemp) != DS18B20_OK)
+  {
+    SensorAcq_SetReady(SENSOR_ACQ_STEP_WATER_TEMP);
+  }
+
+  return true;
+}
+
+bool SensorAcq_IsBusy(void)
+{
+  return (PendingSteps != 0);
+}
+
+/* Private functions ---------------------------------------------------------*/
+static void SensorAcq_SetReady(uint32_t step)
+{
+  UTILS_ENTER_CRITICAL_SECTION();
+  ReadySteps |= step;
+  UTILS_EXIT_CRITICAL_SECTION();
+
+  UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_SensorAcqProcess), CFG_SEQ_Prio_0);
+}
+
+static void SensorAcq_OnThermalFrame(HAL_StatusTypeDef status, const int16_t *frame)
+{
+  int size;
+
+  /* One frame per cycle */
+  AMG8833_StopCapture();
+
+  if (status != HAL_OK)
+  {
+    APP_LOG(TS_ON, VLEVEL_L, "Error reading AMG8833 data: %d\r\n", status);
+  }
+  else
+  {
+    AMG8833_GetStats(&Snapshot.thermalMin, &Snapshot.thermalMax, &Snapshot.thermalAvg);
+    Snapshot.validMask |= SENSOR_ACQ_VALID_THERMAL;
+
+    size = AMG8833_PrepareCompressedData(Snapshot.thermalImage, sizeof(Snapshot.thermalImage), 0);
+    if (size > 0)
+    {
+      Snapshot.thermalImageSize = (uint8_t)size;
+      Snapshot.validMask |= SENSOR_ACQ_VALID_THERMAL_IMAGE;
+    }
+    else
+    {
+      APP_LOG(TS_ON, VLEVEL_L, "Error preparing thermal image data\r\n");
+    }
+
+    /* The flag covers the frames of this capture, read it before sleeping */
+    if (AMG8833_ReadInterrupt(&Snapshot.thermalAlarm) == HAL_OK)
+    {
+      Snapshot.validMask |= SENSOR_ACQ_VALID_THERMAL_ALARM;
+    }
+  }
+
+  /* Put AMG8833 back to sleep to save power */
+  AMG8833_Sleep();
+
+  SensorAcq_SetReady(SENSOR_ACQ_STEP_THERMAL);
+}
+
+static void SensorAcq_OnWaterTemp(DS18B20_Status_t status, float temperature)
+{
+  const DS18B20_Probe_t *probe;
+
+  if (status == DS18B20_OK)
+  {
+    Snapshot.waterTemperature = temperature;
+    Snapshot.validMask |= SENSOR_ACQ_VALID_WATER_TEMP;
+  }
+
+  /* All probes converted in the same window */
+  Snapshot.waterProbeCount = DS18B20_GetProbeCount();
+  for (uint8_t i = 0; (i < Snapshot.waterProbeCount) && (i < SENSOR_ACQ_WATER_PROBES); i++)
+  {
+    probe = DS18B20_GetProbe(i);
+    if ((probe != NULL) && probe->valid)
+    {
+      Snapshot.waterProfile[i] = probe->temperature;
+      Snapshot.waterProfileMask |= (1U << i);
+    }
+  }
+  SensorAcq_SetReady(SENSOR_ACQ_STEP_WATER_TEMP);
+}
+
+static void SensorAcq_OnAnalogScan(const ADC_Snapshot_t *snapshot)
+{
+  /* The pH/TDS drivers pick the snapshot up with ADC_ScanGetLast() */
+  UNUSED(snapshot);
+
+  SensorAcq_SetReady(SENSOR_ACQ_STEP_ANALOG);
+}
+
+static void SensorAcq_Process(void)
+{
+  uint32_t ready;
+
+  UTILS_ENTER_CRITICAL_SECTION();
+  ready = ReadySteps & PendingSteps;
+  ReadySteps &= ~ready;
+  UTILS_EXIT_CRITICAL_SECTION();
+
+  if ((ready & SENSOR_ACQ_STEP_WATER_TEMP) != 0)
+  {
+    PendingSteps &= ~SENSOR_ACQ_STEP_WATER_TEMP;
+    PendingSteps |= SENSOR_ACQ_STEP_ANALOG;
+    if (ADC_ScanStartSeries(SENSOR_ACQ_ANALOG_SCANS, SensorAcq_OnAnalogScan) != HAL_OK)
+    {
+      /* Busy or failed: the pH/TDS drivers read the channels themselves */
+      SensorAcq_SetReady(SENSOR_ACQ_STEP_ANALOG);
+    }
+  }
+
+  if ((ready & SENSOR_ACQ_STEP_ANALOG) != 0)
+  {
+    SensorAcq_CollectAnalog();
+    PendingSteps &= ~SENSOR_ACQ_STEP_ANALOG;
+  }
+
+  if ((ready & SENSOR_ACQ_STEP_THERMAL) != 0)
+  {
+    PendingSteps &= ~SENSOR_ACQ_STEP_THERMAL;
+  }
+
+  if ((ready != 0) && (PendingSteps == 0) && (OnComplete != NULL))
+  {
+    OnComplete(&Snapshot);
+  }
+}
+
+static void SensorAcq_CollectAnalog(void)
+{
+  float compensationTemp = PH_REFERENCE_TEMP;
+
+  if ((Snapshot.validMask & SENSOR_ACQ_VALID_WATER_TEMP) != 0)
+  {
+    compensationTemp = Snapshot.waterTemperature;
+  }
+
+  pH_ReadingTypeDef ph = pH_ReadSensor(compensationTemp);
+  if (pH_IsReadingValid(ph))
+  {
+    Snapshot.phValue = ph.phValue;
+    Snapshot.validMask |= SENSOR_ACQ_VALID_PH;
+  }
+
+  TDS_ReadingTypeDef tds = TDS_ReadSensor(compensationTemp);
+  if (TDS_IsReadingValid(tds))
+  {
+    Snapshot.tdsValue = tds.tdsValue;
+    Snapshot.validMask |= SENSOR_ACQ_VALID_TDS;
+  }
+}
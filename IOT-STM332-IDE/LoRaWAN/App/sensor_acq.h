@@ -0,0 +1,91 @@
+/**
+  ******************************************************************************
+  * @file    sensor_acq.h
+  * @brief   Non-blocking sensor acquisition state machine
+  * @note    Sensor settle/conversion times are waited with UTIL_TIMER one-shots
+  *          and each step is resumed from a UTIL_SEQ task, so the sequencer
+  *          keeps running (and the MCU may enter Stop mode) during the waits.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SENSOR_ACQ_H__
+#define __SENSOR_ACQ_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "sys_sensors.h"
+#include "thermal_codec.h"
+
+/* Exported constants --------------------------------------------------------*/
+/**
+  * @brief Bits of SensorAcq_Snapshot_t.validMask
+  */
+#define SENSOR_ACQ_VALID_WATER_TEMP     (1U << 0)
+#define SENSOR_ACQ_VALID_PH             (1U << 1)
+#define SENSOR_ACQ_VALID_TDS            (1U << 2)
+#define SENSOR_ACQ_VALID_THERMAL        (1U << 3)
+#define SENSOR_ACQ_VALID_THERMAL_IMAGE  (1U << 4)
+#define SENSOR_ACQ_VALID_THERMAL_ALARM  (1U << 5)
+
+/**
+  * @brief Maximum number of water temperature probes (depth profile)
+  */
+#define SENSOR_ACQ_WATER_PROBES         4
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief Result of one complete acquisition cycle
+  */
+typedef struct
+{
+  sensor_t env;                 /*!< Environmental sensors (IKS01A2) */
+  float waterTemperature;       /*!< DS18B20 water temperature in degC (first valid probe) */
+  float waterProfile[SENSOR_ACQ_WATER_PROBES]; /*!< Temperature of each DS18B20 probe in degC */
+  uint8_t waterProfileMask;     /*!< Bit n set when waterProfile[n] is valid */
+  uint8_t waterProbeCount;      /*!< Number of DS18B20 probes on the bus */
+  float phValue;                /*!< Temperature compensated pH */
+  float tdsValue;               /*!< Temperature compensated TDS in ppm */
+  float thermalMin;             /*!< AMG8833 minimum pixel temperature in degC */
+  float thermalMax;             /*!< AMG8833 maximum pixel temperature in degC */
+  float thermalAvg;             /*!< AMG8833 average pixel temperature in degC */
+  uint8_t thermalImage[THERMAL_CODEC_MAX_SIZE]; /*!< Thermal frame encoded by thermal_codec */
+  uint8_t thermalImageSize;     /*!< Number of valid bytes in thermalImage */
+  bool thermalAlarm;            /*!< AMG8833 interrupt flag, a pixel was outside the interrupt levels */
+  uint32_t validMask;           /*!< SENSOR_ACQ_VALID_xxx bits of the fields above */
+} SensorAcq_Snapshot_t;
+
+/**
+  * @brief Called from the sequencer once every sensor has reported
+  */
+typedef void (*SensorAcq_Callback_t)(const SensorAcq_Snapshot_t *snapshot);
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  Initialize the sensors and register the acquisition sequencer task
+  * @param  onComplete callback invoked when an acquisition cycle completes
+  */
+void SensorAcq_Init(SensorAcq_Callback_t onComplete);
+
+/**
+  * @brief  Start an acquisition cycle
+  * @retval false if a cycle is already in progress
+  */
+bool SensorAcq_Start(void);
+
+/**
+  * @brief  Check whether an acquisition cycle is in progress
+  * @retval true if busy
+  */
+bool SensorAcq_IsBusy(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SENSOR_ACQ_H__ */
@@ -0,0 +1,342 @@
+/**
+  ******************************************************************************
+  * @file    sensor_payload.c
+  * @brief   Schema-driven bit-packed uplink payload of the water-quality node
+  * @note    See sensor_payload.h for the frame layout.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "sensor_payload.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/**
+  * @brief Bit cursor over a byte buffer, MSB first
+  */
+typedef struct
+{
+  uint8_t *out;
+  const uint8_t *in;
+  uint16_t size;
+  uint32_t bitPos;
+} SensorPayload_Bits_t;
+
+/* Private variables ---------------------------------------------------------*/
+/**
+  * @brief Schema SENSOR_PAYLOAD_SCHEMA_ID, indexed by field id
+  */
+static const SensorPayload_Schema_t Schema[SENSOR_PAYLOAD_FIELD_COUNT] =
+{
+  [SENSOR_PAYLOAD_PRESSURE]            = { 10, false, 1.0f,   300.0f, 3 },  /* 1 hPa, 300..1323 */
+  [SENSOR_PAYLOAD_AIR_TEMPERATURE]     = { 11, false, 10.0f,  -40.0f, 3 },  /* 0.1 degC, -40..164.7 */
+  [SENSOR_PAYLOAD_HUMIDITY]            = {  7, false, 1.0f,   0.0f,   3 },  /* 1 %, 0..127 */
+  [SENSOR_PAYLOAD_WATER_TEMPERATURE]   = { 10, false, 10.0f,  -10.0f, 0 },  /* 0.1 degC, -10..92.3 */
+  [SENSOR_PAYLOAD_PH]                  = { 11, false, 100.0f, 0.0f,   0 },  /* 0.01, 0..20.47 */
+  [SENSOR_PAYLOAD_TDS]                 = { 12, false, 1.0f,   0.0f,   0 },  /* 1 ppm, 0..4095 */
+  [SENSOR_PAYLOAD_LATITUDE]            = { 24, true,  8388607.0f / 90.0f,  0.0f, 4 }, /* ~1.2 m */
+  [SENSOR_PAYLOAD_LONGITUDE]           = { 24, true,  8388607.0f / 180.0f, 0.0f, 4 }, /* ~2.4 m */
+  [SENSOR_PAYLOAD_WATER_QUALITY]       = {  2, false, 1.0f,   0.0f,   1 },  /* class 0..3 */
+  [SENSOR_PAYLOAD_THERMAL_MIN]         = {  9, false, 4.0f,   -20.0f, 5 },  /* 0.25 degC, -20..107.75 */
+  [SENSOR_PAYLOAD_THERMAL_MAX]         = {  9, false, 4.0f,   -20.0f, 5 },
+  [SENSOR_PAYLOAD_THERMAL_AVG]         = {  9, false, 4.0f,   -20.0f, 2 },
+  [SENSOR_PAYLOAD_WATER_TEMPERATURE_1] = { 10, false, 10.0f,  -10.0f, 6 },
+  [SENSOR_PAYLOAD_WATER_TEMPERATURE_2] = { 10, false, 10.0f,  -10.0f, 6 },
+  [SENSOR_PAYLOAD_WATER_TEMPERATURE_3] = { 10, false, 10.0f,  -10.0f, 6 },
+  [SENSOR_PAYLOAD_COMMAND_ACK]         = { 16, false, 1.0f,   0.0f,   0 },  /* sequence, failed commands */
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t SensorPayload_Quantize(const SensorPayload_Schema_t *schema, float value);
+static float SensorPayload_Dequantize(const SensorPayload_Schema_t *schema, uint32_t raw);
+static uint32_t SensorPayload_GetBits(const SensorPayload_t *payload);
+static int SensorPayload_Put(SensorPayload_Bits_t *bits, uint32_t value, uint8_t count);
+static int SensorPayload_Get(SensorPayload_Bits_t *bits, uint8_t count, uint32_t *value);
+
+/* Exported functions --------------------------------------------------------*/
+void SensorPayload_Init(SensorPayload_t *payload)
+{
+  memset(payload, 0, sizeof(*payload));
+}
+
+void SensorPayload_Set(SensorPayload_t *payload, SensorPayload_Field_t field, float value)
+{
+  if (field < SENSOR_PAYLOAD_FIELD_COUNT)
+  {
+    payload->value[field] = value;
+    payload->presentMask |= (1UL << field);
+  }
+}
+
+void SensorPayload_SetImage(SensorPayload_t *payload, const uint8_t *image, uint8_t size, uint8_t offset)
+{
+  payload->image = image;
+  payload->imageTotal = size;
+  payload->imageOffset = offset;
+  payload->imageSize = (offset < size) ? (uint8_t)(size - offset) : 0;
+  if ((image != NULL) && (payload->imageSize > 0))
+  {
+    payload->presentMask |= (1UL << SENSOR_PAYLOAD_THERMAL_IMAGE);
+  }
+  else
+  {
+    payload->presentMask &= ~(1UL << SENSOR_PAYLOAD_THERMAL_IMAGE);
+  }
+}
+
+uint16_t SensorPayload_GetSize(const SensorPayload_t *payload)
+{
+  uint16_t size = (uint16_t)((SensorPayload_GetBits(payload) + 7) / 8);
+
+  if ((payload->presentMask & (1UL << SENSOR_PAYLOAD_THERMAL_IMAGE)) != 0)
+  {
+    size += SENSOR_PAYLOAD_IMAGE_HEADER_SIZE + payload->imageSize;
+  }
+  return size;
+}
+
+bool SensorPayload_Fit(SensorPayload_t *payload, uint16_t maxSize)
+{
+  uint32_t imageBit = (1UL << SENSOR_PAYLOAD_THERMAL_IMAGE);
+  uint16_t fieldsSize;
+  int8_t lowest;
+
+  if (maxSize < SENSOR_PAYLOAD_HEADER_SIZE)
+  {
+    return false;
+  }
+
+  /* Drop the lowest priority field until the fields fit */
+  while ((fieldsSize = (uint16_t)((SensorPayload_GetBits(payload) + 7) / 8)) > maxSize)
+  {
+    lowest = -1;
+    for (uint8_t field = 0; field < SENSOR_PAYLOAD_FIELD_COUNT; field++)
+    {
+      if (((payload->presentMask & (1UL << field)) != 0) &&
+          ((lowest < 0) || (Schema[field].priority >= Schema[lowest].priority)))
+      {
+        lowest = (int8_t)field;
+      }
+    }
+    payload->presentMask &= ~(1UL << lowest);
+  }
+
+  /* The thermal image comes last and takes the room left */
+  if ((payload->presentMask & imageBit) != 0)
+  {
+    if ((fieldsSize + SENSOR_PAYLOAD_IMAGE_HEADER_SIZE) >= maxSize)
+    {
+      payload->presentMask &= ~imageBit;
+      payload->imageSize = 0;
+    }
+    else if ((fieldsSize + SENSOR_PAYLOAD_IMAGE_HEADER_SIZE + payload->imageSize) > maxSize)
+    {
+      payload->imageSize = (uint8_t)(maxSize - fieldsSize - SENSOR_PAYLOAD_IMAGE_HEADER_SIZE);
+    }
+  }
+
+  return true;
+}
+
+int SensorPayload_Encode(const SensorPayload_t *payload, uint8_t *out, uint16_t outSize)
+{
+  SensorPayload_Bits_t bits = { out, NULL, outSize, 0 };
+  uint16_t pos;
+
+  if ((SensorPayload_Put(&bits, SENSOR_PAYLOAD_SCHEMA_ID, 8) != 0) ||
+      (SensorPayload_Put(&bits, payload->presentMask, SENSOR_PAYLOAD_PRESENCE_BITS) != 0))
+  {
+    return -1;
+  }
+
+  for (uint8_t field = 0; field < SENSOR_PAYLOAD_FIELD_COUNT; field++)
+  {
+    if ((payload->presentMask & (1UL << field)) != 0)
+    {
+      if (SensorPayload_Put(&bits, SensorPayload_Quantize(&Schema[field], payload->value[field]),
+                            Schema[field].bits) != 0)
+      {
+        return -1;
+      }
+    }
+  }
+
+  /* The thermal frame stays byte aligned, it is copied as is */
+  pos = (uint16_t)((bits.bitPos + 7) / 8);
+  if ((payload->presentMask & (1UL << SENSOR_PAYLOAD_THERMAL_IMAGE)) != 0)
+  {
+    if ((pos + SENSOR_PAYLOAD_IMAGE_HEADER_SIZE + payload->imageSize) > outSize)
+    {
+      return -1;
+    }
+    out[pos++] = payload->imageOffset;
+    out[pos++] = payload->imageTotal;
+    memcpy(&out[pos], &payload->image[payload->imageOffset], payload->imageSize);
+    pos += payload->imageSize;
+  }
+
+  return pos;
+}
+
+int SensorPayload_Decode(const uint8_t *in, uint16_t len, SensorPayload_t *payload)
+{
+  SensorPayload_Bits_t bits = { NULL, in, len, 0 };
+  uint32_t raw;
+  uint16_t pos;
+
+  SensorPayload_Init(payload);
+
+  if ((SensorPayload_Get(&bits, 8, &raw) != 0) || (raw != SENSOR_PAYLOAD_SCHEMA_ID) ||
+      (SensorPayload_Get(&bits, SENSOR_PAYLOAD_PRESENCE_BITS, &payload->presentMask) != 0))
+  {
+    return -1;
+  }
+
+  for (uint8_t field = 0; field < SENSOR_PAYLOAD_FIELD_COUNT; field++)
+  {
+    if ((payload->presentMask & (1UL << field)) != 0)
+    {
+      if (SensorPayload_Get(&bits, Schema[field].bits, &raw) != 0)
+      {
+        return -1;
+      }
+      payload->value[field] = SensorPayload_Dequantize(&Schema[field], raw);
+    }
+  }
+
+  pos = (uint16_t)((bits.bitPos + 7) / 8);
+  if ((payload->presentMask & (1UL << SENSOR_PAYLOAD_THERMAL_IMAGE)) != 0)
+  {
+    if (((pos + SENSOR_PAYLOAD_IMAGE_HEADER_SIZE) >= len) ||
+        ((len - pos - SENSOR_PAYLOAD_IMAGE_HEADER_SIZE) > UINT8_MAX))
+    {
+      return -1;
+    }
+    payload->imageOffset = in[pos++];
+    payload->imageTotal = in[pos++];
+    payload->image = &in[pos];
+    payload->imageSize = (uint8_t)(len - pos);
+    if ((payload->imageOffset + payload->imageSize) > payload->imageTotal)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+const SensorPayload_Schema_t *SensorPayload_GetSchema(SensorPayload_Field_t field)
+{
+  return (field < SENSOR_PAYLOAD_FIELD_COUNT) ? &Schema[field] : NULL;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Fixed-point value of a field, rounded and saturated to its width
+  */
+static uint32_t SensorPayload_Quantize(const SensorPayload_Schema_t *schema, float value)
+{
+  float scaled = (value - schema->offset) * schema->scale;
+  int32_t lo = schema->isSigned ? -(1L << (schema->bits - 1)) : 0;
+  int32_t hi = schema->isSigned ? ((1L << (schema->bits - 1)) - 1) : ((1L << schema->bits) - 1);
+  int32_t raw;
+
+  if (scaled <= (float)lo)
+  {
+    raw = lo;
+  }
+  else if (scaled >= (float)hi)
+  {
+    raw = hi;
+  }
+  else
+  {
+    raw = (scaled >= 0.0f) ? (int32_t)(scaled + 0.5f) : (int32_t)(scaled - 0.5f);
+  }
+
+  return (uint32_t)raw & ((1UL << schema->bits) - 1);
+}
+
+/**
+  * @brief  Field value of a fixed-point value
+  */
+static float SensorPayload_Dequantize(const SensorPayload_Schema_t *schema, uint32_t raw)
+{
+  int32_t value = (int32_t)raw;
+
+  if (schema->isSigned && ((raw & (1UL << (schema->bits - 1))) != 0))
+  {
+    value -= (int32_t)(1UL << schema->bits);
+  }
+
+  return ((float)value / schema->scale) + schema->offset;
+}
+
+/**
+  * @brief  Number of bits before the thermal frame
+  */
+static uint32_t SensorPayload_GetBits(const SensorPayload_t *payload)
+{
+  uint32_t count = 8 + SENSOR_PAYLOAD_PRESENCE_BITS;
+
+  for (uint8_t field = 0; field < SENSOR_PAYLOAD_FIELD_COUNT; field++)
+  {
+    if ((payload->presentMask & (1UL << field)) != 0)
+    {
+      count += Schema[field].bits;
+    }
+  }
+  return count;
+}
+
+/**
+  * @brief  Append bits, MSB first
+  * @retval 0 if successful, -1 if the buffer is full
+  */
+static int SensorPayload_Put(SensorPayload_Bits_t *bits, uint32_t value, uint8_t count)
+{
+  while (count > 0)
+  {
+    uint32_t byte = bits->bitPos >> 3;
+    uint8_t room = 8 - (bits->bitPos & 7);
+    uint8_t n = (count < room) ? count : room;
+    uint8_t chunk = (uint8_t)((value >> (count - n)) & ((1U << n) - 1));
+
+    if (byte >= bits->size)
+    {
+      return -1;
+    }
+    if (room == 8)
+    {
+      bits->out[byte] = 0;
+    }
+    bits->out[byte] |= (uint8_t)(chunk << (room - n));
+    bits->bitPos += n;
+    count -= n;
+  }
+  return 0;
+}
+
+/**
+  * @brief  Read bits, MSB first
+  * @retval 0 if successful, -1 past the end of the frame
+  */
+static int SensorPayload_Get(SensorPayload_Bits_t *bits, uint8_t count, uint32_t *value)
+{
+  *value = 0;
+  while (count > 0)
+  {
+    uint32_t byte = bits->bitPos >> 3;
+    uint8_t left = 8 - (bits->bitPos & 7);
+    uint8_t n = (count < left) ? count : left;
+
+    if (byte >= bits->size)
+    {
+      return -1;
+    }
+    *value = (*value << n) | ((bits->in[byte] >> (left - n)) & ((1U << n) - 1));
+    bits->bitPos += n;
+    count -= n;
+  }
+  return 0;
+}
@@ -0,0 +1,173 @@
+/**
+  ******************************************************************************
+  * @file    sensor_payload.h
+  * @brief   Schema-driven bit-packed uplink payload of the water-quality node
+  * @note    Frame layout (bits are written MSB first):
+  *            - byte 0: schema id (SENSOR_PAYLOAD_SCHEMA_ID)
+  *            - presence mask, one bit per field id, field 0 first
+  *            - each present field, in field id order, as an unsigned
+  *              (or two's complement) fixed-point value of the width given
+  *              by the schema table: raw = (value - offset) * scale
+  *            - if SENSOR_PAYLOAD_THERMAL_IMAGE is present, the frame is
+  *              padded to a byte boundary and followed by a fragment of the
+  *              encoded thermal frame (thermal_codec.h): its offset in the
+  *              encoded frame, the encoded frame size, then the fragment
+  *              bytes up to the end of the frame
+  *          Values outside a field's range saturate. Any change to the table
+  *          must bump the schema id. The file has no hardware dependency so
+  *          the decoder can be built on a host.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SENSOR_PAYLOAD_H__
+#define __SENSOR_PAYLOAD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+/**
+  * @brief Version of the field table, first byte of every frame
+  */
+#define SENSOR_PAYLOAD_SCHEMA_ID        0x03
+
+/**
+  * @brief Size of the frame header (schema id and presence mask)
+  */
+#define SENSOR_PAYLOAD_HEADER_SIZE      4
+
+/**
+  * @brief Size of the thermal image fragment header (offset and total size)
+  */
+#define SENSOR_PAYLOAD_IMAGE_HEADER_SIZE 2
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief Field ids, also the bit of each field in the presence mask
+  */
+typedef enum
+{
+  SENSOR_PAYLOAD_PRESSURE = 0,          /*!< Barometric pressure, hPa */
+  SENSOR_PAYLOAD_AIR_TEMPERATURE,       /*!< Air temperature, degC */
+  SENSOR_PAYLOAD_HUMIDITY,              /*!< Relative humidity, % */
+  SENSOR_PAYLOAD_WATER_TEMPERATURE,     /*!< Water temperature of the first probe, degC */
+  SENSOR_PAYLOAD_PH,                    /*!< pH */
+  SENSOR_PAYLOAD_TDS,                   /*!< Total dissolved solids, ppm */
+  SENSOR_PAYLOAD_LATITUDE,              /*!< Latitude, degrees */
+  SENSOR_PAYLOAD_LONGITUDE,             /*!< Longitude, degrees */
+  SENSOR_PAYLOAD_WATER_QUALITY,         /*!< TDS water quality class (0..3, 3 is Poor or worse) */
+  SENSOR_PAYLOAD_THERMAL_MIN,           /*!< AMG8833 minimum pixel temperature, degC */
+  SENSOR_PAYLOAD_THERMAL_MAX,           /*!< AMG8833 maximum pixel temperature, degC */
+  SENSOR_PAYLOAD_THERMAL_AVG,           /*!< AMG8833 average pixel temperature, degC */
+  SENSOR_PAYLOAD_WATER_TEMPERATURE_1,   /*!< Water temperature of the deeper probes, degC */
+  SENSOR_PAYLOAD_WATER_TEMPERATURE_2,
+  SENSOR_PAYLOAD_WATER_TEMPERATURE_3,
+  SENSOR_PAYLOAD_COMMAND_ACK,           /*!< Acknowledgement of the last downlink commands, see downlink_cmd.h */
+  SENSOR_PAYLOAD_FIELD_COUNT,
+  SENSOR_PAYLOAD_THERMAL_IMAGE = SENSOR_PAYLOAD_FIELD_COUNT, /*!< Trailing encoded thermal frame */
+  SENSOR_PAYLOAD_PRESENCE_BITS          /*!< Width of the presence mask */
+} SensorPayload_Field_t;
+
+/**
+  * @brief Schema entry of one fixed-point field
+  */
+typedef struct
+{
+  uint8_t bits;                 /*!< Width in the frame */
+  bool isSigned;                /*!< Two's complement instead of unsigned */
+  float scale;                  /*!< Steps per unit */
+  float offset;                 /*!< Value of raw 0 */
+  uint8_t priority;             /*!< Kept first when the frame is too small, 0 is the highest */
+} SensorPayload_Schema_t;
+
+/**
+  * @brief Decoded content of one frame
+  */
+typedef struct
+{
+  float value[SENSOR_PAYLOAD_FIELD_COUNT]; /*!< Field values, in the units of SensorPayload_Field_t */
+  uint32_t presentMask;         /*!< Bit n set when field n is present */
+  const uint8_t *image;         /*!< Encoded thermal frame when encoding, the fragment when decoded */
+  uint8_t imageSize;            /*!< Size of the fragment */
+  uint8_t imageOffset;          /*!< Offset of the fragment in the encoded thermal frame */
+  uint8_t imageTotal;           /*!< Size of the encoded thermal frame */
+} SensorPayload_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  Clear a payload, no field present
+  * @param  payload payload to clear
+  */
+void SensorPayload_Init(SensorPayload_t *payload);
+
+/**
+  * @brief  Set a field and mark it present
+  * @param  payload payload
+  * @param  field field id
+  * @param  value value in the field units
+  */
+void SensorPayload_Set(SensorPayload_t *payload, SensorPayload_Field_t field, float value);
+
+/**
+  * @brief  Attach the rest of an encoded thermal frame, from an offset
+  * @note   SensorPayload_Fit() may shorten the fragment, see imageSize
+  * @param  payload payload
+  * @param  image encoded frame, must stay valid until the payload is encoded
+  * @param  size size of the encoded frame
+  * @param  offset first byte to send
+  */
+void SensorPayload_SetImage(SensorPayload_t *payload, const uint8_t *image, uint8_t size, uint8_t offset);
+
+/**
+  * @brief  Fit a payload into a frame size, dropping the lowest priority
+  *         fields first and shortening the thermal image fragment to the
+  *         room left by the fields
+  * @param  payload payload
+  * @param  maxSize largest frame size
+  * @retval true if the payload fits, false if even the header does not
+  */
+bool SensorPayload_Fit(SensorPayload_t *payload, uint16_t maxSize);
+
+/**
+  * @brief  Number of bytes SensorPayload_Encode() will write
+  * @param  payload payload
+  * @retval frame size in bytes
+  */
+uint16_t SensorPayload_GetSize(const SensorPayload_t *payload);
+
+/**
+  * @brief  Encode a payload
+  * @param  payload payload
+  * @param  out output buffer
+  * @param  outSize size of the output buffer
+  * @retval number of bytes written, -1 if the buffer is too small
+  */
+int SensorPayload_Encode(const SensorPayload_t *payload, uint8_t *out, uint16_t outSize);
+
+/**
+  * @brief  Decode a frame
+  * @param  in frame
+  * @param  len length of the frame
+  * @param  payload decoded payload, payload->image points into in
+  * @retval 0 if successful, -1 if the schema is unknown or the frame truncated
+  */
+int SensorPayload_Decode(const uint8_t *in, uint16_t len, SensorPayload_t *payload);
+
+/**
+  * @brief  Schema entry of a field
+  * @param  field field id
+  * @retval schema entry, NULL if the field does not exist
+  */
+const SensorPayload_Schema_t *SensorPayload_GetSchema(SensorPayload_Field_t field);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SENSOR_PAYLOAD_H__ */
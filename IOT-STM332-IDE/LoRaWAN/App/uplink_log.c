@@ -0,0 +1,493 @@
+/**
+  ******************************************************************************
+  * @file    uplink_log.c
+  * @brief   Circular flash log of the uplinks that could not be sent
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "uplink_log.h"
+
+/* Private define ------------------------------------------------------------*/
+/**
+  * @brief Flash programming unit
+  */
+#define UPLINK_LOG_DWORD                8U
+
+/**
+  * @brief Size of the page header, and of the record header and marker
+  */
+#define UPLINK_LOG_PAGE_HEADER_SIZE     UPLINK_LOG_DWORD
+#define UPLINK_LOG_RECORD_HEADER_SIZE   (2U * UPLINK_LOG_DWORD)
+
+/**
+  * @brief Size of the CRC after the data
+  */
+#define UPLINK_LOG_CRC_SIZE             2U
+
+/* Private macro -------------------------------------------------------------*/
+#define UPLINK_LOG_ALIGN(n)             (((n) + UPLINK_LOG_DWORD - 1U) & ~(UPLINK_LOG_DWORD - 1U))
+#define UPLINK_LOG_RECORD_SIZE(size)    (UPLINK_LOG_RECORD_HEADER_SIZE + UPLINK_LOG_ALIGN((uint32_t)(size) + UPLINK_LOG_CRC_SIZE))
+
+/* Private typedef -----------------------------------------------------------*/
+/**
+  * @brief State of a parsed record
+  */
+typedef enum
+{
+  UPLINK_LOG_END = 0,           /*!< Erased, end of the page */
+  UPLINK_LOG_TORN,              /*!< Header unreadable, rest of the page lost */
+  UPLINK_LOG_INVALID,           /*!< Data not completely programmed */
+  UPLINK_LOG_SENT,
+  UPLINK_LOG_PENDING,
+} UplinkLog_State_t;
+
+/* Private variables ---------------------------------------------------------*/
+/**
+  * @brief Flash of the log, NULL until UplinkLog_Init() succeeds
+  */
+static const UplinkLog_Flash_t *Flash = NULL;
+
+/**
+  * @brief Page written, its sequence number and the offset of the next record
+  */
+static uint16_t WritePage = 0;
+static uint32_t WriteSequence = 0;
+static uint32_t WriteOffset = 0;
+
+/**
+  * @brief Records counts
+  */
+static uint32_t Pending = 0;
+static uint32_t Dropped = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t UplinkLog_Crc(uint16_t crc, const uint8_t *data, uint32_t size);
+static uint16_t UplinkLog_HeaderCrc(const uint8_t *header);
+static const uint8_t *UplinkLog_Address(uint16_t page, uint32_t offset);
+static int UplinkLog_Read(uint16_t page, uint32_t offset, void *data, uint32_t size);
+static bool UplinkLog_ReadPageHeader(uint16_t page, uint32_t *sequence);
+static UplinkLog_State_t UplinkLog_Parse(uint16_t page, uint32_t offset, uint32_t *size);
+static uint32_t UplinkLog_CountPending(uint16_t page, uint32_t *end);
+static int UplinkLog_Format(uint16_t page, uint32_t sequence);
+static int UplinkLog_Program(uint16_t page, uint32_t offset, const uint8_t *data, uint32_t size);
+
+/* Exported functions --------------------------------------------------------*/
+int UplinkLog_Init(const UplinkLog_Flash_t *flash)
+{
+  uint32_t sequence;
+  uint32_t end;
+  bool found = false;
+
+  Flash = NULL;
+  Pending = 0;
+  Dropped = 0;
+  if ((flash == NULL) || (flash->erase == NULL) || (flash->program == NULL) ||
+      (flash->pageCount < 2U) || (flash->pageCount > UPLINK_LOG_MAX_PAGES) ||
+      ((flash->pageSize % UPLINK_LOG_DWORD) != 0U) ||
+      (flash->pageSize <= (UPLINK_LOG_PAGE_HEADER_SIZE + UPLINK_LOG_RECORD_SIZE(1))))
+  {
+    return -1;
+  }
+  Flash = flash;
+
+  for (uint16_t page = 0; page < Flash->pageCount; page++)
+  {
+    if (!UplinkLog_ReadPageHeader(page, &sequence))
+    {
+      continue;
+    }
+    Pending += UplinkLog_CountPending(page, &end);
+    if (!found || ((int32_t)(sequence - WriteSequence) > 0))
+    {
+      found = true;
+      WritePage = page;
+      WriteSequence = sequence;
+      WriteOffset = end;
+    }
+  }
+
+  if (!found && (UplinkLog_Format(0, 1) != 0))
+  {
+    /* First use */
+    Flash = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+int UplinkLog_Append(uint32_t time, uint8_t port, const uint8_t *data, uint8_t size)
+{
+  uint8_t record[UPLINK_LOG_RECORD_SIZE(UINT8_MAX)];
+  uint32_t recordSize = UPLINK_LOG_RECORD_SIZE(size);
+  uint16_t next;
+  uint32_t lost;
+  uint32_t end;
+  uint32_t sequence;
+  uint16_t crc;
+
+  if ((Flash == NULL) || (data == NULL) || (size == 0U) ||
+      ((UPLINK_LOG_PAGE_HEADER_SIZE + recordSize) > Flash->pageSize))
+  {
+    return -1;
+  }
+
+  if ((WriteOffset + recordSize) > Flash->pageSize)
+  {
+    /* Reuse the oldest page, its pending records are lost */
+    next = (uint16_t)((WritePage + 1U) % Flash->pageCount);
+    if (UplinkLog_ReadPageHeader(next, &sequence))
+    {
+      lost = UplinkLog_CountPending(next, &end);
+      Pending -= lost;
+      Dropped += lost;
+    }
+    if (UplinkLog_Format(next, WriteSequence + 1U) != 0)
+    {
+      return -1;
+    }
+  }
+
+  memset(record, 0xFF, recordSize);
+  record[0] = UPLINK_LOG_RECORD_MAGIC;
+  record[1] = size;
+  record[2] = port;
+  record[3] = (uint8_t)~size;
+  memcpy(&record[4], &time, sizeof(time));
+  memcpy(&record[UPLINK_LOG_RECORD_HEADER_SIZE], data, size);
+  crc = UplinkLog_Crc(UplinkLog_HeaderCrc(record), data, size);
+  record[UPLINK_LOG_RECORD_HEADER_SIZE + size] = (uint8_t)crc;
+  record[UPLINK_LOG_RECORD_HEADER_SIZE + size + 1U] = (uint8_t)(crc >> 8);
+
+  /* Header first, the marker double-word is left erased */
+  if ((UplinkLog_Program(WritePage, WriteOffset, record, UPLINK_LOG_DWORD) != 0) ||
+      (UplinkLog_Program(WritePage, WriteOffset + UPLINK_LOG_RECORD_HEADER_SIZE,
+                         &record[UPLINK_LOG_RECORD_HEADER_SIZE], recordSize - UPLINK_LOG_RECORD_HEADER_SIZE) != 0))
+  {
+    /* Skip what may have been programmed */
+    WriteOffset = Flash->pageSize;
+    return -1;
+  }
+
+  WriteOffset += recordSize;
+  Pending++;
+  return 0;
+}
+
+int UplinkLog_Next(UplinkLog_Policy_t policy, uint8_t maxSize, UplinkLog_Record_t *record)
+{
+  const uint8_t *header;
+  uint32_t sequence;
+  uint32_t offset;
+  uint32_t size;
+  UplinkLog_State_t state;
+  bool found = false;
+  uint16_t page;
+
+  if ((Flash == NULL) || (Pending == 0U))
+  {
+    return -1;
+  }
+
+  /* Pages in age order: the one after the written page is the oldest */
+  for (uint16_t k = 1; k <= Flash->pageCount; k++)
+  {
+    page = (uint16_t)((WritePage + k) % Flash->pageCount);
+    if (!UplinkLog_ReadPageHeader(page, &sequence))
+    {
+      continue;
+    }
+    for (offset = UPLINK_LOG_PAGE_HEADER_SIZE; ; offset += size)
+    {
+      state = UplinkLog_Parse(page, offset, &size);
+      if ((state == UPLINK_LOG_END) || (state == UPLINK_LOG_TORN))
+      {
+        break;
+      }
+      header = UplinkLog_Address(page, offset);
+      if ((state == UPLINK_LOG_PENDING) && (header[1] <= maxSize))
+      {
+        record->id = ((uint64_t)sequence << 32) | (((uint32_t)page * Flash->pageSize) + offset);
+        memcpy(&record->time, &header[4], sizeof(record->time));
+        record->port = header[2];
+        record->size = header[1];
+        record->data = &header[UPLINK_LOG_RECORD_HEADER_SIZE];
+        found = true;
+        if (policy == UPLINK_LOG_OLDEST_FIRST)
+        {
+          return 0;
+        }
+      }
+    }
+  }
+
+  return found ? 0 : -1;
+}
+
+int UplinkLog_MarkSent(uint64_t id, uint32_t frameCounter)
+{
+  uint32_t place = (uint32_t)id;
+  uint16_t page;
+  uint32_t offset;
+  uint32_t size;
+  uint32_t sequence;
+  uint32_t marker[2] = { frameCounter, 0 };
+
+  if ((Flash == NULL) || (place >= ((uint32_t)Flash->pageCount * Flash->pageSize)))
+  {
+    return -1;
+  }
+  page = (uint16_t)(place / Flash->pageSize);
+  offset = place % Flash->pageSize;
+  if (!UplinkLog_ReadPageHeader(page, &sequence) || (sequence != (uint32_t)(id >> 32)) ||
+      (UplinkLog_Parse(page, offset, &size) != UPLINK_LOG_PENDING))
+  {
+    /* Already sent, or the page was reused meanwhile */
+    return -1;
+  }
+
+  if (UplinkLog_Program(page, offset + UPLINK_LOG_DWORD, (const uint8_t *)marker, sizeof(marker)) != 0)
+  {
+    return -1;
+  }
+  Pending--;
+  return 0;
+}
+
+uint32_t UplinkLog_GetPending(void)
+{
+  return Pending;
+}
+
+uint32_t UplinkLog_GetDropped(void)
+{
+  return Dropped;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Update a CRC-16/CCITT
+  * @param  crc CRC so far
+  * @param  data data
+  * @param  size size of the data
+  * @retval CRC
+  */
+static uint16_t UplinkLog_Crc(uint16_t crc, const uint8_t *data, uint32_t size)
+{
+  uint8_t bit;
+
+  for (uint32_t i = 0; i < size; i++)
+  {
+    crc ^= (uint16_t)data[i] << 8;
+    for (bit = 0; bit < 8; bit++)
+    {
+      crc = ((crc & 0x8000U) != 0U) ? (uint16_t)((crc << 1) ^ 0x1021U) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+/**
+  * @brief  CRC of the time, port and size of a record, the data follow
+  * @param  header first double-word of the record
+  * @retval CRC
+  */
+static uint16_t UplinkLog_HeaderCrc(const uint8_t *header)
+{
+  return UplinkLog_Crc(UplinkLog_Crc(UplinkLog_Crc(0xFFFF, &header[4], 4), &header[2], 1), &header[1], 1);
+}
+
+/**
+  * @brief  Address of an offset in a page
+  * @param  page page index
+  * @param  offset offset in the page
+  * @retval address
+  */
+static const uint8_t *UplinkLog_Address(uint16_t page, uint32_t offset)
+{
+  return (const uint8_t *)(Flash->base + ((uint32_t)page * Flash->pageSize) + offset);
+}
+
+/**
+  * @brief  Copy from a page
+  * @param  page page index
+  * @param  offset offset in the page
+  * @param  data destination
+  * @param  size size to copy
+  * @retval 0 if successful, -1 on an uncorrectable ECC error
+  */
+static int UplinkLog_Read(uint16_t page, uint32_t offset, void *data, uint32_t size)
+{
+  if (Flash->read == NULL)
+  {
+    memcpy(data, UplinkLog_Address(page, offset), size);
+    return 0;
+  }
+  return Flash->read((uintptr_t)UplinkLog_Address(page, offset), data, size);
+}
+
+/**
+  * @brief  Check the header of a page
+  * @param  page page index
+  * @param  sequence sequence number of the page
+  * @retval true if the page is in use
+  */
+static bool UplinkLog_ReadPageHeader(uint16_t page, uint32_t *sequence)
+{
+  uint32_t header[2];
+
+  if (UplinkLog_Read(page, 0, header, sizeof(header)) != 0)
+  {
+    /* Torn by a reset during its format */
+    return false;
+  }
+  *sequence = header[1];
+  return (header[0] == UPLINK_LOG_MAGIC);
+}
+
+/**
+  * @brief  Parse the record at an offset
+  * @param  page page index
+  * @param  offset offset of the record
+  * @param  size size of the record in the page
+  * @retval state of the record
+  */
+static UplinkLog_State_t UplinkLog_Parse(uint16_t page, uint32_t offset, uint32_t *size)
+{
+  uint8_t header[UPLINK_LOG_DWORD];
+  uint8_t dword[UPLINK_LOG_DWORD];
+  uint32_t marker[2];
+  uint32_t dataSize;
+  uint32_t count;
+  uint16_t crc;
+  uint16_t stored = 0;
+
+  if ((offset + UPLINK_LOG_RECORD_HEADER_SIZE) > Flash->pageSize)
+  {
+    return UPLINK_LOG_END;
+  }
+  if (UplinkLog_Read(page, offset, header, sizeof(header)) != 0)
+  {
+    return UPLINK_LOG_TORN;
+  }
+  /* Erased: a header torn with its first bytes still erased is not the end */
+  memset(dword, 0xFF, sizeof(dword));
+  if (memcmp(header, dword, sizeof(header)) == 0)
+  {
+    return UPLINK_LOG_END;
+  }
+
+  *size = UPLINK_LOG_RECORD_SIZE(header[1]);
+  if ((header[0] != UPLINK_LOG_RECORD_MAGIC) || ((uint8_t)(header[1] ^ header[3]) != 0xFFU) ||
+      ((offset + *size) > Flash->pageSize))
+  {
+    return UPLINK_LOG_TORN;
+  }
+
+  /* Data and CRC a double-word at a time, the CRC is stored little-endian after the data */
+  crc = UplinkLog_HeaderCrc(header);
+  dataSize = header[1];
+  for (uint32_t i = 0; i < (dataSize + UPLINK_LOG_CRC_SIZE); i += UPLINK_LOG_DWORD)
+  {
+    if (UplinkLog_Read(page, offset + UPLINK_LOG_RECORD_HEADER_SIZE + i, dword, sizeof(dword)) != 0)
+    {
+      return UPLINK_LOG_INVALID;
+    }
+    count = (dataSize > i) ? (dataSize - i) : 0U;
+    count = (count > UPLINK_LOG_DWORD) ? UPLINK_LOG_DWORD : count;
+    crc = UplinkLog_Crc(crc, dword, count);
+    for (uint32_t j = count; (j < UPLINK_LOG_DWORD) && ((i + j) < (dataSize + UPLINK_LOG_CRC_SIZE)); j++)
+    {
+      stored |= (uint16_t)((uint16_t)dword[j] << (8U * (i + j - dataSize)));
+    }
+  }
+  if (stored != crc)
+  {
+    return UPLINK_LOG_INVALID;
+  }
+
+  if (UplinkLog_Read(page, offset + UPLINK_LOG_DWORD, marker, sizeof(marker)) != 0)
+  {
+    /* Torn while being marked, the uplink was delivered */
+    return UPLINK_LOG_SENT;
+  }
+  return ((marker[0] == 0xFFFFFFFFU) && (marker[1] == 0xFFFFFFFFU)) ? UPLINK_LOG_PENDING : UPLINK_LOG_SENT;
+}
+
+/**
+  * @brief  Count the pending records of a page and find its end
+  * @param  page page index
+  * @param  end offset after the last record, the page size if it is torn
+  * @retval pending records
+  */
+static uint32_t UplinkLog_CountPending(uint16_t page, uint32_t *end)
+{
+  uint32_t offset = UPLINK_LOG_PAGE_HEADER_SIZE;
+  uint32_t count = 0;
+  uint32_t size;
+  UplinkLog_State_t state;
+
+  while ((state = UplinkLog_Parse(page, offset, &size)) != UPLINK_LOG_END)
+  {
+    if (state == UPLINK_LOG_TORN)
+    {
+      offset = Flash->pageSize;
+      break;
+    }
+    if (state == UPLINK_LOG_PENDING)
+    {
+      count++;
+    }
+    offset += size;
+  }
+
+  *end = offset;
+  return count;
+}
+
+/**
+  * @brief  Erase a page and make it the empty written page
+  * @param  page page index
+  * @param  sequence sequence number of the page
+  * @retval 0 if successful, -1 otherwise
+  */
+static int UplinkLog_Format(uint16_t page, uint32_t sequence)
+{
+  uint32_t header[2] = { UPLINK_LOG_MAGIC, sequence };
+
+  if ((Flash->erase((uintptr_t)UplinkLog_Address(page, 0)) != 0) ||
+      (UplinkLog_Program(page, 0, (const uint8_t *)header, sizeof(header)) != 0))
+  {
+    return -1;
+  }
+
+  WritePage = page;
+  WriteSequence = sequence;
+  WriteOffset = UPLINK_LOG_PAGE_HEADER_SIZE;
+  return 0;
+}
+
+/**
+  * @brief  Program whole double-words
+  * @param  page page index
+  * @param  offset offset in the page, a multiple of 8
+  * @param  data data
+  * @param  size size of the data, a multiple of 8
+  * @retval 0 if successful, -1 otherwise
+  */
+static int UplinkLog_Program(uint16_t page, uint32_t offset, const uint8_t *data, uint32_t size)
+{
+  uint64_t dword;
+  uint32_t i;
+
+  for (i = 0; i < size; i += UPLINK_LOG_DWORD)
+  {
+    memcpy(&dword, &data[i], sizeof(dword));
+    if (Flash->program((uintptr_t)UplinkLog_Address(page, offset + i), dword) != 0)
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
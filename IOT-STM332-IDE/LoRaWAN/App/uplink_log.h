@@ -0,0 +1,147 @@
+/**
+  ******************************************************************************
+  * @file    uplink_log.h
+  * @brief   Circular flash log of the uplinks that could not be sent
+  * @note    Records are appended page after page. When the last page is full
+  *          the oldest page is erased and reused, dropping its records. Each
+  *          record has an erased marker double-word, programmed with the
+  *          frame counter of the uplink that delivered it, so the drain
+  *          progress survives a reset without rewriting anything.
+  *          Layout, in 64-bit double-words (the flash programming unit):
+  *            - page header: magic (UPLINK_LOG_MAGIC), sequence number, the
+  *              oldest page has the lowest number
+  *            - record header: UPLINK_LOG_RECORD_MAGIC, size, port, bitwise
+  *              inverse of size, then the capture time in s
+  *            - marker: erased while pending, frame counter and 0 once sent
+  *            - data and CRC-16 of time, port, size and data, padded to a
+  *              double-word with 0xFF
+  *          A double-word torn by a reset can read with an uncorrectable ECC
+  *          error. With a read operation, the log reads the flash through it
+  *          and such a double-word ends the page in a record header, makes
+  *          the record invalid in its data, marks it sent in its marker.
+  *          A record is identified by the sequence number of its page as well
+  *          as its place, so a handle does not match a later record once the
+  *          page is reused.
+  *          The flash is accessed through UplinkLog_Flash_t, the file has no
+  *          hardware dependency so the log can run on a host against RAM.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __UPLINK_LOG_H__
+#define __UPLINK_LOG_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+/**
+  * @brief First word of a page in use, "LOG1"
+  */
+#define UPLINK_LOG_MAGIC                0x31474F4CU
+
+/**
+  * @brief First byte of a record
+  */
+#define UPLINK_LOG_RECORD_MAGIC         0x5A
+
+/**
+  * @brief Most pages in the log
+  */
+#define UPLINK_LOG_MAX_PAGES            32
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief Flash pages and operations of the log
+  */
+typedef struct
+{
+  uintptr_t base;               /*!< Memory mapped address of the first page */
+  uint16_t pageCount;           /*!< Number of consecutive pages, 2..UPLINK_LOG_MAX_PAGES */
+  uint32_t pageSize;            /*!< Size of a page, a multiple of 8 */
+  int (*erase)(uintptr_t address);                  /*!< Erase the page at address, 0 if successful */
+  int (*program)(uintptr_t address, uint64_t data); /*!< Program a double-word, 0 if successful */
+  int (*read)(uintptr_t address, void *data, uint32_t size); /*!< Copy from the flash, 0 if successful, -1 on an
+                                                                  uncorrectable ECC error; NULL to read the memory */
+} UplinkLog_Flash_t;
+
+/**
+  * @brief Order in which pending records are drained
+  */
+typedef enum
+{
+  UPLINK_LOG_OLDEST_FIRST = 0,
+  UPLINK_LOG_NEWEST_FIRST,
+} UplinkLog_Policy_t;
+
+/**
+  * @brief One pending record
+  */
+typedef struct
+{
+  uint64_t id;                  /*!< Handle for UplinkLog_MarkSent(): page sequence number, offset in the log */
+  uint32_t time;                /*!< Capture time, s */
+  uint8_t port;                 /*!< LoRaWAN port of the uplink */
+  uint8_t size;
+  const uint8_t *data;          /*!< Payload, in flash, read without ECC error */
+} UplinkLog_Record_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  Find the newest page and count the pending records, format the
+  *         log if no page is in use
+  * @param  flash flash pages and operations, must stay valid
+  * @retval 0 if successful, -1 if the log could not be formatted
+  */
+int UplinkLog_Init(const UplinkLog_Flash_t *flash);
+
+/**
+  * @brief  Append an uplink
+  * @param  time capture time, s
+  * @param  port LoRaWAN port
+  * @param  data payload
+  * @param  size size of the payload, 1 to less than a page
+  * @retval 0 if successful, -1 otherwise
+  */
+int UplinkLog_Append(uint32_t time, uint8_t port, const uint8_t *data, uint8_t size);
+
+/**
+  * @brief  Find the next pending record
+  * @param  policy drain order
+  * @param  maxSize largest payload that can be sent now, larger records are
+  *         skipped
+  * @param  record pending record
+  * @retval 0 if found, -1 if none
+  */
+int UplinkLog_Next(UplinkLog_Policy_t policy, uint8_t maxSize, UplinkLog_Record_t *record);
+
+/**
+  * @brief  Mark a record delivered
+  * @param  id record handle
+  * @param  frameCounter uplink frame counter of the delivery
+  * @retval 0 if successful, -1 otherwise
+  */
+int UplinkLog_MarkSent(uint64_t id, uint32_t frameCounter);
+
+/**
+  * @brief  Number of pending records
+  * @retval count
+  */
+uint32_t UplinkLog_GetPending(void);
+
+/**
+  * @brief  Number of pending records dropped by page reuse since the init
+  * @retval count
+  */
+uint32_t UplinkLog_GetDropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UPLINK_LOG_H__ */
@@ -83,6 +83,14 @@ extern "C" {
 #endif /* LORAMAC_CLASSB_ENABLED == 1 */
 
 /* USER CODE BEGIN EC */
+/**
+  * @brief AES used by the soft secure element, see aes_backend.h:
+  *        LORAWAN_AES_BACKEND_SOFTWARE or LORAWAN_AES_BACKEND_HARDWARE,
+  *        may be given by the build
+  */
+#ifndef LORAWAN_AES_BACKEND
+#define LORAWAN_AES_BACKEND     LORAWAN_AES_BACKEND_SOFTWARE
+#endif /* LORAWAN_AES_BACKEND */
 
 /* USER CODE END EC */
 
@@ -0,0 +1,145 @@
+/**
+  ******************************************************************************
+  * @file    aes_backend.h
+  * @brief   AES-128 primitives used by the soft secure element
+  * @note    The implementation is selected at build time by LORAWAN_AES_BACKEND:
+  *            - LORAWAN_AES_BACKEND_SOFTWARE: lorawan_aes.c and cmac.c, the
+  *              reference implementation, also builds on a host
+  *            - LORAWAN_AES_BACKEND_HARDWARE: the STM32WL AES peripheral
+  *          Both implement the same functions, so one known-answer test suite
+  *          validates either of them. On a host the hardware backend runs it
+  *          against a register model of the peripheral written from the
+  *          reference manual (Tests/Stubs/stm32wlxx_aes.c), not against the
+  *          silicon.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AES_BACKEND_H__
+#define __AES_BACKEND_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "lorawan_conf.h"
+
+/* Exported constants --------------------------------------------------------*/
+/**
+  * @brief Values of LORAWAN_AES_BACKEND
+  */
+#define LORAWAN_AES_BACKEND_SOFTWARE    0
+#define LORAWAN_AES_BACKEND_HARDWARE    1
+
+#ifndef LORAWAN_AES_BACKEND
+#define LORAWAN_AES_BACKEND             LORAWAN_AES_BACKEND_SOFTWARE
+#endif /* LORAWAN_AES_BACKEND */
+
+#if (LORAWAN_AES_BACKEND == LORAWAN_AES_BACKEND_SOFTWARE)
+#include "lorawan_aes.h"
+#endif /* LORAWAN_AES_BACKEND */
+
+/**
+  * @brief AES block and key size, bytes
+  */
+#define AES_BACKEND_BLOCK_SIZE          16
+
+/**
+  * @brief Most CMACs computed by AesBackend_CtrCmac(), B0 and B1 of a
+  *        LoRaWAN 1.1 uplink
+  */
+#define AES_BACKEND_MAX_CMACS           2
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief Key prepared for the backend, filled by AesBackend_SetKey()
+  */
+typedef struct
+{
+#if (LORAWAN_AES_BACKEND == LORAWAN_AES_BACKEND_SOFTWARE)
+  lorawan_aes_context Schedule;                 /*!< Expanded key schedule */
+#else /* LORAWAN_AES_BACKEND_HARDWARE */
+  uint32_t Key[4];                              /*!< Key words, KEYR3 first */
+  uint8_t K1[AES_BACKEND_BLOCK_SIZE];           /*!< CMAC subkey of a complete last block */
+  uint8_t K2[AES_BACKEND_BLOCK_SIZE];           /*!< CMAC subkey of a padded last block */
+#endif /* LORAWAN_AES_BACKEND */
+} AesBackend_Key_t;
+
+/**
+  * @brief One CMAC computed by AesBackend_CtrCmac()
+  */
+typedef struct
+{
+  const AesBackend_Key_t *Key;                  /*!< Prepared key */
+  const uint8_t *FirstBlock;                    /*!< Block processed before the frame, NULL if none */
+  uint8_t Mac[AES_BACKEND_BLOCK_SIZE];          /*!< Computed CMAC */
+} AesBackend_CmacJob_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  Prepare the backend, once before any other call
+  */
+void AesBackend_Init(void);
+
+/**
+  * @brief  Prepare a 128-bit key
+  * @param  key key bytes
+  * @param  prepared prepared key
+  */
+void AesBackend_SetKey(const uint8_t key[AES_BACKEND_BLOCK_SIZE], AesBackend_Key_t *prepared);
+
+/**
+  * @brief  Encrypt blocks in ECB mode
+  * @param  key prepared key
+  * @param  in plain text
+  * @param  out cipher text, may be in
+  * @param  size size of in, a multiple of AES_BACKEND_BLOCK_SIZE
+  */
+void AesBackend_EncryptEcb(const AesBackend_Key_t *key, const uint8_t *in, uint8_t *out, uint16_t size);
+
+/**
+  * @brief  XOR a buffer in place with the AES-CTR key stream
+  * @param  key prepared key
+  * @param  ctrBlock first counter block, its last byte is incremented for
+  *         each next block
+  * @param  buffer data
+  * @param  size size of buffer, the last counter byte must not wrap
+  */
+void AesBackend_Ctr(const AesBackend_Key_t *key, const uint8_t ctrBlock[AES_BACKEND_BLOCK_SIZE],
+                    uint8_t *buffer, uint16_t size);
+
+/**
+  * @brief  AES-CMAC of an optional first block followed by a buffer
+  * @param  key prepared key
+  * @param  firstBlock block processed before buffer, NULL if none
+  * @param  buffer data
+  * @param  size size of buffer
+  * @param  mac computed CMAC
+  */
+void AesBackend_Cmac(const AesBackend_Key_t *key, const uint8_t *firstBlock, const uint8_t *buffer,
+                     uint16_t size, uint8_t mac[AES_BACKEND_BLOCK_SIZE]);
+
+/**
+  * @brief  Encrypt part of a frame in place with the AES-CTR key stream and
+  *         compute the CMACs of the resulting frame, the same as
+  *         AesBackend_Ctr() followed by AesBackend_Cmac() for each job
+  * @param  ctrKey prepared key of the encryption
+  * @param  ctrBlock first counter block, see AesBackend_Ctr()
+  * @param  buffer frame
+  * @param  size size of the frame
+  * @param  encOffset offset of the first byte to encrypt
+  * @param  encSize number of bytes to encrypt, may be 0
+  * @param  cmacs CMACs to compute
+  * @param  cmacCount number of CMACs, 1 to AES_BACKEND_MAX_CMACS
+  */
+void AesBackend_CtrCmac(const AesBackend_Key_t *ctrKey, const uint8_t ctrBlock[AES_BACKEND_BLOCK_SIZE],
+                        uint8_t *buffer, uint16_t size, uint16_t encOffset, uint16_t encSize,
+                        AesBackend_CmacJob_t *cmacs, uint8_t cmacCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AES_BACKEND_H__ */
@@ -0,0 +1,256 @@
+/**
+  ******************************************************************************
+  * @file    aes_backend_hw.c
+  * @brief   AES backend on the STM32WL AES peripheral
+  * @note    See aes_backend.h. The peripheral runs ECB, CBC (for the CMAC
+  *          chaining) and CTR itself; the key and the chaining are set up
+  *          again for every call, so nothing depends on the peripheral
+  *          state across low power modes. Data is swapped by the peripheral
+  *          (DATATYPE byte), words are moved with little-endian loads and
+  *          stores. Blocks are fed by polling: a LoRaWAN frame is at most 16
+  *          blocks, less than a DMA setup would cost.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "aes_backend.h"
+
+#if (LORAWAN_AES_BACKEND == LORAWAN_AES_BACKEND_HARDWARE)
+#include "stm32wlxx.h"
+#include "stm32wlxx_ll_bus.h"
+#include "utilities.h"
+
+/* Private defines -----------------------------------------------------------*/
+/**
+  * @brief Chaining modes, CR.CHMOD
+  */
+#define AES_BACKEND_ECB     0U
+#define AES_BACKEND_CBC     AES_CR_CHMOD_0
+#define AES_BACKEND_CTR     AES_CR_CHMOD_1
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t AesBackend_GetBe32(const uint8_t *in);
+static uint32_t AesBackend_GetLe32(const uint8_t *in);
+static void AesBackend_PutLe32(uint8_t *out, uint32_t value);
+static void AesBackend_Start(const AesBackend_Key_t *key, uint32_t chainingMode, const uint8_t *iv);
+static void AesBackend_Block(const uint8_t *in, uint8_t *out);
+static void AesBackend_Stop(void);
+static void AesBackend_Double(const uint8_t *in, uint8_t *out);
+
+/* Exported functions --------------------------------------------------------*/
+void AesBackend_Init(void)
+{
+  LL_AHB3_GRP1_EnableClock(LL_AHB3_GRP1_PERIPH_AES);
+  AES->CR = 0;
+}
+
+void AesBackend_SetKey(const uint8_t key[AES_BACKEND_BLOCK_SIZE], AesBackend_Key_t *prepared)
+{
+  uint8_t zero[AES_BACKEND_BLOCK_SIZE] = { 0 };
+  uint8_t l[AES_BACKEND_BLOCK_SIZE];
+
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    prepared->Key[i] = AesBackend_GetBe32(&key[4 * i]);
+  }
+
+  /* CMAC subkeys, RFC 4493: L = AES(K, 0), K1 = 2L, K2 = 4L in GF(2^128) */
+  AesBackend_EncryptEcb(prepared, zero, l, AES_BACKEND_BLOCK_SIZE);
+  AesBackend_Double(l, prepared->K1);
+  AesBackend_Double(prepared->K1, prepared->K2);
+}
+
+void AesBackend_EncryptEcb(const AesBackend_Key_t *key, const uint8_t *in, uint8_t *out, uint16_t size)
+{
+  AesBackend_Start(key, AES_BACKEND_ECB, NULL);
+  for (uint16_t block = 0; block < size; block += AES_BACKEND_BLOCK_SIZE)
+  {
+    AesBackend_Block(&in[block], &out[block]);
+  }
+  AesBackend_Stop();
+}
+
+void AesBackend_Ctr(const AesBackend_Key_t *key, const uint8_t ctrBlock[AES_BACKEND_BLOCK_SIZE],
+                    uint8_t *buffer, uint16_t size)
+{
+  uint8_t block[AES_BACKEND_BLOCK_SIZE];
+  uint16_t bufferIndex = 0;
+  uint8_t blockSize;
+
+  /* The peripheral increments the last counter word, the same as the last
+     byte while that byte does not wrap */
+  AesBackend_Start(key, AES_BACKEND_CTR, ctrBlock);
+  while (size > 0)
+  {
+    blockSize = (size > AES_BACKEND_BLOCK_SIZE) ? AES_BACKEND_BLOCK_SIZE : (uint8_t)size;
+    if (blockSize == AES_BACKEND_BLOCK_SIZE)
+    {
+      AesBackend_Block(&buffer[bufferIndex], &buffer[bufferIndex]);
+    }
+    else
+    {
+      memset1(block, 0, sizeof(block));
+      memcpy1(block, &buffer[bufferIndex], blockSize);
+      AesBackend_Block(block, block);
+      memcpy1(&buffer[bufferIndex], block, blockSize);
+    }
+    size -= blockSize;
+    bufferIndex += blockSize;
+  }
+  AesBackend_Stop();
+}
+
+void AesBackend_Cmac(const AesBackend_Key_t *key, const uint8_t *firstBlock, const uint8_t *buffer,
+                     uint16_t size, uint8_t mac[AES_BACKEND_BLOCK_SIZE])
+{
+  uint8_t block[AES_BACKEND_BLOCK_SIZE];
+  uint16_t firstSize = (firstBlock != NULL) ? AES_BACKEND_BLOCK_SIZE : 0;
+  uint16_t total = firstSize + size;
+  uint16_t blockCount = (total == 0) ? 1 : (uint16_t)((total + AES_BACKEND_BLOCK_SIZE - 1) / AES_BACKEND_BLOCK_SIZE);
+  uint16_t offset;
+  const uint8_t *subkey;
+
+  /* CBC-MAC with a zero IV, the last block is masked with a subkey */
+  AesBackend_Start(key, AES_BACKEND_CBC, NULL);
+  for (uint16_t n = 0; n < blockCount; n++)
+  {
+    for (uint8_t i = 0; i < AES_BACKEND_BLOCK_SIZE; i++)
+    {
+      offset = (uint16_t)(n * AES_BACKEND_BLOCK_SIZE + i);
+      if (offset < firstSize)
+      {
+        block[i] = firstBlock[offset];
+      }
+      else if (offset < total)
+      {
+        block[i] = buffer[offset - firstSize];
+      }
+      else
+      {
+        block[i] = (offset == total) ? 0x80 : 0x00;
+      }
+    }
+    if (n == (blockCount - 1))
+    {
+      subkey = ((total != 0) && ((total % AES_BACKEND_BLOCK_SIZE) == 0)) ? key->K1 : key->K2;
+      for (uint8_t i = 0; i < AES_BACKEND_BLOCK_SIZE; i++)
+      {
+        block[i] ^= subkey[i];
+      }
+    }
+    AesBackend_Block(block, block);
+  }
+  AesBackend_Stop();
+
+  memcpy1(mac, block, AES_BACKEND_BLOCK_SIZE);
+}
+
+void AesBackend_CtrCmac(const AesBackend_Key_t *ctrKey, const uint8_t ctrBlock[AES_BACKEND_BLOCK_SIZE],
+                        uint8_t *buffer, uint16_t size, uint16_t encOffset, uint16_t encSize,
+                        AesBackend_CmacJob_t *cmacs, uint8_t cmacCount)
+{
+  /* The peripheral holds one key and one chaining at a time, switching
+     them for every block would cost more than a second pass */
+  if (encSize > 0)
+  {
+    AesBackend_Ctr(ctrKey, ctrBlock, &buffer[encOffset], encSize);
+  }
+  for (uint8_t i = 0; i < cmacCount; i++)
+  {
+    AesBackend_Cmac(cmacs[i].Key, cmacs[i].FirstBlock, buffer, size, cmacs[i].Mac);
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Big-endian word of 4 bytes, the layout of the key and IV registers
+  */
+static uint32_t AesBackend_GetBe32(const uint8_t *in)
+{
+  return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+}
+
+/**
+  * @brief  Little-endian word of 4 bytes, the layout of the data registers
+  *         with the byte swap of DATATYPE
+  */
+static uint32_t AesBackend_GetLe32(const uint8_t *in)
+{
+  return ((uint32_t)in[3] << 24) | ((uint32_t)in[2] << 16) | ((uint32_t)in[1] << 8) | in[0];
+}
+
+static void AesBackend_PutLe32(uint8_t *out, uint32_t value)
+{
+  out[0] = (uint8_t)value;
+  out[1] = (uint8_t)(value >> 8);
+  out[2] = (uint8_t)(value >> 16);
+  out[3] = (uint8_t)(value >> 24);
+}
+
+/**
+  * @brief  Configure and enable the peripheral for an encryption
+  * @param  key prepared key
+  * @param  chainingMode AES_BACKEND_xxx
+  * @param  iv initialization vector or first counter block, NULL for zeros
+  */
+static void AesBackend_Start(const AesBackend_Key_t *key, uint32_t chainingMode, const uint8_t *iv)
+{
+  AES->CR = 0;
+  AES->CR = chainingMode | AES_CR_DATATYPE_1;
+
+  AES->KEYR3 = key->Key[0];
+  AES->KEYR2 = key->Key[1];
+  AES->KEYR1 = key->Key[2];
+  AES->KEYR0 = key->Key[3];
+
+  AES->IVR3 = (iv != NULL) ? AesBackend_GetBe32(&iv[0]) : 0;
+  AES->IVR2 = (iv != NULL) ? AesBackend_GetBe32(&iv[4]) : 0;
+  AES->IVR1 = (iv != NULL) ? AesBackend_GetBe32(&iv[8]) : 0;
+  AES->IVR0 = (iv != NULL) ? AesBackend_GetBe32(&iv[12]) : 0;
+
+  AES->CR |= AES_CR_EN;
+}
+
+/**
+  * @brief  Process one block
+  * @param  in input block
+  * @param  out output block, may be in
+  */
+static void AesBackend_Block(const uint8_t *in, uint8_t *out)
+{
+  AES->DINR = AesBackend_GetLe32(&in[0]);
+  AES->DINR = AesBackend_GetLe32(&in[4]);
+  AES->DINR = AesBackend_GetLe32(&in[8]);
+  AES->DINR = AesBackend_GetLe32(&in[12]);
+
+  while ((AES->SR & AES_SR_CCF) == 0)
+  {
+  }
+  AES->CR |= AES_CR_CCFC;
+
+  AesBackend_PutLe32(&out[0], AES->DOUTR);
+  AesBackend_PutLe32(&out[4], AES->DOUTR);
+  AesBackend_PutLe32(&out[8], AES->DOUTR);
+  AesBackend_PutLe32(&out[12], AES->DOUTR);
+}
+
+static void AesBackend_Stop(void)
+{
+  AES->CR &= ~AES_CR_EN;
+}
+
+/**
+  * @brief  Multiply a block by x in GF(2^128), CMAC subkey generation
+  */
+static void AesBackend_Double(const uint8_t *in, uint8_t *out)
+{
+  uint8_t carry = in[0] >> 7;
+
+  for (uint8_t i = 0; i < (AES_BACKEND_BLOCK_SIZE - 1); i++)
+  {
+    out[i] = (uint8_t)((in[i] << 1) | (in[i + 1] >> 7));
+  }
+  out[AES_BACKEND_BLOCK_SIZE - 1] = (uint8_t)((in[AES_BACKEND_BLOCK_SIZE - 1] << 1) ^ (carry ? 0x87 : 0x00));
+}
+
+#endif /* LORAWAN_AES_BACKEND_HARDWARE */
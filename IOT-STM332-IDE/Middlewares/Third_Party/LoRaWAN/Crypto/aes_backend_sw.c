@@ -0,0 +1,153 @@
+/**
+  ******************************************************************************
+  * @file    aes_backend_sw.c
+  * @brief   Software AES backend, lorawan_aes.c and cmac.c
+  * @note    See aes_backend.h. Reference implementation of the interface.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "aes_backend.h"
+
+#if (LORAWAN_AES_BACKEND == LORAWAN_AES_BACKEND_SOFTWARE)
+#include "cmac.h"
+#include "utilities.h"
+
+/* Private function prototypes -----------------------------------------------*/
+static void AesBackend_CmacChain(AES_CMAC_CTX *ctx, const uint8_t *block);
+
+/* Exported functions --------------------------------------------------------*/
+void AesBackend_Init(void)
+{
+}
+
+void AesBackend_SetKey(const uint8_t key[AES_BACKEND_BLOCK_SIZE], AesBackend_Key_t *prepared)
+{
+  memset1((uint8_t *)&prepared->Schedule, '\0', sizeof(prepared->Schedule));
+  lorawan_aes_set_key(key, AES_BACKEND_BLOCK_SIZE, &prepared->Schedule);
+}
+
+void AesBackend_EncryptEcb(const AesBackend_Key_t *key, const uint8_t *in, uint8_t *out, uint16_t size)
+{
+  for (uint16_t block = 0; block < size; block += AES_BACKEND_BLOCK_SIZE)
+  {
+    lorawan_aes_encrypt(&in[block], &out[block], &key->Schedule);
+  }
+}
+
+void AesBackend_Ctr(const AesBackend_Key_t *key, const uint8_t ctrBlock[AES_BACKEND_BLOCK_SIZE],
+                    uint8_t *buffer, uint16_t size)
+{
+  uint8_t aBlock[AES_BACKEND_BLOCK_SIZE];
+  uint8_t sBlock[AES_BACKEND_BLOCK_SIZE];
+  uint16_t bufferIndex = 0;
+  uint8_t blockSize;
+
+  memcpy1(aBlock, ctrBlock, AES_BACKEND_BLOCK_SIZE);
+  while (size > 0)
+  {
+    lorawan_aes_encrypt(aBlock, sBlock, &key->Schedule);
+    aBlock[AES_BACKEND_BLOCK_SIZE - 1]++;
+
+    blockSize = (size > AES_BACKEND_BLOCK_SIZE) ? AES_BACKEND_BLOCK_SIZE : (uint8_t)size;
+    for (uint8_t i = 0; i < blockSize; i++)
+    {
+      buffer[bufferIndex + i] ^= sBlock[i];
+    }
+    size -= blockSize;
+    bufferIndex += blockSize;
+  }
+}
+
+void AesBackend_Cmac(const AesBackend_Key_t *key, const uint8_t *firstBlock, const uint8_t *buffer,
+                     uint16_t size, uint8_t mac[AES_BACKEND_BLOCK_SIZE])
+{
+  AES_CMAC_CTX aesCmacCtx[1];
+
+  AES_CMAC_Init(aesCmacCtx);
+  AES_CMAC_SetKeySchedule(aesCmacCtx, &key->Schedule);
+  if (firstBlock != NULL)
+  {
+    AES_CMAC_Update(aesCmacCtx, firstBlock, AES_BACKEND_BLOCK_SIZE);
+  }
+  AES_CMAC_Update(aesCmacCtx, buffer, size);
+  AES_CMAC_Final(mac, aesCmacCtx);
+}
+
+void AesBackend_CtrCmac(const AesBackend_Key_t *ctrKey, const uint8_t ctrBlock[AES_BACKEND_BLOCK_SIZE],
+                        uint8_t *buffer, uint16_t size, uint16_t encOffset, uint16_t encSize,
+                        AesBackend_CmacJob_t *cmacs, uint8_t cmacCount)
+{
+  AES_CMAC_CTX aesCmacCtx[AES_BACKEND_MAX_CMACS];
+  uint8_t aBlock[AES_BACKEND_BLOCK_SIZE];
+  uint8_t sBlock[AES_BACKEND_BLOCK_SIZE];
+  uint8_t sIndex = AES_BACKEND_BLOCK_SIZE;
+  uint16_t encEnd = encOffset + encSize;
+  uint16_t block = 0;
+  uint8_t blockSize;
+
+  memcpy1(aBlock, ctrBlock, AES_BACKEND_BLOCK_SIZE);
+  for (uint8_t i = 0; i < cmacCount; i++)
+  {
+    AES_CMAC_Init(&aesCmacCtx[i]);
+    AES_CMAC_SetKeySchedule(&aesCmacCtx[i], &cmacs[i].Key->Schedule);
+    if ((cmacs[i].FirstBlock != NULL) && (size > 0))
+    {
+      AesBackend_CmacChain(&aesCmacCtx[i], cmacs[i].FirstBlock);
+    }
+    else if (cmacs[i].FirstBlock != NULL)
+    {
+      AES_CMAC_Update(&aesCmacCtx[i], cmacs[i].FirstBlock, AES_BACKEND_BLOCK_SIZE);
+    }
+  }
+
+  /* The frame is walked once in CMAC blocks: the payload bytes of a block
+     are encrypted, then the block is chained into every CMAC. The last
+     block goes through AES_CMAC_Update() for the padding and subkey */
+  while (block < size)
+  {
+    blockSize = ((size - block) > AES_BACKEND_BLOCK_SIZE) ? AES_BACKEND_BLOCK_SIZE : (uint8_t)(size - block);
+    for (uint16_t n = MAX(block, encOffset); n < MIN(block + blockSize, encEnd); n++)
+    {
+      if (sIndex == AES_BACKEND_BLOCK_SIZE)
+      {
+        lorawan_aes_encrypt(aBlock, sBlock, &ctrKey->Schedule);
+        aBlock[AES_BACKEND_BLOCK_SIZE - 1]++;
+        sIndex = 0;
+      }
+      buffer[n] ^= sBlock[sIndex++];
+    }
+    for (uint8_t i = 0; i < cmacCount; i++)
+    {
+      if ((block + blockSize) < size)
+      {
+        AesBackend_CmacChain(&aesCmacCtx[i], &buffer[block]);
+      }
+      else
+      {
+        AES_CMAC_Update(&aesCmacCtx[i], &buffer[block], blockSize);
+      }
+    }
+    block += blockSize;
+  }
+
+  for (uint8_t i = 0; i < cmacCount; i++)
+  {
+    AES_CMAC_Final(cmacs[i].Mac, &aesCmacCtx[i]);
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Chain a complete block that is not the last one into a CMAC
+  */
+static void AesBackend_CmacChain(AES_CMAC_CTX *ctx, const uint8_t *block)
+{
+  for (uint8_t i = 0; i < AES_BACKEND_BLOCK_SIZE; i++)
+  {
+    ctx->X[i] ^= block[i];
+  }
+  lorawan_aes_encrypt(ctx->X, ctx->X, &ctx->rijndael);
+}
+
+#endif /* LORAWAN_AES_BACKEND_SOFTWARE */
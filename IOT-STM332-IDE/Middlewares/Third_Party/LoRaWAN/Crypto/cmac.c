@@ -68,6 +68,12 @@ void AES_CMAC_SetKey( AES_CMAC_CTX* ctx, const uint8_t key[AES_CMAC_KEY_LENGTH]
     lorawan_aes_set_key( key, AES_CMAC_KEY_LENGTH, &ctx->rijndael );
 }
 
+void AES_CMAC_SetKeySchedule( AES_CMAC_CTX* ctx, const lorawan_aes_context* keySchedule )
+{
+    // Key already expanded by the caller
+    memcpy1( ( uint8_t* ) &ctx->rijndael, ( const uint8_t* ) keySchedule, sizeof( ctx->rijndael ) );
+}
+
 void AES_CMAC_Update( AES_CMAC_CTX* ctx, const uint8_t* data, uint32_t len )
 {
     uint32_t mlen;
@@ -62,8 +62,20 @@
 #  define VERSION_1
 #endif
 
+/* define to encrypt with 32-bit words and a combined SubBytes/MixColumns
+   table (1 kB more of tables) instead of the 8-bit byte operations, build
+   with LORAWAN_AES_TTABLE=0 to keep the byte operations */
+#if !defined( LORAWAN_AES_TTABLE ) || ( LORAWAN_AES_TTABLE != 0 )
+#  define AES_ENC_TTABLE
+#endif
+
 #include "lorawan_aes.h"
 
+/* the byte oriented encryption rounds, unless the T-table replaces them */
+#if !defined( AES_ENC_TTABLE ) || defined( AES_ENC_128_OTFK ) || defined( AES_ENC_256_OTFK )
+#  define BYTE_ENC_ROUNDS
+#endif
+
 //#if defined( HAVE_UINT_32T )
 //  typedef unsigned long uint32_t;
 //#endif
@@ -197,8 +209,17 @@ static const uint8_t sbox[256]  =  sb_data(f1);
 static const uint8_t isbox[256] = isb_data(f1);
 #endif
 
+#if defined( BYTE_ENC_ROUNDS )
 static const uint8_t gfm2_sbox[256] = sb_data(f2);
 static const uint8_t gfm3_sbox[256] = sb_data(f3);
+#endif
+
+#if defined( AES_ENC_TTABLE )
+/* column (2s, s, s, 3s) of MixColumns for s = S(x), row 0 in the low byte */
+#define t_col(x)    ((uint32_t)f2(x) | ((uint32_t)(x) << 8) | ((uint32_t)(x) << 16) \
+                          | ((uint32_t)f3(x) << 24))
+static const uint32_t t_enc[256] = sb_data(t_col);
+#endif
 
 #if defined( AES_DEC_PREKEYED )
 static const uint8_t gfmul_9[256] = mm_data(f9);
@@ -213,6 +234,9 @@ static const uint8_t gfmul_e[256] = mm_data(fe);
 #endif
 #define gfm2_sb(x)   gfm2_sbox[(x)]
 #define gfm3_sb(x)   gfm3_sbox[(x)]
+#if defined( AES_ENC_TTABLE )
+#define t_box(x)     t_enc[(x)]
+#endif
 #if defined( AES_DEC_PREKEYED )
 #define gfm_9(x)     gfmul_9[(x)]
 #define gfm_b(x)     gfmul_b[(x)]
@@ -373,6 +397,9 @@ static void xor_block( void *d, const void *s )
 #endif
 }
 
+#if defined( BYTE_ENC_ROUNDS ) || defined( AES_DEC_PREKEYED ) || defined( AES_DEC_128_OTFK ) \
+    || defined( AES_DEC_256_OTFK )
+
 static void copy_and_key( void *d, const void *s, const void *k )
 {
 #if defined( HAVE_UINT_32T )
@@ -408,6 +435,10 @@ static void add_round_key( uint8_t d[N_BLOCK], const uint8_t k[N_BLOCK] )
     xor_block(d, k);
 }
 
+#endif
+
+#if defined( BYTE_ENC_ROUNDS )
+
 static void shift_sub_rows( uint8_t st[N_BLOCK] )
 {   uint8_t tt;
 
@@ -424,6 +455,8 @@ static void shift_sub_rows( uint8_t st[N_BLOCK] )
     st[ 7] = s_box(st[ 3]); st[ 3] = s_box( tt );
 }
 
+#endif
+
 #if defined( AES_DEC_PREKEYED )
 
 static void inv_shift_sub_rows( uint8_t st[N_BLOCK] )
@@ -444,6 +477,8 @@ static void inv_shift_sub_rows( uint8_t st[N_BLOCK] )
 
 #endif
 
+#if defined( BYTE_ENC_ROUNDS )
+
 #if defined( VERSION_1 )
   static void mix_sub_columns( uint8_t dt[N_BLOCK] )
   { uint8_t st[N_BLOCK];
@@ -473,6 +508,8 @@ static void inv_shift_sub_rows( uint8_t st[N_BLOCK] )
     dt[15] = gfm3_sb(st[12]) ^ s_box(st[1]) ^ s_box(st[6]) ^ gfm2_sb(st[11]);
   }
 
+#endif
+
 #if defined( AES_DEC_PREKEYED )
 
 #if defined( VERSION_1 )
@@ -563,6 +600,74 @@ return_type lorawan_aes_set_key( const uint8_t key[], length_type keylen, lorawa
 
 #if defined( AES_ENC_PREKEYED )
 
+#if defined( AES_ENC_TTABLE )
+
+#if !defined( USE_TABLES )
+#  error "AES_ENC_TTABLE needs USE_TABLES"
+#endif
+
+#define rotl32(x, n)    (((x) << (n)) | ((x) >> (32 - (n))))
+
+/* one column of SubBytes, ShiftRows and MixColumns, a to d are the state
+   columns from which rows 0 to 3 are taken */
+#define t_round(a, b, c, d)   (t_box((a) & 0xff) ^ rotl32(t_box(((b) >> 8) & 0xff), 8) \
+                              ^ rotl32(t_box(((c) >> 16) & 0xff), 16) ^ rotl32(t_box((d) >> 24), 24))
+
+/* one column of the last round, SubBytes and ShiftRows only */
+#define f_round(a, b, c, d)   ((uint32_t)s_box((a) & 0xff) | ((uint32_t)s_box(((b) >> 8) & 0xff) << 8) \
+                              | ((uint32_t)s_box(((c) >> 16) & 0xff) << 16) | ((uint32_t)s_box((d) >> 24) << 24))
+
+/* a column of 4 bytes as a word, row 0 in the low byte, any alignment */
+static uint32_t load_col( const uint8_t *p )
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void store_col( uint8_t *p, uint32_t w )
+{
+    p[0] = (uint8_t)w;
+    p[1] = (uint8_t)(w >> 8);
+    p[2] = (uint8_t)(w >> 16);
+    p[3] = (uint8_t)(w >> 24);
+}
+
+/*  Encrypt a single block of 16 bytes, the state is kept in four column
+    words and each round is four table lookups per column */
+
+return_type lorawan_aes_encrypt( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK], const lorawan_aes_context ctx[1] )
+{
+    const uint8_t *rk = ctx->ksch;
+    uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+    uint8_t r;
+
+    if( !ctx->rnd )
+        return ( uint8_t )-1;
+
+    s0 = load_col(in +  0) ^ load_col(rk +  0);
+    s1 = load_col(in +  4) ^ load_col(rk +  4);
+    s2 = load_col(in +  8) ^ load_col(rk +  8);
+    s3 = load_col(in + 12) ^ load_col(rk + 12);
+
+    for( r = 1 ; r < ctx->rnd ; ++r )
+    {
+        rk += N_BLOCK;
+        t0 = t_round(s0, s1, s2, s3) ^ load_col(rk +  0);
+        t1 = t_round(s1, s2, s3, s0) ^ load_col(rk +  4);
+        t2 = t_round(s2, s3, s0, s1) ^ load_col(rk +  8);
+        t3 = t_round(s3, s0, s1, s2) ^ load_col(rk + 12);
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    rk += N_BLOCK;
+    store_col(out +  0, f_round(s0, s1, s2, s3) ^ load_col(rk +  0));
+    store_col(out +  4, f_round(s1, s2, s3, s0) ^ load_col(rk +  4));
+    store_col(out +  8, f_round(s2, s3, s0, s1) ^ load_col(rk +  8));
+    store_col(out + 12, f_round(s3, s0, s1, s2) ^ load_col(rk + 12));
+    return 0;
+}
+
+#else
+
 /*  Encrypt a single block of 16 bytes */
 
 return_type lorawan_aes_encrypt( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK], const lorawan_aes_context ctx[1] )
@@ -592,6 +697,8 @@ return_type lorawan_aes_encrypt( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK
     return 0;
 }
 
+#endif
+
 /* CBC encrypt a number of blocks (input and return an IV) */
 
 return_type lorawan_aes_cbc_encrypt( const uint8_t *in, uint8_t *out,
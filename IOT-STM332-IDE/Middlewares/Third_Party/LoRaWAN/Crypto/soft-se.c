@@ -53,8 +53,7 @@
 #include "se-identity.h"
 
 #if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
-#include "lorawan_aes.h"
-#include "cmac.h"
+#include "aes_backend.h"
 #else /* LORAWAN_KMS == 1 */
 #include "mw_log_conf.h"   /* needed for MW_LOG */
 #include "kms_if.h"
@@ -87,6 +86,21 @@
                                         + LORAMAC_JOIN_EUI_FIELD_SIZE + DEV_NONCE_SIZE + LORAMAC_MHDR_FIELD_SIZE )
 
 #if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
+/*!
+ * Number of expanded AES key schedules kept between calls, at least 1. An
+ * uplink uses one encryption key and one (1.0.x) or two (1.1.x) MIC keys,
+ * SecureElementAesCtrEncryptCmac() runs in one pass when they all fit
+ */
+#ifndef SE_KEY_SCHEDULE_CACHE_SIZE
+#if ( USE_LRWAN_1_1_X_CRYPTO == 1 )
+#define SE_KEY_SCHEDULE_CACHE_SIZE    3U
+#else /* USE_LRWAN_1_1_X_CRYPTO == 0 */
+#define SE_KEY_SCHEDULE_CACHE_SIZE    2U
+#endif /* USE_LRWAN_1_1_X_CRYPTO */
+#endif /* SE_KEY_SCHEDULE_CACHE_SIZE */
+#if ( SE_KEY_SCHEDULE_CACHE_SIZE < 1 )
+#error SE_KEY_SCHEDULE_CACHE_SIZE must be at least 1
+#endif /* SE_KEY_SCHEDULE_CACHE_SIZE */
 #else /* LORAWAN_KMS == 1 */
 #define DERIVED_OBJECT_HANDLE_RESET_VAL      0x0UL
 #define PAYLOAD_MAX_SIZE     270UL  /* 270 PHYPayload: 1+(22+1+242)+4 */
@@ -152,6 +166,32 @@ typedef struct sSecureElementNvCtx
   Key_t KeyList[NUM_OF_KEYS];
 } SecureElementNvCtx_t;
 
+#if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
+/*
+ * Key prepared for the AES backend, so the key is not expanded again on
+ * every block and every MIC
+ */
+typedef struct sKeySchedule
+{
+  /*
+   * Key identifier, valid when Valid is set
+   */
+  KeyIdentifier_t KeyID;
+  /*
+   * Set once Context holds the schedule of KeyID
+   */
+  uint8_t Valid;
+  /*
+   * Value of KeyScheduleClock at the last use
+   */
+  uint32_t LastUse;
+  /*
+   * Prepared key
+   */
+  AesBackend_Key_t Context;
+} KeySchedule_t;
+#endif /* LORAWAN_KMS == 0 */
+
 /* Private variables ---------------------------------------------------------*/
 /*!
  * Secure element context
@@ -173,6 +213,12 @@ static SecureElementNvCtx_t SeNvmCtx =
 
 #if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
 static const Key_t InitialKeyList[NUM_OF_KEYS] = SOFT_SE_KEY_LIST;
+
+/*
+ * Key schedule cache, the least recently used entry is replaced on a miss
+ */
+static KeySchedule_t KeyScheduleCache[SE_KEY_SCHEDULE_CACHE_SIZE];
+static uint32_t KeyScheduleClock = 0;
 #endif /* LORAWAN_KMS == 0 */
 
 static SecureElementNvmEvent SeNvmCtxChanged;
@@ -206,6 +252,8 @@ static uint8_t tag[SE_KEY_SIZE] ALIGN(4) = {0};
 /* Private functions prototypes ---------------------------------------------------*/
 #if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
 static SecureElementStatus_t GetKeyByID(KeyIdentifier_t keyID, Key_t **keyItem);
+static SecureElementStatus_t GetKeySchedule(KeyIdentifier_t keyID, AesBackend_Key_t **context);
+static void ClearKeySchedules(void);
 #else /* LORAWAN_KMS == 1 */
 static SecureElementStatus_t GetKeyIndexByID(KeyIdentifier_t keyID, CK_OBJECT_HANDLE *keyItem);
 #endif /* LORAWAN_KMS */
@@ -236,6 +284,63 @@ static SecureElementStatus_t GetKeyByID(KeyIdentifier_t keyID, Key_t **keyItem)
   return SECURE_ELEMENT_ERROR_INVALID_KEY_ID;
 }
 
+/*
+ * Gets the expanded key schedule of a key, expanding it on a cache miss.
+ *
+ * \param[IN]  keyID          - Key identifier
+ * \param[OUT] context        - Key schedule, stays valid over the next
+ *                              SE_KEY_SCHEDULE_CACHE_SIZE - 1 lookups
+ * \retval                    - Status of the operation
+ */
+static SecureElementStatus_t GetKeySchedule(KeyIdentifier_t keyID, AesBackend_Key_t **context)
+{
+  SecureElementStatus_t retval;
+  KeySchedule_t *entry = &KeyScheduleCache[0];
+  Key_t *keyItem;
+
+  KeyScheduleClock++;
+  for (uint8_t i = 0; i < SE_KEY_SCHEDULE_CACHE_SIZE; i++)
+  {
+    if ((KeyScheduleCache[i].Valid != 0) && (KeyScheduleCache[i].KeyID == keyID))
+    {
+      KeyScheduleCache[i].LastUse = KeyScheduleClock;
+      *context = &KeyScheduleCache[i].Context;
+      return SECURE_ELEMENT_SUCCESS;
+    }
+    /* Replace an empty entry, otherwise the oldest one */
+    if ((entry->Valid != 0) && ((KeyScheduleCache[i].Valid == 0)
+                                || ((KeyScheduleClock - KeyScheduleCache[i].LastUse) > (KeyScheduleClock - entry->LastUse))))
+    {
+      entry = &KeyScheduleCache[i];
+    }
+  }
+
+  retval = GetKeyByID(keyID, &keyItem);
+  if (retval != SECURE_ELEMENT_SUCCESS)
+  {
+    return retval;
+  }
+
+  AesBackend_SetKey(keyItem->KeyValue, &entry->Context);
+  entry->KeyID = keyID;
+  entry->Valid = 1;
+  entry->LastUse = KeyScheduleClock;
+
+  *context = &entry->Context;
+  return SECURE_ELEMENT_SUCCESS;
+}
+
+/*
+ * Drops the cached key schedules, after a key changed
+ */
+static void ClearKeySchedules(void)
+{
+  for (uint8_t i = 0; i < SE_KEY_SCHEDULE_CACHE_SIZE; i++)
+  {
+    KeyScheduleCache[i].Valid = 0;
+  }
+}
+
 #else /* LORAWAN_KMS == 1 */
 
 /*
@@ -291,25 +396,13 @@ static SecureElementStatus_t ComputeCmac(uint8_t *micBxBuffer, uint8_t *buffer,
 
 #if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
   uint8_t Cmac[16];
-  AES_CMAC_CTX aesCmacCtx[1];
 
-  AES_CMAC_Init(aesCmacCtx);
-
-  Key_t *keyItem;
-  retval = GetKeyByID(keyID, &keyItem);
+  AesBackend_Key_t *keySchedule;
+  retval = GetKeySchedule(keyID, &keySchedule);
 
   if (retval == SECURE_ELEMENT_SUCCESS)
   {
-    AES_CMAC_SetKey(aesCmacCtx, keyItem->KeyValue);
-
-    if (micBxBuffer != NULL)
-    {
-      AES_CMAC_Update(aesCmacCtx, micBxBuffer, 16);
-    }
-
-    AES_CMAC_Update(aesCmacCtx, buffer, size);
-
-    AES_CMAC_Final(Cmac, aesCmacCtx);
+    AesBackend_Cmac(keySchedule, micBxBuffer, buffer, size, Cmac);
 
     /* Bring into the required format */
     *cmac = (uint32_t)((uint32_t) Cmac[3] << 24 | (uint32_t) Cmac[2] << 16 | (uint32_t) Cmac[1] << 8 |
@@ -400,6 +493,8 @@ SecureElementStatus_t SecureElementInit(SecureElementNvmEvent seNvmCtxChanged)
 
   /* Initialize LoRaWAN Key List buffer */
   memcpy1((uint8_t *)(SeNvmCtx.KeyList), (const uint8_t *)InitialKeyList, sizeof(Key_t)*NUM_OF_KEYS);
+  AesBackend_Init();
+  ClearKeySchedules();
 
   retval = GetKeyByID(APP_KEY, &keyItem);
   KEY_LOG(TS_OFF, VLEVEL_M, "###### OTAA ######\r\n");
@@ -528,6 +623,9 @@ SecureElementStatus_t SecureElementRestoreNvmCtx(void *seNvmCtx)
   if (seNvmCtx != 0)
   {
     memcpy1((uint8_t *) &SeNvmCtx, (uint8_t *) seNvmCtx, sizeof(SeNvmCtx));
+#if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
+    ClearKeySchedules();
+#endif /* LORAWAN_KMS == 0 */
     return SECURE_ELEMENT_SUCCESS;
   }
   else
@@ -567,6 +665,7 @@ SecureElementStatus_t SecureElementSetKey(KeyIdentifier_t keyID, uint8_t *key)
         retval = SecureElementAesEncrypt(key, 16, MC_KE_KEY, decryptedKey);
 
         memcpy1(SeNvmCtx.KeyList[i].KeyValue, decryptedKey, SE_KEY_SIZE);
+        ClearKeySchedules();
         SeNvmCtxChanged();
 
         return retval;
@@ -574,6 +673,7 @@ SecureElementStatus_t SecureElementSetKey(KeyIdentifier_t keyID, uint8_t *key)
       else
       {
         memcpy1(SeNvmCtx.KeyList[i].KeyValue, key, SE_KEY_SIZE);
+        ClearKeySchedules();
         SeNvmCtxChanged();
         return SECURE_ELEMENT_SUCCESS;
       }
@@ -703,24 +803,12 @@ SecureElementStatus_t SecureElementAesEncrypt(uint8_t *buffer, uint16_t size, Ke
   }
 
 #if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
-  lorawan_aes_context aesContext;
-  memset1(aesContext.ksch, '\0', 240);
-
-  Key_t *pItem;
-  retval = GetKeyByID(keyID, &pItem);
+  AesBackend_Key_t *aesContext;
+  retval = GetKeySchedule(keyID, &aesContext);
 
   if (retval == SECURE_ELEMENT_SUCCESS)
   {
-    lorawan_aes_set_key(pItem->KeyValue, 16, &aesContext);
-
-    uint8_t block = 0;
-
-    while (size != 0)
-    {
-      lorawan_aes_encrypt(&buffer[block], &encBuffer[block], &aesContext);
-      block = block + 16;
-      size = size - 16;
-    }
+    AesBackend_EncryptEcb(aesContext, buffer, encBuffer, size);
   }
 #else /* LORAWAN_KMS == 1 */
   CK_RV rv;
@@ -777,6 +865,121 @@ SecureElementStatus_t SecureElementAesEncrypt(uint8_t *buffer, uint16_t size, Ke
   return retval;
 }
 
+SecureElementStatus_t SecureElementAesCtrEncrypt(uint8_t *ctrBlock, uint8_t *buffer, uint16_t size,
+                                                 KeyIdentifier_t keyID)
+{
+  SecureElementStatus_t retval = SECURE_ELEMENT_SUCCESS;
+
+  if ((ctrBlock == NULL) || (buffer == NULL))
+  {
+    return SECURE_ELEMENT_ERROR_NPE;
+  }
+
+#if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
+  /* One key lookup for the whole buffer */
+  AesBackend_Key_t *aesContext;
+  retval = GetKeySchedule(keyID, &aesContext);
+  if (retval == SECURE_ELEMENT_SUCCESS)
+  {
+    AesBackend_Ctr(aesContext, ctrBlock, buffer, size);
+  }
+#else /* LORAWAN_KMS == 1 */
+  uint8_t aBlock[16];
+  uint8_t sBlock[16];
+  uint16_t bufferIndex = 0;
+  uint8_t blockSize;
+
+  memcpy1(aBlock, ctrBlock, 16);
+  while (size > 0)
+  {
+    retval = SecureElementAesEncrypt(aBlock, 16, keyID, sBlock);
+    if (retval != SECURE_ELEMENT_SUCCESS)
+    {
+      return retval;
+    }
+    aBlock[15]++;
+
+    blockSize = (size > 16) ? 16 : (uint8_t)size;
+    for (uint8_t i = 0; i < blockSize; i++)
+    {
+      buffer[bufferIndex + i] ^= sBlock[i];
+    }
+    size -= blockSize;
+    bufferIndex += blockSize;
+  }
+#endif /* LORAWAN_KMS */
+
+  return retval;
+}
+
+SecureElementStatus_t SecureElementAesCtrEncryptCmac(uint8_t *ctrBlock, KeyIdentifier_t encKeyID, uint8_t *buffer,
+                                                     uint16_t size, uint16_t encOffset, uint16_t encSize,
+                                                     SecureElementFrameCmac_t *cmacs, uint8_t nbCmacs)
+{
+  SecureElementStatus_t retval = SECURE_ELEMENT_SUCCESS;
+
+  if ((ctrBlock == NULL) || (buffer == NULL) || (cmacs == NULL))
+  {
+    return SECURE_ELEMENT_ERROR_NPE;
+  }
+  if ((nbCmacs == 0) || (nbCmacs > SE_MAX_FRAME_CMACS) || (((uint32_t)encOffset + encSize) > size))
+  {
+    return SECURE_ELEMENT_ERROR_BUF_SIZE;
+  }
+  for (uint8_t i = 0; i < nbCmacs; i++)
+  {
+    if (cmacs[i].KeyID >= LORAMAC_CRYPTO_MULTICAST_KEYS)
+    {
+      /* Never accept multicast key identifier for cmac computation */
+      return SECURE_ELEMENT_ERROR_INVALID_KEY_ID;
+    }
+  }
+
+#if (!defined (LORAWAN_KMS) || (LORAWAN_KMS == 0))
+  /* One pass when all the keys stay in the cache together */
+  if ((1U + nbCmacs) <= SE_KEY_SCHEDULE_CACHE_SIZE)
+  {
+    AesBackend_CmacJob_t jobs[SE_MAX_FRAME_CMACS];
+    AesBackend_Key_t *encKey;
+    AesBackend_Key_t *cmacKey;
+
+    retval = GetKeySchedule(encKeyID, &encKey);
+    for (uint8_t i = 0; (i < nbCmacs) && (retval == SECURE_ELEMENT_SUCCESS); i++)
+    {
+      retval = GetKeySchedule(cmacs[i].KeyID, &cmacKey);
+      jobs[i].Key = cmacKey;
+      jobs[i].FirstBlock = cmacs[i].BxBlock;
+    }
+    if (retval != SECURE_ELEMENT_SUCCESS)
+    {
+      return retval;
+    }
+
+    AesBackend_CtrCmac(encKey, ctrBlock, buffer, size, encOffset, encSize, jobs, nbCmacs);
+
+    /* Bring into the required format */
+    for (uint8_t i = 0; i < nbCmacs; i++)
+    {
+      cmacs[i].Cmac = (uint32_t)((uint32_t) jobs[i].Mac[3] << 24 | (uint32_t) jobs[i].Mac[2] << 16 |
+                                 (uint32_t) jobs[i].Mac[1] << 8 | (uint32_t) jobs[i].Mac[0]);
+    }
+    return SECURE_ELEMENT_SUCCESS;
+  }
+#endif /* LORAWAN_KMS == 0 */
+
+  /* Encrypt, then one pass over the frame per cmac */
+  if (encSize > 0)
+  {
+    retval = SecureElementAesCtrEncrypt(ctrBlock, &buffer[encOffset], encSize, encKeyID);
+  }
+  for (uint8_t i = 0; (i < nbCmacs) && (retval == SECURE_ELEMENT_SUCCESS); i++)
+  {
+    retval = ComputeCmac(cmacs[i].BxBlock, buffer, size, cmacs[i].KeyID, &cmacs[i].Cmac);
+  }
+
+  return retval;
+}
+
 SecureElementStatus_t SecureElementDeriveAndStoreKey(Version_t version, uint8_t *input, KeyIdentifier_t rootKeyID,
                                                      KeyIdentifier_t targetKeyID)
 {
@@ -232,12 +232,8 @@ typedef struct sLoRaMacCtx
     * Current processed transmit message
     */
     LoRaMacMessage_t TxMsg;
-    /*!
-    * Buffer containing the data received by the application.
-    */
-    uint8_t AppData[LORAMAC_PHY_MAXPAYLOAD];
     /*
-    * Size of buffer containing the application data.
+    * Size of the application data, serialized in place in PktBuffer
     */
     uint8_t AppDataSize;
     /*
@@ -2733,7 +2729,6 @@ static LoRaMacStatus_t PrepareFrame( LoRaMacHeader_t* macHdr, LoRaMacFrameCtrl_t
         fBufferSize = 0;
     }
 
-    memcpy1( MacCtx.AppData, ( uint8_t* ) fBuffer, fBufferSize );
     MacCtx.AppDataSize = fBufferSize;
     MacCtx.PktBuffer[0] = macHdr->Value;
 
@@ -2751,7 +2746,7 @@ static LoRaMacStatus_t PrepareFrame( LoRaMacHeader_t* macHdr, LoRaMacFrameCtrl_t
             MacCtx.TxMsg.Message.Data.FHDR.DevAddr = MacCtx.NvmCtx->DevAddr;
             MacCtx.TxMsg.Message.Data.FHDR.FCtrl.Value = fCtrl->Value;
             MacCtx.TxMsg.Message.Data.FRMPayloadSize = MacCtx.AppDataSize;
-            MacCtx.TxMsg.Message.Data.FRMPayload = MacCtx.AppData;
+            MacCtx.TxMsg.Message.Data.FRMPayload = ( uint8_t* ) fBuffer;
 
             if( LORAMAC_CRYPTO_SUCCESS != LoRaMacCryptoGetFCntUp( &fCntUp ) )
             {
@@ -2793,6 +2788,12 @@ static LoRaMacStatus_t PrepareFrame( LoRaMacHeader_t* macHdr, LoRaMacFrameCtrl_t
                     {
                         return LORAMAC_STATUS_MAC_COMMAD_ERROR;
                     }
+                    // The application payload is dropped and the MAC commands go alone in the
+                    // FRMPayload, so the frame no longer refers to the application buffer.
+                    MacCtx.AppDataSize = 0;
+                    MacCtx.TxMsg.Message.Data.FPort = 0;
+                    MacCtx.TxMsg.Message.Data.FRMPayload = MacCtx.NvmCtx->MacCommandsBuffer;
+                    MacCtx.TxMsg.Message.Data.FRMPayloadSize = macCmdsSize;
                     return LORAMAC_STATUS_SKIPPED_APP_DATA;
                 }
                 // No application payload available therefore add all mac commands to the FRMPayload.
@@ -2810,6 +2811,21 @@ static LoRaMacStatus_t PrepareFrame( LoRaMacHeader_t* macHdr, LoRaMacFrameCtrl_t
                 }
             }
 
+            // Copy the application payload straight to its place in the frame, FOpts
+            // length is now known. It is encrypted there and survives retransmissions.
+            if( ( MacCtx.AppDataSize > 0 ) && ( MacCtx.TxMsg.Message.Data.FRMPayload == ( uint8_t* ) fBuffer ) )
+            {
+                size_t frmPayloadPos = LORAMAC_MHDR_FIELD_SIZE + LORAMAC_FHDR_DEV_ADDR_FIELD_SIZE +
+                                       LORAMAC_FHDR_F_CTRL_FIELD_SIZE + LORAMAC_FHDR_F_CNT_FIELD_SIZE +
+                                       fCtrl->Bits.FOptsLen + LORAMAC_F_PORT_FIELD_SIZE;
+
+                if( ( frmPayloadPos + MacCtx.AppDataSize + LORAMAC_MIC_FIELD_SIZE ) > LORAMAC_PHY_MAXPAYLOAD )
+                {
+                    return LORAMAC_STATUS_LENGTH_ERROR;
+                }
+                memcpy1( MacCtx.PktBuffer + frmPayloadPos, ( uint8_t* ) fBuffer, MacCtx.AppDataSize );
+                MacCtx.TxMsg.Message.Data.FRMPayload = MacCtx.PktBuffer + frmPayloadPos;
+            }
             break;
         case FRAME_TYPE_PROPRIETARY:
             if( ( fBuffer != NULL ) && ( MacCtx.AppDataSize > 0 ) )
@@ -239,27 +239,17 @@ static KeyAddr_t KeyAddrList[NUM_OF_SEC_CTX] =
  */
 
 /*
- * Encrypts the payload
+ * Prepares the first Ai block of the FRMPayload key stream, the next blocks
+ * are counted in its last byte.
  *
- * \param[IN]  keyID            - Key identifier
  * \param[IN]  address          - Address
  * \param[IN]  dir              - Frame direction ( Uplink or Downlink )
  * \param[IN]  frameCounter     - Frame counter
- * \param[IN]  size             - Size of data
- * \param[IN/OUT]  buffer       - Data buffer
- * \retval                      - Status of the operation
+ * \param[OUT] aBlock           - A1 block
  */
-static LoRaMacCryptoStatus_t PayloadEncrypt( uint8_t* buffer, int16_t size, KeyIdentifier_t keyID, uint32_t address, uint8_t dir, uint32_t frameCounter )
+static void PrepareA1( uint32_t address, uint8_t dir, uint32_t frameCounter, uint8_t* aBlock )
 {
-    if( buffer == 0 )
-    {
-        return LORAMAC_CRYPTO_ERROR_NPE;
-    }
-
-    uint8_t bufferIndex = 0;
-    uint16_t ctr = 1;
-    uint8_t sBlock[16] = { 0 };
-    uint8_t aBlock[16] = { 0 };
+    memset1( aBlock, 0, 16 );
 
     aBlock[0] = 0x01;
 
@@ -275,21 +265,39 @@ static LoRaMacCryptoStatus_t PayloadEncrypt( uint8_t* buffer, int16_t size, KeyI
     aBlock[12] = ( frameCounter >> 16 ) & 0xFF;
     aBlock[13] = ( frameCounter >> 24 ) & 0xFF;
 
-    while( size > 0 )
+    aBlock[15] = 0x01;
+}
+
+/*
+ * Encrypts the payload
+ *
+ * \param[IN]  keyID            - Key identifier
+ * \param[IN]  address          - Address
+ * \param[IN]  dir              - Frame direction ( Uplink or Downlink )
+ * \param[IN]  frameCounter     - Frame counter
+ * \param[IN]  size             - Size of data
+ * \param[IN/OUT]  buffer       - Data buffer
+ * \retval                      - Status of the operation
+ */
+static LoRaMacCryptoStatus_t PayloadEncrypt( uint8_t* buffer, int16_t size, KeyIdentifier_t keyID, uint32_t address, uint8_t dir, uint32_t frameCounter )
+{
+    if( buffer == 0 )
     {
-        aBlock[15] = ctr & 0xFF;
-        ctr++;
-        if( SecureElementAesEncrypt( aBlock, 16, keyID, sBlock ) != SECURE_ELEMENT_SUCCESS )
-        {
-            return LORAMAC_CRYPTO_ERROR_SECURE_ELEMENT_FUNC;
-        }
+        return LORAMAC_CRYPTO_ERROR_NPE;
+    }
 
-        for( uint8_t i = 0; i < ( ( size > 16 ) ? 16 : size ); i++ )
-        {
-            buffer[bufferIndex + i] = buffer[bufferIndex + i] ^ sBlock[i];
-        }
-        size -= 16;
-        bufferIndex += 16;
+    uint8_t aBlock[16];
+
+    PrepareA1( address, dir, frameCounter, aBlock );
+
+    // Whole FRMPayload with one key lookup, Ai blocks counted from 1
+    if( size <= 0 )
+    {
+        return LORAMAC_CRYPTO_SUCCESS;
+    }
+    if( SecureElementAesCtrEncrypt( aBlock, buffer, ( uint16_t )size, keyID ) != SECURE_ELEMENT_SUCCESS )
+    {
+        return LORAMAC_CRYPTO_ERROR_SECURE_ELEMENT_FUNC;
     }
 
     return LORAMAC_CRYPTO_SUCCESS;
@@ -441,44 +449,6 @@ static LoRaMacCryptoStatus_t PrepareB0( uint16_t msgLen, KeyIdentifier_t keyID,
     return LORAMAC_CRYPTO_SUCCESS;
 }
 
-/*
- * Computes cmac with adding B0 block in front.
- *
- *  cmac = aes128_cmac(keyID, B0 | msg)
- *
- * \param[IN]  msg            - Message to compute the integrity code
- * \param[IN]  len            - Length of message
- * \param[IN]  keyID          - Key identifier
- * \param[IN]  isAck          - True if it is a acknowledge frame ( Sets ConfFCnt in B0 block )
- * \param[IN]  devAddr        - Device address
- * \param[IN]  dir            - Frame direction ( Uplink:0, Downlink:1 )
- * \param[IN]  fCnt           - Frame counter
- * \param[OUT] cmac           - Computed cmac
- * \retval                    - Status of the operation
- */
-static LoRaMacCryptoStatus_t ComputeCmacB0( uint8_t* msg, uint16_t len, KeyIdentifier_t keyID, bool isAck, uint8_t dir, uint32_t devAddr, uint32_t fCnt, uint32_t* cmac )
-{
-    if( ( msg == 0 ) || ( cmac == 0 ) )
-    {
-        return LORAMAC_CRYPTO_ERROR_NPE;
-    }
-    if( len > CRYPTO_MAXMESSAGE_SIZE )
-    {
-        return LORAMAC_CRYPTO_ERROR_BUF_SIZE;
-    }
-
-    uint8_t micBuff[MIC_BLOCK_BX_SIZE];
-
-    // Initialize the first Block
-    PrepareB0( len, keyID, isAck, dir, devAddr, fCnt, micBuff );
-
-    if( SecureElementComputeAesCmac( micBuff, msg, len, keyID, cmac ) != SECURE_ELEMENT_SUCCESS )
-    {
-        return LORAMAC_CRYPTO_ERROR_SECURE_ELEMENT_FUNC;
-    }
-    return LORAMAC_CRYPTO_SUCCESS;
-}
-
 /*!
  * Verifies cmac with adding B0 block in front.
  *
@@ -584,45 +554,94 @@ static LoRaMacCryptoStatus_t PrepareB1( uint16_t msgLen, KeyIdentifier_t keyID,
     return LORAMAC_CRYPTO_SUCCESS;
 }
 
+#endif
+
 /*
- * Computes cmac with adding B1 block in front ( only for Uplink frames LoRaWAN 1.1 )
+ * Encrypts the FRMPayload of a serialized uplink and computes its MIC, in a
+ * single pass over the frame
  *
- *  cmac = aes128_cmac(keyID, B1 | msg)
+ *  LoRaWAN 1.0.x: MIC = aes128_cmac(NwkSKey, B0 | msg)[0..3]
+ *  LoRaWAN 1.1.x: MIC = aes128_cmac(SNwkSIntKey, B1 | msg)[0..1] | aes128_cmac(FNwkSIntKey, B0 | msg)[0..1]
  *
- * \param[IN]  msg            - Message to calculate the Integrity code
- * \param[IN]  len            - Length of message
- * \param[IN]  keyID          - Key identifier
- * \param[IN]  isAck          - True if it is a acknowledge frame ( Sets ConfFCnt in B0 block )
+ * \param[IN/OUT] macMsg      - Serialized message, MIC field not yet set
+ * \param[IN]  encKeyID       - Key identifier of the FRMPayload encryption
+ * \param[IN]  encrypt        - False if the FRMPayload is already encrypted ( retransmission )
+ * \param[IN]  fCntUp         - Uplink frame counter
  * \param[IN]  txDr           - Data rate used for the transmission
  * \param[IN]  txCh           - Index of the channel used for the transmission
- * \param[IN]  devAddr        - Device address
- * \param[IN]  fCntUp         - Uplink Frame counter
- * \param[OUT] cmac           - Computed cmac
  * \retval                    - Status of the operation
  */
-static LoRaMacCryptoStatus_t ComputeCmacB1( uint8_t* msg, uint16_t len, KeyIdentifier_t keyID, bool isAck, uint8_t txDr, uint8_t txCh, uint32_t devAddr, uint32_t fCntUp, uint32_t* cmac )
+static LoRaMacCryptoStatus_t EncryptAndComputeMic( LoRaMacMessageData_t* macMsg, KeyIdentifier_t encKeyID, bool encrypt, uint32_t fCntUp, uint8_t txDr, uint8_t txCh )
 {
-    if( ( msg == 0 ) || ( cmac == 0 ) )
-    {
-        return LORAMAC_CRYPTO_ERROR_NPE;
-    }
+    uint16_t len = macMsg->BufSize - LORAMAC_MIC_FIELD_SIZE;
+    // The FRMPayload ends the message, see LoRaMacSerializerData
+    uint16_t payloadOffset = len - macMsg->FRMPayloadSize;
+    uint16_t encSize = ( encrypt == true ) ? macMsg->FRMPayloadSize : 0;
+    uint8_t aBlock[16];
+    uint8_t b0[MIC_BLOCK_BX_SIZE];
+    SecureElementFrameCmac_t cmacs[SE_MAX_FRAME_CMACS];
+    uint8_t nbCmacs = 1;
+
     if( len > CRYPTO_MAXMESSAGE_SIZE )
     {
         return LORAMAC_CRYPTO_ERROR_BUF_SIZE;
     }
 
-    uint8_t micBuff[MIC_BLOCK_BX_SIZE];
+    PrepareA1( macMsg->FHDR.DevAddr, UPLINK, fCntUp, aBlock );
 
-    // Initialize the first Block
-    PrepareB1( len, keyID, isAck, txDr, txCh, devAddr, fCntUp, micBuff );
+#if ( USE_LRWAN_1_1_X_CRYPTO == 1 )
+    uint8_t b1[MIC_BLOCK_BX_SIZE];
 
-    if( SecureElementComputeAesCmac( micBuff, msg, len, keyID, cmac ) != SECURE_ELEMENT_SUCCESS )
+    if( CryptoCtx.NvmCtx->LrWanVersion.Fields.Minor == 1 )
+    {
+        // cmacF = aes128_cmac(FNwkSIntKey, B0 | msg)
+        PrepareB0( len, F_NWK_S_INT_KEY, macMsg->FHDR.FCtrl.Bits.Ack, UPLINK, macMsg->FHDR.DevAddr, fCntUp, b0 );
+        cmacs[0].BxBlock = b0;
+        cmacs[0].KeyID = F_NWK_S_INT_KEY;
+        // cmacS  = aes128_cmac(SNwkSIntKey, B1 | msg)
+        PrepareB1( len, S_NWK_S_INT_KEY, macMsg->FHDR.FCtrl.Bits.Ack, txDr, txCh, macMsg->FHDR.DevAddr, fCntUp, b1 );
+        cmacs[1].BxBlock = b1;
+        cmacs[1].KeyID = S_NWK_S_INT_KEY;
+        nbCmacs = 2;
+    }
+    else
+#endif
+    {
+        // The IsAck parameter is every time false since the ConfFCnt field is not used in legacy mode.
+#if ( USE_LRWAN_1_1_X_CRYPTO == 1 )
+        cmacs[0].KeyID = NWK_S_ENC_KEY;
+#else /* USE_LRWAN_1_1_X_CRYPTO == 0 */
+        cmacs[0].KeyID = NWK_S_KEY;
+#endif /* USE_LRWAN_1_1_X_CRYPTO */
+        PrepareB0( len, cmacs[0].KeyID, false, UPLINK, macMsg->FHDR.DevAddr, fCntUp, b0 );
+        cmacs[0].BxBlock = b0;
+    }
+
+    if( SecureElementAesCtrEncryptCmac( aBlock, encKeyID, macMsg->Buffer, len, payloadOffset, encSize, cmacs, nbCmacs ) != SECURE_ELEMENT_SUCCESS )
     {
         return LORAMAC_CRYPTO_ERROR_SECURE_ELEMENT_FUNC;
     }
+
+    // Only the buffer holds the encrypted FRMPayload, the bytes FRMPayload pointed at are
+    // left as they were. Point at the buffer so that serializing again, for the MIC or a
+    // retransmission, keeps the encrypted bytes.
+    if( macMsg->FRMPayloadSize > 0 )
+    {
+        macMsg->FRMPayload = &macMsg->Buffer[payloadOffset];
+    }
+
+#if ( USE_LRWAN_1_1_X_CRYPTO == 1 )
+    if( nbCmacs == 2 )
+    {
+        // MIC = cmacS[0..1] | cmacF[0..1]
+        macMsg->MIC = ( ( cmacs[0].Cmac << 16 ) & 0xFFFF0000 ) | ( cmacs[1].Cmac & 0x0000FFFF );
+        return LORAMAC_CRYPTO_SUCCESS;
+    }
+#endif
+    // MIC = cmacF[0..3]
+    macMsg->MIC = cmacs[0].Cmac;
     return LORAMAC_CRYPTO_SUCCESS;
 }
-#endif
 
 /*
  * Gets security item from list.
@@ -1402,70 +1421,32 @@ LoRaMacCryptoStatus_t LoRaMacCryptoSecureMessage( uint32_t fCntUp, uint8_t txDr,
 #endif /* USE_LRWAN_1_1_X_CRYPTO */
     }
 
-    if( fCntUp > CryptoCtx.NvmCtx->FCntList.FCntUp )
+    // A retransmission keeps the FRMPayload encrypted the first time
+    bool encrypt = ( fCntUp > CryptoCtx.NvmCtx->FCntList.FCntUp );
+
+#if ( USE_LRWAN_1_1_X_CRYPTO == 1 )
+    if( ( encrypt == true ) && ( CryptoCtx.NvmCtx->LrWanVersion.Fields.Minor == 1 ) )
     {
-        retval = PayloadEncrypt( macMsg->FRMPayload, macMsg->FRMPayloadSize, payloadDecryptionKeyID, macMsg->FHDR.DevAddr, UPLINK, fCntUp );
+        // Encrypt FOpts
+        retval = FOptsEncrypt( macMsg->FHDR.FCtrl.Bits.FOptsLen, macMsg->FHDR.DevAddr, UPLINK, FCNT_UP, fCntUp, macMsg->FHDR.FOpts );
         if( retval != LORAMAC_CRYPTO_SUCCESS )
         {
             return retval;
         }
-
-#if ( USE_LRWAN_1_1_X_CRYPTO == 1 )
-        if( CryptoCtx.NvmCtx->LrWanVersion.Fields.Minor == 1 )
-        {
-            // Encrypt FOpts
-            retval = FOptsEncrypt( macMsg->FHDR.FCtrl.Bits.FOptsLen, macMsg->FHDR.DevAddr, UPLINK, FCNT_UP, fCntUp, macMsg->FHDR.FOpts );
-            if( retval != LORAMAC_CRYPTO_SUCCESS )
-            {
-                return retval;
-            }
-        }
-#endif
     }
+#endif
 
-    // Serialize message
+    // Serialize message, the FRMPayload is encrypted afterwards in the buffer
     if( LoRaMacSerializerData( macMsg ) != LORAMAC_SERIALIZER_SUCCESS )
     {
         return LORAMAC_CRYPTO_ERROR_SERIALIZER;
     }
 
-    // Compute mic
-#if ( USE_LRWAN_1_1_X_CRYPTO == 1 )
-    if( CryptoCtx.NvmCtx->LrWanVersion.Fields.Minor == 1 )
+    // Encrypt FRMPayload and compute mic in one pass over the serialized message
+    retval = EncryptAndComputeMic( macMsg, payloadDecryptionKeyID, encrypt, fCntUp, txDr, txCh );
+    if( retval != LORAMAC_CRYPTO_SUCCESS )
     {
-        uint32_t cmacS = 0;
-        uint32_t cmacF = 0;
-
-        // cmacS  = aes128_cmac(SNwkSIntKey, B1 | msg)
-        retval = ComputeCmacB1( macMsg->Buffer, ( macMsg->BufSize - LORAMAC_MIC_FIELD_SIZE ), S_NWK_S_INT_KEY, macMsg->FHDR.FCtrl.Bits.Ack, txDr, txCh, macMsg->FHDR.DevAddr, fCntUp, &cmacS );
-        if( retval != LORAMAC_CRYPTO_SUCCESS )
-        {
-            return retval;
-        }
-        //cmacF = aes128_cmac(FNwkSIntKey, B0 | msg)
-        retval = ComputeCmacB0( macMsg->Buffer, ( macMsg->BufSize - LORAMAC_MIC_FIELD_SIZE ), F_NWK_S_INT_KEY, macMsg->FHDR.FCtrl.Bits.Ack, UPLINK, macMsg->FHDR.DevAddr, fCntUp, &cmacF );
-        if( retval != LORAMAC_CRYPTO_SUCCESS )
-        {
-            return retval;
-        }
-        // MIC = cmacS[0..1] | cmacF[0..1]
-        macMsg->MIC = ( ( cmacF << 16 ) & 0xFFFF0000 ) | ( cmacS & 0x0000FFFF );
-    }
-    else
-#endif
-    {        // Use network session key
-#if ( USE_LRWAN_1_1_X_CRYPTO == 1 )
-        payloadDecryptionKeyID = NWK_S_ENC_KEY;
-#else /* USE_LRWAN_1_1_X_CRYPTO == 0 */
-        payloadDecryptionKeyID = NWK_S_KEY;
-#endif /* USE_LRWAN_1_1_X_CRYPTO */
-        // MIC = cmacF[0..3]
-        // The IsAck parameter is every time false since the ConfFCnt field is not used in legacy mode.
-        retval = ComputeCmacB0( macMsg->Buffer, ( macMsg->BufSize - LORAMAC_MIC_FIELD_SIZE ), payloadDecryptionKeyID, false, UPLINK, macMsg->FHDR.DevAddr, fCntUp, &macMsg->MIC );
-        if( retval != LORAMAC_CRYPTO_SUCCESS )
-        {
-            return retval;
-        }
+        return retval;
     }
 
     // Re-serialize message to add the MIC
@@ -135,18 +135,43 @@ static uint16_t UpdateTimeCredits( Band_t* band, bool joined, bool dutyCycleEnab
     return dutyCycle;
 }
 
-static uint8_t CountChannels( uint16_t mask, uint8_t nbBits )
+static uint8_t CountChannels( uint16_t mask )
 {
+#if defined( __GNUC__ )
+    return ( uint8_t )__builtin_popcount( mask );
+#else
     uint8_t nbActiveBits = 0;
 
-    for( uint8_t j = 0; j < nbBits; j++ )
+    // One iteration per active bit
+    while( mask != 0 )
     {
-        if( ( mask & ( 1 << j ) ) == ( 1 << j ) )
-        {
-            nbActiveBits++;
-        }
+        mask &= mask - 1;
+        nbActiveBits++;
     }
     return nbActiveBits;
+#endif
+}
+
+/*!
+ * Index of the lowest active bit of a channels mask word, mask must not be 0.
+ * Walking the active bits only keeps the cost of the channel searches
+ * proportional to the number of enabled channels, not to the size of the
+ * channel plan ( 72 channels for US915/AU915 ).
+ */
+static uint8_t LowestChannel( uint16_t mask )
+{
+#if defined( __GNUC__ )
+    return ( uint8_t )__builtin_ctz( mask );
+#else
+    uint8_t index = 0;
+
+    while( ( mask & 0x0001 ) == 0 )
+    {
+        mask >>= 1;
+        index++;
+    }
+    return index;
+#endif
 }
 
 uint16_t RegionCommonGetJoinDc( SysTime_t elapsedTime )
@@ -177,16 +202,16 @@ bool RegionCommonChanVerifyDr( uint8_t nbChannels, uint16_t* channelsMask, int8_
 
     for( uint8_t i = 0, k = 0; i < nbChannels; i += 16, k++ )
     {
-        for( uint8_t j = 0; j < 16; j++ )
+        for( uint16_t mask = channelsMask[k]; mask != 0; mask &= mask - 1 )
         {
-            if( ( ( channelsMask[k] & ( 1 << j ) ) != 0 ) )
-            {// Check datarate validity for enabled channels
-                if( RegionCommonValueInRange( dr, ( channels[i + j].DrRange.Fields.Min & 0x0F ),
-                                                  ( channels[i + j].DrRange.Fields.Max & 0x0F ) ) == 1 )
-                {
-                    // At least 1 channel has been found we can return OK.
-                    return true;
-                }
+            uint8_t j = LowestChannel( mask );
+
+            // Check datarate validity for enabled channels
+            if( RegionCommonValueInRange( dr, ( channels[i + j].DrRange.Fields.Min & 0x0F ),
+                                              ( channels[i + j].DrRange.Fields.Max & 0x0F ) ) == 1 )
+            {
+                // At least 1 channel has been found we can return OK.
+                return true;
             }
         }
     }
@@ -228,7 +253,7 @@ uint8_t RegionCommonCountChannels( uint16_t* channelsMask, uint8_t startIdx, uin
 
     for( uint8_t i = startIdx; i < stopIdx; i++ )
     {
-        nbChannels += CountChannels( channelsMask[i], 16 );
+        nbChannels += CountChannels( channelsMask[i] );
     }
 
     return nbChannels;
@@ -475,35 +500,35 @@ void RegionCommonCountNbOfEnabledChannels( RegionCommonCountNbOfEnabledChannelsP
 
     for( uint8_t i = 0, k = 0; i < countNbOfEnabledChannelsParams->MaxNbChannels; i += 16, k++ )
     {
-        for( uint8_t j = 0; j < 16; j++ )
+        // Visit the enabled channels of the mask word only, in increasing order
+        for( uint16_t mask = countNbOfEnabledChannelsParams->ChannelsMask[k]; mask != 0; mask &= mask - 1 )
         {
-            if( ( countNbOfEnabledChannelsParams->ChannelsMask[k] & ( 1 << j ) ) != 0 )
+            uint8_t j = LowestChannel( mask );
+
+            if( countNbOfEnabledChannelsParams->Channels[i + j].Frequency == 0 )
+            { // Check if the channel is enabled
+                continue;
+            }
+            if( ( countNbOfEnabledChannelsParams->Joined == false ) &&
+                ( countNbOfEnabledChannelsParams->JoinChannels > 0 ) )
             {
-                if( countNbOfEnabledChannelsParams->Channels[i + j].Frequency == 0 )
-                { // Check if the channel is enabled
-                    continue;
-                }
-                if( ( countNbOfEnabledChannelsParams->Joined == false ) &&
-                    ( countNbOfEnabledChannelsParams->JoinChannels > 0 ) )
+                if( ( countNbOfEnabledChannelsParams->JoinChannels & ( 1 << j ) ) == 0 )
                 {
-                    if( ( countNbOfEnabledChannelsParams->JoinChannels & ( 1 << j ) ) == 0 )
-                    {
-                        continue;
-                    }
-                }
-                if( RegionCommonValueInRange( countNbOfEnabledChannelsParams->Datarate,
-                                              countNbOfEnabledChannelsParams->Channels[i + j].DrRange.Fields.Min,
-                                              countNbOfEnabledChannelsParams->Channels[i + j].DrRange.Fields.Max ) == false )
-                { // Check if the current channel selection supports the given datarate
-                    continue;
-                }
-                if( countNbOfEnabledChannelsParams->Bands[countNbOfEnabledChannelsParams->Channels[i + j].Band].ReadyForTransmission == false )
-                { // Check if the band is available for transmission
-                    nbRestrictedChannelsCount++;
                     continue;
                 }
-                enabledChannels[nbChannelCount++] = i + j;
             }
+            if( RegionCommonValueInRange( countNbOfEnabledChannelsParams->Datarate,
+                                          countNbOfEnabledChannelsParams->Channels[i + j].DrRange.Fields.Min,
+                                          countNbOfEnabledChannelsParams->Channels[i + j].DrRange.Fields.Max ) == false )
+            { // Check if the current channel selection supports the given datarate
+                continue;
+            }
+            if( countNbOfEnabledChannelsParams->Bands[countNbOfEnabledChannelsParams->Channels[i + j].Band].ReadyForTransmission == false )
+            { // Check if the band is available for transmission
+                nbRestrictedChannelsCount++;
+                continue;
+            }
+            enabledChannels[nbChannelCount++] = i + j;
         }
     }
     *nbEnabledChannels = nbChannelCount;
@@ -56,6 +56,11 @@ extern "C"
  */
 #define SE_EUI_SIZE             8
 
+/*!
+ * Maximum number of cmacs computed by SecureElementAesCtrEncryptCmac
+ */
+#define SE_MAX_FRAME_CMACS      2
+
 /*!
  * Return values.
  */
@@ -95,6 +100,25 @@ typedef enum eSecureElementStatus
     SECURE_ELEMENT_FAIL_ENCRYPT,
 }SecureElementStatus_t;
 
+/*!
+ * Cmac computed by SecureElementAesCtrEncryptCmac
+ */
+typedef struct sSecureElementFrameCmac
+{
+    /*!
+     * Block processed before the frame ( B0 or B1 ), NULL if none
+     */
+    uint8_t* BxBlock;
+    /*!
+     * Key identifier to determine the AES key to be used
+     */
+    KeyIdentifier_t KeyID;
+    /*!
+     * Computed cmac
+     */
+    uint32_t Cmac;
+}SecureElementFrameCmac_t;
+
 /*!
  * Signature of callback function to be called by the Secure Element driver when the
  * non volatile context have to be stored.
@@ -187,6 +211,38 @@ SecureElementStatus_t SecureElementVerifyAesCmac( uint8_t* buffer, uint16_t size
  */
 SecureElementStatus_t SecureElementAesEncrypt( uint8_t* buffer, uint16_t size, KeyIdentifier_t keyID, uint8_t* encBuffer );
 
+/*!
+ * Encrypt or decrypt a buffer in place in AES-CTR mode, with a single key
+ * lookup for all its blocks
+ *
+ * \param[IN]  ctrBlock       - First counter block, its last byte is incremented for each next block
+ * \param[IN/OUT] buffer      - Data buffer, XORed with the key stream
+ * \param[IN]  size           - Data buffer size, any length
+ * \param[IN]  keyID          - Key identifier to determine the AES key to be used
+ * \retval                    - Status of the operation
+ */
+SecureElementStatus_t SecureElementAesCtrEncrypt( uint8_t* ctrBlock, uint8_t* buffer, uint16_t size, KeyIdentifier_t keyID );
+
+/*!
+ * Encrypt part of a frame in place in AES-CTR mode and compute the cmacs of
+ * the resulting frame, in a single pass over the frame when possible
+ *
+ *  cmacs[i].Cmac = aes128_cmac(cmacs[i].KeyID, cmacs[i].BxBlock | buffer)
+ *
+ * \param[IN]  ctrBlock       - First counter block, see SecureElementAesCtrEncrypt
+ * \param[IN]  encKeyID       - Key identifier of the encryption
+ * \param[IN/OUT] buffer      - Frame
+ * \param[IN]  size           - Frame size
+ * \param[IN]  encOffset      - Offset of the first byte to encrypt
+ * \param[IN]  encSize        - Number of bytes to encrypt, may be 0
+ * \param[IN/OUT] cmacs       - Cmacs to compute
+ * \param[IN]  nbCmacs        - Number of cmacs, 1 to SE_MAX_FRAME_CMACS
+ * \retval                    - Status of the operation
+ */
+SecureElementStatus_t SecureElementAesCtrEncryptCmac( uint8_t* ctrBlock, KeyIdentifier_t encKeyID, uint8_t* buffer,
+                                                      uint16_t size, uint16_t encOffset, uint16_t encSize,
+                                                      SecureElementFrameCmac_t* cmacs, uint8_t nbCmacs );
+
 /*!
  * Derives and store a key
  *
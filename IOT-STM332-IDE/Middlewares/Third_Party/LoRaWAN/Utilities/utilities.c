@@ -31,6 +31,7 @@
   ******************************************************************************
   */
 
+#include "stm32_mem.h"
 #include "utilities.h"
 
 /*!
@@ -61,29 +62,20 @@ int32_t randr( int32_t min, int32_t max )
     return ( int32_t )rand1( ) % ( max - min + 1 ) + min;
 }
 
+// Word-wide implementations of the utilities layer
 void memcpy1( uint8_t *dst, const uint8_t *src, uint16_t size )
 {
-    while( size-- )
-    {
-        *dst++ = *src++;
-    }
+    UTIL_MEM_cpy_8( dst, src, size );
 }
 
 void memcpyr( uint8_t *dst, const uint8_t *src, uint16_t size )
 {
-    dst = dst + ( size - 1 );
-    while( size-- )
-    {
-        *dst-- = *src++;
-    }
+    UTIL_MEM_cpyr_8( dst, src, size );
 }
 
 void memset1( uint8_t *dst, uint8_t value, uint16_t size )
 {
-    while( size-- )
-    {
-        *dst++ = value;
-    }
+    UTIL_MEM_set_8( dst, value, size );
 }
 
 int8_t Nibble2HexChar( uint8_t a )
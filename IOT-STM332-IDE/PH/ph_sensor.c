@@ -8,9 +8,16 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "ph_sensor.h"
+#include "calib_store.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
+#define PH_LINEAR_OFFSET_MV         500.0f           // Voltage of pH 14 in the linear mapping
+
+/* Fixed-point constants */
+#define PH_Q24_ONE                  16777216.0f
+#define PH_ADC_TO_MV_Q16            ((int32_t)((((int64_t)PH_SENSOR_VREF << 16) + (PH_SENSOR_ADC_RESOLUTION / 2)) / PH_SENSOR_ADC_RESOLUTION))
+#define PH_TEMP_COEFFICIENT_Q24     ((int32_t)(PH_TEMP_COEFFICIENT * PH_Q24_ONE + 0.5f))
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 static pH_CalibrationTypeDef phCalibration = {
@@ -20,6 +27,9 @@ static pH_CalibrationTypeDef phCalibration = {
     .isCalibrated = 0
 };
 
+// Reciprocal of the calibration slope (pH/mV, Q24), updated with phCalibration
+static int32_t phInvSlopeQ24 = (int32_t)(PH_Q24_ONE / PH_DEFAULT_SLOPE + 0.5f);
+
 // External shared ADC variables (declared in tds_sensor.c)
 extern uint16_t g_adcChannelValues[4];
 extern uint32_t g_lastAdcReadTime;
@@ -33,7 +43,9 @@ extern uint16_t ADC_GetChannelValue(uint8_t rank);
 
 /* Private function prototypes -----------------------------------------------*/
 static float pH_CalculateSlope(float voltage4, float voltage7);
-static float pH_ApplyTemperatureCompensation(float phValue, float temperature);
+static int32_t pH_ApplyTemperatureCompensationQ16(int32_t phValue, int32_t temperature);
+static void pH_UpdateFixedCalibration(void);
+static void pH_SetDefaultCalibration(void);
 
 /* Private functions ---------------------------------------------------------*/
 
@@ -51,17 +63,38 @@ static float pH_CalculateSlope(float voltage4, float voltage7)
 
 /**
  * @brief Apply temperature compensation to pH reading
- * @param phValue: pH value at current temperature
- * @param temperature: Current temperature in °C
- * @retval Temperature compensated pH value
+ * @param phValue: pH value at current temperature (Q16)
+ * @param temperature: Current temperature in °C (Q16)
+ * @retval Temperature compensated pH value (Q16)
  */
-static float pH_ApplyTemperatureCompensation(float phValue, float temperature)
+static int32_t pH_ApplyTemperatureCompensationQ16(int32_t phValue, int32_t temperature)
 {
-    float tempDiff = temperature - PH_REFERENCE_TEMP;
-    float compensation = (PH_NEUTRAL_VALUE - phValue) * PH_TEMP_COEFFICIENT * tempDiff;
+    // (7 - pH) * (T - 25) is Q32, the coefficient Q24
+    int64_t product = (int64_t)(PH_Q16(PH_NEUTRAL_VALUE) - phValue) * (temperature - PH_Q16(PH_REFERENCE_TEMP));
+    int32_t compensation = (int32_t)((product * PH_TEMP_COEFFICIENT_Q24) >> 40);
     return phValue + compensation;
 }
 
+/**
+ * @brief Precompute the fixed-point calibration after a change of phCalibration
+ */
+static void pH_UpdateFixedCalibration(void)
+{
+    float invSlope = PH_Q24_ONE / phCalibration.slope;
+    phInvSlopeQ24 = (int32_t)(invSlope + ((invSlope < 0.0f) ? -0.5f : 0.5f));
+}
+
+/**
+ * @brief Set the default calibration, the stored one is kept
+ */
+static void pH_SetDefaultCalibration(void)
+{
+    phCalibration.neutralVoltage = PH_DEFAULT_NEUTRAL_VOLTAGE;
+    phCalibration.acidVoltage = 0.0f;
+    phCalibration.slope = PH_DEFAULT_SLOPE;
+    phCalibration.isCalibrated = 0;
+}
+
 /* Public functions ----------------------------------------------------------*/
 
 /**
@@ -70,8 +103,16 @@ static float pH_ApplyTemperatureCompensation(float phValue, float temperature)
  */
 HAL_StatusTypeDef pH_Init(void)
 {
-    // Reset calibration to default values
-    pH_ResetCalibration();
+    pH_CalibrationTypeDef stored;
+
+    // Use the stored calibration, the defaults if there is none
+    pH_SetDefaultCalibration();
+    if ((CalibStore_Read(CALIB_STORE_KEY_PH, &stored, sizeof(stored)) == (int)sizeof(stored)) &&
+        (stored.slope != 0.0f))
+    {
+        phCalibration = stored;
+    }
+    pH_UpdateFixedCalibration();
 
     // ADC should already be initialized by CubeMX
     // Just verify it's ready
@@ -105,7 +146,17 @@ uint16_t pH_ReadRawADC(void)
  */
 float pH_ADCToVoltage(uint16_t adcValue)
 {
-    return ((float)adcValue * PH_SENSOR_VREF) / PH_SENSOR_ADC_RESOLUTION;
+    return PH_Q16_TO_FLOAT(pH_ADCToVoltageQ16(adcValue));
+}
+
+/**
+ * @brief Convert ADC value to voltage, fixed-point
+ * @param adcValue: Raw ADC value
+ * @retval Voltage in mV (Q16)
+ */
+int32_t pH_ADCToVoltageQ16(uint16_t adcValue)
+{
+    return (int32_t)adcValue * PH_ADC_TO_MV_Q16;
 }
 
 /**
@@ -116,12 +167,14 @@ float pH_ADCToVoltage(uint16_t adcValue)
 pH_ReadingTypeDef pH_ReadSensor(float temperature)
 {
     pH_ReadingTypeDef reading = {0};
+    int32_t voltage;
 
     // Read raw ADC value
     reading.adcValue = pH_ReadRawADC();
 
-    // Convert to voltage
-    reading.voltage = pH_ADCToVoltage(reading.adcValue);
+    // Convert to voltage, the whole chain runs in Q16
+    voltage = pH_ADCToVoltageQ16(reading.adcValue);
+    reading.voltage = PH_Q16_TO_FLOAT(voltage);
 
     // Store temperature
     reading.temperature = temperature;
@@ -132,7 +185,7 @@ pH_ReadingTypeDef pH_ReadSensor(float temperature)
         reading.isValid = 1;
 
         // Calculate pH value with temperature compensation
-        reading.phValue = pH_VoltageToPhValue(reading.voltage, temperature);
+        reading.phValue = PH_Q16_TO_FLOAT(pH_VoltageToPhValueQ16(voltage, PH_Q16(temperature)));
     }
     else
     {
@@ -170,21 +223,33 @@ float pH_GetValue(void)
  */
 float pH_VoltageToPhValue(float voltage, float temperature)
 {
-    float phValue;
+    return PH_Q16_TO_FLOAT(pH_VoltageToPhValueQ16(PH_Q16(voltage), PH_Q16(temperature)));
+}
+
+/**
+ * @brief Convert voltage to pH value with temperature compensation, fixed-point
+ * @param voltage: Voltage in mV (Q16)
+ * @param temperature: Temperature in °C (Q16)
+ * @retval pH value (Q16)
+ */
+int32_t pH_VoltageToPhValueQ16(int32_t voltage, int32_t temperature)
+{
+    int32_t phValue;
 
     // Use improved calibration equation based on your sensor readings
     // Linear mapping: higher voltage = more acidic (lower pH)
-    phValue = 14.0f - ((voltage - 500.0f) / phCalibration.slope);
+    // The division by the slope is a multiplication by its Q24 reciprocal
+    phValue = PH_Q16(14.0f) - (int32_t)(((int64_t)(voltage - PH_Q16(PH_LINEAR_OFFSET_MV)) * phInvSlopeQ24) >> 24);
 
     // Alternative equation if above doesn't work well:
     // phValue = PH_NEUTRAL_VALUE + (phCalibration.neutralVoltage - voltage) / phCalibration.slope;
 
     // Apply temperature compensation
-    phValue = pH_ApplyTemperatureCompensation(phValue, temperature);
+    phValue = pH_ApplyTemperatureCompensationQ16(phValue, temperature);
 
     // Constrain to valid pH range
-    if (phValue < PH_MIN_VALUE) phValue = PH_MIN_VALUE;
-    if (phValue > PH_MAX_VALUE) phValue = PH_MAX_VALUE;
+    if (phValue < PH_Q16(PH_MIN_VALUE)) phValue = PH_Q16(PH_MIN_VALUE);
+    if (phValue > PH_Q16(PH_MAX_VALUE)) phValue = PH_Q16(PH_MAX_VALUE);
 
     return phValue;
 }
@@ -229,6 +294,11 @@ HAL_StatusTypeDef pH_CalibrateSinglePoint(float voltage)
     phCalibration.neutralVoltage = voltage;
     phCalibration.isCalibrated = 1;
 
+    if (CalibStore_Write(CALIB_STORE_KEY_PH, &phCalibration, sizeof(phCalibration)) != 0)
+    {
+        return HAL_ERROR;
+    }
+
     return HAL_OK;
 }
 
@@ -256,20 +326,29 @@ HAL_StatusTypeDef pH_CalibrateTwoPoint(float voltage4, float voltage7)
     phCalibration.acidVoltage = voltage4;
     phCalibration.slope = pH_CalculateSlope(voltage4, voltage7);
     phCalibration.isCalibrated = 1;
+    pH_UpdateFixedCalibration();
+
+    if (CalibStore_Write(CALIB_STORE_KEY_PH, &phCalibration, sizeof(phCalibration)) != 0)
+    {
+        return HAL_ERROR;
+    }
 
     return HAL_OK;
 }
 
 /**
- * @brief Reset calibration to default values
+ * @brief Reset calibration to default values and delete the stored one
  * @retval HAL status
  */
 HAL_StatusTypeDef pH_ResetCalibration(void)
 {
-    phCalibration.neutralVoltage = PH_DEFAULT_NEUTRAL_VOLTAGE;
-    phCalibration.acidVoltage = 0.0f;
-    phCalibration.slope = PH_DEFAULT_SLOPE;
-    phCalibration.isCalibrated = 0;
+    pH_SetDefaultCalibration();
+    pH_UpdateFixedCalibration();
+
+    if (CalibStore_Delete(CALIB_STORE_KEY_PH) != 0)
+    {
+        return HAL_ERROR;
+    }
 
     return HAL_OK;
 }
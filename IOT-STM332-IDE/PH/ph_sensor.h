@@ -60,6 +60,11 @@ typedef struct {
 #define PH_MIN_VALUE                0.0f
 #define PH_MAX_VALUE                14.0f
 
+/* Fixed-point conversion path (Q16.16, 1.0 = 65536) */
+#define PH_Q16_ONE                  65536
+#define PH_Q16(x)                   ((int32_t)((x) * 65536.0f + (((x) < 0) ? -0.5f : 0.5f)))
+#define PH_Q16_TO_FLOAT(q)          ((float)(q) * (1.0f / 65536.0f))
+
 /* Exported macro ------------------------------------------------------------*/
 #define IS_PH_VALID(ph)            ((ph >= PH_MIN_VALUE) && (ph <= PH_MAX_VALUE))
 #define IS_PH_ADC_VALID(adc)       ((adc >= PH_MIN_ADC_VALUE) && (adc <= PH_MAX_ADC_VALUE) && (adc != 0))
@@ -85,6 +90,13 @@ uint16_t pH_ReadRawADC(void);
  */
 float pH_ADCToVoltage(uint16_t adcValue);
 
+/**
+ * @brief  Convert ADC value to voltage, fixed-point
+ * @param  adcValue: Raw ADC value
+ * @retval Voltage in mV (Q16)
+ */
+int32_t pH_ADCToVoltageQ16(uint16_t adcValue);
+
 /**
  * @brief  Read pH sensor with temperature compensation
  * @param  temperature: Current temperature in °C
@@ -120,7 +132,16 @@ const char* pH_GetStatusString(float phValue);
 float pH_VoltageToPhValue(float voltage, float temperature);
 
 /**
- * @brief  Calibrate pH sensor with single point (pH 7.0)
+ * @brief  Convert voltage to pH value with temperature compensation, fixed-point
+ * @note   Same result as pH_VoltageToPhValue() without soft-float operations
+ * @param  voltage: Voltage in mV (Q16)
+ * @param  temperature: Temperature in °C (Q16)
+ * @retval pH value (Q16)
+ */
+int32_t pH_VoltageToPhValueQ16(int32_t voltage, int32_t temperature);
+
+/**
+ * @brief  Calibrate pH sensor with single point (pH 7.0), saved to flash
  * @param  voltage: Measured voltage at pH 7.0 in mV
  * @retval HAL status
  */
@@ -130,12 +151,13 @@ HAL_StatusTypeDef pH_CalibrateSinglePoint(float voltage);
  * @brief  Calibrate pH sensor with two points (pH 4.0 and pH 7.0)
  * @param  voltage4: Measured voltage at pH 4.0 in mV
  * @param  voltage7: Measured voltage at pH 7.0 in mV
+ * @note   The calibration is saved to flash and loaded by pH_Init
  * @retval HAL status
  */
 HAL_StatusTypeDef pH_CalibrateTwoPoint(float voltage4, float voltage7);
 
 /**
- * @brief  Reset calibration to default values
+ * @brief  Reset calibration to default values and erase the saved one
  * @retval HAL status
  */
 HAL_StatusTypeDef pH_ResetCalibration(void);
@@ -8,10 +8,21 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "tds_sensor.h"
+#include "adc_if.h"
+#include "calib_store.h"
 #include <stdbool.h>
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
+#define TDS_FULL_SCALE_CONDUCTIVITY    2000.0f     // Conductivity at VREF (uS/cm)
+#define TDS_MAX_CONDUCTIVITY           3000.0f     // Largest conductivity reported (uS/cm)
+#define TDS_CONDUCTIVITY_FACTOR        0.5f        // TDS (ppm) per uS/cm
+
+/* Fixed-point constants */
+#define TDS_Q24_ONE                    16777216.0f
+#define TDS_ADC_TO_MV_Q16              ((int32_t)(TDS_SENSOR_VREF * 65536.0f / TDS_SENSOR_ADC_RESOLUTION + 0.5f))
+#define TDS_TEMP_COEFFICIENT_Q24       ((int32_t)(TDS_TEMP_COEFFICIENT * TDS_Q24_ONE + 0.5f))
+#define TDS_MIN_COMPENSATION_Q16       (TDS_Q16_ONE / 64) // Keeps the reciprocal finite far below 0°C
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 static TDS_CalibrationTypeDef tdsCalibration = {
@@ -20,6 +31,10 @@ static TDS_CalibrationTypeDef tdsCalibration = {
     .isCalibrated = 0
 };
 
+// Conductivity per mV including kValue (Q24), updated with tdsCalibration
+static int32_t tdsGainQ24 = (int32_t)(TDS_DEFAULT_K_VALUE * TDS_FULL_SCALE_CONDUCTIVITY / TDS_SENSOR_VREF * TDS_Q24_ONE + 0.5f);
+static int32_t tdsOffsetQ16 = 0;
+
 // Shared ADC reading variables (global for use by both TDS and pH sensors)
 uint16_t g_adcChannelValues[4] = {0};
 uint32_t g_lastAdcReadTime = 0;
@@ -29,6 +44,9 @@ extern ADC_HandleTypeDef hadc;
 
 /* Private function prototypes -----------------------------------------------*/
 static const char* TDS_ClassifyWaterQuality(float tdsValue);
+static void TDS_UpdateFixedCalibration(void);
+static void TDS_SetDefaultCalibration(void);
+static int32_t TDS_SaturateQ16(int64_t value);
 
 /* Shared function prototypes ------------------------------------------------*/
 HAL_StatusTypeDef ADC_ReadAllChannels(void);
@@ -38,53 +56,39 @@ HAL_StatusTypeDef ADC_ForceRefresh(void);
 /* Private functions ---------------------------------------------------------*/
 
 /**
- * @brief Read all ADC channels and store in global array (Simple Robust Version)
+ * @brief Read all ADC channels and store in global array
+ * @note  The four channels are the filter outputs of the oversampled DMA scans
+ *        (adc_if.c), a scan less than 50ms old (e.g. the end of the series run
+ *        by the acquisition task) is reused
  * @retval HAL status
  */
 HAL_StatusTypeDef ADC_ReadAllChannels(void)
 {
     uint32_t currentTime = HAL_GetTick();
+    ADC_Snapshot_t snapshot;
+    bool fresh;
 
     // Only read if it's been more than 50ms since last read (avoid excessive reading)
     if (currentTime - g_lastAdcReadTime < 50) {
         return HAL_OK; // Use cached values
     }
 
-    // Always stop ADC first to ensure clean state
-    HAL_ADC_Stop(&hadc);
-    HAL_Delay(10); // Give ADC time to stop completely
-
-    // Clear old values first
-    for (int j = 0; j < 4; j++) {
-        g_adcChannelValues[j] = 0;
-    }
-
-    // Start ADC with error checking
-    HAL_StatusTypeDef status = HAL_ADC_Start(&hadc);
-    if (status != HAL_OK) {
+    // A copy of the last scan, the DMA interrupt of a series may be rewriting it
+    fresh = (g_lastAdcReadTime != 0) && ADC_ScanGetLast(&snapshot) && (currentTime - snapshot.tick < 50);
+    if (!fresh && (ADC_ScanRead(&snapshot) != HAL_OK)) {
+        for (int i = 0; i < 4; i++) {
+            g_adcChannelValues[i] = 0;
+        }
+        g_lastAdcReadTime = currentTime;
         return HAL_ERROR;
     }
 
-    // Read all 4 channels in sequence
-    uint8_t readSuccess = 1;
     for (int i = 0; i < 4; i++) {
-        status = HAL_ADC_PollForConversion(&hadc, 300); // Increased timeout
-        if (status == HAL_OK) {
-            g_adcChannelValues[i] = HAL_ADC_GetValue(&hadc);
-        } else {
-            // Mark as failed but continue to try other channels
-            readSuccess = 0;
-            g_adcChannelValues[i] = 0;
-        }
+        g_adcChannelValues[i] = snapshot.filtered[i];
     }
-
-    // Always stop ADC
-    HAL_ADC_Stop(&hadc);
-
-    // Update timestamp only if we attempted a read
     g_lastAdcReadTime = currentTime;
 
-    return readSuccess ? HAL_OK : HAL_ERROR;
+    return HAL_OK;
 }
 
 /**
@@ -108,10 +112,6 @@ uint16_t ADC_GetChannelValue(uint8_t rank)
  */
 HAL_StatusTypeDef ADC_ForceRefresh(void)
 {
-    // Ensure ADC is stopped first
-    HAL_ADC_Stop(&hadc);
-    HAL_Delay(5); // Small delay to ensure ADC is fully stopped
-
     // Reset timestamp to force fresh read
     g_lastAdcReadTime = 0;
 
@@ -131,30 +131,44 @@ HAL_StatusTypeDef ADC_ForceRefresh(void)
  */
 static const char* TDS_ClassifyWaterQuality(float tdsValue)
 {
-    if (tdsValue <= 300.0f)        // TDS_EXCELLENT_MAX
-    {
-        return "Excellent";
-    }
-    else if (tdsValue <= 600.0f)   // TDS_GOOD_MAX
-    {
-        return "Good";
-    }
-    else if (tdsValue <= 900.0f)   // TDS_FAIR_MAX
-    {
-        return "Fair";
-    }
-    else if (tdsValue <= 1200.0f)  // TDS_POOR_MAX
-    {
-        return "Poor";
-    }
-    else if (tdsValue <= 2000.0f)  // TDS_UNACCEPTABLE_MAX
-    {
-        return "Unacceptable";
-    }
-    else
-    {
-        return "Dangerous";
-    }
+    static const char* const names[] = {
+        "Excellent", "Good", "Fair", "Poor", "Unacceptable", "Dangerous"
+    };
+
+    return names[TDS_GetWaterQuality(tdsValue)];
+}
+
+/**
+ * @brief Precompute the fixed-point calibration after a change of tdsCalibration
+ */
+static void TDS_UpdateFixedCalibration(void)
+{
+    tdsGainQ24 = (int32_t)(tdsCalibration.kValue * TDS_FULL_SCALE_CONDUCTIVITY / TDS_SENSOR_VREF * TDS_Q24_ONE + 0.5f);
+    tdsOffsetQ16 = TDS_Q16(tdsCalibration.offsetVoltage);
+}
+
+/**
+ * @brief Set the default calibration, the stored one is kept
+ */
+static void TDS_SetDefaultCalibration(void)
+{
+    tdsCalibration.kValue = TDS_DEFAULT_K_VALUE;
+    tdsCalibration.offsetVoltage = TDS_DEFAULT_OFFSET;
+    tdsCalibration.isCalibrated = 0;
+}
+
+/**
+ * @brief Saturate a 64-bit intermediate to the Q16 range
+ * @note  A large kValue or offset, or a cold sample, takes the conductivity
+ *        past 32767 uS/cm before it is clamped
+ * @param value: Q16 value
+ * @retval Q16 value, saturated
+ */
+static int32_t TDS_SaturateQ16(int64_t value)
+{
+    if (value > INT32_MAX) return INT32_MAX;
+    if (value < INT32_MIN) return INT32_MIN;
+    return (int32_t)value;
 }
 
 /* Public functions ----------------------------------------------------------*/
@@ -165,8 +179,16 @@ static const char* TDS_ClassifyWaterQuality(float tdsValue)
  */
 HAL_StatusTypeDef TDS_Init(void)
 {
-    // Reset calibration to default values
-    TDS_ResetCalibration();
+    TDS_CalibrationTypeDef stored;
+
+    // Use the stored calibration, the defaults if there is none
+    TDS_SetDefaultCalibration();
+    if ((CalibStore_Read(CALIB_STORE_KEY_TDS, &stored, sizeof(stored)) == (int)sizeof(stored)) &&
+        (stored.kValue > 0.0f))
+    {
+        tdsCalibration = stored;
+    }
+    TDS_UpdateFixedCalibration();
 
     // Initialize ADC channel values
     for (int i = 0; i < 4; i++) {
@@ -206,7 +228,17 @@ uint16_t TDS_ReadRawADC(void)
  */
 float TDS_ADCToVoltage(uint16_t adcValue)
 {
-    return ((float)adcValue * TDS_SENSOR_VREF) / TDS_SENSOR_ADC_RESOLUTION;
+    return TDS_Q16_TO_FLOAT(TDS_ADCToVoltageQ16(adcValue));
+}
+
+/**
+ * @brief Convert ADC value to voltage, fixed-point
+ * @param adcValue: Raw ADC value
+ * @retval Voltage in mV (Q16)
+ */
+int32_t TDS_ADCToVoltageQ16(uint16_t adcValue)
+{
+    return (int32_t)adcValue * TDS_ADC_TO_MV_Q16;
 }
 
 /**
@@ -216,20 +248,32 @@ float TDS_ADCToVoltage(uint16_t adcValue)
  * @retval Conductivity in uS/cm
  */
 float TDS_VoltageToconductivity(float voltage, float temperature)
+{
+    return TDS_Q16_TO_FLOAT(TDS_VoltageToConductivityQ16(TDS_Q16(voltage), TDS_Q16(temperature)));
+}
+
+/**
+ * @brief Convert voltage to conductivity with temperature compensation, fixed-point
+ * @param voltage: Voltage in mV (Q16)
+ * @param temperature: Temperature in °C for compensation (Q16)
+ * @retval Conductivity in uS/cm (Q16)
+ */
+int32_t TDS_VoltageToConductivityQ16(int32_t voltage, int32_t temperature)
 {
     // Apply voltage offset calibration
-    float compensatedVoltage = voltage - tdsCalibration.offsetVoltage;
+    int32_t compensatedVoltage = voltage - tdsOffsetQ16;
 
     // Convert voltage to conductivity (empirical formula for TDS sensors)
     // Typical TDS sensor: 0V = 0 uS/cm, 3.3V = ~2000 uS/cm
-    float conductivity = (compensatedVoltage / TDS_SENSOR_VREF) * 2000.0f * tdsCalibration.kValue;
+    // 2000 / VREF * kValue is precomputed in tdsGainQ24
+    int32_t conductivity = TDS_SaturateQ16(((int64_t)compensatedVoltage * tdsGainQ24) >> 24);
 
     // Apply temperature compensation
-    conductivity = TDS_ApplyTemperatureCompensation(conductivity, temperature);
+    conductivity = TDS_ApplyTemperatureCompensationQ16(conductivity, temperature);
 
     // Ensure conductivity is within valid range
-    if (conductivity < 0.0f) conductivity = 0.0f;
-    if (conductivity > 3000.0f) conductivity = 3000.0f;
+    if (conductivity < 0) conductivity = 0;
+    if (conductivity > TDS_Q16(TDS_MAX_CONDUCTIVITY)) conductivity = TDS_Q16(TDS_MAX_CONDUCTIVITY);
 
     return conductivity;
 }
@@ -240,14 +284,24 @@ float TDS_VoltageToconductivity(float voltage, float temperature)
  * @retval TDS value in ppm
  */
 float TDS_ConductivityToTDS(float conductivity)
+{
+    return TDS_Q16_TO_FLOAT(TDS_ConductivityToTDSQ16(TDS_Q16(conductivity)));
+}
+
+/**
+ * @brief Convert conductivity to TDS value, fixed-point
+ * @param conductivity: Conductivity in uS/cm (Q16)
+ * @retval TDS value in ppm (Q16)
+ */
+int32_t TDS_ConductivityToTDSQ16(int32_t conductivity)
 {
     // Standard conversion: TDS (ppm) ≈ Conductivity (uS/cm) × 0.5
     // This factor can vary between 0.4-0.8 depending on water composition
-    float tdsValue = conductivity * 0.5f;
+    int32_t tdsValue = (int32_t)(((int64_t)conductivity * TDS_Q16(TDS_CONDUCTIVITY_FACTOR)) >> 16);
 
     // Constrain to valid TDS range
-    if (tdsValue < TDS_MIN_VALUE) tdsValue = TDS_MIN_VALUE;
-    if (tdsValue > TDS_MAX_VALUE) tdsValue = TDS_MAX_VALUE;
+    if (tdsValue < TDS_Q16(TDS_MIN_VALUE)) tdsValue = TDS_Q16(TDS_MIN_VALUE);
+    if (tdsValue > TDS_Q16(TDS_MAX_VALUE)) tdsValue = TDS_Q16(TDS_MAX_VALUE);
 
     return tdsValue;
 }
@@ -259,12 +313,30 @@ float TDS_ConductivityToTDS(float conductivity)
  * @retval Temperature compensated conductivity
  */
 float TDS_ApplyTemperatureCompensation(float conductivity, float temperature)
+{
+    return TDS_Q16_TO_FLOAT(TDS_ApplyTemperatureCompensationQ16(TDS_Q16(conductivity), TDS_Q16(temperature)));
+}
+
+/**
+ * @brief Apply temperature compensation to conductivity, fixed-point
+ * @param conductivity: Raw conductivity value (Q16)
+ * @param temperature: Current temperature in °C (Q16)
+ * @retval Temperature compensated conductivity (Q16)
+ */
+int32_t TDS_ApplyTemperatureCompensationQ16(int32_t conductivity, int32_t temperature)
 {
     // Temperature compensation: conductivity increases ~2% per °C
-    float tempDiff = temperature - TDS_REFERENCE_TEMP;
-    float compensationFactor = 1.0f + (TDS_TEMP_COEFFICIENT * tempDiff);
+    int32_t compensationFactor = TDS_Q16_ONE +
+        (int32_t)(((int64_t)(temperature - TDS_Q16(TDS_REFERENCE_TEMP)) * TDS_TEMP_COEFFICIENT_Q24) >> 24);
+
+    if (compensationFactor < TDS_MIN_COMPENSATION_Q16) {
+        compensationFactor = TDS_MIN_COMPENSATION_Q16;
+    }
+
+    // One 32-bit hardware division: (2^32 - 1) / factor (Q16) is the reciprocal in Q16
+    uint32_t reciprocal = UINT32_MAX / (uint32_t)compensationFactor;
 
-    return conductivity / compensationFactor;
+    return TDS_SaturateQ16(((int64_t)conductivity * reciprocal) >> 16);
 }
 
 /**
@@ -313,12 +385,15 @@ uint8_t TDS_IsSensorConnected(TDS_ReadingTypeDef reading)
 TDS_ReadingTypeDef TDS_ReadSensor(float temperature)
 {
     TDS_ReadingTypeDef reading = {0};
+    int32_t voltage;
+    int32_t conductivity;
 
     // Read raw ADC value
     reading.adcValue = TDS_ReadRawADC();
 
-    // Convert to voltage
-    reading.voltage = TDS_ADCToVoltage(reading.adcValue);
+    // Convert to voltage, the whole chain runs in Q16
+    voltage = TDS_ADCToVoltageQ16(reading.adcValue);
+    reading.voltage = TDS_Q16_TO_FLOAT(voltage);
 
     // Store temperature
     reading.temperature = temperature;
@@ -329,10 +404,11 @@ TDS_ReadingTypeDef TDS_ReadSensor(float temperature)
         reading.isValid = 1;
 
         // Calculate conductivity with temperature compensation
-        reading.conductivity = TDS_VoltageToconductivity(reading.voltage, temperature);
+        conductivity = TDS_VoltageToConductivityQ16(voltage, TDS_Q16(temperature));
+        reading.conductivity = TDS_Q16_TO_FLOAT(conductivity);
 
         // Convert conductivity to TDS
-        reading.tdsValue = TDS_ConductivityToTDS(reading.conductivity);
+        reading.tdsValue = TDS_Q16_TO_FLOAT(TDS_ConductivityToTDSQ16(conductivity));
 
         // Get water quality classification
         reading.waterQuality = TDS_ClassifyWaterQuality(reading.tdsValue);
@@ -377,6 +453,39 @@ const char* TDS_GetWaterQualityString(float tdsValue)
     return TDS_ClassifyWaterQuality(tdsValue);
 }
 
+/**
+ * @brief Get water quality class
+ * @param tdsValue: TDS value in ppm
+ * @retval Water quality class
+ */
+TDS_WaterQualityTypeDef TDS_GetWaterQuality(float tdsValue)
+{
+    if (tdsValue <= TDS_EXCELLENT_MAX)
+    {
+        return TDS_QUALITY_EXCELLENT;
+    }
+    else if (tdsValue <= TDS_GOOD_MAX)
+    {
+        return TDS_QUALITY_GOOD;
+    }
+    else if (tdsValue <= TDS_FAIR_MAX)
+    {
+        return TDS_QUALITY_FAIR;
+    }
+    else if (tdsValue <= TDS_POOR_MAX)
+    {
+        return TDS_QUALITY_POOR;
+    }
+    else if (tdsValue <= TDS_UNACCEPTABLE_MAX)
+    {
+        return TDS_QUALITY_UNACCEPTABLE;
+    }
+    else
+    {
+        return TDS_QUALITY_DANGEROUS;
+    }
+}
+
 /**
  * @brief Calibrate TDS sensor with known solution
  * @param knownTDS: Known TDS value of calibration solution in ppm
@@ -401,19 +510,56 @@ HAL_StatusTypeDef TDS_Calibrate(float knownTDS, float measuredVoltage)
     // Calculate K value
     tdsCalibration.kValue = expectedVoltage / measuredVoltage;
     tdsCalibration.isCalibrated = 1;
+    TDS_UpdateFixedCalibration();
+
+    if (CalibStore_Write(CALIB_STORE_KEY_TDS, &tdsCalibration, sizeof(tdsCalibration)) != 0)
+    {
+        return HAL_ERROR;
+    }
 
     return HAL_OK;
 }
 
 /**
- * @brief Reset calibration to default values
+ * @brief Set the calibration coefficients, e.g. computed on a server
+ * @param kValue: Calibration constant
+ * @param offsetVoltage: Voltage offset in mV
+ * @retval HAL status
+ */
+HAL_StatusTypeDef TDS_SetCalibration(float kValue, float offsetVoltage)
+{
+    if (kValue <= 0.0f || kValue > 10.0f ||
+        offsetVoltage < -TDS_SENSOR_VREF || offsetVoltage > TDS_SENSOR_VREF)
+    {
+        return HAL_ERROR;
+    }
+
+    tdsCalibration.kValue = kValue;
+    tdsCalibration.offsetVoltage = offsetVoltage;
+    tdsCalibration.isCalibrated = 1;
+    TDS_UpdateFixedCalibration();
+
+    if (CalibStore_Write(CALIB_STORE_KEY_TDS, &tdsCalibration, sizeof(tdsCalibration)) != 0)
+    {
+        return HAL_ERROR;
+    }
+
+    return HAL_OK;
+}
+
+/**
+ * @brief Reset calibration to default values and delete the stored one
  * @retval HAL status
  */
 HAL_StatusTypeDef TDS_ResetCalibration(void)
 {
-    tdsCalibration.kValue = TDS_DEFAULT_K_VALUE;
-    tdsCalibration.offsetVoltage = TDS_DEFAULT_OFFSET;
-    tdsCalibration.isCalibrated = 0;
+    TDS_SetDefaultCalibration();
+    TDS_UpdateFixedCalibration();
+
+    if (CalibStore_Delete(CALIB_STORE_KEY_TDS) != 0)
+    {
+        return HAL_ERROR;
+    }
 
     return HAL_OK;
 }
@@ -33,6 +33,18 @@ typedef struct {
     const char* waterQuality;   // Water quality classification string
 } TDS_ReadingTypeDef;
 
+/**
+ * @brief Water quality classes of the TDS value (WHO standards)
+ */
+typedef enum {
+    TDS_QUALITY_EXCELLENT = 0,  // Up to TDS_EXCELLENT_MAX
+    TDS_QUALITY_GOOD,           // Up to TDS_GOOD_MAX
+    TDS_QUALITY_FAIR,           // Up to TDS_FAIR_MAX
+    TDS_QUALITY_POOR,           // Up to TDS_POOR_MAX
+    TDS_QUALITY_UNACCEPTABLE,   // Up to TDS_UNACCEPTABLE_MAX
+    TDS_QUALITY_DANGEROUS       // Above TDS_UNACCEPTABLE_MAX
+} TDS_WaterQualityTypeDef;
+
 /**
  * @brief TDS sensor calibration structure
  */
@@ -64,6 +76,11 @@ typedef struct {
 #define TDS_POOR_MAX                   1200.0f     // Poor water
 #define TDS_UNACCEPTABLE_MAX           2000.0f     // Unacceptable water
 
+// Fixed-point conversion path (Q16.16, 1.0 = 65536)
+#define TDS_Q16_ONE                    65536
+#define TDS_Q16(x)                     ((int32_t)((x) * 65536.0f + (((x) < 0) ? -0.5f : 0.5f)))
+#define TDS_Q16_TO_FLOAT(q)            ((float)(q) * (1.0f / 65536.0f))
+
 // Enhanced validation for better disconnected sensor detection
 #define TDS_FLOATING_ADC_MIN           1200        // Typical floating range start
 #define TDS_FLOATING_ADC_MAX           2400        // Typical floating range end
@@ -96,6 +113,13 @@ uint16_t TDS_ReadRawADC(void);
  */
 float TDS_ADCToVoltage(uint16_t adcValue);
 
+/**
+ * @brief Convert ADC value to voltage, fixed-point
+ * @param adcValue: Raw ADC value
+ * @retval Voltage in mV (Q16)
+ */
+int32_t TDS_ADCToVoltageQ16(uint16_t adcValue);
+
 /**
  * @brief Convert voltage to conductivity
  * @param voltage: Voltage in mV
@@ -104,6 +128,15 @@ float TDS_ADCToVoltage(uint16_t adcValue);
  */
 float TDS_VoltageToconductivity(float voltage, float temperature);
 
+/**
+ * @brief Convert voltage to conductivity, fixed-point
+ * @note  Same result as TDS_VoltageToconductivity() without soft-float operations
+ * @param voltage: Voltage in mV (Q16)
+ * @param temperature: Temperature in °C for compensation (Q16)
+ * @retval Conductivity in uS/cm (Q16)
+ */
+int32_t TDS_VoltageToConductivityQ16(int32_t voltage, int32_t temperature);
+
 /**
  * @brief Convert conductivity to TDS value
  * @param conductivity: Conductivity in uS/cm
@@ -111,6 +144,13 @@ float TDS_VoltageToconductivity(float voltage, float temperature);
  */
 float TDS_ConductivityToTDS(float conductivity);
 
+/**
+ * @brief Convert conductivity to TDS value, fixed-point
+ * @param conductivity: Conductivity in uS/cm (Q16)
+ * @retval TDS value in ppm (Q16)
+ */
+int32_t TDS_ConductivityToTDSQ16(int32_t conductivity);
+
 /**
  * @brief Enhanced sensor connection detection
  * @param reading: TDS reading structure
@@ -144,16 +184,33 @@ float TDS_GetValue(void);
  */
 const char* TDS_GetWaterQualityString(float tdsValue);
 
+/**
+ * @brief Get water quality class
+ * @param tdsValue: TDS value in ppm
+ * @retval Water quality class, the one named by TDS_GetWaterQualityString
+ */
+TDS_WaterQualityTypeDef TDS_GetWaterQuality(float tdsValue);
+
 /**
  * @brief Calibrate TDS sensor with known solution
  * @param knownTDS: Known TDS value of calibration solution in ppm
  * @param measuredVoltage: Measured voltage in mV
+ * @note  The calibration is saved to flash and loaded by TDS_Init
  * @retval HAL status
  */
 HAL_StatusTypeDef TDS_Calibrate(float knownTDS, float measuredVoltage);
 
 /**
- * @brief Reset calibration to default values
+ * @brief Set the calibration coefficients, e.g. computed on a server
+ * @param kValue: Calibration constant, 0..10
+ * @param offsetVoltage: Voltage offset in mV
+ * @note  The calibration is saved to flash and loaded by TDS_Init
+ * @retval HAL status
+ */
+HAL_StatusTypeDef TDS_SetCalibration(float kValue, float offsetVoltage);
+
+/**
+ * @brief Reset calibration to default values and erase the saved one
  * @retval HAL status
  */
 HAL_StatusTypeDef TDS_ResetCalibration(void);
@@ -179,6 +236,14 @@ uint8_t TDS_IsReadingValid(TDS_ReadingTypeDef reading);
  */
 float TDS_ApplyTemperatureCompensation(float conductivity, float temperature);
 
+/**
+ * @brief Apply temperature compensation to conductivity, fixed-point
+ * @param conductivity: Raw conductivity value (Q16)
+ * @param temperature: Current temperature in °C (Q16)
+ * @retval Temperature compensated conductivity (Q16)
+ */
+int32_t TDS_ApplyTemperatureCompensationQ16(int32_t conductivity, int32_t temperature);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,28 @@
+/**
+  ******************************************************************************
+  * @file    adc.h
+  * @brief   Host stand-in for Core/Inc/adc.h
+  ******************************************************************************
+  */
+#ifndef __ADC_H__
+#define __ADC_H__
+
+#include "main.h"
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t State;
+} ADC_HandleTypeDef;
+
+/* Exported constants --------------------------------------------------------*/
+#define HAL_ADC_STATE_RESET   0x00000000U
+#define ADC_CHANNEL_2         2U
+#define ADC_CHANNEL_5         5U
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint32_t HAL_ADC_GetState(ADC_HandleTypeDef *hadc);
+
+extern ADC_HandleTypeDef hadc;
+
+#endif /* __ADC_H__ */
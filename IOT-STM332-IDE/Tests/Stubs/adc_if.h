@@ -0,0 +1,30 @@
+/**
+  ******************************************************************************
+  * @file    adc_if.h
+  * @brief   Host stand-in for Core/Inc/adc_if.h, the scan snapshot only
+  ******************************************************************************
+  */
+#ifndef __ADC_IF_H__
+#define __ADC_IF_H__
+
+#include <stdbool.h>
+#include "adc.h"
+
+/* Exported types ------------------------------------------------------------*/
+#define ADC_SCAN_RANKS              6
+
+typedef struct
+{
+  uint16_t raw[ADC_SCAN_RANKS];
+  uint16_t filtered[ADC_SCAN_RANKS];
+  uint16_t vddaMv;
+  int16_t temperature;
+  uint32_t tick;
+} ADC_Snapshot_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+HAL_StatusTypeDef ADC_ScanRead(ADC_Snapshot_t *snapshot);
+
+bool ADC_ScanGetLast(ADC_Snapshot_t *snapshot);
+
+#endif /* __ADC_IF_H__ */
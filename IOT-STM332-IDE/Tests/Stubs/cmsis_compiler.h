@@ -0,0 +1,101 @@
+/**
+  ******************************************************************************
+  * @file    cmsis_compiler.h
+  * @brief   Host stand-in for the CMSIS compiler header
+  * @note    Interrupt masking does nothing on the host. The Cortex-M4 SIMD
+  *          intrinsics are emulated when the test is built with
+  *          __ARM_FEATURE_DSP=1, so the DSP paths of the firmware run here
+  *          too; the GE flags are kept in a global like in the APSR.
+  ******************************************************************************
+  */
+#ifndef __CMSIS_COMPILER_H
+#define __CMSIS_COMPILER_H
+
+#include <stdint.h>
+
+#ifndef __ASM
+#define __ASM                 __asm
+#endif
+#ifndef __INLINE
+#define __INLINE              inline
+#endif
+#ifndef __STATIC_INLINE
+#define __STATIC_INLINE       static inline
+#endif
+#ifndef __STATIC_FORCEINLINE
+#define __STATIC_FORCEINLINE  __attribute__((always_inline)) static inline
+#endif
+#ifndef __WEAK
+#define __WEAK                __attribute__((weak))
+#endif
+#ifndef __PACKED
+#define __PACKED              __attribute__((packed, aligned(1)))
+#endif
+#ifndef __ALIGNED
+#define __ALIGNED(x)          __attribute__((aligned(x)))
+#endif
+#ifndef __NOP
+#define __NOP()               do { } while (0)
+#endif
+
+/* Interrupts ----------------------------------------------------------------*/
+__STATIC_INLINE uint32_t __get_PRIMASK(void)
+{
+  return 0U;
+}
+
+__STATIC_INLINE void __set_PRIMASK(uint32_t priMask)
+{
+  (void)priMask;
+}
+
+__STATIC_INLINE void __disable_irq(void)
+{
+}
+
+__STATIC_INLINE void __enable_irq(void)
+{
+}
+
+/* Byte reversal -------------------------------------------------------------*/
+__STATIC_INLINE uint32_t __REV(uint32_t value)
+{
+  return __builtin_bswap32(value);
+}
+
+/* SIMD ----------------------------------------------------------------------*/
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+/* APSR.GE, one bit per byte lane */
+static uint32_t __GE;
+
+__STATIC_INLINE uint32_t __SSUB16(uint32_t op1, uint32_t op2)
+{
+  int32_t lo = (int32_t)(int16_t)op1 - (int32_t)(int16_t)op2;
+  int32_t hi = (int32_t)(int16_t)(op1 >> 16) - (int32_t)(int16_t)(op2 >> 16);
+
+  __GE = ((lo >= 0) ? 0x3U : 0U) | ((hi >= 0) ? 0xCU : 0U);
+  return ((uint32_t)lo & 0xFFFFU) | ((uint32_t)hi << 16);
+}
+
+__STATIC_INLINE uint32_t __SEL(uint32_t op1, uint32_t op2)
+{
+  uint32_t result = 0U;
+
+  for (uint32_t lane = 0U; lane < 4U; lane++)
+  {
+    uint32_t mask = 0xFFU << (lane * 8U);
+    result |= (((__GE >> lane) & 1U) != 0U) ? (op1 & mask) : (op2 & mask);
+  }
+  return result;
+}
+
+__STATIC_INLINE uint32_t __SMLAD(uint32_t op1, uint32_t op2, uint32_t op3)
+{
+  int32_t lo = (int32_t)(int16_t)op1 * (int32_t)(int16_t)op2;
+  int32_t hi = (int32_t)(int16_t)(op1 >> 16) * (int32_t)(int16_t)(op2 >> 16);
+
+  return (uint32_t)((int32_t)op3 + lo + hi);
+}
+#endif /* __ARM_FEATURE_DSP */
+
+#endif /* __CMSIS_COMPILER_H */
@@ -0,0 +1,14 @@
+/**
+  ******************************************************************************
+  * @file    i2c.h
+  * @brief   Host stand-in for Core/Inc/i2c.h
+  ******************************************************************************
+  */
+#ifndef __I2C_H__
+#define __I2C_H__
+
+#include "main.h"
+
+extern I2C_HandleTypeDef hi2c2;
+
+#endif /* __I2C_H__ */
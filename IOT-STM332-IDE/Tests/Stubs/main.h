@@ -0,0 +1,104 @@
+/**
+  ******************************************************************************
+  * @file    main.h
+  * @brief   Host stand-in for Core/Inc/main.h
+  * @note    Only the HAL types and calls used by the tested modules are
+  *          declared; each test defines the calls it needs as fakes.
+  *          GPIOB and DWT are returned by calls of the test, so a bus
+  *          model sees every register access and can advance the cycle
+  *          counter.
+  ******************************************************************************
+  */
+#ifndef __MAIN_H
+#define __MAIN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cmsis_compiler.h"
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  HAL_OK       = 0x00U,
+  HAL_ERROR    = 0x01U,
+  HAL_BUSY     = 0x02U,
+  HAL_TIMEOUT  = 0x03U
+} HAL_StatusTypeDef;
+
+typedef struct
+{
+  uint32_t Instance;
+} DMA_HandleTypeDef;
+
+typedef struct
+{
+  DMA_HandleTypeDef *hdmarx;
+} I2C_HandleTypeDef;
+
+typedef struct
+{
+  volatile uint32_t IDR;
+  volatile uint32_t BSRR;
+} GPIO_TypeDef;
+
+typedef struct
+{
+  uint32_t Pin;
+  uint32_t Mode;
+  uint32_t Pull;
+  uint32_t Speed;
+} GPIO_InitTypeDef;
+
+typedef struct
+{
+  volatile uint32_t CTRL;
+  volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+  volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+/* Exported constants --------------------------------------------------------*/
+#define I2C_MEMADD_SIZE_8BIT  0x00000001U
+
+#define GPIO_PIN_10           0x0400U
+#define GPIO_MODE_OUTPUT_OD   0x00000011U
+#define GPIO_PULLUP           0x00000001U
+#define GPIO_SPEED_FREQ_HIGH  0x00000002U
+
+#define DWT_CTRL_CYCCNTENA_Msk        0x00000001U
+#define CoreDebug_DEMCR_TRCENA_Msk    0x01000000U
+
+/* Exported variables --------------------------------------------------------*/
+extern uint32_t SystemCoreClock;
+extern CoreDebug_Type TestCoreDebug;
+
+/* Exported macro ------------------------------------------------------------*/
+#define UNUSED(X)             (void)X
+
+#define GPIOB                 (TestGpioB())
+#define DWT                   (TestDwt())
+#define CoreDebug             (&TestCoreDebug)
+#define __HAL_RCC_GPIOB_CLK_ENABLE()  do { } while (0)
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+GPIO_TypeDef *TestGpioB(void);
+DWT_Type *TestDwt(void);
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma);
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                    uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                   uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                       uint16_t MemAddSize, uint8_t *pData, uint16_t Size);
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
+
+#endif /* __MAIN_H */
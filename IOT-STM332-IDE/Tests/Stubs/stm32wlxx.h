@@ -0,0 +1,69 @@
+/**
+  ******************************************************************************
+  * @file    stm32wlxx.h
+  * @brief   Host stand-in for the STM32WL device header, the AES peripheral
+  *          only
+  * @note    AES is the register model of stm32wlxx_aes.c. The data and status
+  *          registers have side effects, so their members are redefined to
+  *          call the model before each access: AES->DINR feeds the next input
+  *          word, AES->DOUTR gives the next output word and AES->SR returns
+  *          the status of the block written so far. The other registers are
+  *          plain memory that the model reads when it runs a block.
+  ******************************************************************************
+  */
+#ifndef __STM32WLXX_H
+#define __STM32WLXX_H
+
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  volatile uint32_t CR;
+  volatile uint32_t SR[1];
+  volatile uint32_t DINR[4];
+  volatile uint32_t DOUTR[4];
+  volatile uint32_t KEYR0;
+  volatile uint32_t KEYR1;
+  volatile uint32_t KEYR2;
+  volatile uint32_t KEYR3;
+  volatile uint32_t IVR0;
+  volatile uint32_t IVR1;
+  volatile uint32_t IVR2;
+  volatile uint32_t IVR3;
+} AES_TypeDef;
+
+/* Exported constants --------------------------------------------------------*/
+/* RM0453 AES_CR and AES_SR */
+#define AES_CR_EN                   (1UL << 0)
+#define AES_CR_DATATYPE_Pos         1U
+#define AES_CR_DATATYPE             (3UL << AES_CR_DATATYPE_Pos)
+#define AES_CR_DATATYPE_0           (1UL << 1)
+#define AES_CR_DATATYPE_1           (1UL << 2)
+#define AES_CR_MODE                 (3UL << 3)
+#define AES_CR_CHMOD_0              (1UL << 5)
+#define AES_CR_CHMOD_1              (1UL << 6)
+#define AES_CR_CCFC                 (1UL << 7)
+#define AES_CR_ERRC                 (1UL << 8)
+#define AES_CR_CHMOD_2              (1UL << 16)
+#define AES_CR_CHMOD                (AES_CR_CHMOD_0 | AES_CR_CHMOD_1 | AES_CR_CHMOD_2)
+#define AES_CR_KEYSIZE              (1UL << 18)
+
+#define AES_SR_CCF                  (1UL << 0)
+#define AES_SR_RDERR                (1UL << 1)
+#define AES_SR_WRERR                (1UL << 2)
+
+/* Exported functions prototypes ---------------------------------------------*/
+extern AES_TypeDef TestAesRegisters;
+
+uint32_t TestAesStatus(void);
+uint32_t TestAesWrite(void);
+uint32_t TestAesRead(void);
+
+/* Exported macros -----------------------------------------------------------*/
+#define AES                         (&TestAesRegisters)
+#define SR                          SR[TestAesStatus()]
+#define DINR                        DINR[TestAesWrite()]
+#define DOUTR                       DOUTR[TestAesRead()]
+
+#endif /* __STM32WLXX_H */
@@ -0,0 +1,230 @@
+/**
+  ******************************************************************************
+  * @file    stm32wlxx_aes.c
+  * @brief   Register model of the STM32WL AES peripheral, for the host build
+  *          of aes_backend_hw.c
+  * @note    Follows the AES chapter of RM0453 for 128-bit encryption: the
+  *          key is taken from KEYR3..KEYR0 and the chaining value from
+  *          IVR3..IVR0, most significant word first, and the chaining value
+  *          is written back after each block as the peripheral does (CBC:
+  *          the output block, CTR: IVR0 incremented). DINR and DOUTR words
+  *          are swapped as CR.DATATYPE selects. A block runs once its fourth
+  *          word is written and sets SR.CCF, cleared by CR.CCFC. The cipher
+  *          is the software AES of lorawan_aes.c.
+  *          Any use the reference manual does not allow (clock off, EN
+  *          clear, decryption or 256-bit key, a word written before the
+  *          previous output was read or before CCF was cleared, a word read
+  *          with no output) prints the fault and aborts the test.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "stm32wlxx.h"
+#include "stm32wlxx_ll_bus.h"
+#include "lorawan_aes.h"
+
+/* The accesses below are the model's own, not through the hooks */
+#undef SR
+#undef DINR
+#undef DOUTR
+
+/* Private define ------------------------------------------------------------*/
+#define BLOCK               16U
+#define WORDS               4U
+
+/* Private variables ---------------------------------------------------------*/
+AES_TypeDef TestAesRegisters;
+
+static bool ClockEnabled;
+static uint32_t InputWords;         /* DINR words written to the current block */
+static uint32_t OutputWords;        /* DOUTR words left to read */
+
+/* Private functions ---------------------------------------------------------*/
+static void Fault(const char *reason)
+{
+  fprintf(stderr, "AES model: %s (CR 0x%08X)\n", reason, (unsigned)TestAesRegisters.CR);
+  abort();
+}
+
+/**
+  * @brief Word swap of CR.DATATYPE, between a data register and the block
+  */
+static uint32_t Swap(uint32_t word)
+{
+  uint32_t swapped = 0;
+
+  switch ((TestAesRegisters.CR & AES_CR_DATATYPE) >> AES_CR_DATATYPE_Pos)
+  {
+    case 0:
+      return word;
+    case 1:
+      return (word << 16) | (word >> 16);
+    case 2:
+      return __builtin_bswap32(word);
+    default:
+      for (uint32_t i = 0; i < 32U; i++)
+      {
+        swapped |= ((word >> i) & 1U) << (31U - i);
+      }
+      return swapped;
+  }
+}
+
+static void PutBe32(uint8_t *out, uint32_t value)
+{
+  out[0] = (uint8_t)(value >> 24);
+  out[1] = (uint8_t)(value >> 16);
+  out[2] = (uint8_t)(value >> 8);
+  out[3] = (uint8_t)value;
+}
+
+static uint32_t GetBe32(const uint8_t *in)
+{
+  return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+}
+
+/**
+  * @brief Run the block held by DINR with the key and chaining value of the
+  *        registers
+  */
+static void RunBlock(void)
+{
+  AES_TypeDef *aes = &TestAesRegisters;
+  lorawan_aes_context context;
+  uint8_t key[BLOCK];
+  uint8_t iv[BLOCK];
+  uint8_t in[BLOCK];
+  uint8_t out[BLOCK];
+  uint8_t stream[BLOCK];
+
+  if ((aes->CR & AES_CR_MODE) != 0)
+  {
+    Fault("only encryption is modelled");
+  }
+  if ((aes->CR & AES_CR_KEYSIZE) != 0)
+  {
+    Fault("256-bit key");
+  }
+
+  PutBe32(&key[0], aes->KEYR3);
+  PutBe32(&key[4], aes->KEYR2);
+  PutBe32(&key[8], aes->KEYR1);
+  PutBe32(&key[12], aes->KEYR0);
+  PutBe32(&iv[0], aes->IVR3);
+  PutBe32(&iv[4], aes->IVR2);
+  PutBe32(&iv[8], aes->IVR1);
+  PutBe32(&iv[12], aes->IVR0);
+  for (uint32_t i = 0; i < WORDS; i++)
+  {
+    PutBe32(&in[4 * i], Swap(aes->DINR[i]));
+  }
+
+  memset(&context, 0, sizeof(context));
+  lorawan_aes_set_key(key, BLOCK, &context);
+  switch (aes->CR & AES_CR_CHMOD)
+  {
+    case 0:
+      lorawan_aes_encrypt(in, out, &context);
+      break;
+
+    case AES_CR_CHMOD_0:
+      for (uint32_t i = 0; i < BLOCK; i++)
+      {
+        in[i] ^= iv[i];
+      }
+      lorawan_aes_encrypt(in, out, &context);
+      aes->IVR3 = GetBe32(&out[0]);
+      aes->IVR2 = GetBe32(&out[4]);
+      aes->IVR1 = GetBe32(&out[8]);
+      aes->IVR0 = GetBe32(&out[12]);
+      break;
+
+    case AES_CR_CHMOD_1:
+      lorawan_aes_encrypt(iv, stream, &context);
+      for (uint32_t i = 0; i < BLOCK; i++)
+      {
+        out[i] = in[i] ^ stream[i];
+      }
+      aes->IVR0++;
+      break;
+
+    default:
+      Fault("chaining mode not modelled");
+      break;
+  }
+
+  for (uint32_t i = 0; i < WORDS; i++)
+  {
+    aes->DOUTR[i] = Swap(GetBe32(&out[4 * i]));
+  }
+  aes->SR[0] |= AES_SR_CCF;
+  OutputWords = WORDS;
+  InputWords = 0;
+}
+
+/**
+  * @brief Catch up with the plain register writes since the last hook
+  */
+static void Settle(void)
+{
+  if (!ClockEnabled)
+  {
+    Fault("register access with the clock off");
+  }
+  if ((TestAesRegisters.CR & AES_CR_CCFC) != 0)
+  {
+    TestAesRegisters.CR &= ~AES_CR_CCFC;
+    TestAesRegisters.SR[0] &= ~AES_SR_CCF;
+  }
+  if (InputWords == WORDS)
+  {
+    RunBlock();
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+void LL_AHB3_GRP1_EnableClock(uint32_t Periphs)
+{
+  if ((Periphs & LL_AHB3_GRP1_PERIPH_AES) != 0)
+  {
+    ClockEnabled = true;
+  }
+}
+
+uint32_t TestAesStatus(void)
+{
+  Settle();
+  return 0;
+}
+
+uint32_t TestAesWrite(void)
+{
+  Settle();
+  if ((TestAesRegisters.CR & AES_CR_EN) == 0)
+  {
+    Fault("DINR written with EN clear");
+  }
+  if (OutputWords != 0)
+  {
+    Fault("DINR written before the previous output was read");
+  }
+  if ((TestAesRegisters.SR[0] & AES_SR_CCF) != 0)
+  {
+    Fault("DINR written before CCF was cleared");
+  }
+  return InputWords++;
+}
+
+uint32_t TestAesRead(void)
+{
+  Settle();
+  if (OutputWords == 0)
+  {
+    Fault("DOUTR read with no output");
+  }
+  return WORDS - OutputWords--;
+}
@@ -0,0 +1,16 @@
+/**
+  ******************************************************************************
+  * @file    stm32wlxx_ll_bus.h
+  * @brief   Host stand-in for the STM32WL LL bus header, the AES clock only
+  ******************************************************************************
+  */
+#ifndef __STM32WLXX_LL_BUS_H
+#define __STM32WLXX_LL_BUS_H
+
+#include <stdint.h>
+
+#define LL_AHB3_GRP1_PERIPH_AES     (1UL << 17)
+
+void LL_AHB3_GRP1_EnableClock(uint32_t Periphs);
+
+#endif /* __STM32WLXX_LL_BUS_H */
@@ -0,0 +1,228 @@
+/**
+  ******************************************************************************
+  * @file    test_adc_filter.c
+  * @brief   Host test of the ADC channel filter of adc_filter.c
+  * @note    Checks the Hampel rejection of a single spike against the
+  *          acceptance of a real step once it fills half the window, the
+  *          clamping of the configuration, the settling of the IIR for every
+  *          iirShift against a floating-point reference, and the pass-through
+  *          of a one-sample window.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <math.h>
+#include "test_common.h"
+#include "adc_filter.h"
+
+/* Private define ------------------------------------------------------------*/
+#define HAMPEL_Q4(x)        ((uint8_t)((x) * 16))
+#define ADC_FULL_SCALE      4095U
+
+/* Private functions ---------------------------------------------------------*/
+static void Init(ADC_FilterChannel_t *channel, uint8_t window, uint8_t medianSize, uint8_t iirShift,
+                 uint8_t hampelThreshold)
+{
+  ADC_FilterConfig_t config = { window, medianSize, iirShift, hampelThreshold };
+
+  ADC_Filter_Init(channel, &config);
+}
+
+/**
+  * @brief A spike among noisy samples is replaced by the median and counted
+  */
+static void TestSpike(void)
+{
+  ADC_FilterChannel_t channel;
+  uint16_t output = 0;
+
+  TestSeed(12);
+  Init(&channel, 9, 5, 0, HAMPEL_Q4(4));
+  for (int n = 0; n < 50; n++)
+  {
+    output = ADC_Filter_Push(&channel, (uint16_t)(2000 + TestRandomRange(-1, 1)));
+  }
+  TEST_CHECK_EQ(channel.rejected, 0);
+  TEST_CHECK(abs((int)output - 2000) <= 1);
+
+  /* Up and down spikes, each alone in the window */
+  for (int n = 0; n < 4; n++)
+  {
+    output = ADC_Filter_Push(&channel, ((n & 1) != 0) ? 0 : ADC_FULL_SCALE);
+    TEST_CHECK_EQ(channel.rejected, n + 1);
+    TEST_CHECK(abs((int)output - 2000) <= 1);
+    for (int k = 0; k < 9; k++)
+    {
+      output = ADC_Filter_Push(&channel, (uint16_t)(2000 + TestRandomRange(-1, 1)));
+      TEST_CHECK(abs((int)output - 2000) <= 1);
+    }
+  }
+  TEST_CHECK_EQ(channel.rejected, 4);
+
+  /* Without the Hampel rule the spike reaches the median only */
+  Init(&channel, 9, 1, 0, 0);
+  for (int n = 0; n < 9; n++)
+  {
+    ADC_Filter_Push(&channel, 2000);
+  }
+  TEST_CHECK_EQ(ADC_Filter_Push(&channel, ADC_FULL_SCALE), ADC_FULL_SCALE);
+  TEST_CHECK_EQ(channel.rejected, 0);
+}
+
+/**
+  * @brief A step is rejected until it fills half of the raw window, then
+  *        followed by the median
+  */
+static void TestStep(void)
+{
+  static const uint8_t windows[] = { 3, 5, 8, 9, 16 };
+
+  for (uint32_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++)
+  {
+    ADC_FilterChannel_t channel;
+    uint8_t window = windows[w];
+    uint16_t output = 0;
+    int settled = -1;
+
+    Init(&channel, window, window, 0, HAMPEL_Q4(3));
+    for (int n = 0; n < (2 * window); n++)
+    {
+      ADC_Filter_Push(&channel, 1000);
+    }
+
+    for (int n = 0; n < (2 * window); n++)
+    {
+      output = ADC_Filter_Push(&channel, 1500);
+      if ((settled < 0) && (output == 1500))
+      {
+        settled = n;
+      }
+    }
+
+    /* Rejected while the old level holds the raw median */
+    TEST_CHECK_EQ(channel.rejected, (window + 1) / 2);
+    TEST_CHECK_EQ(output, 1500);
+    TEST_CHECK(settled >= (int)channel.rejected);
+    TEST_CHECK(settled <= (int)(channel.rejected + (channel.config.medianSize / 2) + 1));
+    if (TestFailures != 0)
+    {
+      printf("window %u\n", window);
+      return;
+    }
+  }
+}
+
+/**
+  * @brief Out of range fields are clamped, an even median is shortened
+  */
+static void TestConfigClamp(void)
+{
+  ADC_FilterChannel_t channel;
+
+  Init(&channel, 0, 0, 0, 0);
+  TEST_CHECK_EQ(channel.config.window, 1);
+  TEST_CHECK_EQ(channel.config.medianSize, 1);
+
+  Init(&channel, 40, 0, 20, 0);
+  TEST_CHECK_EQ(channel.config.window, ADC_FILTER_MAX_WINDOW);
+  TEST_CHECK_EQ(channel.config.medianSize, ADC_FILTER_MAX_WINDOW - 1);
+  TEST_CHECK_EQ(channel.config.iirShift, 15);
+
+  Init(&channel, 9, 12, 15, 0);
+  TEST_CHECK_EQ(channel.config.medianSize, 9);
+  TEST_CHECK_EQ(channel.config.iirShift, 15);
+
+  Init(&channel, 9, 8, 3, HAMPEL_Q4(2.5));
+  TEST_CHECK_EQ(channel.config.window, 9);
+  TEST_CHECK_EQ(channel.config.medianSize, 7);
+  TEST_CHECK_EQ(channel.config.iirShift, 3);
+  TEST_CHECK_EQ(channel.config.hampelThreshold, 40);
+
+  Init(&channel, 4, 2, 0, 0);
+  TEST_CHECK_EQ(channel.config.medianSize, 1);
+
+  /* Reset keeps the configuration and forgets the samples */
+  ADC_Filter_Push(&channel, 1234);
+  ADC_Filter_Reset(&channel);
+  TEST_CHECK_EQ(channel.config.window, 4);
+  TEST_CHECK_EQ(channel.count, 0);
+  TEST_CHECK_EQ(channel.output, 0);
+  TEST_CHECK_EQ(ADC_Filter_Push(&channel, 321), 321);
+}
+
+/**
+  * @brief Steps up and down against y += (x - y) / 2^iirShift in floating point
+  */
+static void TestIirSettling(void)
+{
+  for (uint8_t shift = 0; shift <= 15; shift++)
+  {
+    ADC_FilterChannel_t channel;
+    double alpha = 1.0 / (double)(1U << shift);
+    double reference = 0.0;
+    double worst = 0.0;
+    uint32_t steps;
+    uint16_t output = 0;
+
+    /* Steps for the reference to come within half an LSB of the full step */
+    steps = (shift == 0) ? 1U : (uint32_t)ceil(log(0.5 / ADC_FULL_SCALE) / log(1.0 - alpha));
+
+    /* The median of one sample leaves the IIR alone on the step */
+    Init(&channel, 3, 1, shift, 0);
+    TEST_CHECK_EQ(ADC_Filter_Push(&channel, 0), 0);
+
+    for (int direction = 0; direction < 2; direction++)
+    {
+      uint16_t target = (direction == 0) ? ADC_FULL_SCALE : 0;
+
+      for (uint32_t n = 0; n < steps; n++)
+      {
+        double error;
+
+        output = ADC_Filter_Push(&channel, target);
+        reference += (target - reference) * alpha;
+        error = fabs(output - reference);
+        worst = (error > worst) ? error : worst;
+      }
+      TEST_CHECK(abs((int)output - (int)target) <= 1);
+    }
+    TEST_CHECK(worst <= 1.0);
+    if (TestFailures != 0)
+    {
+      printf("iirShift %u: %u steps, worst error %.2f LSB\n", shift, (unsigned)steps, worst);
+      return;
+    }
+  }
+}
+
+/**
+  * @brief A one-sample window outputs every sample, the Hampel rule and the
+  *        IIR never apply
+  */
+static void TestPassThrough(void)
+{
+  ADC_FilterChannel_t channel;
+
+  TestSeed(1);
+  Init(&channel, 1, 5, 4, HAMPEL_Q4(1));
+  for (int n = 0; n < 10000; n++)
+  {
+    uint16_t sample = (uint16_t)TestRandomRange(0, ADC_FULL_SCALE);
+
+    TEST_CHECK_EQ(ADC_Filter_Push(&channel, sample), sample);
+  }
+  TEST_CHECK_EQ(channel.rejected, 0);
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestSpike();
+  TestStep();
+  TestConfigClamp();
+  TestIirSettling();
+  TestPassThrough();
+
+  return TestSummary(argv[0]);
+}
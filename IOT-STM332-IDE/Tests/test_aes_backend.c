@@ -0,0 +1,276 @@
+/**
+  ******************************************************************************
+  * @file    test_aes_backend.c
+  * @brief   Known-answer tests of the AES backend interface
+  * @note    FIPS-197 and SP 800-38A ECB, RFC 4493 CMAC and a LoRaWAN 1.0
+  *          uplink (payload decryption and MIC) go through the AesBackend_*
+  *          functions only, so the file runs unchanged against any backend.
+  *          Built twice for the software backend: with the T-table core of
+  *          lorawan_aes.c and with its byte core (LORAWAN_AES_TTABLE=0).
+  *          Built once more for the hardware backend, on the register model
+  *          of the AES peripheral in Stubs/stm32wlxx_aes.c.
+  *          Multi-block CTR and the fused CTR/CMAC are then checked against
+  *          the ECB and CMAC calls already validated.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test_common.h"
+#include "aes_backend.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BLOCK               AES_BACKEND_BLOCK_SIZE
+#define MAX_FRAME           255
+
+/* Private variables ---------------------------------------------------------*/
+/* SP 800-38A F.1.1 and RFC 4493 key, and their four message blocks */
+static const char Sp800Key[] = "2b7e151628aed2a6abf7158809cf4f3c";
+static const char Sp800Plain[] =
+  "6bc1bee22e409f96e93d7e117393172a" "ae2d8a571e03ac9c9eb76fac45af8e51"
+  "30c81c46a35ce411e5fbc1191a0a52ef" "f69f2445df4f9b17ad2b417be66c3710";
+
+/* Private functions ---------------------------------------------------------*/
+static uint16_t Hex(const char *text, uint8_t *out)
+{
+  uint16_t size = 0;
+
+  while ((text[2 * size] != '\0') && (text[(2 * size) + 1] != '\0'))
+  {
+    unsigned int byte;
+
+    sscanf(&text[2 * size], "%2x", &byte);
+    out[size++] = (uint8_t)byte;
+  }
+  return size;
+}
+
+static bool Equals(const uint8_t *actual, const char *expected)
+{
+  uint8_t bytes[MAX_FRAME];
+  uint16_t size = Hex(expected, bytes);
+
+  return memcmp(actual, bytes, size) == 0;
+}
+
+static void RandomBytes(uint8_t *buffer, uint16_t size)
+{
+  for (uint16_t i = 0; i < size; i++)
+  {
+    buffer[i] = (uint8_t)TestRandom();
+  }
+}
+
+static void TestEcb(void)
+{
+  AesBackend_Key_t key;
+  uint8_t keyBytes[BLOCK];
+  uint8_t in[4 * BLOCK];
+  uint8_t out[(4 * BLOCK) + 1];
+
+  /* FIPS-197 appendix C.1 */
+  Hex("000102030405060708090a0b0c0d0e0f", keyBytes);
+  Hex("00112233445566778899aabbccddeeff", in);
+  AesBackend_SetKey(keyBytes, &key);
+  AesBackend_EncryptEcb(&key, in, out, BLOCK);
+  TEST_CHECK(Equals(out, "69c4e0d86a7b0430d8cdb78070b4c55a"));
+
+  /* SP 800-38A F.1.1, four blocks in one call, in place and unaligned */
+  Hex(Sp800Key, keyBytes);
+  Hex(Sp800Plain, in);
+  AesBackend_SetKey(keyBytes, &key);
+  AesBackend_EncryptEcb(&key, in, &out[1], sizeof(in));
+  TEST_CHECK(Equals(&out[1], "3ad77bb40d7a3660a89ecaf32466ef97" "f5d3d58503b9699de785895a96fdbaaf"
+                             "43b1cd7f598ece23881b00e3ed030688" "7b0c785e27e8ad3f8223207104725dd4"));
+  AesBackend_EncryptEcb(&key, in, in, sizeof(in));
+  TEST_CHECK(memcmp(in, &out[1], sizeof(in)) == 0);
+}
+
+static void TestCmac(void)
+{
+  static const struct
+  {
+    uint16_t size;
+    const char *mac;
+  } examples[] =
+  {
+    /* RFC 4493 section 4, examples 1 to 4 */
+    { 0, "bb1d6929e95937287fa37d129b756746" },
+    { 16, "070a16b46b4d4144f79bdd9dd04a287c" },
+    { 40, "dfa66747de9ae63030ca32611497c827" },
+    { 64, "51f0bebf7e3b9d92fc49741779363cfe" },
+  };
+  AesBackend_Key_t key;
+  uint8_t keyBytes[BLOCK];
+  uint8_t message[4 * BLOCK];
+  uint8_t mac[BLOCK];
+
+  Hex(Sp800Key, keyBytes);
+  Hex(Sp800Plain, message);
+  AesBackend_SetKey(keyBytes, &key);
+  for (uint32_t i = 0; i < (sizeof(examples) / sizeof(examples[0])); i++)
+  {
+    AesBackend_Cmac(&key, NULL, message, examples[i].size, mac);
+    TEST_CHECK(Equals(mac, examples[i].mac));
+
+    /* The same message, its first block passed apart as a B0 block is */
+    if (examples[i].size >= BLOCK)
+    {
+      AesBackend_Cmac(&key, message, &message[BLOCK], examples[i].size - BLOCK, mac);
+      TEST_CHECK(Equals(mac, examples[i].mac));
+    }
+  }
+}
+
+/**
+  * @brief LoRaWAN 1.0 uplink: FRMPayload "test" on port 1, FCnt 2
+  */
+static void TestLoRaWanFrame(void)
+{
+  AesBackend_Key_t appSKey;
+  AesBackend_Key_t nwkSKey;
+  AesBackend_CmacJob_t job;
+  uint8_t keyBytes[BLOCK];
+  uint8_t frame[17];
+  uint8_t aBlock[BLOCK] = { 0x01 };
+  uint8_t b0Block[BLOCK] = { 0x49 };
+  uint8_t mac[BLOCK];
+
+  Hex("ec925802ae430ca77fd3dd73cb2cc588", keyBytes);
+  AesBackend_SetKey(keyBytes, &appSKey);
+  Hex("44024241ed4ce9a68c6a8bc055233fd3", keyBytes);
+  AesBackend_SetKey(keyBytes, &nwkSKey);
+
+  /* MHDR, DevAddr 49BE7DF1, FCtrl, FCnt, FPort, FRMPayload, MIC */
+  Hex("40f17dbe4900020001954378762b11ff0d", frame);
+  memcpy(&aBlock[6], &frame[1], 4);
+  aBlock[10] = 0x02;
+  aBlock[15] = 0x01;
+  memcpy(&b0Block[6], &frame[1], 4);
+  b0Block[10] = 0x02;
+  b0Block[15] = 13;
+
+  AesBackend_Cmac(&nwkSKey, b0Block, frame, 13, mac);
+  TEST_CHECK(memcmp(mac, &frame[13], 4) == 0);
+  AesBackend_Ctr(&appSKey, aBlock, &frame[9], 4);
+  TEST_CHECK(memcmp(&frame[9], "test", 4) == 0);
+
+  /* Securing it again in one pass gives the frame back */
+  job.Key = &nwkSKey;
+  job.FirstBlock = b0Block;
+  AesBackend_CtrCmac(&appSKey, aBlock, frame, 13, 9, 4, &job, 1);
+  TEST_CHECK(Equals(frame, "40f17dbe4900020001954378762b11ff0d"));
+  TEST_CHECK(memcmp(job.Mac, &frame[13], 4) == 0);
+}
+
+/**
+  * @brief Multi-block CTR against ECB of the counter blocks
+  */
+static void TestCtr(void)
+{
+  AesBackend_Key_t key;
+  uint8_t keyBytes[BLOCK];
+  uint8_t ctrBlock[BLOCK];
+  uint8_t counters[16 * BLOCK];
+  uint8_t keyStream[16 * BLOCK];
+  uint8_t buffer[MAX_FRAME];
+  uint8_t expected[MAX_FRAME];
+
+  TestSeed(22);
+  for (int n = 0; n < 2000; n++)
+  {
+    uint16_t size = (uint16_t)TestRandomRange(0, 16 * BLOCK);
+
+    RandomBytes(keyBytes, sizeof(keyBytes));
+    RandomBytes(ctrBlock, sizeof(ctrBlock));
+    RandomBytes(buffer, size);
+    ctrBlock[BLOCK - 1] = (uint8_t)TestRandomRange(0, 255 - 16);
+    AesBackend_SetKey(keyBytes, &key);
+
+    for (uint8_t b = 0; b < 16U; b++)
+    {
+      memcpy(&counters[b * BLOCK], ctrBlock, BLOCK);
+      counters[(b * BLOCK) + BLOCK - 1] = (uint8_t)(ctrBlock[BLOCK - 1] + b);
+    }
+    AesBackend_EncryptEcb(&key, counters, keyStream, sizeof(counters));
+    for (uint16_t i = 0; i < size; i++)
+    {
+      expected[i] = buffer[i] ^ keyStream[i];
+    }
+
+    AesBackend_Ctr(&key, ctrBlock, buffer, size);
+    TEST_CHECK(memcmp(buffer, expected, size) == 0);
+    if (TestFailures != 0)
+    {
+      printf("ctr size %u\n", size);
+      return;
+    }
+  }
+}
+
+/**
+  * @brief Fused CTR/CMAC against AesBackend_Ctr() then AesBackend_Cmac()
+  */
+static void TestCtrCmac(void)
+{
+  AesBackend_Key_t keys[1 + AES_BACKEND_MAX_CMACS];
+  AesBackend_CmacJob_t jobs[AES_BACKEND_MAX_CMACS];
+  uint8_t firstBlocks[AES_BACKEND_MAX_CMACS][BLOCK];
+  uint8_t keyBytes[BLOCK];
+  uint8_t ctrBlock[BLOCK];
+  uint8_t frame[MAX_FRAME];
+  uint8_t expected[MAX_FRAME];
+  uint8_t mac[BLOCK];
+
+  TestSeed(220);
+  for (int n = 0; n < 5000; n++)
+  {
+    uint16_t size = (uint16_t)TestRandomRange(0, MAX_FRAME);
+    uint16_t encOffset = (uint16_t)TestRandomRange(0, size);
+    uint16_t encSize = (uint16_t)TestRandomRange(0, size - encOffset);
+    uint8_t count = (uint8_t)TestRandomRange(1, AES_BACKEND_MAX_CMACS);
+
+    for (uint8_t k = 0; k <= count; k++)
+    {
+      RandomBytes(keyBytes, sizeof(keyBytes));
+      AesBackend_SetKey(keyBytes, &keys[k]);
+    }
+    RandomBytes(ctrBlock, sizeof(ctrBlock));
+    ctrBlock[BLOCK - 1] = 1;
+    RandomBytes(frame, size);
+    memcpy(expected, frame, size);
+    AesBackend_Ctr(&keys[0], ctrBlock, &expected[encOffset], encSize);
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+      RandomBytes(firstBlocks[i], BLOCK);
+      jobs[i].Key = &keys[1 + i];
+      jobs[i].FirstBlock = ((TestRandom() & 3) != 0) ? firstBlocks[i] : NULL;
+    }
+    AesBackend_CtrCmac(&keys[0], ctrBlock, frame, size, encOffset, encSize, jobs, count);
+
+    TEST_CHECK(memcmp(frame, expected, size) == 0);
+    for (uint8_t i = 0; i < count; i++)
+    {
+      AesBackend_Cmac(&keys[1 + i], jobs[i].FirstBlock, expected, size, mac);
+      TEST_CHECK(memcmp(jobs[i].Mac, mac, BLOCK) == 0);
+    }
+    if (TestFailures != 0)
+    {
+      printf("size %u, encrypted %u at %u, %u cmacs\n", size, encSize, encOffset, count);
+      return;
+    }
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  AesBackend_Init();
+  TestEcb();
+  TestCmac();
+  TestLoRaWanFrame();
+  TestCtr();
+  TestCtrCmac();
+
+  return TestSummary(argv[0]);
+}
@@ -0,0 +1,473 @@
+/**
+  ******************************************************************************
+  * @file    test_amg8833.c
+  * @brief   Host test of the AMG8833 integer frame path
+  * @note    The pixel registers are served by a fake I2C bus. The frame
+  *          statistics, the float accessors and the 8-bit image are checked
+  *          against the former float computations. Built twice: with
+  *          __ARM_FEATURE_DSP=1 the SIMD path of AMG8833_ComputeStats runs on
+  *          the emulated intrinsics of Stubs/cmsis_compiler.h. The
+  *          background capture runs on a fake I2C whose DMA reads never
+  *          complete: the stuck transfer must be aborted, the I2C reset and
+  *          Stop mode allowed again.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <math.h>
+#include "test_common.h"
+#include "amg8833.h"
+#include "dev_conf.h"
+#include "calib_store.h"
+#include "stm32_seq.h"
+#include "stm32_timer.h"
+#include "stm32_lpm.h"
+#include "utilities_def.h"
+
+/* Private define ------------------------------------------------------------*/
+#define FRAME_PIXELS        64
+
+/* Private variables ---------------------------------------------------------*/
+I2C_HandleTypeDef hi2c2;
+
+/**
+  * @brief Register file of the fake sensor
+  */
+static uint8_t SensorRegisters[256];
+
+/**
+  * @brief Capture task, frame timer and bus state seen by the fakes
+  */
+static void (*CaptureTask)(void);
+static bool CaptureTaskPending;
+static void (*FrameTimerCallback)(void *);
+static bool StopModeHeld;
+static uint32_t DmaReads;
+static uint32_t DmaAborts;
+static uint32_t I2cDeInits;
+static uint32_t I2cInits;
+static uint32_t FrameCalls;
+static HAL_StatusTypeDef FrameStatus;
+
+/* Fakes ---------------------------------------------------------------------*/
+uint32_t HAL_GetTick(void)
+{
+  return 0;
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+  (void)Delay;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                    uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+  memcpy(&SensorRegisters[MemAddress], pData, Size);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                   uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+  memcpy(pData, &SensorRegisters[MemAddress], Size);
+  return HAL_OK;
+}
+
+/* Started, never completed */
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                       uint16_t MemAddSize, uint8_t *pData, uint16_t Size)
+{
+  DmaReads++;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma)
+{
+  DmaAborts++;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c)
+{
+  I2cDeInits++;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c)
+{
+  TEST_CHECK_EQ(I2cInits + 1, I2cDeInits);
+  I2cInits++;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef AMG8833_AdjustConfig(uint8_t frameRate)
+{
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef AMG8833_ConfigureInterrupt(uint8_t interruptMode, float upperLimit, float lowerLimit,
+                                             float hysteresis)
+{
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef AMG8833_ConfigureAverage(uint8_t enable)
+{
+  return HAL_OK;
+}
+
+int CalibStore_Read(CalibStore_Key_t key, void *value, uint16_t size)
+{
+  return -1;
+}
+
+int CalibStore_Write(CalibStore_Key_t key, const void *value, uint16_t length)
+{
+  return 0;
+}
+
+int CalibStore_Delete(CalibStore_Key_t key)
+{
+  return 0;
+}
+
+void UTIL_SEQ_RegTask(UTIL_SEQ_bm_t TaskId_bm, uint32_t Flags, void (*Task)(void))
+{
+  CaptureTask = Task;
+}
+
+void UTIL_SEQ_SetTask(UTIL_SEQ_bm_t TaskId_bm, uint32_t Task_Prio)
+{
+  CaptureTaskPending = true;
+}
+
+void UTIL_LPM_SetStopMode(UTIL_LPM_bm_t lpm_id_bm, UTIL_LPM_State_t state)
+{
+  if ((lpm_id_bm & (1U << CFG_LPM_AMG8833_Id)) != 0)
+  {
+    StopModeHeld = (state == UTIL_LPM_DISABLE);
+  }
+}
+
+UTIL_TIMER_Status_t UTIL_TIMER_Create(UTIL_TIMER_Object_t *TimerObject, uint32_t PeriodValue,
+                                      UTIL_TIMER_Mode_t Mode, void (*Callback)(void *), void *Argument)
+{
+  FrameTimerCallback = Callback;
+  return UTIL_TIMER_OK;
+}
+
+UTIL_TIMER_Status_t UTIL_TIMER_StartWithPeriod(UTIL_TIMER_Object_t *TimerObject, uint32_t PeriodValue)
+{
+  return UTIL_TIMER_OK;
+}
+
+UTIL_TIMER_Status_t UTIL_TIMER_Stop(UTIL_TIMER_Object_t *TimerObject)
+{
+  return UTIL_TIMER_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief Put 12-bit two's complement pixels in the temperature registers
+  */
+static void SetPixels(const int16_t *pixels)
+{
+  for (int i = 0; i < FRAME_PIXELS; i++)
+  {
+    uint16_t raw = (uint16_t)pixels[i] & 0x0FFFU;
+    SensorRegisters[AMG8833_TEMP_BASE + (2 * i)] = (uint8_t)raw;
+    SensorRegisters[AMG8833_TEMP_BASE + (2 * i) + 1] = (uint8_t)(raw >> 8);
+  }
+}
+
+/**
+  * @brief Random frame: a scene around 25°C with hot and cold spots, or
+  *        pixels over the whole 12-bit range
+  */
+static void RandomFrame(int16_t *pixels, bool fullRange)
+{
+  int32_t base = TestRandomRange(-100, 400);
+
+  for (int i = 0; i < FRAME_PIXELS; i++)
+  {
+    int32_t value = fullRange ? TestRandomRange(-2048, 2047) : base + TestRandomRange(-40, 40);
+    if (value > 2047)
+    {
+      value = 2047;
+    }
+    pixels[i] = (int16_t)value;
+  }
+}
+
+/**
+  * @brief Statistics computed the straightforward way
+  */
+static void ReferenceStats(const int16_t *pixels, AMG8833_Stats_t *stats)
+{
+  memset(stats, 0, sizeof(*stats));
+  stats->min = pixels[0];
+  stats->max = pixels[0];
+  for (int i = 0; i < FRAME_PIXELS; i++)
+  {
+    int32_t bin = (pixels[i] - AMG8833_RAW_MIN) / AMG8833_HIST_BIN_RAW;
+    if (pixels[i] < AMG8833_RAW_MIN)
+    {
+      bin = 0;
+    }
+    if (bin >= AMG8833_HIST_BINS)
+    {
+      bin = AMG8833_HIST_BINS - 1;
+    }
+    stats->histogram[bin]++;
+    stats->min = (pixels[i] < stats->min) ? pixels[i] : stats->min;
+    stats->max = (pixels[i] > stats->max) ? pixels[i] : stats->max;
+    stats->sum += pixels[i];
+  }
+  stats->avg = (int16_t)floor((stats->sum / 64.0) + 0.5);
+}
+
+/**
+  * @brief Float statistics as computed before the integer path
+  */
+static void FloatStats(const float *temperatures, float *min, float *max, float *avg)
+{
+  float sum = 0.0f;
+
+  *min = temperatures[0];
+  *max = temperatures[0];
+  for (int i = 0; i < FRAME_PIXELS; i++)
+  {
+    if (temperatures[i] < *min) *min = temperatures[i];
+    if (temperatures[i] > *max) *max = temperatures[i];
+    sum += temperatures[i];
+  }
+  *avg = sum / 64.0f;
+}
+
+static void TestComputeStats(void)
+{
+  int16_t pixels[FRAME_PIXELS] __ALIGNED(4);
+  AMG8833_Stats_t stats;
+  AMG8833_Stats_t expected;
+
+  TestSeed(6);
+  for (int n = 0; n < 20000; n++)
+  {
+    RandomFrame(pixels, (n & 1) != 0);
+    AMG8833_ComputeStats(pixels, &stats);
+    ReferenceStats(pixels, &expected);
+
+    TEST_CHECK_EQ(stats.min, expected.min);
+    TEST_CHECK_EQ(stats.max, expected.max);
+    TEST_CHECK_EQ(stats.sum, expected.sum);
+    TEST_CHECK_EQ(stats.avg, expected.avg);
+    TEST_CHECK(memcmp(stats.histogram, expected.histogram, sizeof(stats.histogram)) == 0);
+    if (TestFailures != 0)
+    {
+      return;
+    }
+  }
+
+  /* Extremes in either lane of a pair */
+  for (int i = 0; i < FRAME_PIXELS; i++)
+  {
+    pixels[i] = 0;
+  }
+  pixels[7] = -2048;
+  pixels[40] = 2047;
+  AMG8833_ComputeStats(pixels, &stats);
+  TEST_CHECK_EQ(stats.min, -2048);
+  TEST_CHECK_EQ(stats.max, 2047);
+  TEST_CHECK_EQ(stats.sum, -1);
+  TEST_CHECK_EQ(stats.histogram[0], 1);
+  TEST_CHECK_EQ(stats.histogram[1], 62);
+  TEST_CHECK_EQ(stats.histogram[AMG8833_HIST_BINS - 1], 1);
+}
+
+static void TestReadPixels(void)
+{
+  int16_t pixels[FRAME_PIXELS];
+  int16_t raw[FRAME_PIXELS];
+  float temperatures[FRAME_PIXELS];
+  float floats[FRAME_PIXELS];
+  float min, max, avg;
+  float refMin, refMax, refAvg;
+  AMG8833_Stats_t stats;
+
+  TestSeed(60);
+  for (int n = 0; n < 1000; n++)
+  {
+    RandomFrame(pixels, (n % 4) == 0);
+    SetPixels(pixels);
+    TEST_CHECK(AMG8833_ReadPixels() == HAL_OK);
+
+    /* The 12-bit registers are sign extended */
+    AMG8833_GetRawPixels(raw);
+    TEST_CHECK(memcmp(raw, pixels, sizeof(raw)) == 0);
+
+    for (int i = 0; i < FRAME_PIXELS; i++)
+    {
+      floats[i] = pixels[i] * 0.25f;
+    }
+    AMG8833_GetTemperatures(temperatures);
+    TEST_CHECK(memcmp(temperatures, floats, sizeof(floats)) == 0);
+
+    AMG8833_GetStats(&min, &max, &avg);
+    FloatStats(floats, &refMin, &refMax, &refAvg);
+    TEST_CHECK(min == refMin);
+    TEST_CHECK(max == refMax);
+    TEST_CHECK(fabsf(avg - refAvg) <= 1e-3f);
+
+    AMG8833_GetStatsRaw(&stats);
+    TEST_CHECK(avg == stats.sum / 256.0f);
+  }
+
+  /* The offset is applied to every pixel and the result kept in 12 bits */
+  for (int i = 0; i < FRAME_PIXELS; i++)
+  {
+    pixels[i] = (i < 32) ? 2000 : -2000;
+  }
+  SetPixels(pixels);
+  AMG8833_SetTemperatureOffset(100);
+  TEST_CHECK(AMG8833_ReadPixels() == HAL_OK);
+  AMG8833_GetStatsRaw(&stats);
+  TEST_CHECK_EQ(stats.max, 2047);
+  TEST_CHECK_EQ(stats.min, -1900);
+  AMG8833_SetTemperatureOffset(-100);
+  TEST_CHECK(AMG8833_ReadPixels() == HAL_OK);
+  AMG8833_GetStatsRaw(&stats);
+  TEST_CHECK_EQ(stats.max, 1900);
+  TEST_CHECK_EQ(stats.min, -2048);
+  AMG8833_SetTemperatureOffset(0);
+}
+
+static void TestChirpStackData(void)
+{
+  int16_t pixels[FRAME_PIXELS];
+  uint8_t buffer[128];
+
+  TEST_CHECK_EQ(AMG8833_PrepareChirpStackData(buffer, 63), -1);
+
+  /* Every raw value around the -20°C..80°C image range */
+  for (int base = -200; base < 600; base += FRAME_PIXELS)
+  {
+    for (int i = 0; i < FRAME_PIXELS; i++)
+    {
+      pixels[i] = (int16_t)(base + i);
+    }
+    SetPixels(pixels);
+    TEST_CHECK(AMG8833_ReadPixels() == HAL_OK);
+
+    TEST_CHECK_EQ(AMG8833_PrepareChirpStackData(buffer, 64), 64);
+    for (int i = 0; i < FRAME_PIXELS; i++)
+    {
+      /* Former float mapping; the float product may round just below a step */
+      float temp = pixels[i] * 0.25f;
+      if (temp < -20.0f) temp = -20.0f;
+      if (temp > 80.0f) temp = 80.0f;
+      int expected = (int)(uint8_t)((temp + 20.0f) * 2.55f);
+      TEST_CHECK(abs((int)buffer[i] - expected) <= 1);
+      if (pixels[i] <= AMG8833_RAW_MIN)
+      {
+        TEST_CHECK_EQ(buffer[i], 0);
+      }
+      if (pixels[i] >= AMG8833_RAW_MIN + AMG8833_RAW_SPAN)
+      {
+        TEST_CHECK_EQ(buffer[i], 255);
+      }
+    }
+
+    TEST_CHECK_EQ(AMG8833_PrepareChirpStackData(buffer, sizeof(buffer)), 128);
+    for (int i = 0; i < FRAME_PIXELS; i++)
+    {
+      TEST_CHECK_EQ((int16_t)(buffer[2 * i] | (buffer[(2 * i) + 1] << 8)), pixels[i]);
+    }
+  }
+}
+
+static void OnFrame(HAL_StatusTypeDef status, const int16_t *frame)
+{
+  FrameCalls++;
+  FrameStatus = status;
+}
+
+/**
+  * @brief Frame timer expiry, then the sequencer runs the capture task
+  */
+static void FrameTick(void)
+{
+  FrameTimerCallback(NULL);
+  while (CaptureTaskPending)
+  {
+    CaptureTaskPending = false;
+    CaptureTask();
+  }
+}
+
+static void TestStuckTransfer(void)
+{
+  DMA_HandleTypeDef hdmarx = { 0 };
+
+  hi2c2.hdmarx = &hdmarx;
+  TEST_CHECK_EQ(AMG8833_StartCapture(OnFrame), HAL_OK);
+  TEST_CHECK(CaptureTask != NULL);
+  TEST_CHECK(FrameTimerCallback != NULL);
+
+  /* End of the wake-up delay: the first transfer starts and hangs */
+  FrameTick();
+  TEST_CHECK_EQ(DmaReads, 1);
+  TEST_CHECK(StopModeHeld);
+  TEST_CHECK_EQ(FrameCalls, 0);
+
+  /* A frame period later: aborted, bus reset, reported once */
+  FrameTick();
+  TEST_CHECK_EQ(DmaReads, 1);
+  TEST_CHECK_EQ(DmaAborts, 1);
+  TEST_CHECK_EQ(I2cDeInits, 1);
+  TEST_CHECK_EQ(I2cInits, 1);
+  TEST_CHECK(!StopModeHeld);
+  TEST_CHECK_EQ(FrameCalls, 1);
+  TEST_CHECK_EQ(FrameStatus, HAL_TIMEOUT);
+
+  /* A completion of the aborted transfer arriving late is ignored */
+  HAL_I2C_MemRxCpltCallback(&hi2c2);
+  TEST_CHECK(!CaptureTaskPending);
+  TEST_CHECK_EQ(FrameCalls, 1);
+
+  /* The next tick starts a new transfer */
+  FrameTick();
+  TEST_CHECK_EQ(DmaReads, 2);
+  TEST_CHECK(StopModeHeld);
+  TEST_CHECK_EQ(FrameCalls, 1);
+
+  /* Stopped while it hangs: aborted too, without a callback */
+  AMG8833_StopCapture();
+  TEST_CHECK_EQ(DmaAborts, 2);
+  TEST_CHECK_EQ(I2cInits, 2);
+  TEST_CHECK(!StopModeHeld);
+  while (CaptureTaskPending)
+  {
+    CaptureTaskPending = false;
+    CaptureTask();
+  }
+  TEST_CHECK_EQ(FrameCalls, 1);
+
+  /* Nothing in flight any more */
+  AMG8833_StopCapture();
+  TEST_CHECK_EQ(DmaAborts, 2);
+  TEST_CHECK_EQ(I2cInits, 2);
+  hi2c2.hdmarx = NULL;
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestComputeStats();
+  TestReadPixels();
+  TestChirpStackData();
+  TestStuckTransfer();
+
+  return TestSummary(argv[0]);
+}
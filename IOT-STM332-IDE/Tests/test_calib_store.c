@@ -0,0 +1,323 @@
+/**
+  ******************************************************************************
+  * @file    test_calib_store.c
+  * @brief   Host test of the calibration store against a RAM flash
+  * @note    Random writes and deletes are checked against a model of the
+  *          keys, through the compactions and after every reinitialization.
+  *          The power is then cut at every double-word of a sequence: after
+  *          the reset each key must hold its last value, or the one it was
+  *          being written to. The test flash fails when a double-word is
+  *          programmed twice, which catches a torn record taken for the end,
+  *          and a torn double-word may fail to read with an ECC error: the
+  *          store must then take it for a torn record.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test_common.h"
+#include "test_flash.h"
+#include "calib_store.h"
+
+/* Private define ------------------------------------------------------------*/
+#define PAGE_SIZE           512
+#define KEYS                8         /* Keys 1..KEYS-1 are used */
+#define MAX_LENGTH          24        /* The live records of all keys fit a page */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint8_t length;                     /* 0 when the key is absent */
+  uint8_t value[MAX_LENGTH];
+} Model_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const CalibStore_Flash_t Flash =
+{
+  .page = { (uintptr_t)TestFlashMemory, (uintptr_t)TestFlashMemory + PAGE_SIZE },
+  .pageSize = PAGE_SIZE,
+  .erase = TestFlash_Erase,
+  .program = TestFlash_Program,
+  .read = TestFlash_Read,
+};
+
+static Model_t Model[KEYS];
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief True when a key of the store holds the value of the model
+  */
+static bool KeyMatches(uint8_t key, const Model_t *model)
+{
+  uint8_t value[CALIB_STORE_MAX_VALUE];
+  int length = CalibStore_Read((CalibStore_Key_t)key, value, sizeof(value));
+
+  if (model->length == 0U)
+  {
+    return (length == -1);
+  }
+  return (length == model->length) && (memcmp(value, model->value, model->length) == 0);
+}
+
+static void CheckModel(void)
+{
+  for (uint8_t key = 1; key < KEYS; key++)
+  {
+    TEST_CHECK(KeyMatches(key, &Model[key]));
+  }
+}
+
+/**
+  * @brief Random write or delete, the model is updated when it succeeds
+  * @return Key changed
+  */
+static uint8_t RandomOperation(Model_t *next)
+{
+  uint8_t key = (uint8_t)TestRandomRange(1, KEYS - 1);
+
+  *next = Model[key];
+  if (TestRandomRange(0, 4) == 0)
+  {
+    next->length = 0;
+    if (CalibStore_Delete((CalibStore_Key_t)key) == 0)
+    {
+      Model[key] = *next;
+    }
+  }
+  else
+  {
+    next->length = (uint8_t)TestRandomRange(1, MAX_LENGTH);
+    for (uint8_t i = 0; i < next->length; i++)
+    {
+      next->value[i] = (uint8_t)TestRandom();
+    }
+    if (CalibStore_Write((CalibStore_Key_t)key, next->value, next->length) == 0)
+    {
+      Model[key] = *next;
+    }
+  }
+  return key;
+}
+
+static void TestBasic(void)
+{
+  uint8_t value[CALIB_STORE_MAX_VALUE + 1] = { 0 };
+  CalibStore_Flash_t badFlash = Flash;
+  CalibStore_Flash_t noRead = Flash;
+  uint32_t programs;
+
+  TestFlash_Reset(PAGE_SIZE);
+  TEST_CHECK(!CalibStore_IsReady());
+  TEST_CHECK_EQ(CalibStore_Read(CALIB_STORE_KEY_PH, value, sizeof(value)), -1);
+
+  badFlash.pageSize = PAGE_SIZE - 4;
+  TEST_CHECK_EQ(CalibStore_Init(&badFlash), -1);
+  TEST_CHECK_EQ(CalibStore_Init(NULL), -1);
+
+  /* First use formats the store */
+  TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+  TEST_CHECK(CalibStore_IsReady());
+  TEST_CHECK_EQ(TestFlashErases[0], 1);
+  TEST_CHECK_EQ(CalibStore_Read(CALIB_STORE_KEY_PH, value, sizeof(value)), -1);
+
+  /* Arguments */
+  TEST_CHECK_EQ(CalibStore_Write((CalibStore_Key_t)0, value, 4), -1);
+  TEST_CHECK_EQ(CalibStore_Write((CalibStore_Key_t)CALIB_STORE_MAX_KEYS, value, 4), -1);
+  TEST_CHECK_EQ(CalibStore_Write(CALIB_STORE_KEY_PH, value, 0), -1);
+  TEST_CHECK_EQ(CalibStore_Write(CALIB_STORE_KEY_PH, value, CALIB_STORE_MAX_VALUE + 1), -1);
+  TEST_CHECK_EQ(CalibStore_Write(CALIB_STORE_KEY_PH, NULL, 4), -1);
+
+  /* Write, read back, buffer too small */
+  memcpy(value, "pH-7", 4);
+  TEST_CHECK_EQ(CalibStore_Write(CALIB_STORE_KEY_PH, value, 4), 0);
+  memset(value, 0, sizeof(value));
+  TEST_CHECK_EQ(CalibStore_Read(CALIB_STORE_KEY_PH, value, sizeof(value)), 4);
+  TEST_CHECK(memcmp(value, "pH-7", 4) == 0);
+  TEST_CHECK_EQ(CalibStore_Read(CALIB_STORE_KEY_PH, value, 3), -1);
+
+  /* Writing the same value does not program the flash */
+  programs = TestFlashPrograms;
+  TEST_CHECK_EQ(CalibStore_Write(CALIB_STORE_KEY_PH, "pH-7", 4), 0);
+  TEST_CHECK_EQ(TestFlashPrograms, programs);
+
+  /* Delete survives a reinitialization */
+  TEST_CHECK_EQ(CalibStore_Delete(CALIB_STORE_KEY_PH), 0);
+  TEST_CHECK_EQ(CalibStore_Read(CALIB_STORE_KEY_PH, value, sizeof(value)), -1);
+  programs = TestFlashPrograms;
+  TEST_CHECK_EQ(CalibStore_Delete(CALIB_STORE_KEY_PH), 0);
+  TEST_CHECK_EQ(TestFlashPrograms, programs);
+  TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+  TEST_CHECK_EQ(CalibStore_Read(CALIB_STORE_KEY_PH, value, sizeof(value)), -1);
+
+  /* Without a read operation the memory is read directly */
+  noRead.read = NULL;
+  TEST_CHECK_EQ(CalibStore_Write(CALIB_STORE_KEY_TDS, "TDS", 3), 0);
+  TEST_CHECK_EQ(CalibStore_Init(&noRead), 0);
+  TEST_CHECK_EQ(CalibStore_Read(CALIB_STORE_KEY_TDS, value, sizeof(value)), 3);
+  TEST_CHECK(memcmp(value, "TDS", 3) == 0);
+  TEST_CHECK_EQ(CalibStore_Write(CALIB_STORE_KEY_TDS, "tds", 3), 0);
+  TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+  TEST_CHECK_EQ(CalibStore_Read(CALIB_STORE_KEY_TDS, value, sizeof(value)), 3);
+  TEST_CHECK(memcmp(value, "tds", 3) == 0);
+}
+
+static void TestRandomOperations(void)
+{
+  Model_t next;
+  uint32_t erases;
+
+  TestSeed(14);
+  TestFlash_Reset(PAGE_SIZE);
+  memset(Model, 0, sizeof(Model));
+  TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+
+  for (int n = 0; n < 50000; n++)
+  {
+    RandomOperation(&next);
+    TEST_CHECK(KeyMatches((uint8_t)(n % (KEYS - 1)) + 1U, &Model[(n % (KEYS - 1)) + 1]));
+    if ((n % 97) == 0)
+    {
+      TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+      CheckModel();
+    }
+    if (TestFailures != 0)
+    {
+      return;
+    }
+  }
+  TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+  CheckModel();
+
+  /* Many compactions, the two pages wear alike */
+  erases = TestFlashErases[0] + TestFlashErases[1];
+  TEST_CHECK(erases > 1000);
+  TEST_CHECK(((TestFlashErases[0] - TestFlashErases[1]) + 1U) <= 2U);
+}
+
+static void TestTornHeader(void)
+{
+  uint8_t value[4] = { 1, 2, 3, 4 };
+
+  /* A header cut with its first 4 bytes still erased, after one record */
+  TestFlash_Reset(PAGE_SIZE);
+  TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+  TEST_CHECK_EQ(CalibStore_Write(CALIB_STORE_KEY_PH, value, sizeof(value)), 0);
+  TEST_CHECK_EQ(TestFlash_Program(TestFlash_Address(3U * TEST_FLASH_DWORD), 0x5A00A5FFFFFFFFFFULL), 0);
+
+  /* It is not the end of the log, the next write goes past it */
+  TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+  TEST_CHECK_EQ(CalibStore_Write(CALIB_STORE_KEY_TDS, value, sizeof(value)), 0);
+  TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+  TEST_CHECK_EQ(CalibStore_Read(CALIB_STORE_KEY_PH, value, sizeof(value)), 4);
+  TEST_CHECK_EQ(CalibStore_Read(CALIB_STORE_KEY_TDS, value, sizeof(value)), 4);
+}
+
+/**
+  * @brief Double-words of the last record failing with an ECC error, as after a reset
+  */
+static void TestEccErrors(void)
+{
+  uint8_t value[4];
+
+  /* PH "old" at 8 (header) and 16 (value), then PH "new" at 24 and 32 */
+  TestFlash_Reset(PAGE_SIZE);
+  TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+  TEST_CHECK_EQ(CalibStore_Write(CALIB_STORE_KEY_PH, "old", 4), 0);
+  TEST_CHECK_EQ(CalibStore_Write(CALIB_STORE_KEY_PH, "new", 4), 0);
+
+  /* Unreadable value: the record is skipped, the previous one is read */
+  TestFlashEcc[4] = true;
+  TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+  TEST_CHECK_EQ(CalibStore_Read(CALIB_STORE_KEY_PH, value, sizeof(value)), 4);
+  TEST_CHECK(memcmp(value, "old", 4) == 0);
+  TEST_CHECK(TestFlashEccErrors > 0U);
+
+  /* Unreadable header: the end of the page, the next write compacts past it */
+  TestFlashEcc[3] = true;
+  TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+  TEST_CHECK_EQ(CalibStore_Read(CALIB_STORE_KEY_PH, value, sizeof(value)), 4);
+  TEST_CHECK(memcmp(value, "old", 4) == 0);
+  TEST_CHECK_EQ(CalibStore_Write(CALIB_STORE_KEY_TDS, "tds", 4), 0);
+  TEST_CHECK_EQ(TestFlashErases[1], 1);
+  TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+  TEST_CHECK_EQ(CalibStore_Read(CALIB_STORE_KEY_PH, value, sizeof(value)), 4);
+  TEST_CHECK(memcmp(value, "old", 4) == 0);
+  TEST_CHECK_EQ(CalibStore_Read(CALIB_STORE_KEY_TDS, value, sizeof(value)), 4);
+  TEST_CHECK(memcmp(value, "tds", 4) == 0);
+
+  /* Unreadable page header: the page is not in use, the store formats the other */
+  TestFlash_Reset(PAGE_SIZE);
+  TestFlashEcc[0] = true;
+  TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+  TEST_CHECK_EQ(TestFlashErases[0], 1);
+}
+
+static void TestPowerCut(void)
+{
+  uint32_t eccErrors = 0;
+  Model_t before[KEYS];
+  Model_t next;
+  uint8_t key;
+
+  TestSeed(140);
+  for (int32_t cut = 0; cut < 3000; cut++)
+  {
+    /* Fill the store, then cut the power somewhere in the next operations */
+    TestFlash_Reset(PAGE_SIZE);
+    memset(Model, 0, sizeof(Model));
+    TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+    for (int n = 0; n < 40; n++)
+    {
+      RandomOperation(&next);
+    }
+
+    TestFlash_CutPower(cut % 150);
+    do
+    {
+      memcpy(before, Model, sizeof(Model));
+      key = RandomOperation(&next);
+    } while (!TestFlashPowerLost);
+
+    /* After the reset, the interrupted key is old or new, the others intact */
+    TestFlash_CutPower(-1);
+    TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+    for (uint8_t k = 1; k < KEYS; k++)
+    {
+      if (k == key)
+      {
+        TEST_CHECK(KeyMatches(k, &before[k]) || KeyMatches(k, &next));
+        Model[k] = KeyMatches(k, &next) ? next : before[k];
+      }
+      else
+      {
+        TEST_CHECK(KeyMatches(k, &before[k]));
+      }
+    }
+
+    /* And the store keeps working */
+    for (int n = 0; n < 40; n++)
+    {
+      RandomOperation(&next);
+    }
+    TEST_CHECK_EQ(CalibStore_Init(&Flash), 0);
+    CheckModel();
+    eccErrors += TestFlashEccErrors;
+    if (TestFailures != 0)
+    {
+      printf("power cut after %d double-words\n", (int)(cut % 150));
+      return;
+    }
+  }
+  TEST_CHECK(eccErrors > 0U);
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestBasic();
+  TestRandomOperations();
+  TestTornHeader();
+  TestEccErrors();
+  TestPowerCut();
+
+  return TestSummary(argv[0]);
+}
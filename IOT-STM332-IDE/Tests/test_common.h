@@ -0,0 +1,117 @@
+/**
+  ******************************************************************************
+  * @file    test_common.h
+  * @brief   Checks, random source and timer shared by the host tests
+  * @note    Each test is one program. It returns non-zero when a check
+  *          failed and runs its benchmarks when called with "bench".
+  ******************************************************************************
+  */
+#ifndef __TEST_COMMON_H__
+#define __TEST_COMMON_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Exported macros -----------------------------------------------------------*/
+/**
+  * @brief Record a failure when cond is false
+  */
+#define TEST_CHECK(cond) \
+  do { \
+    if (!(cond)) \
+    { \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      TestFailures++; \
+    } \
+  } while (0)
+
+/**
+  * @brief Record a failure when two integers differ, printing both
+  */
+#define TEST_CHECK_EQ(actual, expected) \
+  do { \
+    long long actual_ = (long long)(actual); \
+    long long expected_ = (long long)(expected); \
+    if (actual_ != expected_) \
+    { \
+      printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, actual_, expected_); \
+      TestFailures++; \
+    } \
+  } while (0)
+
+/**
+  * @brief Keep a benchmark result alive so the measured loop is not removed
+  */
+#define TEST_KEEP(value)  do { TestSink += (uint32_t)(value); } while (0)
+
+/* Private variables ---------------------------------------------------------*/
+static int TestFailures = 0;
+static uint32_t TestState = 1U;
+static volatile uint32_t TestSink;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief Restart the random sequence, tests are reproducible
+  */
+static inline void TestSeed(uint32_t seed)
+{
+  TestState = (seed != 0U) ? seed : 1U;
+}
+
+/**
+  * @brief Next 32-bit random value (xorshift32)
+  */
+static inline uint32_t TestRandom(void)
+{
+  TestState ^= TestState << 13;
+  TestState ^= TestState >> 17;
+  TestState ^= TestState << 5;
+  return TestState;
+}
+
+/**
+  * @brief Random value in [min, max]
+  */
+static inline int32_t TestRandomRange(int32_t min, int32_t max)
+{
+  return min + (int32_t)(TestRandom() % (uint32_t)(max - min + 1));
+}
+
+/**
+  * @brief Monotonic time in nanoseconds, for the host benchmarks
+  */
+static inline uint64_t TestNanoseconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t)now.tv_sec * 1000000000U) + (uint64_t)now.tv_nsec;
+}
+
+/**
+  * @brief True when the benchmarks were requested on the command line
+  */
+static inline bool TestIsBench(int argc, char **argv)
+{
+  return (argc > 1) && (strcmp(argv[1], "bench") == 0);
+}
+
+/**
+  * @brief Print the result of a test program
+  * @return Exit status, 0 if every check passed
+  */
+static inline int TestSummary(const char *name)
+{
+  if (TestFailures != 0)
+  {
+    printf("%s: %d check(s) failed\n", name, TestFailures);
+    return 1;
+  }
+  printf("%s: ok\n", name);
+  return 0;
+}
+
+#endif /* __TEST_COMMON_H__ */
@@ -0,0 +1,230 @@
+/**
+  ******************************************************************************
+  * @file    test_downlink_cmd.c
+  * @brief   Host test of the downlink command parser and diagnostic uplink
+  * @note    Every opcode is decoded from a known frame, malformed frames must
+  *          be rejected before any command runs, and random frames must
+  *          either be rejected or run exactly the commands they hold.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test_common.h"
+#include "downlink_cmd.h"
+
+/* Private define ------------------------------------------------------------*/
+#define MAX_FRAME           242
+
+/* Private variables ---------------------------------------------------------*/
+static DownlinkCmd_t Commands[DOWNLINK_CMD_MAX_BATCH + 1];
+static uint32_t CommandCount;
+static uint32_t FailMask;             /* Commands the handler fails, by index */
+
+/* Private functions ---------------------------------------------------------*/
+static bool Handler(const DownlinkCmd_t *command)
+{
+  bool applied = ((FailMask & (1UL << CommandCount)) == 0);
+
+  if (CommandCount < (sizeof(Commands) / sizeof(Commands[0])))
+  {
+    Commands[CommandCount] = *command;
+  }
+  CommandCount++;
+  return applied;
+}
+
+static int Process(const uint8_t *frame, uint8_t size, DownlinkCmd_Ack_t *ack)
+{
+  CommandCount = 0;
+  return DownlinkCmd_Process(frame, size, Handler, ack);
+}
+
+static void TestOpcodes(void)
+{
+  static const uint8_t frame[] =
+  {
+    0x5A,
+    0x01, 0x02, 0x58,                                     /* period 600 s */
+    0x02, 0x07, 0xD0, 0x0B, 0xB8,                         /* pH 2000, 3000 */
+    0x03, 0x27, 0x10, 0xFF, 0x38,                         /* TDS 10000, -200 */
+    0x04, 0x09, 0x00, 0x78, 0xFF, 0xF0, 0x00, 0x08,       /* thermal 0x09, 120, -16, 8 */
+    0x05, 0x80, 0x00, 0x01, 0x23,                         /* fields */
+    0x06,                                                 /* diagnostic */
+    0x07, 0xFF, 0xFE,                                     /* offset -2 */
+    0x08, 0x03, 0x81, 0x01, 0x2C, 0xFF, 0x9C, 0x00, 0x05, 0x00, 0x0A, 0x00, 0x3C,
+  };
+  static const uint8_t reporting[] = { 0xA5, 0x09, 0x02, 0x05, 0xA0 };
+  DownlinkCmd_Ack_t ack;
+
+  TEST_CHECK_EQ(Process(frame, sizeof(frame), &ack), 8);
+  TEST_CHECK_EQ(CommandCount, 8);
+  TEST_CHECK_EQ(ack.sequence, 0x5A);
+  TEST_CHECK_EQ(ack.failedMask, 0);
+
+  TEST_CHECK_EQ(Commands[0].opcode, DOWNLINK_CMD_SET_TX_PERIOD);
+  TEST_CHECK_EQ(Commands[0].arg.txPeriod, 600);
+  TEST_CHECK_EQ(Commands[1].opcode, DOWNLINK_CMD_SET_PH_CALIBRATION);
+  TEST_CHECK_EQ(Commands[1].arg.ph.acidVoltage, 2000);
+  TEST_CHECK_EQ(Commands[1].arg.ph.neutralVoltage, 3000);
+  TEST_CHECK_EQ(Commands[2].opcode, DOWNLINK_CMD_SET_TDS_CALIBRATION);
+  TEST_CHECK_EQ(Commands[2].arg.tds.kValue, 10000);
+  TEST_CHECK_EQ(Commands[2].arg.tds.offsetVoltage, -200);
+  TEST_CHECK_EQ(Commands[3].opcode, DOWNLINK_CMD_SET_THERMAL);
+  TEST_CHECK_EQ(Commands[3].arg.thermal.flags, 0x09);
+  TEST_CHECK_EQ(Commands[3].arg.thermal.upper, 120);
+  TEST_CHECK_EQ(Commands[3].arg.thermal.lower, -16);
+  TEST_CHECK_EQ(Commands[3].arg.thermal.hysteresis, 8);
+  TEST_CHECK_EQ(Commands[4].opcode, DOWNLINK_CMD_SET_FIELDS);
+  TEST_CHECK_EQ(Commands[4].arg.fieldMask, 0x80000123UL);
+  TEST_CHECK_EQ(Commands[5].opcode, DOWNLINK_CMD_REQUEST_DIAGNOSTIC);
+  TEST_CHECK_EQ(Commands[6].opcode, DOWNLINK_CMD_SET_THERMAL_OFFSET);
+  TEST_CHECK_EQ(Commands[6].arg.thermalOffset, -2);
+  TEST_CHECK_EQ(Commands[7].opcode, DOWNLINK_CMD_SET_REPORT_RULE);
+  TEST_CHECK_EQ(Commands[7].arg.rule.metric, 3);
+  TEST_CHECK_EQ(Commands[7].arg.rule.flags, 0x81);
+  TEST_CHECK_EQ(Commands[7].arg.rule.high, 300);
+  TEST_CHECK_EQ(Commands[7].arg.rule.low, -100);
+  TEST_CHECK_EQ(Commands[7].arg.rule.hysteresis, 5);
+  TEST_CHECK_EQ(Commands[7].arg.rule.delta, 10);
+  TEST_CHECK_EQ(Commands[7].arg.rule.rate, 60);
+
+  TEST_CHECK_EQ(Process(reporting, sizeof(reporting), &ack), 1);
+  TEST_CHECK_EQ(Commands[0].opcode, DOWNLINK_CMD_SET_REPORTING);
+  TEST_CHECK_EQ(Commands[0].arg.reporting.mode, 2);
+  TEST_CHECK_EQ(Commands[0].arg.reporting.heartbeat, 1440);
+
+  /* Failed commands are acknowledged by index */
+  FailMask = (1UL << 1) | (1UL << 7);
+  TEST_CHECK_EQ(Process(frame, sizeof(frame), &ack), 8);
+  TEST_CHECK_EQ(ack.failedMask, 0x82);
+  TEST_CHECK_EQ(DownlinkCmd_AckValue(&ack), 0x5A82);
+  FailMask = 0;
+
+  /* Every truncation cuts an argument or leaves a shorter valid frame */
+  for (uint8_t size = 0; size < sizeof(frame); size++)
+  {
+    int count = Process(frame, size, &ack);
+
+    TEST_CHECK((count == -1) || ((count > 0) && (ack.failedMask == 0)));
+    if (count == -1)
+    {
+      TEST_CHECK_EQ(CommandCount, 0);
+      TEST_CHECK_EQ(ack.failedMask, 0xFF);
+    }
+  }
+}
+
+static void TestRejected(void)
+{
+  uint8_t frame[MAX_FRAME];
+  DownlinkCmd_Ack_t ack;
+
+  /* Sequence number only, or nothing */
+  frame[0] = 0x11;
+  TEST_CHECK_EQ(Process(frame, 1, &ack), -1);
+  TEST_CHECK_EQ(ack.sequence, 0x11);
+  TEST_CHECK_EQ(Process(frame, 0, &ack), -1);
+  TEST_CHECK_EQ(ack.sequence, 0);
+
+  /* An unknown opcode after valid commands rejects the whole frame */
+  memcpy(frame, (const uint8_t[]){ 0x12, 0x06, 0x01, 0x00, 0x3C, 0x0A }, 6);
+  TEST_CHECK_EQ(Process(frame, 6, &ack), -1);
+  TEST_CHECK_EQ(CommandCount, 0);
+  TEST_CHECK_EQ(DownlinkCmd_AckValue(&ack), 0x12FF);
+  frame[5] = 0x00;
+  TEST_CHECK_EQ(Process(frame, 6, &ack), -1);
+
+  /* One command too many */
+  frame[0] = 0x13;
+  memset(&frame[1], DOWNLINK_CMD_REQUEST_DIAGNOSTIC, DOWNLINK_CMD_MAX_BATCH + 1);
+  TEST_CHECK_EQ(Process(frame, DOWNLINK_CMD_MAX_BATCH + 1, &ack), DOWNLINK_CMD_MAX_BATCH);
+  TEST_CHECK_EQ(Process(frame, DOWNLINK_CMD_MAX_BATCH + 2, &ack), -1);
+  TEST_CHECK_EQ(CommandCount, 0);
+}
+
+static void TestRandomFrames(void)
+{
+  static const uint8_t argSize[] = { 0, 2, 4, 4, 7, 4, 0, 2, 12, 3 };
+  uint8_t frame[MAX_FRAME];
+  DownlinkCmd_Ack_t ack;
+  uint32_t accepted = 0;
+
+  TestSeed(15);
+  for (int n = 0; n < 200000; n++)
+  {
+    uint8_t size = (uint8_t)TestRandomRange(0, 40);
+    int expected = 0;
+    uint8_t pos = 1;
+
+    for (uint8_t i = 0; i < size; i++)
+    {
+      /* Mostly known opcodes so that some frames are valid */
+      frame[i] = (uint8_t)(((TestRandom() & 3) != 0) ? (uint32_t)TestRandomRange(1, 9) : TestRandom());
+    }
+
+    /* Reference parse */
+    if (size < 2)
+    {
+      expected = -1;
+    }
+    while ((expected >= 0) && (pos < size))
+    {
+      if ((frame[pos] == 0) || (frame[pos] > 9) || (expected == DOWNLINK_CMD_MAX_BATCH) ||
+          ((pos + 1 + argSize[frame[pos]]) > size))
+      {
+        expected = -1;
+        break;
+      }
+      pos += 1 + argSize[frame[pos]];
+      expected++;
+    }
+
+    TEST_CHECK_EQ(Process(frame, size, &ack), expected);
+    TEST_CHECK_EQ(CommandCount, (expected < 0) ? 0 : (uint32_t)expected);
+    TEST_CHECK_EQ(ack.failedMask, (expected < 0) ? 0xFF : 0);
+    accepted += (expected > 0) ? 1U : 0U;
+    if (TestFailures != 0)
+    {
+      return;
+    }
+  }
+  TEST_CHECK(accepted > 1000);
+}
+
+static void TestDiagnostic(void)
+{
+  DownlinkCmd_Diagnostic_t diagnostic =
+  {
+    .firmwareVersion = 0x01020304, .uptime = 86400, .txPeriod = 600, .fieldMask = 0x1FF,
+    .vddaMv = 3300, .mcuTemperature = -5, .batteryLevel = 200, .calibrationFlags = 0x05,
+    .phNeutralVoltage = 15000, .phSlope = -591, .tdsKValue = 10000, .tdsOffsetVoltage = -12,
+    .thermalFlags = 0x02, .thermalOffset = -3, .rssi = -112, .snr = -7,
+  };
+  static const uint8_t expected[DOWNLINK_CMD_DIAGNOSTIC_SIZE] =
+  {
+    DOWNLINK_CMD_DIAGNOSTIC_ID, 0x21, 0x04,
+    0x01, 0x02, 0x03, 0x04, 0x00, 0x01, 0x51, 0x80, 0x02, 0x58, 0x00, 0x00, 0x01, 0xFF,
+    0x0C, 0xE4, 0xFB, 0xC8, 0x05,
+    0x3A, 0x98, 0xFD, 0xB1, 0x27, 0x10, 0xFF, 0xF4,
+    0x02, 0xFF, 0xFD, 0xFF, 0x90, 0xF9,
+  };
+  DownlinkCmd_Ack_t ack = { 0x21, 0x04 };
+  uint8_t out[DOWNLINK_CMD_DIAGNOSTIC_SIZE + 4];
+
+  memset(out, 0xEE, sizeof(out));
+  TEST_CHECK_EQ(DownlinkCmd_EncodeDiagnostic(&diagnostic, &ack, out, sizeof(out)), DOWNLINK_CMD_DIAGNOSTIC_SIZE);
+  TEST_CHECK(memcmp(out, expected, sizeof(expected)) == 0);
+  TEST_CHECK_EQ(out[DOWNLINK_CMD_DIAGNOSTIC_SIZE], 0xEE);
+  TEST_CHECK_EQ(DownlinkCmd_EncodeDiagnostic(&diagnostic, &ack, out, DOWNLINK_CMD_DIAGNOSTIC_SIZE - 1), -1);
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestOpcodes();
+  TestRejected();
+  TestRandomFrames();
+  TestDiagnostic();
+
+  return TestSummary(argv[0]);
+}
@@ -0,0 +1,145 @@
+/**
+  ******************************************************************************
+  * @file    test_flash.h
+  * @brief   RAM model of the STM32WL flash for the host tests
+  * @note    Pages are erased to 0xFF and programmed by 64-bit double-words,
+  *          a double-word can only be programmed once after an erase.
+  *          TestFlash_CutPower() makes the flash fail after a number of
+  *          double-words; the double-word being programmed when the power is
+  *          cut is left torn, with a random part of its bits programmed, and
+  *          one time in two with an uncorrectable ECC error: read through
+  *          TestFlash_Read() it fails as FLASH_IF_Read() does on the target.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TEST_FLASH_H__
+#define __TEST_FLASH_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include "test_common.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define TEST_FLASH_SIZE     8192
+#define TEST_FLASH_DWORD    8U
+
+/* Exported variables --------------------------------------------------------*/
+static uint64_t TestFlashMemory[TEST_FLASH_SIZE / TEST_FLASH_DWORD];
+static uint32_t TestFlashPageSize = TEST_FLASH_SIZE;
+static uint32_t TestFlashErases[TEST_FLASH_SIZE / TEST_FLASH_DWORD];
+static uint32_t TestFlashPrograms;
+static bool TestFlashEcc[TEST_FLASH_SIZE / TEST_FLASH_DWORD];
+static uint32_t TestFlashEccErrors;
+
+/* Double-words left before the power cut, -1 when the power stays on */
+static int32_t TestFlashBudget = -1;
+static bool TestFlashPowerLost;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief Erase the whole flash and restore the power
+  */
+static inline void TestFlash_Reset(uint32_t pageSize)
+{
+  memset(TestFlashMemory, 0xFF, sizeof(TestFlashMemory));
+  memset(TestFlashErases, 0, sizeof(TestFlashErases));
+  memset(TestFlashEcc, 0, sizeof(TestFlashEcc));
+  TestFlashEccErrors = 0;
+  TestFlashPageSize = pageSize;
+  TestFlashPrograms = 0;
+  TestFlashBudget = -1;
+  TestFlashPowerLost = false;
+}
+
+/**
+  * @brief Address of an offset in the flash
+  */
+static inline uintptr_t TestFlash_Address(uint32_t offset)
+{
+  return (uintptr_t)TestFlashMemory + offset;
+}
+
+/**
+  * @brief Cut the power after a number of double-words, -1 never
+  */
+static inline void TestFlash_CutPower(int32_t dwords)
+{
+  TestFlashBudget = dwords;
+  TestFlashPowerLost = false;
+}
+
+/**
+  * @brief Erase callback of the stores
+  */
+static inline int TestFlash_Erase(uintptr_t address)
+{
+  uint32_t offset = (uint32_t)(address - (uintptr_t)TestFlashMemory);
+
+  TEST_CHECK((offset % TestFlashPageSize) == 0U);
+  TEST_CHECK((offset + TestFlashPageSize) <= TEST_FLASH_SIZE);
+  if (TestFlashPowerLost)
+  {
+    return -1;
+  }
+  memset(&TestFlashMemory[offset / TEST_FLASH_DWORD], 0xFF, TestFlashPageSize);
+  memset(&TestFlashEcc[offset / TEST_FLASH_DWORD], 0, TestFlashPageSize / TEST_FLASH_DWORD);
+  TestFlashErases[offset / TestFlashPageSize]++;
+  return 0;
+}
+
+/**
+  * @brief Program callback of the stores
+  */
+static inline int TestFlash_Program(uintptr_t address, uint64_t data)
+{
+  uint32_t offset = (uint32_t)(address - (uintptr_t)TestFlashMemory);
+  uint64_t *dword = &TestFlashMemory[offset / TEST_FLASH_DWORD];
+
+  TEST_CHECK((offset % TEST_FLASH_DWORD) == 0U);
+  TEST_CHECK(offset < TEST_FLASH_SIZE);
+  if (TestFlashPowerLost)
+  {
+    return -1;
+  }
+
+  /* The hardware refuses to program a double-word twice */
+  TEST_CHECK(*dword == UINT64_MAX);
+
+  if (TestFlashBudget == 0)
+  {
+    /* Torn: only some of the zero bits were programmed */
+    *dword = data | (((uint64_t)TestRandom() << 32) | TestRandom());
+    TestFlashEcc[offset / TEST_FLASH_DWORD] = ((TestRandom() & 1) != 0);
+    TestFlashPowerLost = true;
+    return -1;
+  }
+  if (TestFlashBudget > 0)
+  {
+    TestFlashBudget--;
+  }
+  *dword = data;
+  TestFlashPrograms++;
+  return 0;
+}
+
+/**
+  * @brief Read callback of the stores
+  */
+static inline int TestFlash_Read(uintptr_t address, void *data, uint32_t size)
+{
+  uint32_t offset = (uint32_t)(address - (uintptr_t)TestFlashMemory);
+
+  TEST_CHECK((offset + size) <= TEST_FLASH_SIZE);
+  for (uint32_t i = offset / TEST_FLASH_DWORD; (size != 0U) && (i <= ((offset + size - 1U) / TEST_FLASH_DWORD)); i++)
+  {
+    if (TestFlashEcc[i])
+    {
+      TestFlashEccErrors++;
+      return -1;
+    }
+  }
+  memcpy(data, (const uint8_t *)TestFlashMemory + offset, size);
+  return 0;
+}
+
+#endif /* __TEST_FLASH_H__ */
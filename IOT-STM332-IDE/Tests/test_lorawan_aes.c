@@ -0,0 +1,201 @@
+/**
+  ******************************************************************************
+  * @file    test_lorawan_aes.c
+  * @brief   NIST vectors and benchmark of the lorawan_aes.c block cipher
+  * @note    Built twice, with the T-table core and with the byte core
+  *          (LORAWAN_AES_TTABLE=0). Both must pass the FIPS-197 appendix C,
+  *          SP 800-38A and AESAVS vectors, with aligned, unaligned and in
+  *          place blocks. The iterated test chains 100000 blocks through
+  *          1000 keys; its result was checked against OpenSSL. The
+  *          benchmark prints the time per block and per key expansion of
+  *          the core it was built with.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test_common.h"
+#include "lorawan_aes.h"
+
+/* Private define ------------------------------------------------------------*/
+#if defined(LORAWAN_AES_TTABLE) && (LORAWAN_AES_TTABLE == 0)
+#define CORE_NAME           "byte core"
+#else
+#define CORE_NAME           "T-table core"
+#endif
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  const char *name;
+  const char *key;
+  const char *plain;
+  const char *cipher;
+} Vector_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const Vector_t Vectors[] =
+{
+  { "FIPS-197 C.1", "000102030405060708090a0b0c0d0e0f",
+    "00112233445566778899aabbccddeeff", "69c4e0d86a7b0430d8cdb78070b4c55a" },
+  { "FIPS-197 C.2", "000102030405060708090a0b0c0d0e0f1011121314151617",
+    "00112233445566778899aabbccddeeff", "dda97ca4864cdfe06eaf70a0ec0d7191" },
+  { "FIPS-197 C.3", "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f",
+    "00112233445566778899aabbccddeeff", "8ea2b7ca516745bfeafc49904b496089" },
+  { "SP 800-38A F.1.1 #1", "2b7e151628aed2a6abf7158809cf4f3c",
+    "6bc1bee22e409f96e93d7e117393172a", "3ad77bb40d7a3660a89ecaf32466ef97" },
+  { "SP 800-38A F.1.1 #2", "2b7e151628aed2a6abf7158809cf4f3c",
+    "ae2d8a571e03ac9c9eb76fac45af8e51", "f5d3d58503b9699de785895a96fdbaaf" },
+  { "SP 800-38A F.1.1 #3", "2b7e151628aed2a6abf7158809cf4f3c",
+    "30c81c46a35ce411e5fbc1191a0a52ef", "43b1cd7f598ece23881b00e3ed030688" },
+  { "SP 800-38A F.1.1 #4", "2b7e151628aed2a6abf7158809cf4f3c",
+    "f69f2445df4f9b17ad2b417be66c3710", "7b0c785e27e8ad3f8223207104725dd4" },
+  { "AESAVS VarTxt 0", "00000000000000000000000000000000",
+    "80000000000000000000000000000000", "3ad78e726c1ec02b7ebfe92b23d9ec34" },
+  { "AESAVS VarTxt 127", "00000000000000000000000000000000",
+    "ffffffffffffffffffffffffffffffff", "3f5b8cc9ea855a0afa7347d23e8d664e" },
+  { "AESAVS VarKey 0", "80000000000000000000000000000000",
+    "00000000000000000000000000000000", "0edd33d3c621e546455bd8ba1418bec8" },
+  { "AESAVS VarKey 127", "ffffffffffffffffffffffffffffffff",
+    "00000000000000000000000000000000", "a1f6258c877d5fcd8964484538bfc92c" },
+  { "AESAVS GFSbox 0", "00000000000000000000000000000000",
+    "f34481ec3cc627bacd5dc3fb08f273e6", "0336763e966d92595a567cc9ce537f5e" },
+  { "AESAVS KeySbox 0", "10a58869d74be5a374cf867cfb473859",
+    "00000000000000000000000000000000", "6d251e6944b051e04eaa6fb4dbf78465" },
+};
+
+/* Private functions ---------------------------------------------------------*/
+static uint8_t Hex(const char *text, uint8_t *out)
+{
+  uint8_t size = 0;
+
+  while (text[2 * size] != '\0')
+  {
+    unsigned int byte;
+
+    sscanf(&text[2 * size], "%2x", &byte);
+    out[size++] = (uint8_t)byte;
+  }
+  return size;
+}
+
+static void SetKey(const uint8_t *key, uint8_t size, lorawan_aes_context *context)
+{
+  memset(context, 0, sizeof(*context));
+  TEST_CHECK_EQ(lorawan_aes_set_key(key, size, context), 0);
+}
+
+static void TestVectors(void)
+{
+  for (uint32_t v = 0; v < (sizeof(Vectors) / sizeof(Vectors[0])); v++)
+  {
+    lorawan_aes_context context;
+    uint8_t key[32];
+    uint8_t plain[16];
+    uint8_t cipher[16];
+    uint8_t out[16 + 3];
+    uint8_t keySize = Hex(Vectors[v].key, key);
+
+    Hex(Vectors[v].plain, plain);
+    Hex(Vectors[v].cipher, cipher);
+    SetKey(key, keySize, &context);
+
+    lorawan_aes_encrypt(plain, out, &context);
+    TEST_CHECK(memcmp(out, cipher, 16) == 0);
+
+    /* Any alignment, in place */
+    for (uint8_t offset = 1; offset <= 3U; offset++)
+    {
+      memcpy(&out[offset], plain, 16);
+      lorawan_aes_encrypt(&out[offset], &out[offset], &context);
+      TEST_CHECK(memcmp(&out[offset], cipher, 16) == 0);
+    }
+    if (TestFailures != 0)
+    {
+      printf("%s\n", Vectors[v].name);
+      return;
+    }
+  }
+
+  /* Key sizes the cipher does not have */
+  {
+    lorawan_aes_context context;
+    uint8_t key[32] = { 0 };
+
+    TEST_CHECK(lorawan_aes_set_key(key, 20, &context) != 0);
+  }
+}
+
+/**
+  * @brief Each key encrypts its block 100 times, the result is xored into the key
+  */
+static void TestIterated(void)
+{
+  lorawan_aes_context context;
+  uint8_t key[16] = { 0 };
+  uint8_t block[16] = { 0 };
+  uint8_t expected[16];
+
+  for (int k = 0; k < 1000; k++)
+  {
+    SetKey(key, sizeof(key), &context);
+    for (int n = 0; n < 100; n++)
+    {
+      lorawan_aes_encrypt(block, block, &context);
+    }
+    for (int i = 0; i < 16; i++)
+    {
+      key[i] ^= block[i];
+    }
+  }
+  Hex("f260ab4e5ea9f98b11196b11513b09ba", expected);
+  TEST_CHECK(memcmp(block, expected, 16) == 0);
+}
+
+/**
+  * @brief Time per block and per key expansion of the core built
+  */
+static void BenchCore(void)
+{
+  const uint32_t blocks = 2000000;
+  const uint32_t keys = 200000;
+  lorawan_aes_context context;
+  uint8_t key[16] = { 0x2b };
+  uint8_t block[16] = { 0x6b };
+  uint64_t start;
+  double perBlock;
+  double perKey;
+
+  SetKey(key, sizeof(key), &context);
+  start = TestNanoseconds();
+  for (uint32_t n = 0; n < blocks; n++)
+  {
+    lorawan_aes_encrypt(block, block, &context);
+  }
+  perBlock = (double)(TestNanoseconds() - start) / blocks;
+  TEST_KEEP(block[0]);
+
+  start = TestNanoseconds();
+  for (uint32_t n = 0; n < keys; n++)
+  {
+    key[0] = (uint8_t)n;
+    lorawan_aes_set_key(key, sizeof(key), &context);
+  }
+  perKey = (double)(TestNanoseconds() - start) / keys;
+  TEST_KEEP(context.ksch[16]);
+
+  printf("  %s: %.1f ns/block, %.1f MB/s, key expansion %.1f ns\n", CORE_NAME, perBlock,
+         16000.0 / perBlock, perKey);
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestVectors();
+  TestIterated();
+  if (TestIsBench(argc, argv))
+  {
+    BenchCore();
+  }
+
+  return TestSummary(argv[0]);
+}
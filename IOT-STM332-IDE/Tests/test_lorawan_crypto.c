@@ -0,0 +1,263 @@
+/**
+  ******************************************************************************
+  * @file    test_lorawan_crypto.c
+  * @brief   Host test of the uplink securing of LoRaMacCrypto.c
+  * @note    LoRaMacCryptoSecureMessage() encrypts the FRMPayload and computes
+  *          the MIC in one pass over the serialized frame. A LoRaWAN 1.0
+  *          uplink must give its known bytes, and random frames must match a
+  *          reference built from the AES and CMAC primitives, whether the
+  *          FRMPayload is already in the frame buffer or in a buffer of the
+  *          caller. The caller's FRMPayload must be left as it was, and a
+  *          retransmission must give the same frame again.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test_common.h"
+#include "radio.h"
+#include "sys_app.h"
+#include "stm32_adv_trace.h"
+#include "secure-element.h"
+#include "LoRaMacCrypto.h"
+#include "lorawan_aes.h"
+#include "cmac.h"
+
+/* Private define ------------------------------------------------------------*/
+#define MAX_FRAME           255
+#define HEADER_SIZE         8U
+#define MIC_SIZE            4U
+
+/* Fakes ---------------------------------------------------------------------*/
+/* Unused by the tested functions, SecureElementRandomNumber() reads it */
+const struct Radio_s Radio;
+
+void GetUniqueId(uint8_t *id)
+{
+  memset(id, 0x01, 8);
+}
+
+UTIL_ADV_TRACE_Status_t UTIL_ADV_TRACE_COND_FSend(uint32_t VerboseLevel, uint32_t Region, uint32_t TimeStampState,
+                                                  const char *strFormat, ...)
+{
+  return UTIL_ADV_TRACE_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+static void NvmChanged(void)
+{
+}
+
+static uint16_t Hex(const char *text, uint8_t *out)
+{
+  uint16_t size = 0;
+
+  while ((text[2 * size] != '\0') && (text[(2 * size) + 1] != '\0'))
+  {
+    unsigned int byte;
+
+    sscanf(&text[2 * size], "%2x", &byte);
+    out[size++] = (uint8_t)byte;
+  }
+  return size;
+}
+
+static void RandomBytes(uint8_t *buffer, uint16_t size)
+{
+  for (uint16_t i = 0; i < size; i++)
+  {
+    buffer[i] = (uint8_t)TestRandom();
+  }
+}
+
+/**
+  * @brief Start a 1.0.4 session with the given session keys
+  */
+static void StartSession(const uint8_t appSKey[16], const uint8_t nwkSKey[16])
+{
+  Version_t version;
+
+  version.Value = 0x01000400;
+  TEST_CHECK_EQ(SecureElementInit(NvmChanged), SECURE_ELEMENT_SUCCESS);
+  TEST_CHECK_EQ(LoRaMacCryptoInit(NvmChanged), LORAMAC_CRYPTO_SUCCESS);
+  TEST_CHECK_EQ(LoRaMacCryptoSetLrWanVersion(version), LORAMAC_CRYPTO_SUCCESS);
+  TEST_CHECK_EQ(LoRaMacCryptoSetKey(APP_S_KEY, (uint8_t *)appSKey), LORAMAC_CRYPTO_SUCCESS);
+  TEST_CHECK_EQ(LoRaMacCryptoSetKey(NWK_S_KEY, (uint8_t *)nwkSKey), LORAMAC_CRYPTO_SUCCESS);
+}
+
+/**
+  * @brief Reference uplink: header, FPort, FRMPayload encrypted block by block, MIC
+  */
+static uint16_t ReferenceFrame(const LoRaMacMessageData_t *message, const uint8_t *plain, uint32_t fCnt,
+                               const uint8_t appSKey[16], const uint8_t nwkSKey[16], uint8_t *frame)
+{
+  lorawan_aes_context context;
+  AES_CMAC_CTX cmac;
+  uint8_t aBlock[16] = { 0x01 };
+  uint8_t b0Block[16] = { 0x49 };
+  uint8_t sBlock[16];
+  uint8_t mac[16];
+  uint8_t fOptsLen = message->FHDR.FCtrl.Bits.FOptsLen;
+  uint16_t size = 0;
+
+  frame[size++] = message->MHDR.Value;
+  for (uint8_t i = 0; i < 4U; i++)
+  {
+    frame[size++] = (uint8_t)(message->FHDR.DevAddr >> (8U * i));
+  }
+  frame[size++] = message->FHDR.FCtrl.Value;
+  frame[size++] = (uint8_t)fCnt;
+  frame[size++] = (uint8_t)(fCnt >> 8);
+  memcpy(&frame[size], message->FHDR.FOpts, fOptsLen);
+  size += fOptsLen;
+
+  for (uint8_t i = 0; i < 4U; i++)
+  {
+    aBlock[6 + i] = (uint8_t)(message->FHDR.DevAddr >> (8U * i));
+    aBlock[10 + i] = (uint8_t)(fCnt >> (8U * i));
+  }
+  if (message->FRMPayloadSize > 0)
+  {
+    frame[size++] = message->FPort;
+    memset(&context, 0, sizeof(context));
+    lorawan_aes_set_key((message->FPort == 0) ? nwkSKey : appSKey, 16, &context);
+    for (uint16_t i = 0; i < message->FRMPayloadSize; i++)
+    {
+      if ((i % 16U) == 0U)
+      {
+        aBlock[15] = (uint8_t)((i / 16U) + 1U);
+        lorawan_aes_encrypt(aBlock, sBlock, &context);
+      }
+      frame[size++] = plain[i] ^ sBlock[i % 16U];
+    }
+  }
+
+  memcpy(&b0Block[6], &aBlock[6], 8);
+  b0Block[15] = (uint8_t)size;
+  AES_CMAC_Init(&cmac);
+  AES_CMAC_SetKey(&cmac, nwkSKey);
+  AES_CMAC_Update(&cmac, b0Block, 16);
+  AES_CMAC_Update(&cmac, frame, size);
+  AES_CMAC_Final(mac, &cmac);
+  memcpy(&frame[size], mac, MIC_SIZE);
+  return size + MIC_SIZE;
+}
+
+/**
+  * @brief LoRaWAN 1.0 uplink: FRMPayload "test" on port 1, FCnt 2
+  */
+static void TestKnownFrame(void)
+{
+  LoRaMacMessageData_t message;
+  uint8_t appSKey[16];
+  uint8_t nwkSKey[16];
+  uint8_t buffer[MAX_FRAME];
+  uint8_t expected[MAX_FRAME];
+  uint8_t payload[4] = { 't', 'e', 's', 't' };
+  uint16_t size = Hex("40f17dbe4900020001954378762b11ff0d", expected);
+
+  Hex("ec925802ae430ca77fd3dd73cb2cc588", appSKey);
+  Hex("44024241ed4ce9a68c6a8bc055233fd3", nwkSKey);
+  StartSession(appSKey, nwkSKey);
+
+  memset(&message, 0, sizeof(message));
+  message.Buffer = buffer;
+  message.BufSize = sizeof(buffer);
+  message.MHDR.Value = 0x40;
+  message.FHDR.DevAddr = 0x49BE7DF1;
+  message.FHDR.FCnt = 2;
+  message.FPort = 1;
+  message.FRMPayload = payload;
+  message.FRMPayloadSize = sizeof(payload);
+
+  TEST_CHECK_EQ(LoRaMacCryptoSecureMessage(2, 0, 0, &message), LORAMAC_CRYPTO_SUCCESS);
+  TEST_CHECK_EQ(message.BufSize, size);
+  TEST_CHECK(memcmp(buffer, expected, size) == 0);
+  TEST_CHECK(memcmp(payload, "test", sizeof(payload)) == 0);
+
+  TEST_CHECK_EQ(LoRaMacCryptoSecureMessage(2, 0, 0, &message), LORAMAC_CRYPTO_SUCCESS);
+  TEST_CHECK(memcmp(buffer, expected, size) == 0);
+  TEST_CHECK(memcmp(payload, "test", sizeof(payload)) == 0);
+}
+
+/**
+  * @brief Random frames against the reference, some of them sent twice
+  */
+static void TestRandomFrames(void)
+{
+  uint8_t appSKey[16];
+  uint8_t nwkSKey[16];
+  uint8_t buffer[MAX_FRAME];
+  uint8_t expected[MAX_FRAME];
+  uint8_t payload[MAX_FRAME];
+  uint8_t plain[MAX_FRAME];
+
+  TestSeed(24);
+  RandomBytes(appSKey, sizeof(appSKey));
+  RandomBytes(nwkSKey, sizeof(nwkSKey));
+  StartSession(appSKey, nwkSKey);
+
+  for (uint32_t fCnt = 1; fCnt <= 5000U; fCnt++)
+  {
+    LoRaMacMessageData_t message;
+    uint8_t fOptsLen = ((TestRandom() & 1) != 0) ? (uint8_t)TestRandomRange(0, 15) : 0;
+    uint16_t payloadSize = (uint16_t)TestRandomRange(0, MAX_FRAME - HEADER_SIZE - 15 - 1 - MIC_SIZE);
+    bool inPlace = ((TestRandom() & 1) != 0);
+    uint16_t size;
+
+    memset(&message, 0, sizeof(message));
+    message.Buffer = buffer;
+    message.BufSize = sizeof(buffer);
+    message.MHDR.Value = 0x40;
+    message.FHDR.DevAddr = (uint32_t)TestRandom();
+    message.FHDR.FCtrl.Bits.FOptsLen = fOptsLen;
+    message.FHDR.FCtrl.Bits.Ack = (uint8_t)(TestRandom() & 1);
+    message.FHDR.FCnt = (uint16_t)fCnt;
+    RandomBytes(message.FHDR.FOpts, fOptsLen);
+    message.FPort = ((TestRandom() & 3) != 0) ? (uint8_t)TestRandomRange(1, 223) : 0;
+    RandomBytes(plain, payloadSize);
+    RandomBytes(buffer, sizeof(buffer));
+
+    /* As PrepareFrame leaves it: in the frame buffer, or in a buffer of the caller */
+    message.FRMPayload = inPlace ? &buffer[HEADER_SIZE + fOptsLen + 1U] : payload;
+    message.FRMPayloadSize = payloadSize;
+    memcpy(message.FRMPayload, plain, payloadSize);
+    size = ReferenceFrame(&message, plain, fCnt, appSKey, nwkSKey, expected);
+
+    TEST_CHECK_EQ(LoRaMacCryptoSecureMessage(fCnt, 0, 0, &message), LORAMAC_CRYPTO_SUCCESS);
+    TEST_CHECK_EQ(message.BufSize, size);
+    TEST_CHECK(memcmp(buffer, expected, size) == 0);
+    if (!inPlace)
+    {
+      TEST_CHECK(memcmp(payload, plain, payloadSize) == 0);
+    }
+
+    /* Retransmission, with the message as the first call left it */
+    if ((fCnt % 4U) == 0U)
+    {
+      memset(&buffer[size], 0xEE, sizeof(buffer) - size);
+      TEST_CHECK_EQ(LoRaMacCryptoSecureMessage(fCnt, 0, 0, &message), LORAMAC_CRYPTO_SUCCESS);
+      TEST_CHECK_EQ(message.BufSize, size);
+      TEST_CHECK(memcmp(buffer, expected, size) == 0);
+      if (!inPlace)
+      {
+        TEST_CHECK(memcmp(payload, plain, payloadSize) == 0);
+      }
+    }
+
+    if (TestFailures != 0)
+    {
+      printf("FCnt %u, FOpts %u, FRMPayload %u on port %u, %s\n", (unsigned)fCnt, fOptsLen, payloadSize,
+             message.FPort, inPlace ? "in place" : "caller buffer");
+      return;
+    }
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestKnownFrame();
+  TestRandomFrames();
+
+  return TestSummary(argv[0]);
+}
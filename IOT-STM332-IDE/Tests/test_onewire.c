@@ -0,0 +1,340 @@
+/**
+  ******************************************************************************
+  * @file    test_onewire.c
+  * @brief   Host test of the 1-Wire slot timing of onewire.c
+  * @note    GPIOB and DWT are served by a bus model: every register access
+  *          costs a few cycles of a simulated cycle counter, the BSRR writes
+  *          are recorded as pin edges with their cycle and the IDR reads as
+  *          sample points. The reset pulse and the read and write slots are
+  *          checked against the DS18B20 datasheet windows at the 48 MHz
+  *          system clock, and at the 16 MHz HSI and 4 MHz MSI clocks. The
+  *          cycle counter wraps around during each run.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test_common.h"
+#include "onewire.h"
+
+/* Private define ------------------------------------------------------------*/
+#define ACCESS_CYCLES       3       /* Cost of one register access, loop included */
+#define MAX_EVENTS          64
+
+/* DS18B20 datasheet windows, us */
+#define T_RSTL_MIN          480.0
+#define T_RSTL_MAX          960.0
+#define T_RSTH_MIN          480.0
+#define T_PDH_MAX           60.0    /* Presence pulse starts by then */
+#define T_PDH_PDL_MIN       75.0    /* tPDH 15 + tPDL 60, may end from then */
+#define T_LOW0_MIN          60.0
+#define T_LOW0_MAX          120.0
+#define T_LOW1_MIN          1.0
+#define T_LOW1_MAX          15.0
+#define T_INIT_MIN          1.0
+#define T_RDV_MAX           15.0
+#define T_SLOT_MIN          60.0
+#define T_SLOT_MAX          120.0
+#define T_REC_MIN           1.0
+
+/* Private variables ---------------------------------------------------------*/
+uint32_t SystemCoreClock;
+CoreDebug_Type TestCoreDebug;
+
+static GPIO_TypeDef Port;
+static DWT_Type Dwt;
+static GPIO_InitTypeDef PortInit;
+
+/**
+  * @brief Simulated time, cycles since the start of the run
+  */
+static uint64_t Cycles;
+static uint32_t CycleBase;          /* CYCCNT at cycle 0 */
+static bool PortAccessed;           /* GPIOB returned, access not yet classified */
+static uint64_t PortAccessCycle;
+
+/**
+  * @brief Pin edges driven by the master and bus samples, in cycles
+  */
+static uint64_t Edges[MAX_EVENTS];
+static bool EdgeLevels[MAX_EVENTS];
+static uint32_t EdgeCount;
+static uint64_t Samples[MAX_EVENTS];
+static uint32_t SampleCount;
+
+/**
+  * @brief Bus: the master pin and one slave
+  */
+static bool MasterLow;
+static uint64_t MasterFall;
+static bool SlavePresent;
+static uint8_t SlaveBit;            /* Answer to the read slots */
+static uint64_t SlaveLowFrom;
+static uint64_t SlaveLowUntil;
+
+/* Fakes ---------------------------------------------------------------------*/
+static uint64_t UsToCycles(double us)
+{
+  return (uint64_t)((us * SystemCoreClock) / 1e6);
+}
+
+static double CyclesToUs(uint64_t cycles)
+{
+  return ((double)cycles * 1e6) / SystemCoreClock;
+}
+
+static bool BusLevel(uint64_t cycle)
+{
+  return !(MasterLow || ((cycle >= SlaveLowFrom) && (cycle < SlaveLowUntil)));
+}
+
+/**
+  * @brief Classify the last GPIOB access: a BSRR write drives the pin, otherwise
+  *        IDR was read
+  */
+static void Settle(void)
+{
+  uint32_t bsrr = Port.BSRR;
+
+  if (!PortAccessed)
+  {
+    return;
+  }
+  PortAccessed = false;
+  Port.BSRR = 0;
+
+  if (bsrr == 0)
+  {
+    TEST_CHECK(SampleCount < MAX_EVENTS);
+    Samples[SampleCount++ % MAX_EVENTS] = PortAccessCycle;
+    return;
+  }
+
+  if (((bsrr & ((uint32_t)ONEWIRE_PIN << 16)) != 0) && !MasterLow)
+  {
+    MasterLow = true;
+    MasterFall = PortAccessCycle;
+    /* A slave answering 0 holds the line for the shortest valid time */
+    if (SlavePresent && (SlaveBit == 0))
+    {
+      SlaveLowFrom = MasterFall;
+      SlaveLowUntil = MasterFall + UsToCycles(T_RDV_MAX);
+    }
+  }
+  else if (((bsrr & ONEWIRE_PIN) != 0) && MasterLow)
+  {
+    MasterLow = false;
+    /* Presence pulse after a reset pulse */
+    if (SlavePresent && ((PortAccessCycle - MasterFall) >= UsToCycles(T_RSTL_MIN)))
+    {
+      SlaveLowFrom = PortAccessCycle + UsToCycles(30.0);
+      SlaveLowUntil = SlaveLowFrom + UsToCycles(120.0);
+    }
+  }
+  else
+  {
+    return;
+  }
+
+  TEST_CHECK(EdgeCount < MAX_EVENTS);
+  Edges[EdgeCount % MAX_EVENTS] = PortAccessCycle;
+  EdgeLevels[EdgeCount++ % MAX_EVENTS] = !MasterLow;
+}
+
+GPIO_TypeDef *TestGpioB(void)
+{
+  Settle();
+  Cycles += ACCESS_CYCLES;
+  Port.IDR = BusLevel(Cycles) ? ONEWIRE_PIN : 0U;
+  PortAccessed = true;
+  PortAccessCycle = Cycles;
+  return &Port;
+}
+
+DWT_Type *TestDwt(void)
+{
+  Settle();
+  Cycles += ACCESS_CYCLES;
+  Dwt.CYCCNT = CycleBase + (uint32_t)Cycles;
+  return &Dwt;
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+  PortInit = *GPIO_Init;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief Start a run at a system clock, the cycle counter wraps 100 us later
+  */
+static void StartRun(uint32_t clock)
+{
+  SystemCoreClock = clock;
+  Cycles = 0;
+  CycleBase = (uint32_t)(0U - (uint32_t)UsToCycles(100.0));
+  PortAccessed = false;
+  Port.BSRR = 0;
+  MasterLow = false;
+  SlaveLowFrom = 0;
+  SlaveLowUntil = 0;
+}
+
+static void StartOperation(void)
+{
+  Settle();
+  EdgeCount = 0;
+  SampleCount = 0;
+}
+
+static double EdgeUs(uint32_t from, uint32_t to)
+{
+  return CyclesToUs(Edges[to] - Edges[from]);
+}
+
+/**
+  * @brief Reset pulse, presence sampled where every device pulls the line low
+  */
+static void CheckReset(bool present)
+{
+  uint64_t end;
+  bool presence;
+
+  SlavePresent = present;
+  StartOperation();
+  presence = OneWire_Reset();
+  Settle();
+  end = Cycles;
+
+  TEST_CHECK_EQ(presence, present);
+  TEST_CHECK_EQ(EdgeCount, 2);
+  TEST_CHECK_EQ(SampleCount, 1);
+  TEST_CHECK(!EdgeLevels[0] && EdgeLevels[1]);
+  TEST_CHECK(EdgeUs(0, 1) >= T_RSTL_MIN);
+  TEST_CHECK(EdgeUs(0, 1) <= T_RSTL_MAX);
+  TEST_CHECK(CyclesToUs(Samples[0] - Edges[1]) >= T_PDH_MAX);
+  TEST_CHECK(CyclesToUs(Samples[0] - Edges[1]) <= T_PDH_PDL_MIN);
+  TEST_CHECK(CyclesToUs(end - Edges[1]) >= T_RSTH_MIN);
+}
+
+static void CheckWriteBit(uint8_t bit)
+{
+  uint64_t end;
+
+  SlavePresent = true;
+  SlaveBit = 1;
+  StartOperation();
+  OneWire_WriteBit(bit);
+  Settle();
+  end = Cycles;
+
+  TEST_CHECK_EQ(EdgeCount, 2);
+  TEST_CHECK_EQ(SampleCount, 0);
+  TEST_CHECK(!EdgeLevels[0] && EdgeLevels[1]);
+  if (bit != 0)
+  {
+    TEST_CHECK(EdgeUs(0, 1) >= T_LOW1_MIN);
+    TEST_CHECK(EdgeUs(0, 1) < T_LOW1_MAX);
+  }
+  else
+  {
+    TEST_CHECK(EdgeUs(0, 1) >= T_LOW0_MIN);
+    TEST_CHECK(EdgeUs(0, 1) <= T_LOW0_MAX);
+  }
+  TEST_CHECK(CyclesToUs(end - Edges[0]) >= T_SLOT_MIN + T_REC_MIN);
+  TEST_CHECK(CyclesToUs(end - Edges[0]) <= T_SLOT_MAX + T_LOW1_MAX);
+  TEST_CHECK(CyclesToUs(end - Edges[1]) >= T_REC_MIN);
+}
+
+/**
+  * @brief Read slot against a slave holding a 0 only for tRDV
+  */
+static void CheckReadBit(uint8_t bit)
+{
+  uint64_t end;
+
+  SlavePresent = true;
+  SlaveBit = bit;
+  StartOperation();
+  TEST_CHECK_EQ(OneWire_ReadBit(), bit);
+  Settle();
+  end = Cycles;
+
+  TEST_CHECK_EQ(EdgeCount, 2);
+  TEST_CHECK_EQ(SampleCount, 1);
+  TEST_CHECK(!EdgeLevels[0] && EdgeLevels[1]);
+  TEST_CHECK(EdgeUs(0, 1) >= T_INIT_MIN);
+  TEST_CHECK(Samples[0] > Edges[1]);
+  TEST_CHECK(CyclesToUs(Samples[0] - Edges[0]) < T_RDV_MAX);
+  TEST_CHECK(CyclesToUs(end - Edges[0]) >= T_SLOT_MIN + T_REC_MIN);
+}
+
+/**
+  * @brief Back to back slots of a byte: slot length and recovery between them
+  */
+static void CheckWriteByte(uint8_t byte)
+{
+  SlavePresent = true;
+  SlaveBit = 1;
+  StartOperation();
+  OneWire_WriteByte(byte);
+  Settle();
+
+  TEST_CHECK_EQ(EdgeCount, 16);
+  for (uint32_t i = 0; (i + 2) < EdgeCount; i += 2)
+  {
+    TEST_CHECK(EdgeUs(i, i + 2) >= T_SLOT_MIN + T_REC_MIN);
+    TEST_CHECK(EdgeUs(i + 1, i + 2) >= T_REC_MIN);
+    if (((byte >> (i / 2)) & 1U) != 0)
+    {
+      TEST_CHECK(EdgeUs(i, i + 1) < T_LOW1_MAX);
+    }
+    else
+    {
+      TEST_CHECK(EdgeUs(i, i + 1) >= T_LOW0_MIN);
+    }
+  }
+}
+
+static void TestSlots(void)
+{
+  static const uint32_t clocks[] = { 48000000U, 16000000U, 4000000U };
+
+  for (uint32_t c = 0; c < sizeof(clocks) / sizeof(clocks[0]); c++)
+  {
+    int failures = TestFailures;
+
+    StartRun(clocks[c]);
+    TestCoreDebug.DEMCR = 0;
+    Dwt.CTRL = 0;
+    OneWire_Init();
+    TEST_CHECK((TestCoreDebug.DEMCR & CoreDebug_DEMCR_TRCENA_Msk) != 0);
+    TEST_CHECK((Dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk) != 0);
+    TEST_CHECK_EQ(PortInit.Mode, GPIO_MODE_OUTPUT_OD);
+    TEST_CHECK_EQ(PortInit.Pull, GPIO_PULLUP);
+    TEST_CHECK(!MasterLow);
+
+    CheckReset(true);
+    CheckReset(false);
+    CheckWriteBit(0);
+    CheckWriteBit(1);
+    CheckReadBit(0);
+    CheckReadBit(1);
+    CheckWriteByte(0xA5);
+    CheckWriteByte(ONEWIRE_CMD_SKIP_ROM);
+
+    /* The run went across the cycle counter wrap-around */
+    TEST_CHECK(Cycles > UsToCycles(100.0));
+    if (TestFailures != failures)
+    {
+      printf("SYSCLK %u Hz\n", (unsigned)clocks[c]);
+    }
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestSlots();
+
+  return TestSummary(argv[0]);
+}
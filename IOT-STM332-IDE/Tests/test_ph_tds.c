@@ -0,0 +1,257 @@
+/**
+  ******************************************************************************
+  * @file    test_ph_tds.c
+  * @brief   Differential host test of the Q16 pH and TDS conversion chains
+  * @note    Every ADC code is converted at temperatures from -10 to 45 degC
+  *          under several calibrations and compared with the float formulas
+  *          the Q16 code replaced. The readings also go through
+  *          pH_ReadSensor()/TDS_ReadSensor() with a fake ADC scan.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <math.h>
+#include "test_common.h"
+#include "adc_if.h"
+#include "calib_store.h"
+#include "ph_sensor.h"
+#include "tds_sensor.h"
+
+/* Private define ------------------------------------------------------------*/
+#define ADC_CODES           4096
+
+/* Largest differences allowed with the float formulas */
+#define PH_TOLERANCE        0.0005
+#define CONDUCTIVITY_TOLERANCE 0.25    /* uS/cm */
+#define TDS_TOLERANCE       0.15       /* ppm */
+
+/* Private variables ---------------------------------------------------------*/
+ADC_HandleTypeDef hadc = { 1U };
+
+static uint32_t Tick = 1000;
+static uint16_t ScanCodes[ADC_SCAN_RANKS];
+
+/* Fakes ---------------------------------------------------------------------*/
+uint32_t HAL_GetTick(void)
+{
+  /* Every read is a new scan, the 50 ms cache never hits */
+  Tick += 100;
+  return Tick;
+}
+
+uint32_t HAL_ADC_GetState(ADC_HandleTypeDef *adc)
+{
+  return adc->State;
+}
+
+HAL_StatusTypeDef ADC_ScanRead(ADC_Snapshot_t *snapshot)
+{
+  memset(snapshot, 0, sizeof(*snapshot));
+  memcpy(snapshot->filtered, ScanCodes, sizeof(ScanCodes));
+  snapshot->tick = Tick;
+  return HAL_OK;
+}
+
+bool ADC_ScanGetLast(ADC_Snapshot_t *snapshot)
+{
+  return false;
+}
+
+int CalibStore_Read(CalibStore_Key_t key, void *value, uint16_t size)
+{
+  return -1;
+}
+
+int CalibStore_Write(CalibStore_Key_t key, const void *value, uint16_t length)
+{
+  return 0;
+}
+
+int CalibStore_Delete(CalibStore_Key_t key)
+{
+  return 0;
+}
+
+/* Float reference -----------------------------------------------------------*/
+static float RefVoltage(uint16_t adcValue)
+{
+  return ((float)adcValue * 3300.0f) / 4095.0f;
+}
+
+static float RefPh(float voltage, float temperature, float slope)
+{
+  float phValue = 14.0f - ((voltage - 500.0f) / slope);
+
+  phValue += (PH_NEUTRAL_VALUE - phValue) * PH_TEMP_COEFFICIENT * (temperature - PH_REFERENCE_TEMP);
+  if (phValue < PH_MIN_VALUE) phValue = PH_MIN_VALUE;
+  if (phValue > PH_MAX_VALUE) phValue = PH_MAX_VALUE;
+  return phValue;
+}
+
+static float RefConductivity(float voltage, float temperature, float kValue, float offset)
+{
+  float conductivity = ((voltage - offset) / TDS_SENSOR_VREF) * 2000.0f * kValue;
+
+  conductivity /= 1.0f + (TDS_TEMP_COEFFICIENT * (temperature - TDS_REFERENCE_TEMP));
+  if (conductivity < 0.0f) conductivity = 0.0f;
+  if (conductivity > 3000.0f) conductivity = 3000.0f;
+  return conductivity;
+}
+
+static float RefTds(float conductivity)
+{
+  float tdsValue = conductivity * 0.5f;
+
+  if (tdsValue < TDS_MIN_VALUE) tdsValue = TDS_MIN_VALUE;
+  if (tdsValue > TDS_MAX_VALUE) tdsValue = TDS_MAX_VALUE;
+  return tdsValue;
+}
+
+/* Private functions ---------------------------------------------------------*/
+static void TestPh(void)
+{
+  /* Default calibration, then two-point calibrations of either sign */
+  static const float points[][2] = { { 0.0f, 0.0f }, { 2032.0f, 1500.0f }, { 1250.0f, 2100.0f }, { 900.0f, 1000.0f } };
+  double worst = 0.0;
+
+  TEST_CHECK(pH_Init() == HAL_OK);
+  for (uint32_t c = 0; c < sizeof(points) / sizeof(points[0]); c++)
+  {
+    float slope;
+
+    if (c == 0)
+    {
+      TEST_CHECK(pH_ResetCalibration() == HAL_OK);
+    }
+    else
+    {
+      TEST_CHECK(pH_CalibrateTwoPoint(points[c][0], points[c][1]) == HAL_OK);
+    }
+    slope = pH_GetCalibration().slope;
+
+    for (float temperature = -10.0f; temperature <= 45.0f; temperature += 0.5f)
+    {
+      for (uint16_t code = 0; code < ADC_CODES; code++)
+      {
+        float expected = RefPh(RefVoltage(code), temperature, slope);
+        int32_t voltage = pH_ADCToVoltageQ16(code);
+        double error;
+
+        TEST_CHECK(fabsf(PH_Q16_TO_FLOAT(voltage) - RefVoltage(code)) < 0.01f);
+        error = fabs(PH_Q16_TO_FLOAT(pH_VoltageToPhValueQ16(voltage, PH_Q16(temperature))) - expected);
+        worst = (error > worst) ? error : worst;
+        TEST_CHECK(fabs(pH_VoltageToPhValue(RefVoltage(code), temperature) - expected) <= PH_TOLERANCE);
+      }
+    }
+
+    /* Whole reading, through the ADC scan */
+    for (uint16_t code = PH_MIN_ADC_VALUE; code <= PH_MAX_ADC_VALUE; code += 7)
+    {
+      pH_ReadingTypeDef reading;
+
+      ScanCodes[PH_ADC_CHANNEL_RANK] = code;
+      reading = pH_ReadSensor(18.5f);
+      TEST_CHECK_EQ(reading.adcValue, code);
+      TEST_CHECK(pH_IsReadingValid(reading));
+      TEST_CHECK(fabs(reading.phValue - RefPh(RefVoltage(code), 18.5f, slope)) <= PH_TOLERANCE);
+    }
+  }
+  TEST_CHECK(worst <= PH_TOLERANCE);
+
+  /* Out of the valid ADC range: neutral and invalid */
+  ScanCodes[PH_ADC_CHANNEL_RANK] = PH_MIN_ADC_VALUE - 1;
+  TEST_CHECK(!pH_IsReadingValid(pH_ReadSensor(25.0f)));
+  TEST_CHECK(pH_CalibrateTwoPoint(1500.0f, 1520.0f) == HAL_ERROR);
+}
+
+static void TestTds(void)
+{
+  /* Default calibration, then k value and offset pairs */
+  static const float calibrations[][2] = { { 1.0f, 0.0f }, { 0.5f, 20.0f }, { 2.5f, -100.0f }, { 9.0f, 300.0f } };
+  double worstConductivity = 0.0;
+  double worstTds = 0.0;
+
+  TEST_CHECK(TDS_Init() == HAL_OK);
+  for (uint32_t c = 0; c <= sizeof(calibrations) / sizeof(calibrations[0]); c++)
+  {
+    TDS_CalibrationTypeDef calibration;
+
+    if (c == 0)
+    {
+      TEST_CHECK(TDS_ResetCalibration() == HAL_OK);
+    }
+    else if (c < sizeof(calibrations) / sizeof(calibrations[0]))
+    {
+      TEST_CHECK(TDS_SetCalibration(calibrations[c][0], calibrations[c][1]) == HAL_OK);
+    }
+    else
+    {
+      /* 500 ppm standard measured at 1200 mV */
+      TEST_CHECK(TDS_SetCalibration(1.0f, 0.0f) == HAL_OK);
+      TEST_CHECK(TDS_Calibrate(500.0f, 1200.0f) == HAL_OK);
+    }
+    calibration = TDS_GetCalibration();
+
+    for (float temperature = -10.0f; temperature <= 45.0f; temperature += 0.5f)
+    {
+      for (uint16_t code = 0; code < ADC_CODES; code++)
+      {
+        float conductivity = RefConductivity(RefVoltage(code), temperature, calibration.kValue,
+                                             calibration.offsetVoltage);
+        int32_t q16 = TDS_VoltageToConductivityQ16(TDS_ADCToVoltageQ16(code), TDS_Q16(temperature));
+        double error;
+
+        error = fabs(TDS_Q16_TO_FLOAT(q16) - conductivity);
+        worstConductivity = (error > worstConductivity) ? error : worstConductivity;
+        error = fabs(TDS_Q16_TO_FLOAT(TDS_ConductivityToTDSQ16(q16)) - RefTds(conductivity));
+        worstTds = (error > worstTds) ? error : worstTds;
+      }
+    }
+
+    /* Whole reading, through the ADC scan */
+    for (uint16_t code = 1; code < ADC_CODES; code += 5)
+    {
+      TDS_ReadingTypeDef reading;
+      float conductivity = RefConductivity(RefVoltage(code), 12.0f, calibration.kValue,
+                                           calibration.offsetVoltage);
+
+      ScanCodes[TDS_ADC_CHANNEL_RANK] = code;
+      reading = TDS_ReadSensor(12.0f);
+      TEST_CHECK_EQ(reading.adcValue, code);
+      if (TDS_IsReadingValid(reading))
+      {
+        TEST_CHECK(fabs(reading.conductivity - conductivity) <= CONDUCTIVITY_TOLERANCE);
+        TEST_CHECK(fabs(reading.tdsValue - RefTds(conductivity)) <= TDS_TOLERANCE);
+      }
+    }
+  }
+  TEST_CHECK(worstConductivity <= CONDUCTIVITY_TOLERANCE);
+  TEST_CHECK(worstTds <= TDS_TOLERANCE);
+
+  /* The float wrappers run the same chain */
+  TEST_CHECK(fabs(TDS_ApplyTemperatureCompensation(1000.0f, 35.0f) - (1000.0 / 1.2)) <= CONDUCTIVITY_TOLERANCE);
+  TEST_CHECK(fabs(TDS_ConductivityToTDS(1234.5f) - 617.25) <= TDS_TOLERANCE);
+  TEST_CHECK(TDS_SetCalibration(0.0f, 0.0f) == HAL_ERROR);
+
+  /* Water quality classes and their names, limits included */
+  TEST_CHECK_EQ(TDS_GetWaterQuality(0.0f), TDS_QUALITY_EXCELLENT);
+  TEST_CHECK_EQ(TDS_GetWaterQuality(TDS_EXCELLENT_MAX), TDS_QUALITY_EXCELLENT);
+  TEST_CHECK_EQ(TDS_GetWaterQuality(TDS_EXCELLENT_MAX + 0.1f), TDS_QUALITY_GOOD);
+  TEST_CHECK_EQ(TDS_GetWaterQuality(TDS_FAIR_MAX), TDS_QUALITY_FAIR);
+  TEST_CHECK_EQ(TDS_GetWaterQuality(TDS_POOR_MAX), TDS_QUALITY_POOR);
+  TEST_CHECK_EQ(TDS_GetWaterQuality(TDS_UNACCEPTABLE_MAX), TDS_QUALITY_UNACCEPTABLE);
+  TEST_CHECK_EQ(TDS_GetWaterQuality(TDS_UNACCEPTABLE_MAX + 0.1f), TDS_QUALITY_DANGEROUS);
+  TEST_CHECK(strcmp(TDS_GetWaterQualityString(150.0f), "Excellent") == 0);
+  TEST_CHECK(strcmp(TDS_GetWaterQualityString(450.0f), "Good") == 0);
+  TEST_CHECK(strcmp(TDS_GetWaterQualityString(1500.0f), "Unacceptable") == 0);
+  TEST_CHECK(strcmp(TDS_GetWaterQualityString(2500.0f), "Dangerous") == 0);
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestPh();
+  TestTds();
+
+  return TestSummary(argv[0]);
+}
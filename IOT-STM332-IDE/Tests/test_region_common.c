@@ -0,0 +1,279 @@
+/**
+  ******************************************************************************
+  * @file    test_region_common.c
+  * @brief   Host test and benchmark of the channel searches of RegionCommon.c
+  * @note    The searches walk only the set bits of the channels mask. Random
+  *          EU868 and US915 plans, masks, datarates, join states and band
+  *          readiness are checked against the per-bit loops they replaced,
+  *          kept here as the reference: the same channel list in the same
+  *          order, the same counts and the same datarate checks. The
+  *          benchmark times the NextChannel search of a US915 end-device
+  *          with one sub-band enabled, as on a US915 network, and with all
+  *          72 channels enabled.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test_common.h"
+#include "radio.h"
+#include "stm32_adv_trace.h"
+#include "stm32_timer.h"
+#include "RegionCommon.h"
+
+/* Private define ------------------------------------------------------------*/
+#define US915_CHANNELS      72
+#define EU868_CHANNELS      16
+#define MASK_WORDS          ((US915_CHANNELS + 15) / 16)
+#define BAND_COUNT          6
+
+/* Private variables ---------------------------------------------------------*/
+static ChannelParams_t Channels[US915_CHANNELS];
+static Band_t Bands[BAND_COUNT];
+static uint16_t ChannelsMask[MASK_WORDS];
+
+/* Fakes ---------------------------------------------------------------------*/
+/* Unused by the channel searches, the beacon reception reads it */
+const struct Radio_s Radio;
+
+UTIL_ADV_TRACE_Status_t UTIL_ADV_TRACE_COND_FSend(uint32_t VerboseLevel, uint32_t Region, uint32_t TimeStampState,
+                                                  const char *strFormat, ...)
+{
+  return UTIL_ADV_TRACE_OK;
+}
+
+UTIL_TIMER_Time_t UTIL_TIMER_GetCurrentTime(void)
+{
+  return 0;
+}
+
+UTIL_TIMER_Time_t UTIL_TIMER_GetElapsedTime(UTIL_TIMER_Time_t past)
+{
+  return 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief Per-bit loops of the previous searches, the reference
+  */
+static void ReferenceCountNbOfEnabledChannels(const RegionCommonCountNbOfEnabledChannelsParams_t *params,
+                                              uint8_t *enabledChannels, uint8_t *nbEnabledChannels,
+                                              uint8_t *nbRestrictedChannels)
+{
+  uint8_t nbChannelCount = 0;
+  uint8_t nbRestrictedChannelsCount = 0;
+
+  for (uint8_t i = 0, k = 0; i < params->MaxNbChannels; i += 16, k++)
+  {
+    for (uint8_t j = 0; j < 16U; j++)
+    {
+      const ChannelParams_t *channel = &params->Channels[i + j];
+
+      if ((params->ChannelsMask[k] & (1U << j)) == 0)
+      {
+        continue;
+      }
+      if (channel->Frequency == 0)
+      {
+        continue;
+      }
+      if ((params->Joined == false) && (params->JoinChannels > 0) && ((params->JoinChannels & (1U << j)) == 0))
+      {
+        continue;
+      }
+      if ((params->Datarate < channel->DrRange.Fields.Min) || (params->Datarate > channel->DrRange.Fields.Max))
+      {
+        continue;
+      }
+      if (params->Bands[channel->Band].ReadyForTransmission == false)
+      {
+        nbRestrictedChannelsCount++;
+        continue;
+      }
+      enabledChannels[nbChannelCount++] = i + j;
+    }
+  }
+  *nbEnabledChannels = nbChannelCount;
+  *nbRestrictedChannels = nbRestrictedChannelsCount;
+}
+
+static uint8_t ReferenceCountChannels(const uint16_t *channelsMask, uint8_t startIdx, uint8_t stopIdx)
+{
+  uint8_t nbChannels = 0;
+
+  for (uint8_t i = startIdx; i < stopIdx; i++)
+  {
+    for (uint8_t j = 0; j < 16U; j++)
+    {
+      nbChannels += (uint8_t)((channelsMask[i] >> j) & 1U);
+    }
+  }
+  return nbChannels;
+}
+
+static bool ReferenceChanVerifyDr(uint8_t nbChannels, const uint16_t *channelsMask, int8_t dr)
+{
+  for (uint8_t i = 0, k = 0; i < nbChannels; i += 16, k++)
+  {
+    for (uint8_t j = 0; j < 16U; j++)
+    {
+      if (((channelsMask[k] & (1U << j)) != 0) && (dr >= (Channels[i + j].DrRange.Fields.Min & 0x0F)) &&
+          (dr <= (Channels[i + j].DrRange.Fields.Max & 0x0F)))
+      {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/**
+  * @brief Random plan: some channels undefined, random datarate ranges, bands and mask
+  */
+static void RandomPlan(uint8_t nbChannels, bool dense)
+{
+  memset(ChannelsMask, 0, sizeof(ChannelsMask));
+  for (uint8_t i = 0; i < nbChannels; i++)
+  {
+    Channels[i].Frequency = ((TestRandom() & 7) != 0) ? (902300000U + (i * 200000U)) : 0;
+    Channels[i].DrRange.Fields.Min = (int8_t)TestRandomRange(0, 2);
+    Channels[i].DrRange.Fields.Max = (int8_t)TestRandomRange(3, 6);
+    Channels[i].Band = (uint8_t)TestRandomRange(0, BAND_COUNT - 1);
+    if (dense ? ((TestRandom() & 3) != 0) : (TestRandomRange(0, 8) == 0))
+    {
+      ChannelsMask[i / 16] |= (uint16_t)(1U << (i % 16));
+    }
+  }
+  for (uint8_t b = 0; b < BAND_COUNT; b++)
+  {
+    Bands[b].ReadyForTransmission = ((TestRandom() & 3) != 0);
+  }
+}
+
+static void TestAgainstReference(void)
+{
+  RegionCommonCountNbOfEnabledChannelsParams_t params = { 0 };
+
+  params.Channels = Channels;
+  params.Bands = Bands;
+  params.ChannelsMask = ChannelsMask;
+
+  TestSeed(25);
+  for (int n = 0; n < 200000; n++)
+  {
+    bool eu868 = ((n & 1) != 0);
+    uint8_t expected[US915_CHANNELS];
+    uint8_t actual[US915_CHANNELS];
+    uint8_t expectedCount;
+    uint8_t actualCount;
+    uint8_t expectedRestricted;
+    uint8_t actualRestricted;
+
+    params.MaxNbChannels = eu868 ? EU868_CHANNELS : US915_CHANNELS;
+    RandomPlan((uint8_t)params.MaxNbChannels, (n & 2) != 0);
+    params.Joined = ((TestRandom() & 1) != 0);
+    params.JoinChannels = eu868 ? 0x0007 : 0;
+    params.Datarate = (uint8_t)TestRandomRange(0, 7);
+
+    ReferenceCountNbOfEnabledChannels(&params, expected, &expectedCount, &expectedRestricted);
+    RegionCommonCountNbOfEnabledChannels(&params, actual, &actualCount, &actualRestricted);
+    TEST_CHECK_EQ(actualCount, expectedCount);
+    TEST_CHECK_EQ(actualRestricted, expectedRestricted);
+    TEST_CHECK(memcmp(actual, expected, expectedCount) == 0);
+    TEST_CHECK_EQ(RegionCommonCountChannels(ChannelsMask, 0, MASK_WORDS),
+                  ReferenceCountChannels(ChannelsMask, 0, MASK_WORDS));
+    TEST_CHECK_EQ(RegionCommonChanVerifyDr((uint8_t)params.MaxNbChannels, ChannelsMask, (int8_t)params.Datarate,
+                                           0, 7, Channels),
+                  ReferenceChanVerifyDr((uint8_t)params.MaxNbChannels, ChannelsMask, (int8_t)params.Datarate));
+    if (TestFailures != 0)
+    {
+      printf("case %d, %s, datarate %u\n", n, eu868 ? "EU868" : "US915", params.Datarate);
+      return;
+    }
+  }
+}
+
+/**
+  * @brief Best time of one NextChannel search, reference or firmware
+  */
+static double BenchSearch(RegionCommonCountNbOfEnabledChannelsParams_t *params, bool reference)
+{
+  const uint32_t calls = 200000;
+  uint8_t enabled[US915_CHANNELS];
+  uint8_t count = 0;
+  uint8_t restricted = 0;
+  double best = 1e30;
+
+  for (int run = 0; run < 20; run++)
+  {
+    uint64_t start = TestNanoseconds();
+    double perCall;
+
+    for (uint32_t n = 0; n < calls; n++)
+    {
+      __asm__ volatile("" : : "r"(ChannelsMask) : "memory");
+      if (reference)
+      {
+        count = ReferenceCountChannels(ChannelsMask, 0, MASK_WORDS - 1);
+        ReferenceCountNbOfEnabledChannels(params, enabled, &count, &restricted);
+      }
+      else
+      {
+        count = RegionCommonCountChannels(ChannelsMask, 0, MASK_WORDS - 1);
+        RegionCommonCountNbOfEnabledChannels(params, enabled, &count, &restricted);
+      }
+    }
+    perCall = (double)(TestNanoseconds() - start) / calls;
+    if (perCall < best)
+    {
+      best = perCall;
+    }
+  }
+  TEST_KEEP(count);
+  return best;
+}
+
+/**
+  * @brief US915 at DR0: sub-band 2 and its 500 kHz channel 65, then all 72 channels
+  */
+static void BenchUs915(void)
+{
+  RegionCommonCountNbOfEnabledChannelsParams_t params = { 0 };
+
+  for (uint8_t i = 0; i < US915_CHANNELS; i++)
+  {
+    Channels[i].Frequency = 902300000U + (i * 200000U);
+    Channels[i].DrRange.Fields.Min = 0;
+    Channels[i].DrRange.Fields.Max = 3;
+    Channels[i].Band = 0;
+  }
+  Bands[0].ReadyForTransmission = true;
+  params.Joined = true;
+  params.Datarate = 0;
+  params.ChannelsMask = ChannelsMask;
+  params.Channels = Channels;
+  params.Bands = Bands;
+  params.MaxNbChannels = US915_CHANNELS;
+
+  memset(ChannelsMask, 0, sizeof(ChannelsMask));
+  ChannelsMask[0] = 0xFF00;
+  ChannelsMask[4] = 0x0002;
+  printf("  US915 9 of 72 channels: per bit %.1f ns, set bits %.1f ns\n", BenchSearch(&params, true),
+         BenchSearch(&params, false));
+
+  memset(ChannelsMask, 0xFF, sizeof(ChannelsMask));
+  ChannelsMask[4] = 0x00FF;
+  printf("  US915 72 of 72 channels: per bit %.1f ns, set bits %.1f ns\n", BenchSearch(&params, true),
+         BenchSearch(&params, false));
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestAgainstReference();
+  if (TestIsBench(argc, argv))
+  {
+    BenchUs915();
+  }
+
+  return TestSummary(argv[0]);
+}
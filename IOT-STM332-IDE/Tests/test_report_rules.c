@@ -0,0 +1,292 @@
+/**
+  ******************************************************************************
+  * @file    test_report_rules.c
+  * @brief   Host test of the uplink rules of report_rules.c
+  * @note    Each condition is driven across its level: HIGH and LOW enter
+  *          above or below the level and leave only once back by the
+  *          hysteresis, DELTA counts from the last report and not from the
+  *          previous sample, RATE scales the change to one minute, the
+  *          heartbeat fires across the tick wrap-around, triggers stay
+  *          pending until ReportRules_Reported() and a HARDWARE rule follows
+  *          the sensor alarm rather than the value.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test_common.h"
+#include "report_rules.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TRIGGER(metric, condition)  ((uint32_t)(condition) << REPORT_TRIGGER_SHIFT(metric))
+#define MINUTE                      60000U
+
+/* Private variables ---------------------------------------------------------*/
+static ReportRules_t Rules;
+
+/* Private functions ---------------------------------------------------------*/
+static void Init(ReportRules_Metric_t metric, const ReportRules_Rule_t *rule, uint32_t heartbeat)
+{
+  ReportRules_Config_t config;
+
+  memset(&config, 0, sizeof(config));
+  config.rule[metric] = *rule;
+  config.heartbeat = heartbeat;
+  ReportRules_Init(&Rules, &config);
+}
+
+static ReportRules_Sample_t Sample(ReportRules_Metric_t metric, float value, bool hardwareAlarm)
+{
+  ReportRules_Sample_t sample;
+
+  memset(&sample, 0, sizeof(sample));
+  sample.value[metric] = value;
+  sample.validMask = (uint8_t)(1U << metric);
+  sample.hardwareAlarm = hardwareAlarm ? sample.validMask : 0;
+  return sample;
+}
+
+/**
+  * @brief Evaluate one value, report it when it fired and return its triggers
+  */
+static uint32_t EvaluateAndReport(ReportRules_Metric_t metric, float value, uint32_t now)
+{
+  ReportRules_Sample_t sample = Sample(metric, value, false);
+  uint32_t triggers = ReportRules_Evaluate(&Rules, &sample, now);
+
+  if (triggers != 0)
+  {
+    ReportRules_Reported(&Rules, &sample, now);
+  }
+  return triggers;
+}
+
+/**
+  * @brief Band above 25 degC and below 10 degC, 0.5 degC of hysteresis
+  */
+static void TestHighLow(void)
+{
+  const ReportRules_Metric_t m = REPORT_METRIC_WATER_TEMPERATURE;
+  const ReportRules_Rule_t rule = { REPORT_RULE_HIGH | REPORT_RULE_LOW, 2500, 1000, 50, 0, 0 };
+  uint32_t now = 0;
+
+  Init(m, &rule, 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 20.0f, now++), 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 25.0f, now++), 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 25.01f, now++), TRIGGER(m, REPORT_RULE_HIGH));
+  TEST_CHECK_EQ(EvaluateAndReport(m, 30.0f, now++), 0);
+
+  /* Dwelling on the level fires once */
+  for (int n = 0; n < 10; n++)
+  {
+    TEST_CHECK_EQ(EvaluateAndReport(m, ((n & 1) != 0) ? 25.01f : 24.99f, now++), 0);
+  }
+  TEST_CHECK_EQ(EvaluateAndReport(m, 24.51f, now++), 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 24.5f, now++), TRIGGER(m, REPORT_RULE_HIGH));
+  TEST_CHECK_EQ(EvaluateAndReport(m, 24.99f, now++), 0);
+
+  TEST_CHECK_EQ(EvaluateAndReport(m, 10.0f, now++), 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 9.99f, now++), TRIGGER(m, REPORT_RULE_LOW));
+  for (int n = 0; n < 10; n++)
+  {
+    TEST_CHECK_EQ(EvaluateAndReport(m, ((n & 1) != 0) ? 9.99f : 10.01f, now++), 0);
+  }
+  TEST_CHECK_EQ(EvaluateAndReport(m, 10.49f, now++), 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 10.5f, now++), TRIGGER(m, REPORT_RULE_LOW));
+
+  /* From one band straight into the other */
+  TEST_CHECK_EQ(EvaluateAndReport(m, 40.0f, now++), TRIGGER(m, REPORT_RULE_HIGH));
+  TEST_CHECK_EQ(EvaluateAndReport(m, 0.0f, now++), TRIGGER(m, REPORT_RULE_HIGH) | TRIGGER(m, REPORT_RULE_LOW));
+
+  /* Only the enabled conditions fire */
+  Init(m, &(ReportRules_Rule_t){ REPORT_RULE_LOW, 2500, 1000, 50, 0, 0 }, 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 40.0f, now++), 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 0.0f, now++), TRIGGER(m, REPORT_RULE_LOW));
+}
+
+/**
+  * @brief 5 ppm from the TDS of the last report
+  */
+static void TestDelta(void)
+{
+  const ReportRules_Metric_t m = REPORT_METRIC_TDS;
+  const ReportRules_Rule_t rule = { REPORT_RULE_DELTA, 0, 0, 0, 50, 0 };
+  ReportRules_Sample_t sample;
+  uint32_t now = 0;
+
+  /* Nothing to compare with before the first report */
+  Init(m, &rule, 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 100.0f, now++), 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 900.0f, now++), 0);
+  sample = Sample(m, 100.0f, false);
+  ReportRules_Reported(&Rules, &sample, now++);
+
+  /* A slow drift adds up from the report */
+  TEST_CHECK_EQ(EvaluateAndReport(m, 102.0f, now++), 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 104.9f, now++), 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 105.0f, now++), TRIGGER(m, REPORT_RULE_DELTA));
+  TEST_CHECK_EQ(EvaluateAndReport(m, 100.1f, now++), 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 100.0f, now++), TRIGGER(m, REPORT_RULE_DELTA));
+
+  /* A report of another metric keeps the reference */
+  sample = Sample(REPORT_METRIC_PH, 7.0f, false);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, now), 0);
+  ReportRules_Reported(&Rules, &sample, now++);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 95.0f, now++), TRIGGER(m, REPORT_RULE_DELTA));
+}
+
+/**
+  * @brief 0.5 pH per minute between consecutive samples
+  */
+static void TestRate(void)
+{
+  const ReportRules_Metric_t m = REPORT_METRIC_PH;
+  const ReportRules_Rule_t rule = { REPORT_RULE_RATE, 0, 0, 0, 0, 500 };
+
+  Init(m, &rule, 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 7.0f, 0), 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 7.499f, MINUTE), 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 7.999f, 2 * MINUTE), TRIGGER(m, REPORT_RULE_RATE));
+
+  /* The same change is faster over a shorter time, either way */
+  TEST_CHECK_EQ(EvaluateAndReport(m, 7.749f, (2 * MINUTE) + 30000U), TRIGGER(m, REPORT_RULE_RATE));
+  TEST_CHECK_EQ(EvaluateAndReport(m, 7.5f, (2 * MINUTE) + 60001U), 0);
+
+  /* A slow ramp never fires, however far it goes */
+  for (uint32_t n = 1; n <= 100; n++)
+  {
+    TEST_CHECK_EQ(EvaluateAndReport(m, 7.5f - (0.4f * (float)n), (3 * MINUTE) + (n * MINUTE)), 0);
+  }
+
+  /* Two samples at the same time give no rate */
+  TEST_CHECK_EQ(EvaluateAndReport(m, 14.0f, (103 * MINUTE) + 1U), TRIGGER(m, REPORT_RULE_RATE));
+  TEST_CHECK_EQ(EvaluateAndReport(m, 0.0f, (103 * MINUTE) + 1U), 0);
+
+  /* Across the tick wrap-around */
+  Init(m, &rule, 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 7.0f, 0xFFFFFFFFU - 1000U), 0);
+  TEST_CHECK_EQ(EvaluateAndReport(m, 7.5f, MINUTE - 1001U), TRIGGER(m, REPORT_RULE_RATE));
+}
+
+/**
+  * @brief One hour without report, the first sample always reported
+  */
+static void TestHeartbeat(void)
+{
+  const ReportRules_Metric_t m = REPORT_METRIC_WATER_TEMPERATURE;
+  const ReportRules_Rule_t rule = { 0 };
+  const uint32_t hour = 60U * MINUTE;
+  const uint32_t start = 0xFFFFFFFFU - (hour / 2);
+  ReportRules_Sample_t sample = Sample(m, 20.0f, false);
+
+  Init(m, &rule, hour);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, start), REPORT_TRIGGER_HEARTBEAT);
+  ReportRules_Reported(&Rules, &sample, start);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, start + hour - 1U), 0);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, start + hour), REPORT_TRIGGER_HEARTBEAT);
+
+  /* Without a valid value too */
+  sample.validMask = 0;
+  ReportRules_Reported(&Rules, &sample, start + hour);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, start + (2 * hour) - 1U), 0);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, start + (2 * hour)), REPORT_TRIGGER_HEARTBEAT);
+
+  /* 0 disables it */
+  Init(m, &rule, 0);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 0), 0);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 0x80000000U), 0);
+}
+
+/**
+  * @brief A trigger whose uplink failed is returned until a report
+  */
+static void TestPending(void)
+{
+  const ReportRules_Rule_t rule = { REPORT_RULE_HIGH, 8000, 0, 0, 0, 0 };
+  ReportRules_Config_t config;
+  ReportRules_Sample_t sample;
+  uint32_t expected;
+
+  memset(&config, 0, sizeof(config));
+  config.rule[REPORT_METRIC_PH] = rule;
+  config.rule[REPORT_METRIC_TDS] = (ReportRules_Rule_t){ REPORT_RULE_DELTA, 0, 0, 0, 10, 0 };
+  ReportRules_Init(&Rules, &config);
+
+  sample = Sample(REPORT_METRIC_PH, 9.0f, false);
+  expected = TRIGGER(REPORT_METRIC_PH, REPORT_RULE_HIGH);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 0), expected);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 1), expected);
+
+  /* Back below the level: the leaving trigger adds to the pending entering one */
+  sample.value[REPORT_METRIC_PH] = 7.0f;
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 2), expected);
+
+  /* A sample without the metric neither clears nor evaluates it */
+  sample = Sample(REPORT_METRIC_TDS, 100.0f, false);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 3), expected);
+  ReportRules_Reported(&Rules, &sample, 3);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 4), 0);
+
+  sample.value[REPORT_METRIC_TDS] = 101.0f;
+  expected = TRIGGER(REPORT_METRIC_TDS, REPORT_RULE_DELTA);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 5), expected);
+  sample.value[REPORT_METRIC_TDS] = 100.0f;
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 6), expected);
+  ReportRules_Reported(&Rules, &sample, 6);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 7), 0);
+
+  /* Reconfiguring keeps the state, initializing forgets it */
+  sample = Sample(REPORT_METRIC_PH, 9.0f, false);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 8), TRIGGER(REPORT_METRIC_PH, REPORT_RULE_HIGH));
+  ReportRules_Configure(&Rules, &config);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 9), TRIGGER(REPORT_METRIC_PH, REPORT_RULE_HIGH));
+  ReportRules_Reported(&Rules, &sample, 9);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 10), 0);
+  ReportRules_Init(&Rules, &config);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 11), TRIGGER(REPORT_METRIC_PH, REPORT_RULE_HIGH));
+}
+
+/**
+  * @brief The AMG8833 pixel interrupt, whatever the maximum temperature says
+  */
+static void TestHardware(void)
+{
+  const ReportRules_Metric_t m = REPORT_METRIC_THERMAL_MAX;
+  const ReportRules_Rule_t rule = { REPORT_RULE_HARDWARE | REPORT_RULE_HIGH | REPORT_RULE_LOW, 3000, 1000, 100, 0, 0 };
+  const uint32_t alarm = TRIGGER(m, REPORT_RULE_HARDWARE);
+  ReportRules_Sample_t sample;
+
+  Init(m, &rule, 0);
+  sample = Sample(m, 80.0f, false);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 0), 0);
+  sample = Sample(m, 0.0f, false);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 1), 0);
+
+  sample = Sample(m, 20.0f, true);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 2), alarm);
+  ReportRules_Reported(&Rules, &sample, 2);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 3), 0);
+  sample.value[m] = 0.0f;
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 4), 0);
+
+  sample.hardwareAlarm = 0;
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 5), alarm);
+  ReportRules_Reported(&Rules, &sample, 5);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 6), 0);
+
+  /* The alarm of another metric is not this one's */
+  sample.hardwareAlarm = (uint8_t)(1U << REPORT_METRIC_WATER_TEMPERATURE);
+  TEST_CHECK_EQ(ReportRules_Evaluate(&Rules, &sample, 7), 0);
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestHighLow();
+  TestDelta();
+  TestRate();
+  TestHeartbeat();
+  TestPending();
+  TestHardware();
+
+  return TestSummary(argv[0]);
+}
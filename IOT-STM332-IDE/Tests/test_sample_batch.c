@@ -0,0 +1,253 @@
+/**
+  ******************************************************************************
+  * @file    test_sample_batch.c
+  * @brief   Host test of the batched sample ring and its delta frames
+  * @note    Random rings are encoded into random frame sizes and must decode
+  *          to the raw records they hold, extreme values included. The
+  *          benchmark prints the bytes per record of a slowly changing
+  *          series, the case the delta coding is for.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <math.h>
+#include "test_common.h"
+#include "sample_batch.h"
+
+/* Private define ------------------------------------------------------------*/
+#define CHANNELS            SAMPLE_BATCH_CHANNEL_COUNT
+#define ALL_CHANNELS        ((1U << CHANNELS) - 1U)
+#define MAX_FRAME           242
+
+/* Private variables ---------------------------------------------------------*/
+static const float Step[CHANNELS] = { 0.01f, 0.01f, 1.0f, 0.25f, 0.1f, 0.5f, 0.1f };
+
+/* Private functions ---------------------------------------------------------*/
+static const SampleBatch_Record_t *RingRecord(const SampleBatch_t *batch, uint8_t n)
+{
+  return &batch->record[(batch->first + n) % SAMPLE_BATCH_CAPACITY];
+}
+
+/**
+  * @brief Random value of a channel, sometimes far out of its raw range
+  */
+static float RandomValue(uint8_t channel)
+{
+  float offset = (channel == SAMPLE_BATCH_PRESSURE) ? 1000.0f : 0.0f;
+
+  if ((TestRandom() % 16) == 0)
+  {
+    return ((TestRandom() & 1) != 0) ? 1e6f : -1e6f;
+  }
+  return offset + ((float)TestRandomRange(-32768, 32767) * Step[channel]);
+}
+
+/**
+  * @brief True when a frame decodes to the first records of a ring
+  */
+static bool FrameMatches(const SampleBatch_t *batch, const uint8_t *out, uint16_t size, uint8_t count,
+                         const uint16_t *ack)
+{
+  SampleBatch_Record_t records[SAMPLE_BATCH_CAPACITY];
+  SampleBatch_Frame_t frame;
+
+  if ((SampleBatch_Decode(out, size, &frame, records, SAMPLE_BATCH_CAPACITY) != 0) || (frame.count != count) ||
+      (((frame.flags & SAMPLE_BATCH_FLAG_ACK) != 0) != (ack != NULL)) ||
+      ((ack != NULL) && (frame.ack != *ack)) ||
+      (((frame.flags & SAMPLE_BATCH_FLAG_LOST) != 0) != batch->lost))
+  {
+    return false;
+  }
+  for (uint8_t n = 0; n < count; n++)
+  {
+    const SampleBatch_Record_t *expected = RingRecord(batch, n);
+
+    if ((records[n].time != expected->time) || (records[n].validMask != expected->validMask) ||
+        (memcmp(records[n].value, expected->value, sizeof(expected->value)) != 0))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void TestRoundTrip(void)
+{
+  static SampleBatch_t batch;
+  uint8_t out[MAX_FRAME];
+  float value[CHANNELS];
+  uint32_t time = 1700000000U;
+  uint32_t pushed = 0;
+  uint32_t sent = 0;
+
+  TestSeed(17);
+  SampleBatch_Init(&batch);
+  for (int n = 0; n < 100000; n++)
+  {
+    uint16_t ack = (uint16_t)TestRandom();
+    const uint16_t *ackPtr = ((TestRandom() & 1) != 0) ? &ack : NULL;
+    uint16_t outSize = (uint16_t)TestRandomRange(SAMPLE_BATCH_HEADER_SIZE, MAX_FRAME);
+    uint8_t count;
+    int size;
+
+    /* Times mostly increase, a clock update can move them back */
+    time += ((TestRandom() % 64) == 0) ? (uint32_t)TestRandom() : (uint32_t)TestRandomRange(1, 900);
+    for (uint8_t c = 0; c < CHANNELS; c++)
+    {
+      value[c] = RandomValue(c);
+    }
+    SampleBatch_Push(&batch, time, value, (uint8_t)TestRandom());
+    pushed++;
+    TEST_CHECK(SampleBatch_Count(&batch) <= SAMPLE_BATCH_CAPACITY);
+    TEST_CHECK_EQ(RingRecord(&batch, SampleBatch_Count(&batch) - 1)->time, time);
+
+    if ((TestRandom() % 4) != 0)
+    {
+      continue;
+    }
+
+    size = SampleBatch_Encode(&batch, ackPtr, out, outSize, &count);
+    if (size < 0)
+    {
+      /* Only when not even the oldest record fits */
+      TEST_CHECK(outSize < (SAMPLE_BATCH_HEADER_SIZE + SAMPLE_BATCH_ACK_SIZE + SAMPLE_BATCH_RECORD_MAX_SIZE));
+      TEST_CHECK_EQ(count, 0);
+      continue;
+    }
+    TEST_CHECK(size <= outSize);
+    TEST_CHECK((count > 0) && (count <= SampleBatch_Count(&batch)));
+    TEST_CHECK(FrameMatches(&batch, out, (uint16_t)size, count, ackPtr));
+
+    /* The next record did not fit */
+    if (count < SampleBatch_Count(&batch))
+    {
+      uint8_t larger[MAX_FRAME + SAMPLE_BATCH_RECORD_MAX_SIZE];
+      uint8_t more;
+
+      TEST_CHECK(SampleBatch_Encode(&batch, ackPtr, larger, (uint16_t)(size + SAMPLE_BATCH_RECORD_MAX_SIZE),
+                                    &more) > size);
+      TEST_CHECK(more > count);
+    }
+
+    /* Every truncation is refused */
+    for (int len = 0; len < size; len++)
+    {
+      SampleBatch_Record_t records[SAMPLE_BATCH_CAPACITY];
+      SampleBatch_Frame_t frame;
+
+      TEST_CHECK_EQ(SampleBatch_Decode(out, (uint16_t)len, &frame, records, SAMPLE_BATCH_CAPACITY), -1);
+    }
+
+    if ((TestRandom() & 1) != 0)
+    {
+      SampleBatch_Drop(&batch, count);
+      sent += count;
+      TEST_CHECK(!batch.lost);
+    }
+    if (TestFailures != 0)
+    {
+      return;
+    }
+  }
+  TEST_CHECK(sent > 10000);
+  TEST_CHECK(pushed > sent);
+}
+
+static void TestRing(void)
+{
+  static SampleBatch_t batch;
+  SampleBatch_Record_t records[SAMPLE_BATCH_CAPACITY];
+  SampleBatch_Frame_t frame;
+  uint8_t out[MAX_FRAME];
+  float value[CHANNELS] = { 17.25f, 7.21f, 312.0f, 24.5f, 21.4f, 64.0f, 1013.2f };
+  uint8_t count;
+  int size;
+
+  SampleBatch_Init(&batch);
+  TEST_CHECK_EQ(SampleBatch_Encode(&batch, NULL, out, sizeof(out), &count), -1);
+
+  /* A full ring overwrites its oldest record and flags the loss */
+  for (uint32_t n = 0; n < SAMPLE_BATCH_CAPACITY + 3; n++)
+  {
+    SampleBatch_Push(&batch, 1000U + (n * 60U), value, ALL_CHANNELS);
+  }
+  TEST_CHECK_EQ(SampleBatch_Count(&batch), SAMPLE_BATCH_CAPACITY);
+  TEST_CHECK_EQ(RingRecord(&batch, 0)->time, 1000U + (3U * 60U));
+  size = SampleBatch_Encode(&batch, NULL, out, sizeof(out), &count);
+  TEST_CHECK_EQ(SampleBatch_Decode(out, (uint16_t)size, &frame, records, SAMPLE_BATCH_CAPACITY), 0);
+  TEST_CHECK((frame.flags & SAMPLE_BATCH_FLAG_LOST) != 0);
+  TEST_CHECK_EQ(frame.count, count);
+  TEST_CHECK_EQ(SampleBatch_Decode(out, (uint16_t)size, &frame, records, (uint8_t)(count - 1)), -1);
+
+  /* Values come back within half a step */
+  for (uint8_t c = 0; c < CHANNELS; c++)
+  {
+    TEST_CHECK(fabsf(SampleBatch_GetValue(&records[count - 1], (SampleBatch_Channel_t)c) - value[c]) <=
+               (Step[c] * 0.5f) + (fabsf(value[c]) * 1e-6f));
+  }
+
+  /* Dropping clears the flag, more than the ring holds empties it */
+  SampleBatch_Drop(&batch, count);
+  TEST_CHECK_EQ(SampleBatch_Count(&batch), SAMPLE_BATCH_CAPACITY - count);
+  TEST_CHECK(!batch.lost);
+  SampleBatch_Drop(&batch, UINT8_MAX);
+  TEST_CHECK_EQ(SampleBatch_Count(&batch), 0);
+
+  /* Invalid channels are not sent */
+  SampleBatch_Push(&batch, 5000, value, (1U << SAMPLE_BATCH_PH) | 0x80U);
+  size = SampleBatch_Encode(&batch, NULL, out, sizeof(out), &count);
+  TEST_CHECK_EQ(size, SAMPLE_BATCH_HEADER_SIZE + 1 + 1 + 2);
+  TEST_CHECK_EQ(SampleBatch_Decode(out, (uint16_t)size, &frame, records, 1), 0);
+  TEST_CHECK_EQ(records[0].validMask, 1U << SAMPLE_BATCH_PH);
+  TEST_CHECK_EQ(records[0].value[SAMPLE_BATCH_TDS], 0);
+
+  /* Wrong frame id */
+  out[0] ^= 0xFF;
+  TEST_CHECK_EQ(SampleBatch_Decode(out, (uint16_t)size, &frame, records, 1), -1);
+}
+
+/**
+  * @brief Bytes per record of a slowly changing series, against raw 16-bit records
+  */
+static void BenchSeries(void)
+{
+  static SampleBatch_t batch;
+  uint8_t out[MAX_FRAME];
+  float value[CHANNELS];
+  uint8_t count;
+  int size;
+
+  TestSeed(170);
+  SampleBatch_Init(&batch);
+  for (uint32_t n = 0; n < SAMPLE_BATCH_CAPACITY; n++)
+  {
+    float t = (float)n / 8.0f;
+
+    value[SAMPLE_BATCH_WATER_TEMPERATURE] = 17.0f + (0.4f * sinf(t)) + ((float)TestRandomRange(-2, 2) * 0.01f);
+    value[SAMPLE_BATCH_PH] = 7.2f + ((float)TestRandomRange(-3, 3) * 0.01f);
+    value[SAMPLE_BATCH_TDS] = 310.0f + (float)TestRandomRange(-2, 2);
+    value[SAMPLE_BATCH_THERMAL_MAX] = 24.0f + (2.0f * sinf(t));
+    value[SAMPLE_BATCH_AIR_TEMPERATURE] = 21.0f + (3.0f * sinf(t));
+    value[SAMPLE_BATCH_HUMIDITY] = 64.0f - (5.0f * sinf(t));
+    value[SAMPLE_BATCH_PRESSURE] = 1013.0f + ((float)TestRandomRange(-1, 1) * 0.1f);
+    SampleBatch_Push(&batch, 1700000000U + (n * 600U) + (uint32_t)TestRandomRange(0, 3), value, ALL_CHANNELS);
+  }
+
+  size = SampleBatch_Encode(&batch, NULL, out, sizeof(out), &count);
+  TEST_CHECK(FrameMatches(&batch, out, (uint16_t)size, count, NULL));
+  printf("  series: %d records in %d bytes, %.1f bytes/record (raw %d)\n", count, size,
+         (double)(size - SAMPLE_BATCH_HEADER_SIZE) / count, 4 + 1 + (2 * CHANNELS));
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestRoundTrip();
+  TestRing();
+  if (TestIsBench(argc, argv))
+  {
+    BenchSeries();
+  }
+
+  return TestSummary(argv[0]);
+}
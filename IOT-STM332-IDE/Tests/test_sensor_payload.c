@@ -0,0 +1,223 @@
+/**
+  ******************************************************************************
+  * @file    test_sensor_payload.c
+  * @brief   Host test of the bit-packed uplink payload
+  * @note    Random payloads must decode to their fields within half a
+  *          quantization step, values out of range must saturate, and
+  *          SensorPayload_Fit() must drop fields by priority.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <math.h>
+#include "test_common.h"
+#include "sensor_payload.h"
+
+/* Private define ------------------------------------------------------------*/
+#define FIELDS              SENSOR_PAYLOAD_FIELD_COUNT
+#define MAX_FRAME           242
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief Smallest and largest value of a field
+  */
+static void FieldRange(const SensorPayload_Schema_t *schema, double *min, double *max)
+{
+  double lo = schema->isSigned ? -ldexp(1.0, schema->bits - 1) : 0.0;
+  double hi = schema->isSigned ? ldexp(1.0, schema->bits - 1) - 1.0 : ldexp(1.0, schema->bits) - 1.0;
+
+  *min = (lo / schema->scale) + schema->offset;
+  *max = (hi / schema->scale) + schema->offset;
+}
+
+/**
+  * @brief True when a decoded value is the nearest step to the sent one
+  */
+static bool IsNearest(const SensorPayload_Schema_t *schema, float sent, float decoded)
+{
+  /* Half a step, plus the float rounding of the wide fields */
+  double tolerance = (0.5 / schema->scale) + (fabs(sent) * 2.5e-7);
+
+  return fabs((double)decoded - (double)sent) <= tolerance;
+}
+
+static void TestRoundTrip(void)
+{
+  SensorPayload_t payload;
+  SensorPayload_t decoded;
+  uint8_t frame[MAX_FRAME];
+  int size;
+
+  TestSeed(9);
+  for (int n = 0; n < 20000; n++)
+  {
+    SensorPayload_Init(&payload);
+    for (int field = 0; field < FIELDS; field++)
+    {
+      const SensorPayload_Schema_t *schema = SensorPayload_GetSchema((SensorPayload_Field_t)field);
+      double min, max;
+
+      if ((TestRandom() & 1) != 0)
+      {
+        FieldRange(schema, &min, &max);
+        SensorPayload_Set(&payload, (SensorPayload_Field_t)field,
+                          (float)(min + ((max - min) * (TestRandom() / 4294967296.0))));
+      }
+    }
+
+    size = SensorPayload_Encode(&payload, frame, sizeof(frame));
+    TEST_CHECK_EQ(size, SensorPayload_GetSize(&payload));
+    TEST_CHECK_EQ(frame[0], SENSOR_PAYLOAD_SCHEMA_ID);
+    TEST_CHECK_EQ(SensorPayload_Decode(frame, (uint16_t)size, &decoded), 0);
+    TEST_CHECK_EQ(decoded.presentMask, payload.presentMask);
+    for (int field = 0; field < FIELDS; field++)
+    {
+      if ((payload.presentMask & (1UL << field)) != 0)
+      {
+        TEST_CHECK(IsNearest(SensorPayload_GetSchema((SensorPayload_Field_t)field),
+                             payload.value[field], decoded.value[field]));
+      }
+    }
+
+    /* Every truncation is refused, a too small buffer too */
+    for (int len = 0; len < size; len++)
+    {
+      TEST_CHECK_EQ(SensorPayload_Decode(frame, (uint16_t)len, &decoded), -1);
+    }
+    TEST_CHECK_EQ(SensorPayload_Encode(&payload, frame, (uint16_t)(size - 1)), -1);
+    if (TestFailures != 0)
+    {
+      return;
+    }
+  }
+}
+
+static void TestSaturation(void)
+{
+  SensorPayload_t payload;
+  SensorPayload_t decoded;
+  uint8_t frame[MAX_FRAME];
+  int size;
+
+  for (int field = 0; field < FIELDS; field++)
+  {
+    const SensorPayload_Schema_t *schema = SensorPayload_GetSchema((SensorPayload_Field_t)field);
+    double min, max;
+
+    FieldRange(schema, &min, &max);
+    for (int side = 0; side < 2; side++)
+    {
+      SensorPayload_Init(&payload);
+      SensorPayload_Set(&payload, (SensorPayload_Field_t)field, (side == 0) ? -1e9f : 1e9f);
+      size = SensorPayload_Encode(&payload, frame, sizeof(frame));
+      TEST_CHECK_EQ(SensorPayload_Decode(frame, (uint16_t)size, &decoded), 0);
+      TEST_CHECK(IsNearest(schema, (float)((side == 0) ? min : max), decoded.value[field]));
+    }
+  }
+
+  /* The schema id is checked */
+  SensorPayload_Init(&payload);
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_PH, 7.0f);
+  size = SensorPayload_Encode(&payload, frame, sizeof(frame));
+  frame[0] ^= 0x01;
+  TEST_CHECK_EQ(SensorPayload_Decode(frame, (uint16_t)size, &decoded), -1);
+}
+
+static void TestTypicalFrame(void)
+{
+  SensorPayload_t payload;
+  SensorPayload_t decoded;
+  uint8_t frame[MAX_FRAME];
+  int size;
+
+  SensorPayload_Init(&payload);
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_PRESSURE, 1013.0f);
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_AIR_TEMPERATURE, 21.4f);
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_HUMIDITY, 64.0f);
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_WATER_TEMPERATURE, 17.3f);
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_PH, 7.21f);
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_TDS, 312.0f);
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_LATITUDE, 36.7461f);
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_LONGITUDE, -4.4215f);
+  SensorPayload_Set(&payload, SENSOR_PAYLOAD_WATER_QUALITY, 2.0f);
+
+  /* About 40 bytes in Cayenne LPP */
+  size = SensorPayload_Encode(&payload, frame, sizeof(frame));
+  TEST_CHECK(size <= 17);
+  TEST_CHECK_EQ(SensorPayload_Decode(frame, (uint16_t)size, &decoded), 0);
+  TEST_CHECK(fabsf(decoded.value[SENSOR_PAYLOAD_PH] - 7.21f) < 0.001f);
+  TEST_CHECK(fabsf(decoded.value[SENSOR_PAYLOAD_LATITUDE] - 36.7461f) < 0.00002f);
+  TEST_CHECK(fabsf(decoded.value[SENSOR_PAYLOAD_LONGITUDE] + 4.4215f) < 0.00003f);
+}
+
+static void TestFit(void)
+{
+  SensorPayload_t payload;
+  SensorPayload_t decoded;
+  uint8_t image[60];
+  uint8_t frame[MAX_FRAME];
+  int size;
+
+  for (int i = 0; i < (int)sizeof(image); i++)
+  {
+    image[i] = (uint8_t)(i * 7);
+  }
+
+  for (uint16_t maxSize = SENSOR_PAYLOAD_HEADER_SIZE; maxSize <= 80; maxSize++)
+  {
+    uint8_t keptWorst = 0;
+    uint8_t droppedBest = UINT8_MAX;
+
+    SensorPayload_Init(&payload);
+    for (int field = 0; field < FIELDS; field++)
+    {
+      SensorPayload_Set(&payload, (SensorPayload_Field_t)field, 1.0f);
+    }
+    SensorPayload_SetImage(&payload, image, sizeof(image), 10);
+
+    TEST_CHECK(SensorPayload_Fit(&payload, maxSize));
+    TEST_CHECK(SensorPayload_GetSize(&payload) <= maxSize);
+
+    /* Nothing kept has a lower priority than something dropped */
+    for (int field = 0; field < FIELDS; field++)
+    {
+      uint8_t priority = SensorPayload_GetSchema((SensorPayload_Field_t)field)->priority;
+
+      if ((payload.presentMask & (1UL << field)) != 0)
+      {
+        keptWorst = (priority > keptWorst) ? priority : keptWorst;
+      }
+      else
+      {
+        droppedBest = (priority < droppedBest) ? priority : droppedBest;
+      }
+    }
+    TEST_CHECK(keptWorst <= droppedBest);
+
+    /* The image fragment takes the room left and arrives intact */
+    size = SensorPayload_Encode(&payload, frame, maxSize);
+    TEST_CHECK(size >= 0);
+    TEST_CHECK_EQ(SensorPayload_Decode(frame, (uint16_t)size, &decoded), 0);
+    if ((payload.presentMask & (1UL << SENSOR_PAYLOAD_THERMAL_IMAGE)) != 0)
+    {
+      TEST_CHECK_EQ(decoded.imageOffset, 10);
+      TEST_CHECK_EQ(decoded.imageTotal, sizeof(image));
+      TEST_CHECK_EQ(decoded.imageSize, payload.imageSize);
+      TEST_CHECK(memcmp(decoded.image, &image[10], decoded.imageSize) == 0);
+      TEST_CHECK((payload.imageSize == (sizeof(image) - 10)) || (size == maxSize));
+    }
+  }
+
+  TEST_CHECK(!SensorPayload_Fit(&payload, SENSOR_PAYLOAD_HEADER_SIZE - 1));
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestRoundTrip();
+  TestSaturation();
+  TestTypicalFrame();
+  TestFit();
+
+  return TestSummary(argv[0]);
+}
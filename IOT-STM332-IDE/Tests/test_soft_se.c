@@ -0,0 +1,387 @@
+/**
+  ******************************************************************************
+  * @file    test_soft_se.c
+  * @brief   Host test of the key schedule cache of the soft secure element
+  * @note    Random key changes, derivations, NVM restores, ECB, CTR and CMAC
+  *          calls over more keys than the cache holds are checked against a
+  *          model of the key values, each operation computed again with a
+  *          freshly expanded key: a stale schedule after a key change or a
+  *          wrong entry replaced gives a different result. The benchmark
+  *          compares a 242-byte payload and its MIC with the key expanded
+  *          per block and per MIC, as before the cache, and cached.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test_common.h"
+#include "radio.h"
+#include "sys_app.h"
+#include "stm32_adv_trace.h"
+#include "secure-element.h"
+#include "lorawan_aes.h"
+#include "cmac.h"
+
+/* Private define ------------------------------------------------------------*/
+#define MAX_PAYLOAD         242
+#define KEY_COUNT           (sizeof(Keys) / sizeof(Keys[0]))
+
+/* Private variables ---------------------------------------------------------*/
+/* Keys of a 1.0.x end-device, the first five can compute a CMAC */
+static const KeyIdentifier_t Keys[] =
+{
+  APP_KEY, NWK_KEY, NWK_S_KEY, APP_S_KEY, MC_ROOT_KEY, MC_KE_KEY, MC_KEY_0, MC_APP_S_KEY_0, MC_NWK_S_KEY_0,
+};
+#define CMAC_KEY_COUNT      5U
+
+static uint8_t Model[KEY_COUNT][16];
+
+/* Fakes ---------------------------------------------------------------------*/
+/* Unused by the tested functions, SecureElementRandomNumber() reads it */
+const struct Radio_s Radio;
+
+void GetUniqueId(uint8_t *id)
+{
+  memset(id, 0x01, 8);
+}
+
+UTIL_ADV_TRACE_Status_t UTIL_ADV_TRACE_COND_FSend(uint32_t VerboseLevel, uint32_t Region, uint32_t TimeStampState,
+                                                  const char *strFormat, ...)
+{
+  return UTIL_ADV_TRACE_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+static void NvmChanged(void)
+{
+}
+
+/**
+  * @brief Reference AES-128 block, key expanded for this block only
+  */
+static void ReferenceEncrypt(const uint8_t key[16], const uint8_t in[16], uint8_t out[16])
+{
+  lorawan_aes_context context;
+
+  memset(&context, 0, sizeof(context));
+  lorawan_aes_set_key(key, 16, &context);
+  lorawan_aes_encrypt(in, out, &context);
+}
+
+/**
+  * @brief Reference AES-CTR of LoRaWAN, key expanded for every block
+  */
+static void ReferenceCtr(const uint8_t key[16], const uint8_t ctrBlock[16], uint8_t *buffer, uint16_t size)
+{
+  uint8_t aBlock[16];
+  uint8_t sBlock[16];
+
+  memcpy(aBlock, ctrBlock, 16);
+  for (uint16_t i = 0; i < size; i++)
+  {
+    if ((i % 16U) == 0U)
+    {
+      ReferenceEncrypt(key, aBlock, sBlock);
+      aBlock[15]++;
+    }
+    buffer[i] ^= sBlock[i % 16U];
+  }
+}
+
+/**
+  * @brief Reference MIC, the CMAC keyed from the key bytes
+  */
+static uint32_t ReferenceCmac(const uint8_t key[16], const uint8_t *bxBlock, const uint8_t *buffer, uint16_t size)
+{
+  AES_CMAC_CTX context;
+  uint8_t mac[16];
+
+  AES_CMAC_Init(&context);
+  AES_CMAC_SetKey(&context, key);
+  if (bxBlock != NULL)
+  {
+    AES_CMAC_Update(&context, bxBlock, 16);
+  }
+  AES_CMAC_Update(&context, buffer, size);
+  AES_CMAC_Final(mac, &context);
+  return ((uint32_t)mac[3] << 24) | ((uint32_t)mac[2] << 16) | ((uint32_t)mac[1] << 8) | mac[0];
+}
+
+static uint32_t KeyIndex(KeyIdentifier_t keyID)
+{
+  uint32_t index = 0;
+
+  while (Keys[index] != keyID)
+  {
+    index++;
+  }
+  return index;
+}
+
+static void RandomBytes(uint8_t *buffer, uint16_t size)
+{
+  for (uint16_t i = 0; i < size; i++)
+  {
+    buffer[i] = (uint8_t)TestRandom();
+  }
+}
+
+/**
+  * @brief Give every key a random value, through the secure element and the model
+  */
+static void SetAllKeys(void)
+{
+  TEST_CHECK_EQ(SecureElementInit(NvmChanged), SECURE_ELEMENT_SUCCESS);
+  for (uint32_t k = 0; k < KEY_COUNT; k++)
+  {
+    uint8_t key[16];
+
+    RandomBytes(key, sizeof(key));
+    TEST_CHECK_EQ(SecureElementSetKey(Keys[k], key), SECURE_ELEMENT_SUCCESS);
+    if (Keys[k] == MC_KEY_0)
+    {
+      /* Multicast keys are given encrypted with McKEKey */
+      ReferenceEncrypt(Model[KeyIndex(MC_KE_KEY)], key, Model[k]);
+    }
+    else
+    {
+      memcpy(Model[k], key, 16);
+    }
+  }
+}
+
+/**
+  * @brief ECB, CTR or CMAC with a random key, against the reference
+  */
+static void RandomUse(void)
+{
+  uint8_t buffer[MAX_PAYLOAD];
+  uint8_t expected[MAX_PAYLOAD];
+  uint8_t ctrBlock[16];
+  uint32_t k = (uint32_t)TestRandomRange(0, KEY_COUNT - 1);
+
+  switch (TestRandomRange(0, 2))
+  {
+    case 0:
+    {
+      uint16_t size = (uint16_t)(16 * TestRandomRange(1, 4));
+
+      RandomBytes(buffer, size);
+      TEST_CHECK_EQ(SecureElementAesEncrypt(buffer, size, Keys[k], expected), SECURE_ELEMENT_SUCCESS);
+      for (uint16_t block = 0; block < size; block += 16U)
+      {
+        uint8_t out[16];
+
+        ReferenceEncrypt(Model[k], &buffer[block], out);
+        TEST_CHECK(memcmp(out, &expected[block], 16) == 0);
+      }
+      break;
+    }
+    case 1:
+    {
+      uint16_t size = (uint16_t)TestRandomRange(0, MAX_PAYLOAD);
+
+      RandomBytes(buffer, size);
+      RandomBytes(ctrBlock, sizeof(ctrBlock));
+      ctrBlock[15] = 1;
+      memcpy(expected, buffer, size);
+      ReferenceCtr(Model[k], ctrBlock, expected, size);
+      TEST_CHECK_EQ(SecureElementAesCtrEncrypt(ctrBlock, buffer, size, Keys[k]), SECURE_ELEMENT_SUCCESS);
+      TEST_CHECK(memcmp(buffer, expected, size) == 0);
+      break;
+    }
+    default:
+    {
+      uint16_t size = (uint16_t)TestRandomRange(0, MAX_PAYLOAD);
+      uint8_t *bxBlock = ((TestRandom() & 1) != 0) ? ctrBlock : NULL;
+      uint32_t cmac = 0;
+
+      k %= CMAC_KEY_COUNT;
+      RandomBytes(buffer, size);
+      RandomBytes(ctrBlock, sizeof(ctrBlock));
+      TEST_CHECK_EQ(SecureElementComputeAesCmac(bxBlock, buffer, size, Keys[k], &cmac), SECURE_ELEMENT_SUCCESS);
+      TEST_CHECK_EQ(cmac, ReferenceCmac(Model[k], bxBlock, buffer, size));
+      break;
+    }
+  }
+}
+
+static void TestRandomOperations(void)
+{
+  static uint8_t savedNvm[2048];
+  static uint8_t savedModel[KEY_COUNT][16];
+  bool saved = false;
+
+  TestSeed(21);
+  SetAllKeys();
+  for (int n = 0; n < 50000; n++)
+  {
+    uint32_t op = (uint32_t)TestRandomRange(0, 19);
+
+    if (op == 0)
+    {
+      /* New value of a key */
+      uint32_t k = (uint32_t)TestRandomRange(0, KEY_COUNT - 1);
+      uint8_t key[16];
+
+      RandomBytes(key, sizeof(key));
+      TEST_CHECK_EQ(SecureElementSetKey(Keys[k], key), SECURE_ELEMENT_SUCCESS);
+      if (Keys[k] == MC_KEY_0)
+      {
+        ReferenceEncrypt(Model[KeyIndex(MC_KE_KEY)], key, Model[k]);
+      }
+      else
+      {
+        memcpy(Model[k], key, 16);
+      }
+    }
+    else if (op == 1)
+    {
+      /* Session key derived from a root key, as after a join */
+      static const KeyIdentifier_t targets[] = { NWK_S_KEY, APP_S_KEY, MC_APP_S_KEY_0, MC_NWK_S_KEY_0 };
+      KeyIdentifier_t target = targets[TestRandomRange(0, 3)];
+      uint32_t root = (uint32_t)TestRandomRange(0, CMAC_KEY_COUNT - 1);
+      Version_t version = { .Value = 0x01000400 };
+      uint8_t input[16];
+
+      RandomBytes(input, sizeof(input));
+      TEST_CHECK_EQ(SecureElementDeriveAndStoreKey(version, input, Keys[root], target), SECURE_ELEMENT_SUCCESS);
+      ReferenceEncrypt(Model[root], input, Model[KeyIndex(target)]);
+    }
+    else if (op == 2)
+    {
+      /* Context saved to NVM, later restored over changed keys */
+      size_t size;
+      void *nvm = SecureElementGetNvmCtx(&size);
+
+      TEST_CHECK(size <= sizeof(savedNvm));
+      if (!saved || ((TestRandom() & 1) != 0))
+      {
+        memcpy(savedNvm, nvm, size);
+        memcpy(savedModel, Model, sizeof(Model));
+        saved = true;
+      }
+      else
+      {
+        TEST_CHECK_EQ(SecureElementRestoreNvmCtx(savedNvm), SECURE_ELEMENT_SUCCESS);
+        memcpy(Model, savedModel, sizeof(Model));
+      }
+    }
+    else
+    {
+      RandomUse();
+    }
+    if (TestFailures != 0)
+    {
+      printf("operation %d\n", n);
+      return;
+    }
+  }
+}
+
+/**
+  * @brief True when a key encrypts a block as its model value does
+  */
+static bool KeyMatches(KeyIdentifier_t keyID)
+{
+  uint8_t block[16] = { 0x5A };
+  uint8_t out[16];
+  uint8_t expected[16];
+
+  ReferenceEncrypt(Model[KeyIndex(keyID)], block, expected);
+  return (SecureElementAesEncrypt(block, 16, keyID, out) == SECURE_ELEMENT_SUCCESS) &&
+         (memcmp(out, expected, 16) == 0);
+}
+
+/**
+  * @brief Each way a key changes drops the schedule cached just before
+  */
+static void TestKeyChanges(void)
+{
+  uint8_t block[16] = { 0x5A };
+  uint8_t input[16];
+  uint8_t before[16];
+  uint8_t out[16];
+  Version_t version = { .Value = 0x01000400 };
+
+  TestSeed(210);
+  SetAllKeys();
+
+  /* Derived session key */
+  TEST_CHECK(KeyMatches(APP_S_KEY));
+  RandomBytes(input, sizeof(input));
+  TEST_CHECK_EQ(SecureElementDeriveAndStoreKey(version, input, APP_KEY, APP_S_KEY), SECURE_ELEMENT_SUCCESS);
+  ReferenceEncrypt(Model[KeyIndex(APP_KEY)], input, Model[KeyIndex(APP_S_KEY)]);
+  TEST_CHECK(KeyMatches(APP_S_KEY));
+
+  /* Multicast key, decrypted with McKEKey on its way in */
+  TEST_CHECK(KeyMatches(MC_KEY_0));
+  RandomBytes(input, sizeof(input));
+  TEST_CHECK_EQ(SecureElementSetKey(MC_KEY_0, input), SECURE_ELEMENT_SUCCESS);
+  ReferenceEncrypt(Model[KeyIndex(MC_KE_KEY)], input, Model[KeyIndex(MC_KEY_0)]);
+  TEST_CHECK(KeyMatches(MC_KEY_0));
+
+  /* Reinitialization back to the initial keys, whatever they are */
+  TEST_CHECK_EQ(SecureElementAesEncrypt(block, 16, NWK_S_KEY, before), SECURE_ELEMENT_SUCCESS);
+  TEST_CHECK_EQ(SecureElementInit(NvmChanged), SECURE_ELEMENT_SUCCESS);
+  TEST_CHECK_EQ(SecureElementAesEncrypt(block, 16, NWK_S_KEY, out), SECURE_ELEMENT_SUCCESS);
+  TEST_CHECK(memcmp(out, before, 16) != 0);
+  TEST_CHECK_EQ(SecureElementSetKey(APP_KEY, input), SECURE_ELEMENT_SUCCESS);
+  TEST_CHECK_EQ(SecureElementAesEncrypt(block, 16, NWK_S_KEY, before), SECURE_ELEMENT_SUCCESS);
+  TEST_CHECK(memcmp(out, before, 16) == 0);
+
+  /* Unknown key */
+  TEST_CHECK_EQ(SecureElementAesEncrypt(block, 16, (KeyIdentifier_t)200, out), SECURE_ELEMENT_ERROR_INVALID_KEY_ID);
+  TEST_CHECK_EQ(SecureElementAesCtrEncrypt(block, out, 16, (KeyIdentifier_t)200), SECURE_ELEMENT_ERROR_INVALID_KEY_ID);
+}
+
+/**
+  * @brief Payload and MIC of a 242-byte uplink, key expanded per use against cached
+  */
+static void BenchPayload(void)
+{
+  const uint32_t frames = 20000;
+  uint8_t payload[MAX_PAYLOAD] = { 0 };
+  uint8_t ctrBlock[16] = { 0x01 };
+  uint8_t bxBlock[16] = { 0x49 };
+  uint64_t start;
+  double perBlock;
+  double cached;
+
+  TestSeed(211);
+  SetAllKeys();
+
+  start = TestNanoseconds();
+  for (uint32_t n = 0; n < frames; n++)
+  {
+    ReferenceCtr(Model[KeyIndex(APP_S_KEY)], ctrBlock, payload, sizeof(payload));
+    TEST_KEEP(ReferenceCmac(Model[KeyIndex(NWK_S_KEY)], bxBlock, payload, sizeof(payload)));
+  }
+  perBlock = (double)(TestNanoseconds() - start) / frames;
+
+  start = TestNanoseconds();
+  for (uint32_t n = 0; n < frames; n++)
+  {
+    uint32_t cmac;
+
+    SecureElementAesCtrEncrypt(ctrBlock, payload, sizeof(payload), APP_S_KEY);
+    SecureElementComputeAesCmac(bxBlock, payload, sizeof(payload), NWK_S_KEY, &cmac);
+    TEST_KEEP(cmac);
+  }
+  cached = (double)(TestNanoseconds() - start) / frames;
+
+  printf("  242-byte payload and MIC: %.2f us expanding the key per use, %.2f us cached, x%.1f\n",
+         perBlock / 1000.0, cached / 1000.0, perBlock / cached);
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestRandomOperations();
+  TestKeyChanges();
+  if (TestIsBench(argc, argv))
+  {
+    BenchPayload();
+  }
+
+  return TestSummary(argv[0]);
+}
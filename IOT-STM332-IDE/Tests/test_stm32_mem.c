@@ -0,0 +1,209 @@
+/**
+  ******************************************************************************
+  * @file    test_stm32_mem.c
+  * @brief   Host test of the word-wide memory utilities against libc
+  * @note    Every size up to 256 bytes is copied, reverse copied and filled
+  *          at every source and destination alignment, inside a guarded
+  *          buffer: the result must match memcpy, memset or a byte-reversed
+  *          reference and nothing around it may change. The benchmark
+  *          compares each function with the byte loop it replaced.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test_common.h"
+#include "stm32_mem.h"
+
+/* Private define ------------------------------------------------------------*/
+#define MAX_SIZE            256
+#define GUARD               8
+#define BUFFER_SIZE         (GUARD + 4 + MAX_SIZE + GUARD)
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t Source[BUFFER_SIZE] __attribute__((aligned(8)));
+static uint8_t Actual[BUFFER_SIZE] __attribute__((aligned(8)));
+static uint8_t Expected[BUFFER_SIZE] __attribute__((aligned(8)));
+
+/* Private functions ---------------------------------------------------------*/
+static void RandomFill(uint8_t *buffer, uint32_t size)
+{
+  for (uint32_t i = 0; i < size; i++)
+  {
+    buffer[i] = (uint8_t)TestRandom();
+  }
+}
+
+/**
+  * @brief Byte loops of the original utilities, reference and benchmark baseline
+  */
+static void ByteCpy(void *dst, const void *src, uint16_t size)
+{
+  uint8_t *dst8 = (uint8_t *)dst;
+  const uint8_t *src8 = (const uint8_t *)src;
+
+  while (size--)
+  {
+    *dst8++ = *src8++;
+  }
+}
+
+static void ByteCpyr(void *dst, const void *src, uint16_t size)
+{
+  uint8_t *dst8 = (uint8_t *)dst + size;
+  const uint8_t *src8 = (const uint8_t *)src;
+
+  while (size--)
+  {
+    *--dst8 = *src8++;
+  }
+}
+
+static void ByteSet(void *dst, uint8_t value, uint16_t size)
+{
+  uint8_t *dst8 = (uint8_t *)dst;
+
+  while (size--)
+  {
+    *dst8++ = value;
+  }
+}
+
+/**
+  * @brief Start both buffers from the same random content
+  */
+static void Prepare(void)
+{
+  RandomFill(Source, sizeof(Source));
+  RandomFill(Actual, sizeof(Actual));
+  memcpy(Expected, Actual, sizeof(Actual));
+}
+
+static void TestAllAlignments(void)
+{
+  TestSeed(20);
+  for (uint16_t size = 0; size <= MAX_SIZE; size++)
+  {
+    for (uint32_t srcAlign = 0; srcAlign < 4U; srcAlign++)
+    {
+      for (uint32_t dstAlign = 0; dstAlign < 4U; dstAlign++)
+      {
+        uint8_t *src = &Source[GUARD + srcAlign];
+        uint8_t value = (uint8_t)TestRandom();
+
+        Prepare();
+        UTIL_MEM_cpy_8(&Actual[GUARD + dstAlign], src, size);
+        memcpy(&Expected[GUARD + dstAlign], src, size);
+        TEST_CHECK(memcmp(Actual, Expected, sizeof(Actual)) == 0);
+
+        Prepare();
+        UTIL_MEM_cpyr_8(&Actual[GUARD + dstAlign], src, size);
+        for (uint16_t i = 0; i < size; i++)
+        {
+          Expected[GUARD + dstAlign + size - 1U - i] = src[i];
+        }
+        TEST_CHECK(memcmp(Actual, Expected, sizeof(Actual)) == 0);
+
+        Prepare();
+        UTIL_MEM_set_8(&Actual[GUARD + dstAlign], value, size);
+        memset(&Expected[GUARD + dstAlign], value, size);
+        TEST_CHECK(memcmp(Actual, Expected, sizeof(Actual)) == 0);
+
+        if (TestFailures != 0)
+        {
+          printf("size %u, source +%u, destination +%u\n", size, (unsigned)srcAlign, (unsigned)dstAlign);
+          return;
+        }
+      }
+    }
+  }
+}
+
+/**
+  * @brief Copies within one buffer, as the sequencer and trace FIFO do
+  */
+static void TestSameBuffer(void)
+{
+  TestSeed(21);
+  for (int n = 0; n < 20000; n++)
+  {
+    uint16_t size = (uint16_t)TestRandomRange(0, MAX_SIZE / 2);
+    uint32_t from = (uint32_t)TestRandomRange(0, MAX_SIZE / 2);
+    uint32_t to = (uint32_t)TestRandomRange(0, MAX_SIZE / 2);
+
+    /* memcpy does not allow overlap, the utilities only copy between regions */
+    if (((from + size) > to) && ((to + size) > from))
+    {
+      continue;
+    }
+    Prepare();
+    UTIL_MEM_cpy_8(&Actual[GUARD + to], &Actual[GUARD + from], size);
+    memcpy(&Expected[GUARD + to], &Expected[GUARD + from], size);
+    TEST_CHECK(memcmp(Actual, Expected, sizeof(Actual)) == 0);
+    if (TestFailures != 0)
+    {
+      return;
+    }
+  }
+}
+
+/**
+  * @brief Nanoseconds per call of a copy, dst and src 1 byte off word alignment
+  */
+static double BenchCopy(void (*copy)(void *, const void *, uint16_t), uint16_t size, uint32_t dstAlign)
+{
+  const uint32_t calls = 200000;
+  uint64_t start = TestNanoseconds();
+
+  for (uint32_t n = 0; n < calls; n++)
+  {
+    copy(&Actual[GUARD + dstAlign], &Source[GUARD + 1], size);
+    __asm__ volatile("" : : "r"(Actual) : "memory");
+  }
+  TEST_KEEP(Actual[GUARD]);
+  return (double)(TestNanoseconds() - start) / calls;
+}
+
+static double BenchSet(void (*set)(void *, uint8_t, uint16_t), uint16_t size)
+{
+  const uint32_t calls = 200000;
+  uint64_t start = TestNanoseconds();
+
+  for (uint32_t n = 0; n < calls; n++)
+  {
+    set(&Actual[GUARD + 1], (uint8_t)n, size);
+    __asm__ volatile("" : : "r"(Actual) : "memory");
+  }
+  TEST_KEEP(Actual[GUARD]);
+  return (double)(TestNanoseconds() - start) / calls;
+}
+
+/**
+  * @brief Byte loops against the word-wide utilities, sizes 1 to 256
+  */
+static void BenchSizes(void)
+{
+  /* cpy: same alignment; cpyr: source start and destination end aligned together */
+  printf("  size     cpy byte/word     cpyr byte/word      set byte/word (ns)\n");
+  for (uint16_t size = 1; size <= MAX_SIZE; size *= 2)
+  {
+    uint32_t cpyrAlign = (4U - ((1U + size) & 3U)) & 3U;
+
+    printf("  %4u  %7.1f %7.1f   %7.1f %7.1f   %7.1f %7.1f\n", size,
+           BenchCopy(ByteCpy, size, 1), BenchCopy(UTIL_MEM_cpy_8, size, 1),
+           BenchCopy(ByteCpyr, size, cpyrAlign), BenchCopy(UTIL_MEM_cpyr_8, size, cpyrAlign),
+           BenchSet(ByteSet, size), BenchSet(UTIL_MEM_set_8, size));
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestAllAlignments();
+  TestSameBuffer();
+  if (TestIsBench(argc, argv))
+  {
+    BenchSizes();
+  }
+
+  return TestSummary(argv[0]);
+}
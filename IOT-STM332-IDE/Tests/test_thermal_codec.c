@@ -0,0 +1,386 @@
+/**
+  ******************************************************************************
+  * @file    test_thermal_codec.c
+  * @brief   Host test of the thermal frame codec
+  * @note    Keyframes must decode to the encoded frame, exactly when the
+  *          quantization shift is 0. Sequences of delta frames, some lost
+  *          on the way, must decode to what the encoder expects and stay
+  *          within the threshold of the input. The benchmark prints the
+  *          frame sizes over a corpus of synthetic scenes.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdlib.h>
+#include "test_common.h"
+#include "thermal_codec.h"
+
+/* Private define ------------------------------------------------------------*/
+#define PIXELS              THERMAL_CODEC_PIXELS
+
+/**
+  * @brief Synthetic scenes of the corpus
+  */
+typedef enum
+{
+  SCENE_WATER,          /* Smooth water surface, sensor noise */
+  SCENE_OBJECT,         /* Water with a warm object */
+  SCENE_HORIZON,        /* Water below, sky above */
+  SCENE_NOISE,          /* Uncorrelated pixels over the whole range */
+  SCENE_COUNT
+} Scene_t;
+
+static const char *const SceneNames[SCENE_COUNT] = { "water", "object", "horizon", "noise" };
+
+/* Private functions ---------------------------------------------------------*/
+static int16_t Clamp12(int32_t value)
+{
+  if (value > 2047)
+  {
+    return 2047;
+  }
+  if (value < -2048)
+  {
+    return -2048;
+  }
+  return (int16_t)value;
+}
+
+/**
+  * @brief Fill a frame with a scene, raw 0.25°C units
+  */
+static void MakeScene(Scene_t scene, int16_t *frame)
+{
+  int32_t water = TestRandomRange(40, 100);
+  int32_t slope = TestRandomRange(-2, 2);
+  int32_t objectRow = TestRandomRange(0, 5);
+  int32_t objectCol = TestRandomRange(0, 5);
+
+  for (int i = 0; i < PIXELS; i++)
+  {
+    int32_t row = i / THERMAL_CODEC_WIDTH;
+    int32_t col = i % THERMAL_CODEC_WIDTH;
+    int32_t value = water + (slope * row) + TestRandomRange(-1, 1);
+
+    switch (scene)
+    {
+      case SCENE_OBJECT:
+        if ((row >= objectRow) && (row < objectRow + 3) && (col >= objectCol) && (col < objectCol + 2))
+        {
+          value = 140 + TestRandomRange(-2, 2);
+        }
+        break;
+      case SCENE_HORIZON:
+        if (row < 3)
+        {
+          value = -40 + TestRandomRange(-3, 3);
+        }
+        break;
+      case SCENE_NOISE:
+        value = TestRandomRange(-2048, 2047);
+        break;
+      default:
+        break;
+    }
+    frame[i] = Clamp12(value);
+  }
+}
+
+static void TestKeyframeRoundTrip(void)
+{
+  int16_t frame[PIXELS];
+  int16_t decoded[PIXELS];
+  uint8_t stream[THERMAL_CODEC_MAX_SIZE];
+  int size;
+
+  TestSeed(7);
+  for (int n = 0; n < 4000; n++)
+  {
+    Scene_t scene = (Scene_t)(n % SCENE_COUNT);
+    uint8_t shift = (uint8_t)((n / SCENE_COUNT) % (THERMAL_CODEC_MAX_SHIFT + 1));
+
+    MakeScene(scene, frame);
+    size = ThermalCodec_Encode(frame, shift, (uint8_t)n, stream, sizeof(stream));
+    TEST_CHECK(size >= THERMAL_CODEC_HEADER_SIZE);
+    TEST_CHECK(size <= THERMAL_CODEC_MAX_SIZE);
+    TEST_CHECK_EQ(stream[1], (uint8_t)n);
+    TEST_CHECK_EQ(ThermalCodec_Decode(stream, (uint16_t)size, decoded), 0);
+
+    for (int i = 0; i < PIXELS; i++)
+    {
+      /* Quantized pixels round towards minus infinity */
+      TEST_CHECK_EQ(decoded[i], (frame[i] >> shift) * (1 << shift));
+    }
+    if (TestFailures != 0)
+    {
+      return;
+    }
+  }
+}
+
+static void TestKeyframeLimits(void)
+{
+  int16_t frame[PIXELS];
+  int16_t decoded[PIXELS];
+  uint8_t stream[THERMAL_CODEC_MAX_SIZE];
+  int size;
+
+  /* Extreme pixels next to each other still round-trip */
+  for (int i = 0; i < PIXELS; i++)
+  {
+    frame[i] = ((i + (i / THERMAL_CODEC_WIDTH)) & 1) ? 2047 : -2048;
+  }
+  size = ThermalCodec_Encode(frame, 0, 0, stream, sizeof(stream));
+  TEST_CHECK(size > 0);
+  TEST_CHECK_EQ(ThermalCodec_Decode(stream, (uint16_t)size, decoded), 0);
+  TEST_CHECK(memcmp(decoded, frame, sizeof(frame)) == 0);
+
+  /* A flat frame is little more than the header and the first pixel */
+  for (int i = 0; i < PIXELS; i++)
+  {
+    frame[i] = 100;
+  }
+  size = ThermalCodec_Encode(frame, 0, 0, stream, sizeof(stream));
+  TEST_CHECK(size <= 12);
+  TEST_CHECK_EQ(ThermalCodec_Decode(stream, (uint16_t)size, decoded), 0);
+  TEST_CHECK(memcmp(decoded, frame, sizeof(frame)) == 0);
+
+  /* Every truncation of a stream is refused */
+  TestSeed(70);
+  MakeScene(SCENE_OBJECT, frame);
+  size = ThermalCodec_Encode(frame, 0, 0, stream, sizeof(stream));
+  for (int len = 0; len < size; len++)
+  {
+    TEST_CHECK_EQ(ThermalCodec_Decode(stream, (uint16_t)len, decoded), -1);
+  }
+
+  /* Output buffer too small, bad shift */
+  TEST_CHECK_EQ(ThermalCodec_Encode(frame, 0, 0, stream, (uint16_t)(size - 1)), -1);
+  TEST_CHECK_EQ(ThermalCodec_Encode(frame, THERMAL_CODEC_MAX_SHIFT + 1, 0, stream, sizeof(stream)), -1);
+
+  /* Noise does not compress, it is stored packed */
+  MakeScene(SCENE_NOISE, frame);
+  size = ThermalCodec_Encode(frame, 0, 0, stream, sizeof(stream));
+  TEST_CHECK_EQ(size, THERMAL_CODEC_MAX_SIZE);
+  TEST_CHECK((stream[0] & THERMAL_CODEC_MODE_PACKED) != 0);
+  TEST_CHECK_EQ(ThermalCodec_Decode(stream, (uint16_t)size, decoded), 0);
+  TEST_CHECK(memcmp(decoded, frame, sizeof(frame)) == 0);
+}
+
+/**
+  * @brief Move a scene slowly: drift, sensor noise and now and then a warm
+  *        object passing by
+  */
+static void StepScene(int16_t *frame, int step)
+{
+  int32_t drift = ((step % 16) == 0) ? TestRandomRange(-1, 1) : 0;
+
+  for (int i = 0; i < PIXELS; i++)
+  {
+    frame[i] = Clamp12(frame[i] + drift + (((TestRandom() & 7) == 0) ? TestRandomRange(-2, 2) : 0));
+  }
+  if ((step % 40) == 20)
+  {
+    for (int i = 18; i < 22; i++)
+    {
+      frame[i] = Clamp12(frame[i] + 60);
+      frame[i + THERMAL_CODEC_WIDTH] = Clamp12(frame[i + THERMAL_CODEC_WIDTH] + 60);
+    }
+  }
+}
+
+static void TestDeltaSequence(void)
+{
+  ThermalCodec_Encoder_t encoder;
+  ThermalCodec_Decoder_t decoder;
+  int16_t frame[PIXELS];
+  int16_t decoded[PIXELS];
+  uint8_t stream[THERMAL_CODEC_MAX_SIZE];
+  const uint8_t interval = 16;
+
+  for (uint8_t threshold = 0; threshold <= 4; threshold += 2)
+  {
+    for (uint8_t shift = 0; shift <= 2; shift++)
+    {
+      int32_t bound = ((1 << shift) - 1 > threshold) ? (1 << shift) - 1 : threshold;
+      int sinceKeyframe = 0;
+      int deltas = 0;
+
+      TestSeed(8 + threshold + (shift * 16));
+      ThermalCodec_EncoderInit(&encoder, interval, threshold);
+      ThermalCodec_DecoderInit(&decoder);
+      MakeScene(SCENE_WATER, frame);
+
+      for (int step = 0; step < 500; step++)
+      {
+        int size;
+        bool lost = ((TestRandom() % 8) == 0);
+
+        StepScene(frame, step);
+        size = ThermalCodec_EncodeFrame(&encoder, frame, shift, stream, sizeof(stream));
+        TEST_CHECK(size > 0);
+        if ((stream[0] & THERMAL_CODEC_TYPE_DELTA) != 0)
+        {
+          deltas++;
+          sinceKeyframe++;
+          /* Keyframes are forced, counting the frames since the acknowledged one */
+          TEST_CHECK(sinceKeyframe < interval);
+        }
+
+        if (lost)
+        {
+          /* Not acknowledged, the next delta still refers to a frame the decoder has */
+          continue;
+        }
+
+        TEST_CHECK_EQ(ThermalCodec_DecodeFrame(&decoder, stream, (uint16_t)size, decoded), 0);
+        TEST_CHECK(memcmp(decoded, encoder.pending, sizeof(decoded)) == 0);
+        for (int i = 0; i < PIXELS; i++)
+        {
+          TEST_CHECK(abs(decoded[i] - frame[i]) <= bound);
+        }
+        ThermalCodec_Acknowledge(&encoder);
+        if ((stream[0] & THERMAL_CODEC_TYPE_DELTA) == 0)
+        {
+          sinceKeyframe = 0;
+        }
+        if (TestFailures != 0)
+        {
+          return;
+        }
+      }
+      TEST_CHECK(deltas > 250);
+    }
+  }
+}
+
+static void TestDeltaReference(void)
+{
+  ThermalCodec_Encoder_t encoder;
+  ThermalCodec_Decoder_t decoder;
+  int16_t frame[PIXELS];
+  int16_t decoded[PIXELS];
+  uint8_t stream[THERMAL_CODEC_MAX_SIZE];
+  int size;
+
+  TestSeed(80);
+  ThermalCodec_EncoderInit(&encoder, 16, 1);
+  ThermalCodec_DecoderInit(&decoder);
+  MakeScene(SCENE_WATER, frame);
+
+  /* Nothing acknowledged yet: keyframe */
+  size = ThermalCodec_EncodeFrame(&encoder, frame, 0, stream, sizeof(stream));
+  TEST_CHECK((stream[0] & THERMAL_CODEC_TYPE_DELTA) == 0);
+  TEST_CHECK_EQ(ThermalCodec_DecodeFrame(&decoder, stream, (uint16_t)size, decoded), 0);
+  ThermalCodec_Acknowledge(&encoder);
+
+  frame[9] = Clamp12(frame[9] + 20);
+  size = ThermalCodec_EncodeFrame(&encoder, frame, 0, stream, sizeof(stream));
+  TEST_CHECK((stream[0] & THERMAL_CODEC_TYPE_DELTA) != 0);
+
+  /* Keyframe-only decoding and truncated deltas are refused */
+  TEST_CHECK_EQ(ThermalCodec_Decode(stream, (uint16_t)size, decoded), -1);
+  for (int len = 0; len < size; len++)
+  {
+    TEST_CHECK_EQ(ThermalCodec_DecodeFrame(&decoder, stream, (uint16_t)len, decoded), -1);
+  }
+
+  /* A decoder that lost its history cannot resolve the reference */
+  ThermalCodec_DecoderInit(&decoder);
+  TEST_CHECK_EQ(ThermalCodec_DecodeFrame(&decoder, stream, (uint16_t)size, decoded), -1);
+
+  /* No change beyond the threshold: header, reference and an empty row mask */
+  ThermalCodec_Acknowledge(&encoder);
+  size = ThermalCodec_EncodeFrame(&encoder, frame, 0, stream, sizeof(stream));
+  TEST_CHECK((stream[0] & THERMAL_CODEC_TYPE_DELTA) != 0);
+  TEST_CHECK_EQ(size, THERMAL_CODEC_HEADER_SIZE + 2);
+}
+
+/**
+  * @brief Keyframe sizes over the corpus, against the former uplinks: 64
+  *        Cayenne LPP digital inputs (192 bytes) or the 8-bit image (64 bytes)
+  */
+static void BenchCorpus(void)
+{
+  int16_t frame[PIXELS];
+  uint8_t stream[THERMAL_CODEC_MAX_SIZE];
+  const int frames = 1000;
+
+  printf("keyframe size over %d frames per scene (Cayenne LPP 192 bytes, 8-bit image 64 bytes)\n", frames);
+  for (int scene = 0; scene < SCENE_COUNT; scene++)
+  {
+    for (uint8_t shift = 0; shift <= 2; shift++)
+    {
+      long total = 0;
+
+      TestSeed(700 + scene);
+      for (int n = 0; n < frames; n++)
+      {
+        MakeScene((Scene_t)scene, frame);
+        total += ThermalCodec_Encode(frame, shift, 0, stream, sizeof(stream));
+      }
+      printf("  %-8s shift %u: %5.1f bytes, %4.1fx smaller than LPP\n", SceneNames[scene], shift,
+             (double)total / frames, 192.0 * frames / (double)total);
+    }
+  }
+}
+
+/**
+  * @brief Average frame size of acknowledged sequences, stable and moving
+  */
+static void BenchSequence(void)
+{
+  ThermalCodec_Encoder_t encoder;
+  int16_t frame[PIXELS];
+  uint8_t stream[THERMAL_CODEC_MAX_SIZE];
+  const int frames = 2000;
+
+  printf("sequence of %d frames, keyframe every 16 frames at most\n", frames);
+  for (uint8_t threshold = 0; threshold <= 2; threshold++)
+  {
+    for (int moving = 0; moving <= 1; moving++)
+    {
+      long total = 0;
+
+      TestSeed(800);
+      ThermalCodec_EncoderInit(&encoder, 16, threshold);
+      MakeScene(SCENE_WATER, frame);
+      for (int step = 0; step < frames; step++)
+      {
+        if (moving != 0)
+        {
+          StepScene(frame, step);
+        }
+        else
+        {
+          /* Sensor noise only */
+          for (int i = 0; i < PIXELS; i++)
+          {
+            frame[i] = Clamp12(frame[i] + (((TestRandom() & 3) == 0) ? TestRandomRange(-1, 1) : 0));
+          }
+        }
+        total += ThermalCodec_EncodeFrame(&encoder, frame, 0, stream, sizeof(stream));
+        ThermalCodec_Acknowledge(&encoder);
+      }
+      printf("  %-6s threshold %u: %5.1f bytes per frame\n", (moving != 0) ? "moving" : "stable",
+             threshold, (double)total / frames);
+    }
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestKeyframeRoundTrip();
+  TestKeyframeLimits();
+  TestDeltaSequence();
+  TestDeltaReference();
+
+  if (TestIsBench(argc, argv))
+  {
+    BenchCorpus();
+    BenchSequence();
+  }
+
+  return TestSummary(argv[0]);
+}
@@ -0,0 +1,419 @@
+/**
+  ******************************************************************************
+  * @file    test_uplink_log.c
+  * @brief   Host test of the uplink log against a RAM flash
+  * @note    Random appends and deliveries are checked against a model of the
+  *          pending records through page reuse and reinitializations. The
+  *          power is then cut at every double-word of a sequence, leaving
+  *          torn double-words that may read with an ECC error: after the
+  *          reset every record but the interrupted one must drain as before.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test_common.h"
+#include "test_flash.h"
+#include "uplink_log.h"
+
+/* Private define ------------------------------------------------------------*/
+#define PAGE_SIZE           512
+#define PAGE_COUNT          4
+#define MAX_PENDING         1024
+#define NONE                UINT32_MAX
+
+/* Private variables ---------------------------------------------------------*/
+static const UplinkLog_Flash_t Flash =
+{
+  .base = (uintptr_t)TestFlashMemory,
+  .pageCount = PAGE_COUNT,
+  .pageSize = PAGE_SIZE,
+  .erase = TestFlash_Erase,
+  .program = TestFlash_Program,
+  .read = TestFlash_Read,
+};
+
+/* Serial numbers of the pending records, oldest first */
+static uint32_t Model[MAX_PENDING];
+static uint32_t ModelCount;
+static uint32_t NextSerial;
+static uint32_t DroppedSeen;
+static uint32_t DroppedTotal;
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief Size of the payload of a record
+  */
+static uint8_t SerialSize(uint32_t serial)
+{
+  return (uint8_t)(4U + ((serial * 2654435761U) >> 27));
+}
+
+/**
+  * @brief Payload of a record: the serial number, then bytes derived from it
+  */
+static void SerialData(uint32_t serial, uint8_t *data)
+{
+  memcpy(data, &serial, sizeof(serial));
+  for (uint8_t i = 4; i < SerialSize(serial); i++)
+  {
+    data[i] = (uint8_t)((serial * 31U) + i);
+  }
+}
+
+/**
+  * @brief Serial number of a record, NONE if it was not written by Append()
+  */
+static uint32_t RecordSerial(const UplinkLog_Record_t *record)
+{
+  uint8_t data[UINT8_MAX];
+  uint32_t serial;
+
+  memcpy(&serial, record->data, sizeof(serial));
+  SerialData(serial, data);
+  if ((record->time != serial) || (record->port != (uint8_t)(1U + (serial % 200U))) ||
+      (record->size != SerialSize(serial)) || (memcmp(record->data, data, record->size) != 0))
+  {
+    return NONE;
+  }
+  return serial;
+}
+
+static void ModelRemove(uint32_t index)
+{
+  memmove(&Model[index], &Model[index + 1U], (ModelCount - index - 1U) * sizeof(Model[0]));
+  ModelCount--;
+}
+
+/**
+  * @brief Records dropped by page reuse are the oldest pending ones
+  */
+static void ModelDropped(void)
+{
+  uint32_t dropped = UplinkLog_GetDropped();
+
+  TEST_CHECK((dropped - DroppedSeen) <= ModelCount);
+  while ((DroppedSeen != dropped) && (ModelCount != 0U))
+  {
+    ModelRemove(0);
+    DroppedSeen++;
+    DroppedTotal++;
+  }
+}
+
+static void ModelInit(void)
+{
+  ModelCount = 0;
+  DroppedSeen = 0;
+  TEST_CHECK_EQ(UplinkLog_Init(&Flash), 0);
+}
+
+static int Append(void)
+{
+  uint8_t data[UINT8_MAX];
+  uint32_t serial = NextSerial++;
+  int status;
+
+  SerialData(serial, data);
+  status = UplinkLog_Append(serial, (uint8_t)(1U + (serial % 200U)), data, SerialSize(serial));
+  ModelDropped();
+  if (status == 0)
+  {
+    Model[ModelCount++] = serial;
+  }
+  return status;
+}
+
+/**
+  * @brief Deliver the oldest or newest record
+  * @return Serial number delivered, NONE if none
+  */
+static uint32_t Deliver(UplinkLog_Policy_t policy)
+{
+  UplinkLog_Record_t record;
+  uint32_t serial;
+
+  if (UplinkLog_Next(policy, UINT8_MAX, &record) != 0)
+  {
+    return NONE;
+  }
+  serial = RecordSerial(&record);
+  if (UplinkLog_MarkSent(record.id, serial) != 0)
+  {
+    return NONE;
+  }
+  return serial;
+}
+
+/**
+  * @brief Check the log against the model without changing it
+  */
+static void CheckModel(void)
+{
+  UplinkLog_Record_t record;
+
+  TEST_CHECK_EQ(UplinkLog_GetPending(), ModelCount);
+  if (ModelCount == 0U)
+  {
+    TEST_CHECK_EQ(UplinkLog_Next(UPLINK_LOG_OLDEST_FIRST, UINT8_MAX, &record), -1);
+    return;
+  }
+  TEST_CHECK_EQ(UplinkLog_Next(UPLINK_LOG_OLDEST_FIRST, UINT8_MAX, &record), 0);
+  TEST_CHECK_EQ(RecordSerial(&record), Model[0]);
+  TEST_CHECK_EQ(UplinkLog_Next(UPLINK_LOG_NEWEST_FIRST, UINT8_MAX, &record), 0);
+  TEST_CHECK_EQ(RecordSerial(&record), Model[ModelCount - 1U]);
+}
+
+static void TestBasic(void)
+{
+  UplinkLog_Flash_t noRead = Flash;
+  UplinkLog_Record_t record;
+  uint8_t data[8] = { 0 };
+
+  TestFlash_Reset(PAGE_SIZE);
+  NextSerial = 1;
+  TEST_CHECK_EQ(UplinkLog_Init(NULL), -1);
+  TEST_CHECK_EQ(UplinkLog_Append(0, 1, data, sizeof(data)), -1);
+
+  /* Without a read operation the memory is read directly */
+  noRead.read = NULL;
+  TEST_CHECK_EQ(UplinkLog_Init(&noRead), 0);
+  TEST_CHECK_EQ(UplinkLog_GetPending(), 0);
+  TEST_CHECK_EQ(UplinkLog_Append(0, 1, data, 0), -1);
+  TEST_CHECK_EQ(UplinkLog_Append(0, 1, NULL, 1), -1);
+  ModelCount = 0;
+  DroppedSeen = 0;
+  for (int n = 0; n < 5; n++)
+  {
+    TEST_CHECK_EQ(Append(), 0);
+  }
+  CheckModel();
+
+  /* Records too large for the datarate are skipped */
+  TEST_CHECK_EQ(UplinkLog_Next(UPLINK_LOG_OLDEST_FIRST, 3, &record), -1);
+  TEST_CHECK_EQ(UplinkLog_Next(UPLINK_LOG_OLDEST_FIRST, SerialSize(3), &record), 0);
+  TEST_CHECK(record.size <= SerialSize(3));
+
+  /* Delivered once, a second delivery of the same record is refused */
+  TEST_CHECK_EQ(UplinkLog_Next(UPLINK_LOG_OLDEST_FIRST, UINT8_MAX, &record), 0);
+  TEST_CHECK_EQ(UplinkLog_MarkSent(record.id, 7), 0);
+  TEST_CHECK_EQ(UplinkLog_MarkSent(record.id, 7), -1);
+  TEST_CHECK_EQ(UplinkLog_MarkSent(record.id + PAGE_SIZE * PAGE_COUNT, 7), -1);
+  ModelRemove(0);
+
+  /* The state survives a reinitialization, now with the read operation */
+  TEST_CHECK_EQ(UplinkLog_Init(&Flash), 0);
+  CheckModel();
+  TEST_CHECK_EQ(Deliver(UPLINK_LOG_NEWEST_FIRST), Model[ModelCount - 1U]);
+  ModelRemove(ModelCount - 1U);
+  CheckModel();
+}
+
+static void TestPageReuse(void)
+{
+  UplinkLog_Record_t record;
+  UplinkLog_Record_t reused;
+  uint8_t data[24];
+  uint32_t marked = 0;
+
+  /* Same size records land at the same places when a page is reused */
+  TestFlash_Reset(PAGE_SIZE);
+  TEST_CHECK_EQ(UplinkLog_Init(&Flash), 0);
+  memset(data, 0xA5, sizeof(data));
+  TEST_CHECK_EQ(UplinkLog_Append(100, 1, data, sizeof(data)), 0);
+  TEST_CHECK_EQ(UplinkLog_Next(UPLINK_LOG_OLDEST_FIRST, UINT8_MAX, &record), 0);
+
+  /* Fill the log until page 0 is reused and holds a record at the same place */
+  for (uint32_t time = 101; ; time++)
+  {
+    TEST_CHECK_EQ(UplinkLog_Append(time, 1, data, sizeof(data)), 0);
+    if (UplinkLog_GetDropped() != 0U)
+    {
+      break;
+    }
+  }
+  TEST_CHECK_EQ(UplinkLog_Next(UPLINK_LOG_NEWEST_FIRST, UINT8_MAX, &reused), 0);
+  TEST_CHECK_EQ((uint32_t)reused.id, (uint32_t)record.id);
+  TEST_CHECK(reused.id != record.id);
+
+  /* The handle of the dropped record does not mark the new one */
+  TEST_CHECK_EQ(UplinkLog_MarkSent(record.id, 1), -1);
+  TEST_CHECK_EQ(UplinkLog_Next(UPLINK_LOG_NEWEST_FIRST, UINT8_MAX, &record), 0);
+  TEST_CHECK_EQ(record.id, reused.id);
+  TEST_CHECK_EQ(record.time, reused.time);
+
+  /* Nor after a reinitialization */
+  TEST_CHECK_EQ(UplinkLog_Init(&Flash), 0);
+  while (UplinkLog_Next(UPLINK_LOG_OLDEST_FIRST, UINT8_MAX, &record) == 0)
+  {
+    TEST_CHECK_EQ(UplinkLog_MarkSent(record.id, marked++), 0);
+  }
+  TEST_CHECK_EQ(UplinkLog_GetPending(), 0);
+  TEST_CHECK_EQ(UplinkLog_MarkSent(reused.id, 1), -1);
+  TEST_CHECK_EQ(marked, ((PAGE_COUNT - 1U) * ((PAGE_SIZE - 8U) / 48U)) + 1U);
+}
+
+static void TestRandomOperations(void)
+{
+  uint32_t serial;
+
+  TestSeed(18);
+  TestFlash_Reset(PAGE_SIZE);
+  NextSerial = 1;
+  ModelInit();
+  for (int n = 0; n < 50000; n++)
+  {
+    switch (TestRandomRange(0, 7))
+    {
+      case 0:
+      case 1:
+        serial = Deliver(UPLINK_LOG_OLDEST_FIRST);
+        TEST_CHECK_EQ(serial, (ModelCount != 0U) ? Model[0] : NONE);
+        if (serial != NONE)
+        {
+          ModelRemove(0);
+        }
+        break;
+      case 2:
+        serial = Deliver(UPLINK_LOG_NEWEST_FIRST);
+        TEST_CHECK_EQ(serial, (ModelCount != 0U) ? Model[ModelCount - 1U] : NONE);
+        if (serial != NONE)
+        {
+          ModelRemove(ModelCount - 1U);
+        }
+        break;
+      case 3:
+        /* Reset, the dropped count restarts */
+        TEST_CHECK_EQ(UplinkLog_Init(&Flash), 0);
+        DroppedSeen = 0;
+        break;
+      default:
+        TEST_CHECK_EQ(Append(), 0);
+        break;
+    }
+    if ((n % 101) == 0)
+    {
+      CheckModel();
+    }
+    if (TestFailures != 0)
+    {
+      printf("operation %d\n", n);
+      return;
+    }
+  }
+  TEST_CHECK(DroppedTotal > 1000U);
+}
+
+static void TestPowerCut(void)
+{
+  uint32_t drained[MAX_PENDING];
+  uint32_t drainedCount;
+  uint32_t interrupted;
+  uint32_t eccErrors = 0;
+  bool appending;
+
+  TestSeed(180);
+  for (int32_t cut = 0; cut < 4000; cut++)
+  {
+    TestFlash_Reset(PAGE_SIZE);
+    NextSerial = 1;
+    ModelInit();
+    for (int n = TestRandomRange(0, 40); n > 0; n--)
+    {
+      (void)Append();
+    }
+
+    /* Appends and deliveries until the power is cut */
+    TestFlash_CutPower(cut % 80);
+    do
+    {
+      appending = ((ModelCount == 0U) || (TestRandomRange(0, 2) != 0));
+      if (appending)
+      {
+        interrupted = NextSerial;
+        (void)Append();
+      }
+      else
+      {
+        interrupted = Model[0];
+        if (Deliver(UPLINK_LOG_OLDEST_FIRST) != NONE)
+        {
+          ModelRemove(0);
+        }
+      }
+    } while (!TestFlashPowerLost);
+
+    TestFlash_CutPower(-1);
+    TEST_CHECK_EQ(UplinkLog_Init(&Flash), 0);
+
+    /* Drain everything, in order */
+    drainedCount = 0;
+    while (drainedCount < MAX_PENDING)
+    {
+      uint32_t serial = Deliver(UPLINK_LOG_OLDEST_FIRST);
+
+      if (serial == NONE)
+      {
+        break;
+      }
+      drained[drainedCount++] = serial;
+    }
+    TEST_CHECK_EQ(UplinkLog_GetPending(), 0);
+
+    /* Everything pending before, except the interrupted record which may be either */
+    {
+      uint32_t i = 0;
+      uint32_t j = 0;
+
+      while ((i < ModelCount) || (j < drainedCount))
+      {
+        if ((i < ModelCount) && (j < drainedCount) && (Model[i] == drained[j]))
+        {
+          i++;
+          j++;
+        }
+        else if ((i < ModelCount) && (Model[i] == interrupted))
+        {
+          i++;
+        }
+        else if ((j < drainedCount) && (drained[j] == interrupted))
+        {
+          j++;
+        }
+        else
+        {
+          TEST_CHECK(false);
+          break;
+        }
+      }
+    }
+
+    /* And the log keeps working */
+    ModelInit();
+    for (int n = 0; n < 20; n++)
+    {
+      TEST_CHECK_EQ(Append(), 0);
+    }
+    CheckModel();
+    TEST_CHECK_EQ(UplinkLog_Init(&Flash), 0);
+    TEST_CHECK_EQ(UplinkLog_GetPending(), ModelCount);
+
+    eccErrors += TestFlashEccErrors;
+    if (TestFailures != 0)
+    {
+      printf("power cut after %d double-words\n", (int)(cut % 80));
+      return;
+    }
+  }
+  TEST_CHECK(eccErrors > 0U);
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  TestBasic();
+  TestPageReuse();
+  TestRandomOperations();
+  TestPowerCut();
+
+  return TestSummary(argv[0]);
+}
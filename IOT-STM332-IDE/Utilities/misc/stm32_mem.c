@@ -23,7 +23,14 @@
    
 /* Private typedef -----------------------------------------------------------*/
 /* Private defines -----------------------------------------------------------*/
+/**
+  * @brief Below this size the byte loops are faster than aligning the pointers
+  */
+#define UTIL_MEM_WORD_THRESHOLD    8U
+
 /* Private macros ------------------------------------------------------------*/
+#define UTIL_MEM_IS_ALIGNED( __p__ )   ( ( ( uintptr_t )( __p__ ) & 3U ) == 0U )
+
 /* Private variables ---------------------------------------------------------*/
 /* Global variables ----------------------------------------------------------*/
 /* Private function prototypes -----------------------------------------------*/
@@ -32,29 +39,115 @@
 void UTIL_MEM_cpy_8( void *dst, const void *src, uint16_t size )
 {
   uint8_t* dst8= (uint8_t *) dst;
-  uint8_t* src8= (uint8_t *) src;
+  const uint8_t* src8= (const uint8_t *) src;
 
-  while( size-- )
+  /* Word copy when both pointers can be aligned together, 4 words per
+     iteration so the compiler emits LDM/STM pairs */
+  if( ( size >= UTIL_MEM_WORD_THRESHOLD ) && ( ( ( ( uintptr_t )dst8 ^ ( uintptr_t )src8 ) & 3U ) == 0U ) )
+  {
+    uint32_t* dst32;
+    const uint32_t* src32;
+
+    while( !UTIL_MEM_IS_ALIGNED( dst8 ) )
+    {
+      *dst8++ = *src8++;
+      size--;
+    }
+    dst32 = (uint32_t *) dst8;
+    src32 = (const uint32_t *) src8;
+    while( size >= 16U )
+    {
+      dst32[0] = src32[0];
+      dst32[1] = src32[1];
+      dst32[2] = src32[2];
+      dst32[3] = src32[3];
+      dst32 += 4;
+      src32 += 4;
+      size -= 16U;
+    }
+    while( size >= 4U )
     {
-        *dst8++ = *src8++;
+      *dst32++ = *src32++;
+      size -= 4U;
     }
+    dst8 = (uint8_t *) dst32;
+    src8 = (const uint8_t *) src32;
+  }
+
+  while( size-- )
+  {
+    *dst8++ = *src8++;
+  }
 }
 
 void UTIL_MEM_cpyr_8( void *dst, const void *src, uint16_t size )
 {
-    uint8_t* dst8= (uint8_t *) dst;
-    uint8_t* src8= (uint8_t *) src;
-    
-    dst8 = dst8 + ( size - 1 );
-    while( size-- )
+  uint8_t* dst8= (uint8_t *) dst;
+  const uint8_t* src8= (const uint8_t *) src;
+
+  dst8 = dst8 + size;
+
+  /* Word copy with REV when the source start and the destination end can be
+     aligned together: src + i and dst + size - i move in opposite directions */
+  if( ( size >= UTIL_MEM_WORD_THRESHOLD ) && ( ( ( ( uintptr_t )dst8 + ( uintptr_t )src8 ) & 3U ) == 0U ) )
+  {
+    uint32_t* dst32;
+    const uint32_t* src32;
+
+    while( !UTIL_MEM_IS_ALIGNED( src8 ) )
+    {
+      *--dst8 = *src8++;
+      size--;
+    }
+    dst32 = (uint32_t *) dst8;
+    src32 = (const uint32_t *) src8;
+    while( size >= 4U )
     {
-        *dst8-- = *src8++;
+      *--dst32 = __REV( *src32++ );
+      size -= 4U;
     }
+    dst8 = (uint8_t *) dst32;
+    src8 = (const uint8_t *) src32;
+  }
+
+  while( size-- )
+  {
+    *--dst8 = *src8++;
+  }
 }
 
 void UTIL_MEM_set_8( void *dst, uint8_t value, uint16_t size )
 {
   uint8_t* dst8= (uint8_t *) dst;
+
+  if( size >= UTIL_MEM_WORD_THRESHOLD )
+  {
+    uint32_t value32 = value * 0x01010101U;
+    uint32_t* dst32;
+
+    while( !UTIL_MEM_IS_ALIGNED( dst8 ) )
+    {
+      *dst8++ = value;
+      size--;
+    }
+    dst32 = (uint32_t *) dst8;
+    while( size >= 16U )
+    {
+      dst32[0] = value32;
+      dst32[1] = value32;
+      dst32[2] = value32;
+      dst32[3] = value32;
+      dst32 += 4;
+      size -= 16U;
+    }
+    while( size >= 4U )
+    {
+      *dst32++ = value32;
+      size -= 4U;
+    }
+    dst8 = (uint8_t *) dst32;
+  }
+
   while( size-- )
   {
     *dst8++ = value;
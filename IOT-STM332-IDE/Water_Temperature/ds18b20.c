@@ -6,18 +6,47 @@
   */
 
 /* Includes ------------------------------------------------------------------*/
+#include <string.h>
 #include "ds18b20.h"
+#include "onewire.h"
+#include "stm32_seq.h"
+#include "stm32_timer.h"
+#include "utilities_def.h"
+
+/* Private define ------------------------------------------------------------*/
+#define DS18B20_CONFIG_RESERVED_BITS 0x1F    /* Low bits of the configuration register */
+#define DS18B20_CONFIG_MASK          0x9F    /* Configuration bits that read back fixed */
+
+/* Scratchpad layout */
+#define DS18B20_SP_TEMP_LSB          0
+#define DS18B20_SP_TEMP_MSB          1
+#define DS18B20_SP_TH                2
+#define DS18B20_SP_TL                3
+#define DS18B20_SP_CONFIG            4
+#define DS18B20_SP_CRC               8
 
 /* Private variables ---------------------------------------------------------*/
 static bool ds18b20_working = false;
+static DS18B20_Resolution_t ds18b20_resolution = DS18B20_DEFAULT_RESOLUTION;
+
+/* Probes found on the bus */
+static DS18B20_Probe_t ds18b20_probes[DS18B20_MAX_PROBES];
+static uint8_t ds18b20_probe_count = 0;
+
+/* Worst case conversion time per resolution (datasheet tCONV, rounded up) */
+static const uint16_t ds18b20_conversion_ms[4] = { 94, 188, 375, 750 };
+
+/* Asynchronous conversion state */
+static UTIL_TIMER_Object_t ds18b20_timer;
+static DS18B20_Callback_t ds18b20_callback = NULL;
+static volatile bool ds18b20_converting = false;
+static uint8_t ds18b20_poll_retries = 0;
 
 /* Private functions ---------------------------------------------------------*/
-static void DS18B20_DelayUs(uint32_t us);
-static bool DS18B20_Reset(void);
-static void DS18B20_WriteByte(uint8_t byte);
-static uint8_t DS18B20_ReadByte(void);
-static void DS18B20_WriteBit(uint8_t bit);
-static uint8_t DS18B20_ReadBit(void);
+static bool DS18B20_ReadScratchpad(const DS18B20_Probe_t *probe, uint8_t *scratchpad);
+static bool DS18B20_ScratchpadToCelsius(const uint8_t *scratchpad, float *temperature);
+static void DS18B20_OnTimerEvent(void *context);
+static void DS18B20_ConversionProcess(void);
 
 /* Public Functions ----------------------------------------------------------*/
 
@@ -27,29 +56,20 @@ static uint8_t DS18B20_ReadBit(void);
  */
 DS18B20_Status_t DS18B20_Init(void)
 {
-    /* Enable GPIO clock */
-    __HAL_RCC_GPIOB_CLK_ENABLE();
-
-    /* Configure pin as open-drain output with pull-up */
-    GPIO_InitTypeDef GPIO_InitStruct = {0};
-    GPIO_InitStruct.Pin = DS18B20_PIN;
-    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
-    GPIO_InitStruct.Pull = GPIO_PULLUP;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
-    HAL_GPIO_Init(DS18B20_PORT, &GPIO_InitStruct);
+    /* Bus pin and slot timer */
+    OneWire_Init();
 
-    /* Set pin high */
-    HAL_GPIO_WritePin(DS18B20_PORT, DS18B20_PIN, GPIO_PIN_SET);
+    /* Conversion completion runs from the sequencer */
+    UTIL_TIMER_Create(&ds18b20_timer, 0xFFFFFFFFU, UTIL_TIMER_ONESHOT, DS18B20_OnTimerEvent, NULL);
+    UTIL_SEQ_RegTask((1 << CFG_SEQ_Task_DS18B20Conversion), UTIL_SEQ_RFU, DS18B20_ConversionProcess);
 
     /* Wait for sensor to stabilize */
     HAL_Delay(500);
 
-    /* Test if sensor is present */
-    if (DS18B20_Reset()) {
-        ds18b20_working = true;
-        return DS18B20_OK;
+    /* Enumerate the probes */
+    if (DS18B20_SearchProbes() > 0) {
+        return DS18B20_SetResolution(ds18b20_resolution);
     } else {
-        ds18b20_working = false;
         return DS18B20_ERROR;
     }
 }
@@ -61,208 +81,322 @@ DS18B20_Status_t DS18B20_Init(void)
  */
 DS18B20_Status_t DS18B20_ReadTemperature(float *temperature)
 {
-    if (!ds18b20_working || temperature == NULL) {
+    if (temperature == NULL) {
+        return DS18B20_ERROR;
+    }
+
+    if (DS18B20_StartConversion() != DS18B20_OK) {
+        return DS18B20_ERROR;
+    }
+
+    /* Wait for conversion: the sensor answers 0 to read slots until done */
+    uint32_t timeout = DS18B20_GetConversionTimeMs() + (DS18B20_POLL_INTERVAL_MS * DS18B20_POLL_MAX_RETRIES);
+    uint32_t start = HAL_GetTick();
+    while (!DS18B20_IsConversionDone()) {
+        if ((HAL_GetTick() - start) > timeout) {
+            return DS18B20_ERROR;
+        }
+        HAL_Delay(1);
+    }
+
+    return DS18B20_ReadConversion(temperature);
+}
+
+/**
+ * @brief Start a temperature conversion without waiting for it
+ * @retval DS18B20_Status_t: DS18B20_OK if the sensor acknowledged
+ */
+DS18B20_Status_t DS18B20_StartConversion(void)
+{
+    if (!ds18b20_working) {
         return DS18B20_ERROR;
     }
 
+    if (ds18b20_converting) {
+        return DS18B20_BUSY;
+    }
+
     /* Reset and check presence */
-    if (!DS18B20_Reset()) {
+    if (!OneWire_Reset()) {
         ds18b20_working = false;
         return DS18B20_ERROR;
     }
 
-    /* Start conversion */
-    DS18B20_WriteByte(DS18B20_CMD_SKIP_ROM);
-    DS18B20_WriteByte(DS18B20_CMD_CONVERT_T);
+    /* Start conversion on every probe at once */
+    OneWire_WriteByte(DS18B20_CMD_SKIP_ROM);
+    OneWire_WriteByte(DS18B20_CMD_CONVERT_T);
 
-    /* Wait for conversion (750ms for 12-bit) */
-    HAL_Delay(800);
+    return DS18B20_OK;
+}
 
-    /* Reset and check presence */
-    if (!DS18B20_Reset()) {
+/**
+ * @brief Read the result of a conversion started by DS18B20_StartConversion()
+ * @param temperature: pointer to store temperature value in Celsius
+ * @retval DS18B20_Status_t: DS18B20_OK if successful
+ */
+DS18B20_Status_t DS18B20_ReadConversion(float *temperature)
+{
+    if (!ds18b20_working || temperature == NULL) {
         return DS18B20_ERROR;
     }
 
-    /* Read scratchpad */
-    DS18B20_WriteByte(DS18B20_CMD_SKIP_ROM);
-    DS18B20_WriteByte(DS18B20_CMD_READ_SCRATCHPAD);
+    uint8_t scratchpad[DS18B20_SCRATCHPAD_SIZE];
+    bool found = false;
 
-    /* Read temperature bytes (LSB first, then MSB) */
-    uint8_t temp_lsb = DS18B20_ReadByte();
-    uint8_t temp_msb = DS18B20_ReadByte();
+    /* One conversion was broadcast, read every probe by address */
+    for (uint8_t i = 0; i < ds18b20_probe_count; i++) {
+        DS18B20_Probe_t *probe = &ds18b20_probes[i];
 
-    /* Combine bytes to form temperature */
-    int16_t raw_temp = (temp_msb << 8) | temp_lsb;
+        probe->valid = DS18B20_ReadScratchpad(probe, scratchpad) &&
+                       DS18B20_ScratchpadToCelsius(scratchpad, &probe->temperature);
 
-    /* Convert to Celsius (0.0625°C per bit for 12-bit resolution) */
-    *temperature = (float)raw_temp * 0.0625f;
+        if (probe->valid && !found) {
+            *temperature = probe->temperature;
+            found = true;
+        }
+    }
 
-    /* Basic validation */
-    if (*temperature < -55.0f || *temperature > 125.0f) {
-        return DS18B20_ERROR;
+    return found ? DS18B20_OK : DS18B20_ERROR;
+}
+
+/**
+ * @brief Start a conversion and collect it without blocking
+ * @param callback: called with the result once the conversion is collected
+ * @retval DS18B20_Status_t: DS18B20_BUSY if a conversion is already running
+ */
+DS18B20_Status_t DS18B20_StartConversionAsync(DS18B20_Callback_t callback)
+{
+    DS18B20_Status_t status = DS18B20_StartConversion();
+    if (status != DS18B20_OK) {
+        return status;
     }
 
+    ds18b20_callback = callback;
+    ds18b20_poll_retries = 0;
+    ds18b20_converting = true;
+
+    /* Sleep through the conversion, the sequencer enters Stop mode via UTIL_LPM */
+    UTIL_TIMER_StartWithPeriod(&ds18b20_timer, DS18B20_GetConversionTimeMs());
+
     return DS18B20_OK;
 }
 
 /**
- * @brief Check if DS18B20 is working
- * @retval true if working, false otherwise
+ * @brief Check with a read time slot whether the conversion is complete
+ * @retval true when the sensor has finished converting
  */
-bool DS18B20_IsWorking(void)
+bool DS18B20_IsConversionDone(void)
 {
-    return ds18b20_working;
+    return (OneWire_ReadBit() != 0);
 }
 
-/* Private Functions ---------------------------------------------------------*/
-
 /**
- * @brief Microsecond delay
- * @param us: microseconds to delay
+ * @brief Set the conversion resolution
+ * @param resolution: 9 to 12 bit
+ * @retval DS18B20_Status_t: DS18B20_OK if successful
  */
-static void DS18B20_DelayUs(uint32_t us)
+DS18B20_Status_t DS18B20_SetResolution(DS18B20_Resolution_t resolution)
 {
-    /* Simple delay using system clock */
-    uint32_t cycles = us * (SystemCoreClock / 1000000);
-    for (uint32_t i = 0; i < cycles / 4; i++) {
-        __NOP();
+    if (!ds18b20_working || resolution > DS18B20_RESOLUTION_12BIT) {
+        return DS18B20_ERROR;
     }
+
+    if (ds18b20_converting) {
+        return DS18B20_BUSY;
+    }
+
+    for (uint8_t i = 0; i < ds18b20_probe_count; i++) {
+        uint8_t scratchpad[DS18B20_SCRATCHPAD_SIZE];
+
+        /* Read the alarm registers to write them back unchanged */
+        if (!DS18B20_ReadScratchpad(&ds18b20_probes[i], scratchpad)) {
+            return DS18B20_ERROR;
+        }
+
+        /* Write TH, TL and configuration (R1:R0 in bits 6:5) */
+        if (!OneWire_Reset()) {
+            return DS18B20_ERROR;
+        }
+        OneWire_Select(ds18b20_probes[i].rom);
+        uint8_t frame[4] = {
+            DS18B20_CMD_WRITE_SCRATCHPAD,
+            scratchpad[DS18B20_SP_TH],
+            scratchpad[DS18B20_SP_TL],
+            (uint8_t)((resolution << 5) | DS18B20_CONFIG_RESERVED_BITS)
+        };
+        OneWire_Write(frame, sizeof(frame));
+    }
+
+    ds18b20_resolution = resolution;
+
+    return DS18B20_OK;
 }
 
 /**
- * @brief Send reset pulse and check for presence
- * @retval true if device responds
+ * @brief Enumerate the DS18B20 probes on the bus
+ * @retval Number of probes found
  */
-static bool DS18B20_Reset(void)
+uint8_t DS18B20_SearchProbes(void)
 {
-    bool presence = false;
-
-    /* Configure as output */
-    GPIO_InitTypeDef GPIO_InitStruct = {0};
-    GPIO_InitStruct.Pin = DS18B20_PIN;
-    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
-    GPIO_InitStruct.Pull = GPIO_PULLUP;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
-    HAL_GPIO_Init(DS18B20_PORT, &GPIO_InitStruct);
-
-    /* Send reset pulse */
-    HAL_GPIO_WritePin(DS18B20_PORT, DS18B20_PIN, GPIO_PIN_RESET);
-    DS18B20_DelayUs(480);
-    HAL_GPIO_WritePin(DS18B20_PORT, DS18B20_PIN, GPIO_PIN_SET);
-
-    /* Configure as input to read presence pulse */
-    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
-    HAL_GPIO_Init(DS18B20_PORT, &GPIO_InitStruct);
-
-    DS18B20_DelayUs(70);
-
-    /* Check for presence pulse */
-    if (HAL_GPIO_ReadPin(DS18B20_PORT, DS18B20_PIN) == GPIO_PIN_RESET) {
-        presence = true;
+    OneWire_Search_t search;
+    uint8_t rom[ONEWIRE_ROM_SIZE];
+
+    if (ds18b20_converting) {
+        return ds18b20_probe_count;
     }
 
-    DS18B20_DelayUs(410);
+    ds18b20_probe_count = 0;
+    OneWire_SearchReset(&search);
+
+    while ((ds18b20_probe_count < DS18B20_MAX_PROBES) && OneWire_Search(&search, rom)) {
+        /* Other 1-Wire devices may share the bus */
+        if (rom[0] != DS18B20_FAMILY_CODE) {
+            continue;
+        }
+        memcpy(ds18b20_probes[ds18b20_probe_count].rom, rom, ONEWIRE_ROM_SIZE);
+        ds18b20_probes[ds18b20_probe_count].valid = false;
+        ds18b20_probe_count++;
+    }
 
-    /* Configure back as output */
-    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
-    HAL_GPIO_Init(DS18B20_PORT, &GPIO_InitStruct);
-    HAL_GPIO_WritePin(DS18B20_PORT, DS18B20_PIN, GPIO_PIN_SET);
+    ds18b20_working = (ds18b20_probe_count > 0);
 
-    return presence;
+    return ds18b20_probe_count;
 }
 
 /**
- * @brief Write a byte to DS18B20
- * @param byte: byte to write
+ * @brief Get the number of probes found by DS18B20_SearchProbes()
+ * @retval Number of probes
  */
-static void DS18B20_WriteByte(uint8_t byte)
+uint8_t DS18B20_GetProbeCount(void)
 {
-    for (int i = 0; i < 8; i++) {
-        DS18B20_WriteBit((byte >> i) & 0x01);
-    }
+    return ds18b20_probe_count;
 }
 
 /**
- * @brief Read a byte from DS18B20
- * @retval byte read from sensor
+ * @brief Get a probe of the table, in ROM search order
+ * @param index: probe index, below DS18B20_GetProbeCount()
+ * @retval Probe, or NULL if index is out of range
  */
-static uint8_t DS18B20_ReadByte(void)
+const DS18B20_Probe_t *DS18B20_GetProbe(uint8_t index)
 {
-    uint8_t byte = 0;
-    for (int i = 0; i < 8; i++) {
-        byte |= (DS18B20_ReadBit() << i);
+    if (index >= ds18b20_probe_count) {
+        return NULL;
     }
-    return byte;
+    return &ds18b20_probes[index];
 }
 
 /**
- * @brief Write a bit to DS18B20
- * @param bit: bit to write (0 or 1)
+ * @brief Get the current conversion resolution
+ * @retval DS18B20_Resolution_t
  */
-static void DS18B20_WriteBit(uint8_t bit)
+DS18B20_Resolution_t DS18B20_GetResolution(void)
 {
-    /* Configure as output */
-    GPIO_InitTypeDef GPIO_InitStruct = {0};
-    GPIO_InitStruct.Pin = DS18B20_PIN;
-    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
-    GPIO_InitStruct.Pull = GPIO_PULLUP;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
-    HAL_GPIO_Init(DS18B20_PORT, &GPIO_InitStruct);
-
-    if (bit) {
-        /* Write 1 */
-        HAL_GPIO_WritePin(DS18B20_PORT, DS18B20_PIN, GPIO_PIN_RESET);
-        DS18B20_DelayUs(6);
-        HAL_GPIO_WritePin(DS18B20_PORT, DS18B20_PIN, GPIO_PIN_SET);
-        DS18B20_DelayUs(64);
-    } else {
-        /* Write 0 */
-        HAL_GPIO_WritePin(DS18B20_PORT, DS18B20_PIN, GPIO_PIN_RESET);
-        DS18B20_DelayUs(60);
-        HAL_GPIO_WritePin(DS18B20_PORT, DS18B20_PIN, GPIO_PIN_SET);
-        DS18B20_DelayUs(10);
+    return ds18b20_resolution;
+}
+
+/**
+ * @brief Get the worst case conversion time of the current resolution
+ * @retval Conversion time in ms
+ */
+uint32_t DS18B20_GetConversionTimeMs(void)
+{
+    return ds18b20_conversion_ms[ds18b20_resolution];
+}
+
+/**
+ * @brief Check if DS18B20 is working
+ * @retval true if working, false otherwise
+ */
+bool DS18B20_IsWorking(void)
+{
+    return ds18b20_working;
+}
+
+/* Private Functions ---------------------------------------------------------*/
+
+/**
+ * @brief Read and check the 9-byte scratchpad of one probe
+ * @param probe: probe to address
+ * @param scratchpad: DS18B20_SCRATCHPAD_SIZE bytes
+ * @retval true if the CRC and fixed configuration bits are correct
+ */
+static bool DS18B20_ReadScratchpad(const DS18B20_Probe_t *probe, uint8_t *scratchpad)
+{
+    if (!OneWire_Reset()) {
+        return false;
     }
+
+    OneWire_Select(probe->rom);
+    OneWire_WriteByte(DS18B20_CMD_READ_SCRATCHPAD);
+    OneWire_Read(scratchpad, DS18B20_SCRATCHPAD_SIZE);
+
+    if (OneWire_Crc8(scratchpad, DS18B20_SCRATCHPAD_SIZE) != 0) {
+        return false;
+    }
+
+    /* A bus held low reads all zeros, which has a valid CRC */
+    return ((scratchpad[DS18B20_SP_CONFIG] & DS18B20_CONFIG_MASK) == DS18B20_CONFIG_RESERVED_BITS);
 }
 
 /**
- * @brief Read a bit from DS18B20
- * @retval bit value (0 or 1)
+ * @brief Convert the temperature register of a scratchpad
+ * @param scratchpad: scratchpad read by DS18B20_ReadScratchpad()
+ * @param temperature: temperature in Celsius
+ * @retval true if in the sensor range
  */
-static uint8_t DS18B20_ReadBit(void)
+static bool DS18B20_ScratchpadToCelsius(const uint8_t *scratchpad, float *temperature)
 {
-    uint8_t bit = 0;
+    /* Combine bytes to form temperature */
+    int16_t raw_temp = (int16_t)((scratchpad[DS18B20_SP_TEMP_MSB] << 8) | scratchpad[DS18B20_SP_TEMP_LSB]);
 
-    /* Configure as output */
-    GPIO_InitTypeDef GPIO_InitStruct = {0};
-    GPIO_InitStruct.Pin = DS18B20_PIN;
-    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
-    GPIO_InitStruct.Pull = GPIO_PULLUP;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
-    HAL_GPIO_Init(DS18B20_PORT, &GPIO_InitStruct);
+    /* Undefined low bits at reduced resolution */
+    raw_temp &= (int16_t)~((1 << (DS18B20_RESOLUTION_12BIT - ds18b20_resolution)) - 1);
 
-    /* Start read slot */
-    HAL_GPIO_WritePin(DS18B20_PORT, DS18B20_PIN, GPIO_PIN_RESET);
-    DS18B20_DelayUs(3);
+    /* Convert to Celsius (0.0625°C per LSB) */
+    *temperature = (float)raw_temp * 0.0625f;
 
-    /* Configure as input */
-    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
-    HAL_GPIO_Init(DS18B20_PORT, &GPIO_InitStruct);
+    /* Basic validation */
+    return (*temperature >= -55.0f && *temperature <= 125.0f);
+}
+
+/**
+ * @brief Conversion timer callback (timer context): defer to the sequencer
+ * @param context: unused
+ */
+static void DS18B20_OnTimerEvent(void *context)
+{
+    UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_DS18B20Conversion), CFG_SEQ_Prio_0);
+}
 
-    DS18B20_DelayUs(10);
+/**
+ * @brief Collect an asynchronous conversion (sequencer context)
+ */
+static void DS18B20_ConversionProcess(void)
+{
+    float temperature = 0.0f;
+    DS18B20_Status_t status = DS18B20_ERROR;
+    bool done;
 
-    /* Read bit */
-    if (HAL_GPIO_ReadPin(DS18B20_PORT, DS18B20_PIN) == GPIO_PIN_SET) {
-        bit = 1;
+    if (!ds18b20_converting) {
+        return;
     }
 
-    DS18B20_DelayUs(53);
+    /* Conversion time is a worst case bound, still confirm with a read slot */
+    done = DS18B20_IsConversionDone();
+    if (!done && (ds18b20_poll_retries < DS18B20_POLL_MAX_RETRIES)) {
+        ds18b20_poll_retries++;
+        UTIL_TIMER_StartWithPeriod(&ds18b20_timer, DS18B20_POLL_INTERVAL_MS);
+        return;
+    }
 
-    /* Configure back as output */
-    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
-    HAL_GPIO_Init(DS18B20_PORT, &GPIO_InitStruct);
-    HAL_GPIO_WritePin(DS18B20_PORT, DS18B20_PIN, GPIO_PIN_SET);
+    ds18b20_converting = false;
+    if (done) {
+        status = DS18B20_ReadConversion(&temperature);
+    }
 
-    return bit;
+    if (ds18b20_callback != NULL) {
+        ds18b20_callback(status, temperature);
+    }
 }
 
 /**************************** END OF FILE ************************************/
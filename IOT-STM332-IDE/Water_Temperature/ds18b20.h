@@ -14,24 +14,62 @@ extern "C" {
 
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
+#include "onewire.h"
 #include <stdint.h>
 #include <stdbool.h>
 
 /* DS18B20 Pin Configuration -------------------------------------------------*/
-#define DS18B20_PORT    GPIOB
-#define DS18B20_PIN     GPIO_PIN_10
+#define DS18B20_PORT    ONEWIRE_PORT
+#define DS18B20_PIN     ONEWIRE_PIN
 
 /* DS18B20 Commands ----------------------------------------------------------*/
-#define DS18B20_CMD_CONVERT_T       0x44    /* Start temperature conversion */
-#define DS18B20_CMD_READ_SCRATCHPAD 0xBE    /* Read scratchpad memory */
-#define DS18B20_CMD_SKIP_ROM        0xCC    /* Skip ROM command */
+#define DS18B20_CMD_CONVERT_T        0x44    /* Start temperature conversion */
+#define DS18B20_CMD_WRITE_SCRATCHPAD 0x4E    /* Write TH, TL and configuration */
+#define DS18B20_CMD_READ_SCRATCHPAD  0xBE    /* Read scratchpad memory */
+#define DS18B20_CMD_SKIP_ROM         0xCC    /* Skip ROM command */
+
+/* DS18B20 Probes -----------------------------------------------------------*/
+#define DS18B20_FAMILY_CODE          0x28    /* First byte of the ROM code */
+#define DS18B20_MAX_PROBES           4       /* Probes kept in the table */
+#define DS18B20_SCRATCHPAD_SIZE      9       /* Scratchpad bytes including CRC */
+
+/* DS18B20 Timing ------------------------------------------------------------*/
+#define DS18B20_POLL_INTERVAL_MS     10      /* Re-check period when still converting */
+#define DS18B20_POLL_MAX_RETRIES     10      /* Give up after this many re-checks */
+
+/* DS18B20 Resolution --------------------------------------------------------*/
+typedef enum {
+    DS18B20_RESOLUTION_9BIT  = 0,   /* 0.5°C,    93.75ms */
+    DS18B20_RESOLUTION_10BIT = 1,   /* 0.25°C,   187.5ms */
+    DS18B20_RESOLUTION_11BIT = 2,   /* 0.125°C,  375ms   */
+    DS18B20_RESOLUTION_12BIT = 3    /* 0.0625°C, 750ms   */
+} DS18B20_Resolution_t;
+
+#define DS18B20_DEFAULT_RESOLUTION   DS18B20_RESOLUTION_12BIT
 
 /* DS18B20 Status ------------------------------------------------------------*/
 typedef enum {
     DS18B20_OK = 0,
-    DS18B20_ERROR = 1
+    DS18B20_ERROR = 1,
+    DS18B20_BUSY = 2
 } DS18B20_Status_t;
 
+/**
+ * @brief One probe of the bus
+ */
+typedef struct {
+    uint8_t rom[ONEWIRE_ROM_SIZE];  /* ROM code used to address the probe */
+    float temperature;              /* Last temperature in Celsius */
+    bool valid;                     /* Last scratchpad read passed CRC and range checks */
+} DS18B20_Probe_t;
+
+/**
+ * @brief Conversion completion callback, called from the sequencer
+ * @param status: DS18B20_OK if temperature is valid
+ * @param temperature: temperature of the first valid probe in Celsius
+ */
+typedef void (*DS18B20_Callback_t)(DS18B20_Status_t status, float temperature);
+
 /* Public Functions ----------------------------------------------------------*/
 
 /**
@@ -47,6 +85,78 @@ DS18B20_Status_t DS18B20_Init(void);
  */
 DS18B20_Status_t DS18B20_ReadTemperature(float *temperature);
 
+/**
+ * @brief Start a temperature conversion without waiting for it
+ * @note  CONVERT_T is broadcast, every probe converts in the same window.
+ *        The result is available DS18B20_GetConversionTimeMs() later
+ * @retval DS18B20_Status_t: DS18B20_OK if the sensor acknowledged
+ */
+DS18B20_Status_t DS18B20_StartConversion(void);
+
+/**
+ * @brief Read the result of a conversion started by DS18B20_StartConversion()
+ * @note  Every probe is read by address and checked with the scratchpad CRC,
+ *        results are kept in the probe table (see DS18B20_GetProbe())
+ * @param temperature: pointer to store the first valid probe temperature in Celsius
+ * @retval DS18B20_Status_t: DS18B20_OK if successful
+ */
+DS18B20_Status_t DS18B20_ReadConversion(float *temperature);
+
+/**
+ * @brief Start a conversion and collect it without blocking
+ * @note  A timer is armed for the conversion time of the current resolution,
+ *        the CPU is free to enter Stop mode meanwhile. When the timer fires the
+ *        sequencer checks completion with read time slots, reads the scratchpad
+ *        and calls the callback.
+ * @param callback: called with the result once the conversion is collected
+ * @retval DS18B20_Status_t: DS18B20_BUSY if a conversion is already running
+ */
+DS18B20_Status_t DS18B20_StartConversionAsync(DS18B20_Callback_t callback);
+
+/**
+ * @brief Check with a read time slot whether the conversion is complete
+ * @retval true when the sensor has finished converting
+ */
+bool DS18B20_IsConversionDone(void);
+
+/**
+ * @brief Set the conversion resolution
+ * @param resolution: 9 to 12 bit
+ * @retval DS18B20_Status_t: DS18B20_OK if successful
+ */
+DS18B20_Status_t DS18B20_SetResolution(DS18B20_Resolution_t resolution);
+
+/**
+ * @brief Enumerate the DS18B20 probes on the bus (SEARCH_ROM)
+ * @retval Number of probes found, at most DS18B20_MAX_PROBES
+ */
+uint8_t DS18B20_SearchProbes(void);
+
+/**
+ * @brief Get the number of probes found by DS18B20_SearchProbes()
+ * @retval Number of probes
+ */
+uint8_t DS18B20_GetProbeCount(void);
+
+/**
+ * @brief Get a probe of the table, in ROM search order
+ * @param index: probe index, below DS18B20_GetProbeCount()
+ * @retval Probe, or NULL if index is out of range
+ */
+const DS18B20_Probe_t *DS18B20_GetProbe(uint8_t index);
+
+/**
+ * @brief Get the current conversion resolution
+ * @retval DS18B20_Resolution_t
+ */
+DS18B20_Resolution_t DS18B20_GetResolution(void);
+
+/**
+ * @brief Get the worst case conversion time of the current resolution
+ * @retval Conversion time in ms
+ */
+uint32_t DS18B20_GetConversionTimeMs(void);
+
 /**
  * @brief Check if DS18B20 is working
  * @retval true if working, false otherwise
@@ -0,0 +1,311 @@
+/**
+  ******************************************************************************
+  * @file    onewire.c
+  * @brief   1-Wire bus engine (bit-banged, DWT cycle counter timed)
+  * @note    The pin stays an open-drain output: writing 1 releases the line to
+  *          the pull-up and the input register still reads the bus level, so a
+  *          slot is only BSRR writes and an IDR read. Each slot is timed from
+  *          its falling edge so the GPIO access cost does not accumulate.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "onewire.h"
+#include "utilities_conf.h"
+
+/* Private macros ------------------------------------------------------------*/
+#define ONEWIRE_LOW()       (ONEWIRE_PORT->BSRR = (uint32_t)ONEWIRE_PIN << 16)
+#define ONEWIRE_RELEASE()   (ONEWIRE_PORT->BSRR = (uint32_t)ONEWIRE_PIN)
+#define ONEWIRE_LEVEL()     ((ONEWIRE_PORT->IDR & ONEWIRE_PIN) != 0U)
+
+/* Private functions ---------------------------------------------------------*/
+static inline uint32_t OneWire_CyclesPerUs(void);
+static inline void OneWire_WaitUntil(uint32_t start, uint32_t cycles);
+
+/* Public Functions ----------------------------------------------------------*/
+
+/**
+ * @brief Configure the bus pin and start the DWT cycle counter
+ */
+void OneWire_Init(void)
+{
+    /* Enable GPIO clock */
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+
+    /* Open-drain output with pull-up, released */
+    ONEWIRE_RELEASE();
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    GPIO_InitStruct.Pin = ONEWIRE_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    HAL_GPIO_Init(ONEWIRE_PORT, &GPIO_InitStruct);
+
+    /* Cycle counter used for the slot timing */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+ * @brief Send a reset pulse and check for presence
+ * @retval true if at least one device answered
+ */
+bool OneWire_Reset(void)
+{
+    uint32_t cpu = OneWire_CyclesPerUs();
+    uint32_t start;
+    bool presence;
+
+    /* The low phase has no upper bound worth guarding, keep interrupts on */
+    ONEWIRE_LOW();
+    OneWire_DelayUs(ONEWIRE_RESET_LOW_US);
+
+    UTILS_ENTER_CRITICAL_SECTION();
+    start = DWT->CYCCNT;
+    ONEWIRE_RELEASE();
+    OneWire_WaitUntil(start, (ONEWIRE_RESET_SAMPLE_US * cpu));
+    presence = !ONEWIRE_LEVEL();
+    UTILS_EXIT_CRITICAL_SECTION();
+
+    OneWire_WaitUntil(start, ((ONEWIRE_RESET_SLOT_US - ONEWIRE_RESET_LOW_US) * cpu));
+
+    return presence;
+}
+
+/**
+ * @brief Write a bit in one time slot
+ * @param bit: bit to write (0 or 1)
+ */
+void OneWire_WriteBit(uint8_t bit)
+{
+    uint32_t cpu = OneWire_CyclesPerUs();
+    uint32_t low = (bit ? ONEWIRE_WRITE1_LOW_US : ONEWIRE_WRITE0_LOW_US) * cpu;
+    uint32_t start;
+
+    UTILS_ENTER_CRITICAL_SECTION();
+    start = DWT->CYCCNT;
+    ONEWIRE_LOW();
+    OneWire_WaitUntil(start, low);
+    ONEWIRE_RELEASE();
+    UTILS_EXIT_CRITICAL_SECTION();
+
+    /* Recovery, an interrupt here only stretches the idle time */
+    OneWire_WaitUntil(start, (ONEWIRE_SLOT_US * cpu));
+}
+
+/**
+ * @brief Read a bit in one time slot
+ * @retval bit value (0 or 1)
+ */
+uint8_t OneWire_ReadBit(void)
+{
+    uint32_t cpu = OneWire_CyclesPerUs();
+    uint32_t start;
+    uint8_t bit;
+
+    UTILS_ENTER_CRITICAL_SECTION();
+    start = DWT->CYCCNT;
+    ONEWIRE_LOW();
+    OneWire_WaitUntil(start, (ONEWIRE_READ_LOW_US * cpu));
+    ONEWIRE_RELEASE();
+    OneWire_WaitUntil(start, (ONEWIRE_READ_SAMPLE_US * cpu));
+    bit = ONEWIRE_LEVEL() ? 1 : 0;
+    UTILS_EXIT_CRITICAL_SECTION();
+
+    OneWire_WaitUntil(start, (ONEWIRE_SLOT_US * cpu));
+
+    return bit;
+}
+
+/**
+ * @brief Write a byte, LSB first
+ * @param byte: byte to write
+ */
+void OneWire_WriteByte(uint8_t byte)
+{
+    for (int i = 0; i < 8; i++) {
+        OneWire_WriteBit((byte >> i) & 0x01);
+    }
+}
+
+/**
+ * @brief Read a byte, LSB first
+ * @retval byte read from the bus
+ */
+uint8_t OneWire_ReadByte(void)
+{
+    uint8_t byte = 0;
+    for (int i = 0; i < 8; i++) {
+        byte |= (OneWire_ReadBit() << i);
+    }
+    return byte;
+}
+
+/**
+ * @brief Write a buffer
+ * @param data: bytes to write
+ * @param len: number of bytes
+ */
+void OneWire_Write(const uint8_t *data, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++) {
+        OneWire_WriteByte(data[i]);
+    }
+}
+
+/**
+ * @brief Read into a buffer
+ * @param data: destination
+ * @param len: number of bytes
+ */
+void OneWire_Read(uint8_t *data, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++) {
+        data[i] = OneWire_ReadByte();
+    }
+}
+
+/**
+ * @brief Address one device (MATCH_ROM), to be sent after a reset
+ * @param rom: ROM code of the device
+ */
+void OneWire_Select(const uint8_t rom[ONEWIRE_ROM_SIZE])
+{
+    OneWire_WriteByte(ONEWIRE_CMD_MATCH_ROM);
+    OneWire_Write(rom, ONEWIRE_ROM_SIZE);
+}
+
+/**
+ * @brief Restart a ROM search from the first device
+ * @param search: search state
+ */
+void OneWire_SearchReset(OneWire_Search_t *search)
+{
+    memset(search, 0, sizeof(*search));
+}
+
+/**
+ * @brief Find the next device on the bus (SEARCH_ROM)
+ * @note  Each pass walks the 64 ROM bits: all devices answer the bit and its
+ *        complement, a 0/0 answer is a discrepancy. The 0 branch is taken
+ *        first and the deepest one is remembered, so the next pass takes the
+ *        1 branch there. One pass per device.
+ * @param search: search state, initialized by OneWire_SearchReset()
+ * @param rom: ROM code of the device found
+ * @retval true if a device with a valid ROM CRC was found
+ */
+bool OneWire_Search(OneWire_Search_t *search, uint8_t rom[ONEWIRE_ROM_SIZE])
+{
+    uint8_t lastZero = 0;
+
+    if (search->lastDevice) {
+        return false;
+    }
+
+    if (!OneWire_Reset()) {
+        OneWire_SearchReset(search);
+        return false;
+    }
+
+    OneWire_WriteByte(ONEWIRE_CMD_SEARCH_ROM);
+
+    for (uint8_t bitIndex = 1; bitIndex <= (ONEWIRE_ROM_SIZE * 8); bitIndex++) {
+        uint8_t byteIndex = (bitIndex - 1) >> 3;
+        uint8_t mask = 1U << ((bitIndex - 1) & 0x07);
+        uint8_t idBit = OneWire_ReadBit();
+        uint8_t cmpBit = OneWire_ReadBit();
+        uint8_t direction;
+
+        if (idBit && cmpBit) {
+            /* No device left on the bus */
+            OneWire_SearchReset(search);
+            return false;
+        }
+
+        if (idBit != cmpBit) {
+            /* All remaining devices agree on this bit */
+            direction = idBit;
+        } else if (bitIndex < search->lastDiscrepancy) {
+            /* Replay the previous path */
+            direction = (search->rom[byteIndex] & mask) ? 1 : 0;
+        } else {
+            /* Take 1 at the last discrepancy, 0 on any new one */
+            direction = (bitIndex == search->lastDiscrepancy) ? 1 : 0;
+        }
+
+        if (direction == 0 && idBit == cmpBit) {
+            lastZero = bitIndex;
+        }
+
+        if (direction) {
+            search->rom[byteIndex] |= mask;
+        } else {
+            search->rom[byteIndex] &= (uint8_t)~mask;
+        }
+
+        /* Devices whose bit differs drop out until the next reset */
+        OneWire_WriteBit(direction);
+    }
+
+    search->lastDiscrepancy = lastZero;
+    search->lastDevice = (lastZero == 0);
+
+    if (OneWire_Crc8(search->rom, ONEWIRE_ROM_SIZE) != 0) {
+        return false;
+    }
+
+    memcpy(rom, search->rom, ONEWIRE_ROM_SIZE);
+    return true;
+}
+
+/**
+ * @brief Dallas/Maxim CRC8 (x^8 + x^5 + x^4 + 1, reflected)
+ * @param data: bytes to check
+ * @param len: number of bytes
+ * @retval CRC, 0 when computed over data followed by its CRC byte
+ */
+uint8_t OneWire_Crc8(const uint8_t *data, uint16_t len)
+{
+    uint8_t crc = 0;
+
+    for (uint16_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x01) ? (uint8_t)((crc >> 1) ^ 0x8C) : (uint8_t)(crc >> 1);
+        }
+    }
+
+    return crc;
+}
+
+/**
+ * @brief Busy wait on the DWT cycle counter
+ * @param us: microseconds to delay
+ */
+void OneWire_DelayUs(uint32_t us)
+{
+    OneWire_WaitUntil(DWT->CYCCNT, (us * OneWire_CyclesPerUs()));
+}
+
+/* Private Functions ---------------------------------------------------------*/
+
+/**
+ * @brief CPU cycles per microsecond at the current core clock
+ */
+static inline uint32_t OneWire_CyclesPerUs(void)
+{
+    return (SystemCoreClock + 999999U) / 1000000U;
+}
+
+/**
+ * @brief Wait until a number of cycles has elapsed since start
+ * @note  Unsigned difference, safe across CYCCNT wrap-around
+ */
+static inline void OneWire_WaitUntil(uint32_t start, uint32_t cycles)
+{
+    while ((DWT->CYCCNT - start) < cycles) {
+    }
+}
+
+/**************************** END OF FILE ************************************/
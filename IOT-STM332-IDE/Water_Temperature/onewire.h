@@ -0,0 +1,162 @@
+/**
+  ******************************************************************************
+  * @file    onewire.h
+  * @brief   1-Wire bus engine (bit-banged, DWT cycle counter timed)
+  ******************************************************************************
+  */
+
+#ifndef ONEWIRE_H
+#define ONEWIRE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 1-Wire Pin Configuration --------------------------------------------------*/
+#define ONEWIRE_PORT    GPIOB
+#define ONEWIRE_PIN     GPIO_PIN_10
+
+/* 1-Wire ROM Commands ------------------------------------------------------*/
+#define ONEWIRE_CMD_SEARCH_ROM       0xF0    /* Enumerate device ROM codes */
+#define ONEWIRE_CMD_MATCH_ROM        0x55    /* Address one device by ROM code */
+#define ONEWIRE_CMD_SKIP_ROM         0xCC    /* Address all devices */
+
+#define ONEWIRE_ROM_SIZE             8       /* Family code, 48-bit serial, CRC8 */
+
+/* 1-Wire Slot Timing (us, offsets from the falling edge of the slot) --------*/
+#define ONEWIRE_RESET_LOW_US         480     /* tRSTL  >= 480 */
+#define ONEWIRE_RESET_SAMPLE_US      70      /* tPDH 15..60 + tPDL 60..240 */
+#define ONEWIRE_RESET_SLOT_US        970     /* tRSTL + tRSTH (>= 480), release write included */
+
+#define ONEWIRE_WRITE1_LOW_US        6       /* tLOW1  1..15 */
+#define ONEWIRE_WRITE0_LOW_US        60      /* tLOW0  60..120 */
+#define ONEWIRE_READ_LOW_US          2       /* tINIT  >= 1 */
+#define ONEWIRE_READ_SAMPLE_US       12      /* tRDV   < 15 */
+#define ONEWIRE_SLOT_US              70      /* tSLOT 60..120 plus tREC >= 1 */
+
+/* Keep the slot timings inside the datasheet windows */
+#if (ONEWIRE_RESET_LOW_US < 480)
+#error "1-Wire reset pulse shorter than tRSTL"
+#endif
+#if (ONEWIRE_RESET_SAMPLE_US < 15 + 15) || (ONEWIRE_RESET_SAMPLE_US > 60 + 60)
+#error "1-Wire presence sample outside the presence pulse"
+#endif
+#if (ONEWIRE_RESET_SLOT_US - ONEWIRE_RESET_LOW_US <= 480)
+#error "1-Wire reset recovery shorter than tRSTH"
+#endif
+#if (ONEWIRE_WRITE1_LOW_US < 1) || (ONEWIRE_WRITE1_LOW_US >= 15)
+#error "1-Wire write 1 low time outside tLOW1"
+#endif
+#if (ONEWIRE_WRITE0_LOW_US < 60) || (ONEWIRE_WRITE0_LOW_US > 120)
+#error "1-Wire write 0 low time outside tLOW0"
+#endif
+#if (ONEWIRE_READ_LOW_US < 1) || (ONEWIRE_READ_SAMPLE_US <= ONEWIRE_READ_LOW_US) || (ONEWIRE_READ_SAMPLE_US >= 15)
+#error "1-Wire read sample outside tRDV"
+#endif
+#if (ONEWIRE_SLOT_US < 60 + 1) || (ONEWIRE_SLOT_US <= ONEWIRE_WRITE0_LOW_US) || (ONEWIRE_SLOT_US > 120 + 15)
+#error "1-Wire slot length outside tSLOT + tREC"
+#endif
+
+/* 1-Wire Search State ------------------------------------------------------*/
+typedef struct {
+    uint8_t rom[ONEWIRE_ROM_SIZE];  /* ROM code found by the last pass */
+    uint8_t lastDiscrepancy;        /* Bit index (1..64) of the last 0 branch taken */
+    bool lastDevice;                /* No branch left to explore */
+} OneWire_Search_t;
+
+/* Public Functions ----------------------------------------------------------*/
+
+/**
+ * @brief Configure the bus pin and start the DWT cycle counter
+ */
+void OneWire_Init(void);
+
+/**
+ * @brief Send a reset pulse and check for presence
+ * @retval true if at least one device answered
+ */
+bool OneWire_Reset(void);
+
+/**
+ * @brief Write a bit in one time slot
+ * @param bit: bit to write (0 or 1)
+ */
+void OneWire_WriteBit(uint8_t bit);
+
+/**
+ * @brief Read a bit in one time slot
+ * @retval bit value (0 or 1)
+ */
+uint8_t OneWire_ReadBit(void);
+
+/**
+ * @brief Write a byte, LSB first
+ * @param byte: byte to write
+ */
+void OneWire_WriteByte(uint8_t byte);
+
+/**
+ * @brief Read a byte, LSB first
+ * @retval byte read from the bus
+ */
+uint8_t OneWire_ReadByte(void);
+
+/**
+ * @brief Write a buffer
+ * @param data: bytes to write
+ * @param len: number of bytes
+ */
+void OneWire_Write(const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Read into a buffer
+ * @param data: destination
+ * @param len: number of bytes
+ */
+void OneWire_Read(uint8_t *data, uint16_t len);
+
+/**
+ * @brief Address one device (MATCH_ROM), to be sent after a reset
+ * @param rom: ROM code of the device
+ */
+void OneWire_Select(const uint8_t rom[ONEWIRE_ROM_SIZE]);
+
+/**
+ * @brief Restart a ROM search from the first device
+ * @param search: search state
+ */
+void OneWire_SearchReset(OneWire_Search_t *search);
+
+/**
+ * @brief Find the next device on the bus (SEARCH_ROM)
+ * @param search: search state, initialized by OneWire_SearchReset()
+ * @param rom: ROM code of the device found
+ * @retval true if a device with a valid ROM CRC was found
+ */
+bool OneWire_Search(OneWire_Search_t *search, uint8_t rom[ONEWIRE_ROM_SIZE]);
+
+/**
+ * @brief Dallas/Maxim CRC8 (x^8 + x^5 + x^4 + 1, reflected)
+ * @param data: bytes to check
+ * @param len: number of bytes
+ * @retval CRC, 0 when computed over data followed by its CRC byte
+ */
+uint8_t OneWire_Crc8(const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Busy wait on the DWT cycle counter
+ * @note  Follows SystemCoreClock, so it stays correct across clock changes
+ * @param us: microseconds to delay
+ */
+void OneWire_DelayUs(uint32_t us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ONEWIRE_H */